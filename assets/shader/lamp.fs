@@ -1,5 +1,3 @@
-uniform uint u_selected_id;
-
 void main()
 {
   vec4 color = vec4(1.0);
@@ -1,5 +1,4 @@
 uniform sampler2DArray u_terrain_samplers;
-uniform uint u_selected_id;
 
 void main()
 {
@@ -0,0 +1,185 @@
+#include <string>
+
+#include "mesh.h"
+#include "shader.h"
+#include "textures_array.h"
+#include "types.h"
+
+#ifndef __ASSET_WATCHER_H__
+#define __ASSET_WATCHER_H__ 1
+
+/**
+ * @class AssetWatcher
+ *
+ * @brief Reloads the assets whose files change on disk while the engine runs.
+ *
+ * The assets folder is watched with inotify, and every changed file is mapped
+ * to the assets that read it: a shader to its fragment and vertex files, a
+ * mesh to its obj file, the mtl libraries it names and its material textures,
+ * a texture to its image and a textures array to the image of every layer.
+ * Only those assets are loaded again.
+ *
+ * Shaders are compiled again without waiting, like Shader::rechargeShader
+ * does. Meshes and textures are read in the task manager into a new object,
+ * and Update swaps it with the old one and deletes the old GL objects, so the
+ * Mesh, Texture and TexturesArray pointers given by JAM_Engine stay valid.
+ *
+ * Only the assets uploaded with the Upload calls of this class are watched,
+ * they upload with JAM_Engine and register the files read. Assets created in
+ * other ways, like custom meshes, are not reloaded.
+ *
+ * Linux only, Start does nothing in other systems.
+ */
+class AssetWatcher
+{
+public:
+  /**
+   * @struct Stats
+   *
+   * @brief Reloads since the start.
+   */
+  struct Stats
+  {
+    u32 shaders_ = 0;  ///< Shaders compiled again.
+    u32 meshes_ = 0;   ///< Meshes swapped.
+    u32 textures_ = 0; ///< Textures and textures arrays swapped.
+    u32 pending_ = 0;  ///< Meshes and textures still loading.
+  };
+
+  /**
+   * @brief Starts watching a folder and all its subfolders.
+   *
+   * @param directory Folder path, usually ASSETS("").
+   *
+   * @return False if the folder can not be watched.
+   */
+  static boolean Start(const byte *directory);
+
+  /**
+   * @brief Stops watching, the reloads still loading are discarded.
+   */
+  static void Stop();
+
+  /**
+   * @brief Reads the changed files, starts their reloads and swaps in the finished ones.
+   * Call it once per frame, outside the render passes.
+   */
+  static void Update();
+
+  /**
+   * @brief Uploads a shader with JAM_Engine::UploadShader and watches its files.
+   *
+   * @param fragment Path to the fragment shader file.
+   * @param vertex Path to the vertex shader file.
+   *
+   * @return Unique identifier of the loaded shader.
+   */
+  static Shader::Id UploadShader(const byte *fragment, const byte *vertex);
+
+  /**
+   * @brief Uploads a mesh with JAM_Engine::UploadMesh and watches its obj, mtl and texture files.
+   *
+   * @param path Path to the mesh file.
+   * @param center Flag to center and normalize the mesh.
+   * @param wrapS Configuration for mesh textures, 13 values or nullptr.
+   * @param wrapT Configuration for mesh textures, 13 values or nullptr.
+   * @param minF Configuration for mesh textures, 13 values or nullptr.
+   * @param magF Configuration for mesh textures, 13 values or nullptr.
+   *
+   * @return Unique identifier of the loaded mesh.
+   */
+  static Mesh::Id UploadMesh(const byte *path, boolean center, Texture::Wrap *wrapS = nullptr, Texture::Wrap *wrapT = nullptr, Texture::Filter *minF = nullptr, Texture::Filter *magF = nullptr);
+
+  /**
+   * @brief Uploads a texture with JAM_Engine::UploadTexture and watches its image.
+   *
+   * @param path Path to the texture file.
+   * @param wrapS Wrapping mode in S direction.
+   * @param wrapT Wrapping mode in T direction.
+   * @param minF Minimization filter.
+   * @param magF Magnification filter.
+   *
+   * @return Unique identifier of the loaded texture.
+   */
+  static Texture::Id UploadTexture(const byte *path,
+                                   Texture::Wrap wrapS = Texture::Wrap::Repeat, Texture::Wrap wrapT = Texture::Wrap::Repeat,
+                                   Texture::Filter minF = Texture::Filter::Linear, Texture::Filter magF = Texture::Filter::Linear);
+
+  /**
+   * @brief Uploads a textures array with JAM_Engine::UploadTexturesArray and watches the image of every layer.
+   *
+   * @param paths Paths to the texture files.
+   * @param files_count Count of paths.
+   * @param wrapS Wrapping mode in S direction.
+   * @param wrapT Wrapping mode in T direction.
+   * @param minF Minimization filter.
+   * @param magF Magnification filter.
+   *
+   * @return Unique identifier of the loaded textures array.
+   */
+  static TexturesArray::Id UploadTexturesArray(const std::string *paths, const size_t &files_count,
+                                               TexturesArray::Wrap wrapS = TexturesArray::Wrap::Repeat, TexturesArray::Wrap wrapT = TexturesArray::Wrap::Repeat,
+                                               TexturesArray::Filter minF = TexturesArray::Filter::Linear, TexturesArray::Filter magF = TexturesArray::Filter::Linear);
+
+  /**
+   * @brief Sets a function called after a mesh is swapped, e.g. to insert its trees in a SceneBVH again.
+   * The renderer already forgot the old bounds, clusters and shared buffers of the mesh.
+   *
+   * @param mesh_reloaded Function called with the swapped mesh, null for none.
+   */
+  static void SetMeshCallback(void (*mesh_reloaded)(Mesh *mesh));
+
+  /**
+   * @brief Gets the reloads since the start.
+   *
+   * @return Stats.
+   */
+  static Stats GetStats();
+
+private:
+  /**
+   * @brief Private constructor.
+   *
+   * Not intended to be instantiated.
+   */
+  AssetWatcher();
+
+  /**
+   * @brief Private destructor.
+   *
+   * Not intended to be instantiated.
+   */
+  ~AssetWatcher();
+
+  /**
+   * @brief Checks if a loaded mesh reads a file as a material texture.
+   *
+   * @param mesh Mesh to check.
+   * @param file Canonical file path.
+   *
+   * @return True if any material of the mesh uses it.
+   */
+  static boolean UsesTexture(const Mesh *mesh, const std::string &file);
+
+  /**
+   * @brief Swaps in the reloads that finished reading, and starts again the ones whose files changed meanwhile.
+   */
+  static void FinishReloads();
+
+  /**
+   * @brief Swaps a mesh with its new data, the old data left in fresh is freed with its GL objects.
+   *
+   * @param mesh Mesh being reloaded.
+   * @param fresh New mesh.
+   */
+  static void Swap(Mesh *mesh, Mesh &fresh);
+
+  /**
+   * @brief Creates the material textures of a drawn mesh again, from the same files.
+   *
+   * @param mesh Mesh whose textures changed.
+   */
+  static void ReloadMaterialTextures(Mesh *mesh);
+};
+
+#endif /* __ASSET_WATCHER_H__ */
@@ -14,6 +14,18 @@
 #define SPOT_LIGHT_BIND 1
 #define DIRECTIONAL_LIGHT_BIND 2
 #define VERTEX_MATERIAL_BIND 3
+#define INSTANCE_BIND 4
+#define CULL_INSTANCE_BIND 5
+#define CULL_COMMAND_BIND 6
+#define CULLED_INSTANCE_BIND 7
+#define CULL_DRAW_COMMAND_BIND 8
+#define CULL_DRAW_COUNT_BIND 9
+///////////////////////////////////////////////////////////////////////////////
+
+// Uniform buffer
+///////////////////////////////////////////////////////////////////////////////
+#define FRAME_UNIFORM_BIND 0
+#define VIEW_UNIFORM_BIND 1
 ///////////////////////////////////////////////////////////////////////////////
 
 // Samplers bind
@@ -26,6 +38,14 @@ static const std::string binds = R"(
 #define SPOT_LIGHT_BIND 1
 #define DIRECTIONAL_LIGHT_BIND 2
 #define VERTEX_MATERIAL_BIND 3
+#define INSTANCE_BIND 4
+#define CULL_INSTANCE_BIND 5
+#define CULL_COMMAND_BIND 6
+#define CULLED_INSTANCE_BIND 7
+#define CULL_DRAW_COMMAND_BIND 8
+#define CULL_DRAW_COUNT_BIND 9
+#define FRAME_UNIFORM_BIND 0
+#define VIEW_UNIFORM_BIND 1
 )";
 
 #endif /* __BINDS_H__ */
\ No newline at end of file
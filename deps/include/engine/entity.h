@@ -2,6 +2,7 @@
 #include <cassert>
 #include <vector>
 #include <memory>
+#include <span>
 
 #include "types.h"
 #include "defines.h"
@@ -408,7 +409,7 @@ namespace Entity
 
       Components<T> *list_it = reinterpret_cast<Components<T> *>(it->second.get());
 
-      return std::make_pair(list_it->components_, list_it->has_values_);
+      return std::make_pair(list_it->components_, list_it->has_value_);
     }
 
     /**
@@ -561,7 +562,56 @@ public:
    * @return Pointer to the component list associated with the entity, or nullptr if it does not exist.
    */
   template <typename T>
-  T *getComponentsList() { return ComponentsManager::getComponentsList<T>(); }
+  std::pair<T *, boolean *> getComponentsList() { return ComponentsManager::getComponentsList<T>(); }
+
+  /**
+   * @brief Gets the storage of a component type, it's indexed by the internal identifiers.
+   *
+   * @tparam T Type of component to get.
+   *
+   * @return Storage of the components.
+   */
+  template <typename T>
+  Entity::Components<T> *getComponentsStorage()
+  {
+    auto hc = typeid(T).hash_code();
+
+    assert(component_type_list_.contains(hc));
+    auto it = component_type_list_.find(hc);
+
+    return reinterpret_cast<Entity::Components<T> *>(it->second.get());
+  }
+
+  /**
+   * @brief Gets the internal identifiers of many entities with one pass over the ids map.
+   *
+   * @param entity_ids Entities to find.
+   * @param internal_ids Output with one internal identifier per entity, SIZE_MAX if it does not exist.
+   */
+  void getInternalIds(std::span<const Entity::Id> entity_ids, size_t *internal_ids) const
+  {
+    // External to internal table, built once for the whole span
+    thread_local std::vector<size_t> table;
+    table.assign(static_cast<size_t>(external_counter_) + 1, SIZE_MAX);
+    for (const auto &ids : ids_map_)
+      if (ids.first < table.size())
+        table[ids.first] = ids.second;
+
+    for (size_t i = 0; i < entity_ids.size(); i++)
+      internal_ids[i] = (entity_ids[i] < table.size()) ? table[entity_ids[i]] : SIZE_MAX;
+  }
+
+  /**
+   * @brief Calls a function for every entity.
+   *
+   * @param fn Function called with the entity identifier and its internal identifier.
+   */
+  template <typename Fn>
+  void forEachEntity(Fn fn) const
+  {
+    for (const auto &ids : ids_map_)
+      fn(ids.first, ids.second);
+  }
 
   /**
    * @brief Gets the name associated with an entity by its identifier.
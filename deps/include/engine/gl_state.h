@@ -0,0 +1,230 @@
+#include "types.h"
+
+#ifndef __GL_STATE_H__
+#define __GL_STATE_H__ 1
+
+/**
+ * @class GLState
+ *
+ * @brief Keeps a copy of the bound GL state and drops the calls that change nothing.
+ *
+ * Only the calls made through this class are tracked. Code that changes the
+ * state without it, like the engine archive, leaves the copy wrong until
+ * Invalidate, the renderer calls it after every call to the engine.
+ */
+class GLState
+{
+public:
+  /**
+   * @struct Stats
+   *
+   * @brief Tracked calls since the last ResetStats.
+   */
+  struct Stats
+  {
+    u32 issued_ = 0;  ///< Calls that reached the driver.
+    u32 skipped_ = 0; ///< Calls dropped because they changed nothing.
+  };
+
+  /**
+   * @brief Forgets the state, the next call of every kind reaches the driver.
+   */
+  static void Invalidate();
+
+  /**
+   * @brief Uses a program.
+   *
+   * @param program Program identifier.
+   */
+  static void UseProgram(u32 program);
+
+  /**
+   * @brief Binds a vertex array.
+   *
+   * @param array Vertex array identifier.
+   */
+  static void BindVertexArray(u32 array);
+
+  /**
+   * @brief Binds a texture to a unit, without changing the active unit if it is already bound.
+   *
+   * @param unit Texture unit, from 0 to 31.
+   * @param target Texture target.
+   * @param texture Texture identifier.
+   */
+  static void BindTexture(u32 unit, u32 target, u32 texture);
+
+  /**
+   * @brief Binds a sampler to a texture unit.
+   *
+   * @param unit Texture unit, from 0 to 31.
+   * @param sampler Sampler identifier, 0 to use the texture parameters.
+   */
+  static void BindSampler(u32 unit, u32 sampler);
+
+  /**
+   * @brief Binds a buffer to the generic binding of a target.
+   *
+   * @param target Buffer target.
+   * @param buffer Buffer identifier.
+   */
+  static void BindBuffer(u32 target, u32 buffer);
+
+  /**
+   * @brief Binds a buffer to an indexed binding, and to the generic binding of the target.
+   *
+   * @param target GL_SHADER_STORAGE_BUFFER or GL_UNIFORM_BUFFER.
+   * @param index Binding point.
+   * @param buffer Buffer identifier.
+   */
+  static void BindBufferBase(u32 target, u32 index, u32 buffer);
+
+  /**
+   * @brief Binds a range of a buffer to an indexed binding. Ranges are not compared, it always reaches the driver.
+   *
+   * @param target GL_SHADER_STORAGE_BUFFER or GL_UNIFORM_BUFFER.
+   * @param index Binding point.
+   * @param buffer Buffer identifier.
+   * @param offset Offset in bytes.
+   * @param size Size in bytes.
+   */
+  static void BindBufferRange(u32 target, u32 index, u32 buffer, size_t offset, size_t size);
+
+  /**
+   * @brief Binds a framebuffer.
+   *
+   * @param target GL_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER or GL_READ_FRAMEBUFFER.
+   * @param framebuffer Framebuffer identifier.
+   */
+  static void BindFramebuffer(u32 target, u32 framebuffer);
+
+  /**
+   * @brief Turns a capability on or off.
+   *
+   * @param capability GL_CULL_FACE, GL_DEPTH_TEST or GL_BLEND are tracked, the rest always reach the driver.
+   * @param enabled True to turn it on.
+   */
+  static void SetCapability(u32 capability, boolean enabled);
+
+  /**
+   * @brief Sets the faces culled.
+   *
+   * @param mode GL_FRONT, GL_BACK or GL_FRONT_AND_BACK.
+   */
+  static void CullFace(u32 mode);
+
+  /**
+   * @brief Sets the winding of the front faces.
+   *
+   * @param mode GL_CW or GL_CCW.
+   */
+  static void FrontFace(u32 mode);
+
+  /**
+   * @brief Sets the depth test function.
+   *
+   * @param func Depth function.
+   */
+  static void DepthFunc(u32 func);
+
+  /**
+   * @brief Turns the depth writes on or off.
+   *
+   * @param write True to write the depth.
+   */
+  static void DepthMask(boolean write);
+
+  /**
+   * @brief Sets the blend factors.
+   *
+   * @param source Source factor.
+   * @param destination Destination factor.
+   */
+  static void BlendFunc(u32 source, u32 destination);
+
+  /**
+   * @brief Deletes a program and forgets it, a new program can take its name.
+   *
+   * @param program Program identifier.
+   */
+  static void DeleteProgram(u32 program);
+
+  /**
+   * @brief Deletes buffers and forgets them.
+   *
+   * @param count Number of buffers.
+   * @param buffers Buffer identifiers.
+   */
+  static void DeleteBuffers(s32 count, const u32 *buffers);
+
+  /**
+   * @brief Deletes vertex arrays and forgets them.
+   *
+   * @param count Number of vertex arrays.
+   * @param arrays Vertex array identifiers.
+   */
+  static void DeleteVertexArrays(s32 count, const u32 *arrays);
+
+  /**
+   * @brief Deletes textures and forgets them.
+   *
+   * @param count Number of textures.
+   * @param textures Texture identifiers.
+   */
+  static void DeleteTextures(s32 count, const u32 *textures);
+
+  /**
+   * @brief Deletes samplers and forgets them.
+   *
+   * @param count Number of samplers.
+   * @param samplers Sampler identifiers.
+   */
+  static void DeleteSamplers(s32 count, const u32 *samplers);
+
+  /**
+   * @brief Deletes framebuffers and forgets them.
+   *
+   * @param count Number of framebuffers.
+   * @param framebuffers Framebuffer identifiers.
+   */
+  static void DeleteFramebuffers(s32 count, const u32 *framebuffers);
+
+  /**
+   * @brief Gets the buffer bound to an indexed binding, without asking the driver.
+   *
+   * @param target GL_SHADER_STORAGE_BUFFER or GL_UNIFORM_BUFFER.
+   * @param index Binding point.
+   *
+   * @return Buffer identifier, UINT32_MAX if it is not known.
+   */
+  static u32 GetBoundBuffer(u32 target, u32 index);
+
+  /**
+   * @brief Gets the tracked calls since the last ResetStats.
+   *
+   * @return Stats.
+   */
+  static Stats GetStats();
+
+  /**
+   * @brief Starts counting again.
+   */
+  static void ResetStats();
+
+private:
+  /**
+   * @brief Private constructor.
+   *
+   * Not intended to be instantiated.
+   */
+  GLState();
+
+  /**
+   * @brief Private destructor.
+   *
+   * Not intended to be instantiated.
+   */
+  ~GLState();
+};
+
+#endif /* __GL_STATE_H__ */
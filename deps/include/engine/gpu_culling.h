@@ -0,0 +1,171 @@
+#include <vector>
+
+#include "math/mathlib.h"
+#include "ring_buffer.h"
+#include "types.h"
+
+#ifndef __GPU_CULLING_H__
+#define __GPU_CULLING_H__ 1
+
+/**
+ * @class GPUCulling
+ *
+ * @brief Culls the instances of the multi draw buckets with compute shaders.
+ *
+ * The bounds of every instance are uploaded to a storage buffer and a cull
+ * pass tests them against the camera frustum and against a depth pyramid of
+ * the last frame. Visible instances are copied into a compacted instance
+ * buffer and a second pass writes the commands with any instance left, so
+ * every bucket is drawn with one glMultiDrawElementsIndirectCount and the CPU
+ * never reads back what is visible.
+ *
+ * The depth pyramid keeps the farthest depth of every texel of the level
+ * below. It is built at the end of the frame from the depth attachment of the
+ * bound framebuffer, and the cull pass of the next frame projects the bounds
+ * with the camera of that frame, so moving cameras still test against the
+ * depth they were built with.
+ *
+ * Needs the compute shaders of OpenGL 4.3, without them init fails and
+ * nothing is culled. The count draw is from OpenGL 4.6, older contexts draw
+ * every command of the bucket straight from the cull buffer and the ones left
+ * without instances do nothing.
+ */
+class GPUCulling
+{
+public:
+  /**
+   * @struct Instance
+   *
+   * @brief Bounds of an instance, same layout as the cull shader (std430).
+   */
+  struct Instance
+  {
+    f32 min_[3];         ///< Minimum corner of the world bounds.
+    u32 command_;        ///< Command the instance is drawn with.
+    f32 max_[3];         ///< Maximum corner of the world bounds.
+    u32 source_;         ///< Instance data in the buffer bound at INSTANCE_BIND.
+    u32 always_visible_; ///< 1 for instances without bounds.
+    u32 padding_[3];     ///< Struct size is rounded to the vec3 alignment.
+  };
+
+  /**
+   * @struct Command
+   *
+   * @brief Draw of a mesh before the cull, same layout as the cull shader (std430).
+   * The first five fields are a DrawElementsIndirectCommand.
+   */
+  struct Command
+  {
+    u32 count_;          ///< Indices of the mesh.
+    u32 instance_count_; ///< Visible instances, 0 before the cull.
+    u32 first_index_;    ///< First index in the pool.
+    s32 base_vertex_;    ///< First vertex in the pool.
+    u32 base_instance_;  ///< First slot in the compacted instance buffer.
+    u32 bucket_;         ///< Multi draw call of the command.
+    u32 bucket_first_;   ///< First command of the bucket.
+    u32 padding_;        ///< Struct size is rounded to 16 bytes.
+  };
+
+  /**
+   * @brief Constructor, nothing is created until init.
+   */
+  GPUCulling();
+
+  /**
+   * @brief Destructor.
+   */
+  ~GPUCulling();
+
+  /**
+   * @brief Compiles the compute programs, only the first call does the work.
+   *
+   * @return False if the programs can not be built.
+   */
+  boolean init();
+
+  /**
+   * @brief Releases the programs, buffers and the depth pyramid.
+   */
+  void free();
+
+  /**
+   * @brief Culls the instances and compacts the commands of every bucket.
+   * The instance data of the queue must be bound at INSTANCE_BIND.
+   *
+   * @param instances Bounds of every instance.
+   * @param commands Commands of every bucket, the commands of a bucket are consecutive.
+   * @param bucket_count Number of buckets.
+   * @param output_count Slots of the compacted instance buffer, the sum of every command capacity.
+   * @param view_projection View and projection matrix of the camera.
+   */
+  void cull(const std::vector<Instance> &instances, const std::vector<Command> &commands, u32 bucket_count, u32 output_count,
+            const Math::Mat4 &view_projection);
+
+  /**
+   * @brief Draws the commands left in a bucket with the compacted instances bound at INSTANCE_BIND.
+   * The vertex array and the program must be bound.
+   *
+   * @param mode Primitive mode.
+   * @param bucket Bucket to draw.
+   * @param first_command First command of the bucket.
+   * @param command_count Commands of the bucket before the cull.
+   */
+  void draw(u32 mode, u32 bucket, u32 first_command, u32 command_count) const;
+
+  /**
+   * @brief Builds the depth pyramid from the depth attachment of the bound draw framebuffer.
+   * The default framebuffer can not be read, then the next frame only has frustum culling.
+   *
+   * @param view_projection View and projection matrix the depth was rendered with.
+   */
+  void buildPyramid(const Math::Mat4 &view_projection);
+
+  /**
+   * @brief Gets the number of levels of the depth pyramid.
+   *
+   * @return Levels, 0 if there is no pyramid.
+   */
+  u32 pyramidLevels() const;
+
+private:
+  u32 cull_program_;       ///< Frustum and depth test of every instance.
+  u32 compact_program_;    ///< Writes the commands with visible instances.
+  u32 downsample_program_; ///< Builds a level of the pyramid.
+  boolean failed_;         ///< The programs did not build, init is not retried.
+  boolean draw_count_;     ///< glMultiDrawElementsIndirectCount is available.
+
+  u32 buffers_[5];            ///< Instance bounds, commands, compacted instances, compacted commands and bucket counts.
+  size_t buffer_capacity_[5]; ///< Size of every buffer in bytes.
+
+  RingBuffer::Slice instance_slice_; ///< Instance bounds in the ring buffer, used instead of their buffer.
+  RingBuffer::Slice command_slice_;  ///< Commands in the ring buffer, used instead of their buffer.
+
+  u32 depth_texture_;                  ///< Copy of the depth attachment.
+  u32 depth_framebuffer_;              ///< Framebuffer of the depth copy.
+  s32 depth_format_;                   ///< Internal format of the depth copy.
+  u32 pyramid_texture_;                ///< Farthest depth, one level per halving.
+  u32 pyramid_width_;                  ///< Width of the first level.
+  u32 pyramid_height_;                 ///< Height of the first level.
+  u32 pyramid_levels_;                 ///< Levels of the pyramid.
+  Math::Mat4 pyramid_view_projection_; ///< Camera the pyramid was built with.
+
+  /**
+   * @brief Uploads data to a buffer, growing it if it does not fit.
+   *
+   * @param index Buffer to fill.
+   * @param data Data to upload, null only reserves it.
+   * @param size Bytes of the data.
+   */
+  void upload(u32 index, const void *data, size_t size);
+
+  /**
+   * @brief Creates the depth copy and the pyramid if the attachment changed.
+   *
+   * @param width Width of the attachment.
+   * @param height Height of the attachment.
+   * @param format Internal format of the attachment.
+   */
+  void resizePyramid(u32 width, u32 height, s32 format);
+};
+
+#endif /* __GPU_CULLING_H__ */
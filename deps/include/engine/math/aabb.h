@@ -0,0 +1,225 @@
+/**
+ * @author Javier Guinot Almenar <guinotal@esat-alumni.com>
+ *
+ * @file aabb.h
+ *
+ * @brief Axis aligned bounding box Class Definition.
+ * An empty box has min > max, so it can be grown with Expand/Merge.
+ *
+ */
+
+#include <algorithm>
+#include <cfloat>
+
+#include "mathlib.h"
+
+#ifndef __AABB_H__
+#define __AABB_H__ 1
+
+namespace Math
+{
+  class AABB
+  {
+  public:
+    // Console
+    ///////////////////////////////////////////////////////////////////////////
+    inline void print(unsigned d = 5, const char *name = "AABB") const
+    {
+      fprintf(stdout, "%s: min(%.*f, %.*f, %.*f) max(%.*f, %.*f, %.*f)\n", name,
+              d, this->min.x, d, this->min.y, d, this->min.z, d, this->max.x, d, this->max.y, d, this->max.z);
+    }
+    // This it to use with std strings and the operator <<
+    inline friend std::ostream &operator<<(std::ostream &os, AABB b) { return (os << "[" << b.min << ", " << b.max << "]"); }
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Constructors
+    ///////////////////////////////////////////////////////////////////////////
+    inline AABB(); // Empty box
+    inline AABB(Vec3 min, Vec3 max);
+    inline AABB(const AABB &other);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Operators
+    ///////////////////////////////////////////////////////////////////////////
+    inline void operator=(AABB other);
+
+    inline bool operator==(AABB other) const;
+    inline bool operator!=(AABB other) const;
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Static Methods
+    ///////////////////////////////////////////////////////////////////////////
+    inline static AABB FromCenterExtents(Vec3 center, Vec3 extents);
+    // Bounds of count points found every stride bytes (e.g. &vertices[0].position_, sizeof(Vertex))
+    inline static AABB FromPoints(const void *points, size_t stride, size_t count);
+
+    inline static AABB Merge(AABB a, AABB b);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Methods
+    ///////////////////////////////////////////////////////////////////////////
+    inline bool IsEmpty() const;
+
+    inline Vec3 Center() const;
+    inline Vec3 Extents() const; // Half size
+    inline Vec3 Size() const;
+    inline float SurfaceArea() const;
+
+    inline void Expand(Vec3 point);
+    inline void Expand(AABB other);
+
+    inline bool Contains(Vec3 point) const;
+    inline bool Contains(AABB other) const;
+    inline bool Intersects(AABB other) const;
+    // Slab test, inv_dir is 1 / direction so the same ray can test many boxes.
+    // distance is where the ray enters the box, 0 if it starts inside
+    inline bool IntersectsRay(Vec3 origin, Vec3 inv_dir, float max_distance, float &distance) const;
+
+    // Box that holds this one after being transformed by m (row vector, affine)
+    inline AABB Transformed(const Mat4 &m) const;
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Attributes
+    ///////////////////////////////////////////////////////////////////////////
+    Vec3 min, max;
+    ///////////////////////////////////////////////////////////////////////////
+  };
+
+  // Implementation
+  ///////////////////////////////////////////////////////////////////////////////
+
+  // Constructors
+  AABB::AABB() : min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+  AABB::AABB(Vec3 a, Vec3 b) : min(a), max(b) {}
+  AABB::AABB(const AABB &other) : min(other.min), max(other.max) {}
+
+  // Operators
+  void AABB::operator=(AABB other)
+  {
+    this->min = other.min;
+    this->max = other.max;
+  }
+
+  bool AABB::operator==(AABB other) const { return (this->min == other.min && this->max == other.max); }
+  bool AABB::operator!=(AABB other) const { return !((*this) == other); }
+
+  // Static Methods
+  AABB AABB::FromCenterExtents(Vec3 center, Vec3 extents) { return AABB(center - extents, center + extents); }
+
+  AABB AABB::FromPoints(const void *points, size_t stride, size_t count)
+  {
+    AABB ret;
+    const unsigned char *it = reinterpret_cast<const unsigned char *>(points);
+    for (size_t i = 0; i < count; i++, it += stride)
+    {
+      float v[3];
+      std::memcpy(v, it, sizeof(v));
+      ret.Expand(Vec3(v[0], v[1], v[2]));
+    }
+
+    return ret;
+  }
+
+  AABB AABB::Merge(AABB a, AABB b)
+  {
+    a.Expand(b);
+
+    return a;
+  }
+
+  // Methods
+  bool AABB::IsEmpty() const { return (this->min.x > this->max.x || this->min.y > this->max.y || this->min.z > this->max.z); }
+
+  Vec3 AABB::Center() const { return (this->min + this->max) * 0.5f; }
+  Vec3 AABB::Extents() const { return (this->max - this->min) * 0.5f; }
+  Vec3 AABB::Size() const { return this->max - this->min; }
+
+  float AABB::SurfaceArea() const
+  {
+    if (IsEmpty())
+      return 0.0f;
+
+    Vec3 s = Size();
+    return 2.0f * ((s.x * s.y) + (s.y * s.z) + (s.z * s.x));
+  }
+
+  void AABB::Expand(Vec3 point)
+  {
+    this->min = Vec3(std::min(this->min.x, point.x), std::min(this->min.y, point.y), std::min(this->min.z, point.z));
+    this->max = Vec3(std::max(this->max.x, point.x), std::max(this->max.y, point.y), std::max(this->max.z, point.z));
+  }
+
+  void AABB::Expand(AABB other)
+  {
+    if (other.IsEmpty())
+      return;
+
+    Expand(other.min);
+    Expand(other.max);
+  }
+
+  bool AABB::Contains(Vec3 p) const
+  {
+    return (p.x >= this->min.x && p.x <= this->max.x &&
+            p.y >= this->min.y && p.y <= this->max.y &&
+            p.z >= this->min.z && p.z <= this->max.z);
+  }
+
+  bool AABB::Contains(AABB other) const { return (Contains(other.min) && Contains(other.max)); }
+
+  bool AABB::Intersects(AABB other) const
+  {
+    return (this->min.x <= other.max.x && this->max.x >= other.min.x &&
+            this->min.y <= other.max.y && this->max.y >= other.min.y &&
+            this->min.z <= other.max.z && this->max.z >= other.min.z);
+  }
+
+  bool AABB::IntersectsRay(Vec3 origin, Vec3 inv_dir, float max_distance, float &distance) const
+  {
+    float t_min = 0.0f, t_max = max_distance;
+
+    const float o[3] = {origin.x, origin.y, origin.z};
+    const float d[3] = {inv_dir.x, inv_dir.y, inv_dir.z};
+    const float lo[3] = {this->min.x, this->min.y, this->min.z};
+    const float hi[3] = {this->max.x, this->max.y, this->max.z};
+
+    for (int i = 0; i < 3; i++)
+    {
+      // An axis parallel ray gives infinities, they still compare right
+      float t0 = (lo[i] - o[i]) * d[i];
+      float t1 = (hi[i] - o[i]) * d[i];
+      if (t0 > t1)
+        std::swap(t0, t1);
+
+      t_min = std::max(t_min, t0);
+      t_max = std::min(t_max, t1);
+      if (t_min > t_max)
+        return false;
+    }
+
+    distance = t_min;
+
+    return true;
+  }
+
+  AABB AABB::Transformed(const Mat4 &m) const
+  {
+    if (IsEmpty())
+      return (*this);
+
+    // Center goes through the full matrix, extents through the absolute 3x3
+    Vec3 c = Center(), e = Extents();
+    const float *f = m.m;
+
+    Vec3 center((f[0] * c.x) + (f[4] * c.y) + (f[8] * c.z) + f[12],
+                (f[1] * c.x) + (f[5] * c.y) + (f[9] * c.z) + f[13],
+                (f[2] * c.x) + (f[6] * c.y) + (f[10] * c.z) + f[14]);
+    Vec3 extents((std::abs(f[0]) * e.x) + (std::abs(f[4]) * e.y) + (std::abs(f[8]) * e.z),
+                 (std::abs(f[1]) * e.x) + (std::abs(f[5]) * e.y) + (std::abs(f[9]) * e.z),
+                 (std::abs(f[2]) * e.x) + (std::abs(f[6]) * e.y) + (std::abs(f[10]) * e.z));
+
+    return FromCenterExtents(center, extents);
+  }
+}
+
+#endif /* __AABB_H__ */
@@ -0,0 +1,551 @@
+/**
+ * @file batch.h
+ *
+ * @brief Batched math kernels over structure-of-arrays data.
+ * Every function works on N elements at once. With AVX enabled
+ * (-mavx2 -mfma) the loops run 8 lanes per iteration, otherwise
+ * they fall back to the plain scalar path.
+ *
+ * Spans are non-owning views: x, y and z point to arrays of at
+ * least count floats. Input and output spans may alias.
+ *
+ */
+
+#ifndef __BATCH_H__
+#define __BATCH_H__ 1
+
+#include <algorithm>
+#include <cstring>
+
+#include "mathlib.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace Math
+{
+  class Batch
+  {
+  public:
+    // Spans
+    ///////////////////////////////////////////////////////////////////////////
+    struct Vec3Span
+    {
+      float *x = nullptr;
+      float *y = nullptr;
+      float *z = nullptr;
+      size_t count = 0;
+
+      inline Vec3 get(size_t index) const { return Vec3(x[index], y[index], z[index]); }
+      inline void set(size_t index, Vec3 v)
+      {
+        x[index] = v.x;
+        y[index] = v.y;
+        z[index] = v.z;
+      }
+    };
+
+    struct ConstVec3Span
+    {
+      const float *x = nullptr;
+      const float *y = nullptr;
+      const float *z = nullptr;
+      size_t count = 0;
+
+      inline ConstVec3Span() = default;
+      inline ConstVec3Span(const float *px, const float *py, const float *pz, size_t n) : x(px), y(py), z(pz), count(n) {}
+      inline ConstVec3Span(const Vec3Span &other) : x(other.x), y(other.y), z(other.z), count(other.count) {}
+
+      inline Vec3 get(size_t index) const { return Vec3(x[index], y[index], z[index]); }
+    };
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Conversors
+    ///////////////////////////////////////////////////////////////////////////
+    // Copies count Vec3 found every stride bytes from src (e.g. &vertices[0].position_, sizeof(Vertex))
+    inline static void Deinterleave(const void *src, size_t stride, size_t count, Vec3Span out);
+    // Inverse of Deinterleave, writes the span back into an interleaved array
+    inline static void Interleave(ConstVec3Span in, void *dst, size_t stride);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Transforms
+    ///////////////////////////////////////////////////////////////////////////
+    // Same result as MathUtils::Mat4TransformVec3 for every point (w = 1)
+    inline static void TransformPoints(const Mat4 &m, ConstVec3Span in, Vec3Span out);
+    // Upper 3x3 of m applied to every vector (w = 0), the result is not normalized
+    inline static void TransformNormals(const Mat4 &m, ConstVec3Span in, Vec3Span out);
+
+    // out[i] = left[i] * right[i]
+    inline static void MultiplyPairs(const Mat4 *left, const Mat4 *right, Mat4 *out, size_t count);
+    // out[i] = left[i] * right, e.g. every local matrix by the same father matrix
+    inline static void MultiplyBy(const Mat4 *left, const Mat4 &right, Mat4 *out, size_t count);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Vector ops
+    ///////////////////////////////////////////////////////////////////////////
+    // Returns false (and leaves min/max untouched) when the span is empty
+    inline static bool ComputeAABB(ConstVec3Span in, Vec3 &min, Vec3 &max);
+
+    // Zero length vectors are left as zero
+    inline static void Normalize(ConstVec3Span in, Vec3Span out);
+
+    inline static void Dot(ConstVec3Span a, ConstVec3Span b, float *out);
+    inline static void Cross(ConstVec3Span a, ConstVec3Span b, Vec3Span out);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Culling
+    ///////////////////////////////////////////////////////////////////////////
+    // out[i] = frustum.Classify(box i), boxes as center and extents. Returns how many are not Outside
+    inline static size_t ClassifyAABBs(const Frustum &frustum, ConstVec3Span centers, ConstVec3Span extents, Frustum::Result *out);
+    // out[i] = frustum.Classify(sphere i). Returns how many are not Outside
+    inline static size_t ClassifySpheres(const Frustum &frustum, ConstVec3Span centers, const float *radii, Frustum::Result *out);
+    ///////////////////////////////////////////////////////////////////////////
+
+  private:
+    Batch();
+    ~Batch();
+
+    inline static void MultiplyOne(const float *a, const float *b, float *out);
+
+#if defined(__AVX__)
+    inline static __m256 Madd(__m256 a, __m256 b, __m256 c);
+    // Writes 8 results from the lane masks (sign bits) of the outside and intersect tests
+    inline static size_t StoreResults(__m256 outside, __m256 intersect, Frustum::Result *out);
+#endif
+  };
+
+  inline Batch::Batch() {}
+  inline Batch::~Batch() {}
+
+  // Implementation
+  ///////////////////////////////////////////////////////////////////////////////
+
+#if defined(__AVX__)
+  __m256 Batch::Madd(__m256 a, __m256 b, __m256 c)
+  {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+  }
+
+  size_t Batch::StoreResults(__m256 outside, __m256 intersect, Frustum::Result *out)
+  {
+    static_assert(static_cast<int>(Frustum::Result::Outside) == 0 && static_cast<int>(Frustum::Result::Intersect) == 1 &&
+                  static_cast<int>(Frustum::Result::Inside) == 2);
+
+    // 0 outside, 1 intersect, 2 inside, packed down to one byte per lane
+    __m256 value = _mm256_blendv_ps(_mm256_set1_ps(2.0f), _mm256_set1_ps(1.0f), intersect);
+    __m256i lanes = _mm256_cvtps_epi32(_mm256_andnot_ps(outside, value));
+    __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(lanes), _mm256_extractf128_si256(lanes, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(words, words));
+
+    unsigned visible_bits = static_cast<unsigned>(~_mm256_movemask_ps(outside)) & 0xffu;
+    size_t visible = 0;
+    for (; visible_bits; visible_bits &= visible_bits - 1)
+      visible++;
+
+    return visible;
+  }
+#endif
+
+  void Batch::Deinterleave(const void *src, size_t stride, size_t count, Vec3Span out)
+  {
+    const unsigned char *it = reinterpret_cast<const unsigned char *>(src);
+    for (size_t i = 0; i < count; i++, it += stride)
+    {
+      float v[3];
+      std::memcpy(v, it, sizeof(v));
+      out.x[i] = v[0];
+      out.y[i] = v[1];
+      out.z[i] = v[2];
+    }
+  }
+
+  void Batch::Interleave(ConstVec3Span in, void *dst, size_t stride)
+  {
+    unsigned char *it = reinterpret_cast<unsigned char *>(dst);
+    for (size_t i = 0; i < in.count; i++, it += stride)
+    {
+      float v[3] = {in.x[i], in.y[i], in.z[i]};
+      std::memcpy(it, v, sizeof(v));
+    }
+  }
+
+  void Batch::TransformPoints(const Mat4 &m, ConstVec3Span in, Vec3Span out)
+  {
+    const float *f = m.m;
+    const bool affine = (f[3] == 0.0f && f[7] == 0.0f && f[11] == 0.0f && f[15] == 1.0f);
+    size_t i = 0;
+
+#if defined(__AVX__)
+    const __m256 m0 = _mm256_set1_ps(f[0]), m1 = _mm256_set1_ps(f[1]), m2 = _mm256_set1_ps(f[2]), m3 = _mm256_set1_ps(f[3]);
+    const __m256 m4 = _mm256_set1_ps(f[4]), m5 = _mm256_set1_ps(f[5]), m6 = _mm256_set1_ps(f[6]), m7 = _mm256_set1_ps(f[7]);
+    const __m256 m8 = _mm256_set1_ps(f[8]), m9 = _mm256_set1_ps(f[9]), m10 = _mm256_set1_ps(f[10]), m11 = _mm256_set1_ps(f[11]);
+    const __m256 m12 = _mm256_set1_ps(f[12]), m13 = _mm256_set1_ps(f[13]), m14 = _mm256_set1_ps(f[14]), m15 = _mm256_set1_ps(f[15]);
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    for (; i + 8 <= in.count; i += 8)
+    {
+      __m256 x = _mm256_loadu_ps(in.x + i);
+      __m256 y = _mm256_loadu_ps(in.y + i);
+      __m256 z = _mm256_loadu_ps(in.z + i);
+
+      __m256 rx = Madd(x, m0, Madd(y, m4, Madd(z, m8, m12)));
+      __m256 ry = Madd(x, m1, Madd(y, m5, Madd(z, m9, m13)));
+      __m256 rz = Madd(x, m2, Madd(y, m6, Madd(z, m10, m14)));
+
+      if (!affine)
+      {
+        __m256 rw = Madd(x, m3, Madd(y, m7, Madd(z, m11, m15)));
+        __m256 rec_w = _mm256_div_ps(one, rw);
+        rx = _mm256_mul_ps(rx, rec_w);
+        ry = _mm256_mul_ps(ry, rec_w);
+        rz = _mm256_mul_ps(rz, rec_w);
+      }
+
+      _mm256_storeu_ps(out.x + i, rx);
+      _mm256_storeu_ps(out.y + i, ry);
+      _mm256_storeu_ps(out.z + i, rz);
+    }
+#endif
+
+    for (; i < in.count; i++)
+    {
+      float x = in.x[i], y = in.y[i], z = in.z[i];
+      float rx = (f[0] * x) + (f[4] * y) + (f[8] * z) + f[12];
+      float ry = (f[1] * x) + (f[5] * y) + (f[9] * z) + f[13];
+      float rz = (f[2] * x) + (f[6] * y) + (f[10] * z) + f[14];
+
+      if (!affine)
+      {
+        float rec_w = 1.0f / ((f[3] * x) + (f[7] * y) + (f[11] * z) + f[15]);
+        rx *= rec_w;
+        ry *= rec_w;
+        rz *= rec_w;
+      }
+
+      out.x[i] = rx;
+      out.y[i] = ry;
+      out.z[i] = rz;
+    }
+  }
+
+  void Batch::TransformNormals(const Mat4 &m, ConstVec3Span in, Vec3Span out)
+  {
+    const float *f = m.m;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    const __m256 m0 = _mm256_set1_ps(f[0]), m1 = _mm256_set1_ps(f[1]), m2 = _mm256_set1_ps(f[2]);
+    const __m256 m4 = _mm256_set1_ps(f[4]), m5 = _mm256_set1_ps(f[5]), m6 = _mm256_set1_ps(f[6]);
+    const __m256 m8 = _mm256_set1_ps(f[8]), m9 = _mm256_set1_ps(f[9]), m10 = _mm256_set1_ps(f[10]);
+
+    for (; i + 8 <= in.count; i += 8)
+    {
+      __m256 x = _mm256_loadu_ps(in.x + i);
+      __m256 y = _mm256_loadu_ps(in.y + i);
+      __m256 z = _mm256_loadu_ps(in.z + i);
+
+      __m256 rx = Madd(x, m0, Madd(y, m4, _mm256_mul_ps(z, m8)));
+      __m256 ry = Madd(x, m1, Madd(y, m5, _mm256_mul_ps(z, m9)));
+      __m256 rz = Madd(x, m2, Madd(y, m6, _mm256_mul_ps(z, m10)));
+
+      _mm256_storeu_ps(out.x + i, rx);
+      _mm256_storeu_ps(out.y + i, ry);
+      _mm256_storeu_ps(out.z + i, rz);
+    }
+#endif
+
+    for (; i < in.count; i++)
+    {
+      float x = in.x[i], y = in.y[i], z = in.z[i];
+      out.x[i] = (f[0] * x) + (f[4] * y) + (f[8] * z);
+      out.y[i] = (f[1] * x) + (f[5] * y) + (f[9] * z);
+      out.z[i] = (f[2] * x) + (f[6] * y) + (f[10] * z);
+    }
+  }
+
+  void Batch::MultiplyOne(const float *a, const float *b, float *out)
+  {
+#if defined(__AVX__)
+    // Two result lines per register, every line of b repeated in both halves
+    const __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(b + 0));
+    const __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(b + 4));
+    const __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(b + 8));
+    const __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(b + 12));
+
+    for (size_t line = 0; line < 16; line += 8)
+    {
+      __m256 a01 = _mm256_loadu_ps(a + line);
+      __m256 r = _mm256_mul_ps(_mm256_permute_ps(a01, 0x00), b0);
+      r = Madd(_mm256_permute_ps(a01, 0x55), b1, r);
+      r = Madd(_mm256_permute_ps(a01, 0xAA), b2, r);
+      r = Madd(_mm256_permute_ps(a01, 0xFF), b3, r);
+      _mm256_storeu_ps(out + line, r);
+    }
+#else
+    float ret[16];
+    for (size_t line = 0; line < 4; line++)
+      for (size_t col = 0; col < 4; col++)
+        ret[line * 4 + col] = a[line * 4 + 0] * b[col] +
+                              a[line * 4 + 1] * b[4 + col] +
+                              a[line * 4 + 2] * b[8 + col] +
+                              a[line * 4 + 3] * b[12 + col];
+
+    std::memcpy(out, ret, sizeof(ret));
+#endif
+  }
+
+  void Batch::MultiplyPairs(const Mat4 *left, const Mat4 *right, Mat4 *out, size_t count)
+  {
+    for (size_t i = 0; i < count; i++)
+      MultiplyOne(left[i].m, right[i].m, out[i].m);
+  }
+
+  void Batch::MultiplyBy(const Mat4 *left, const Mat4 &right, Mat4 *out, size_t count)
+  {
+    // Copy first so out may alias left or right
+    float r[16];
+    std::memcpy(r, right.m, sizeof(r));
+
+    for (size_t i = 0; i < count; i++)
+      MultiplyOne(left[i].m, r, out[i].m);
+  }
+
+  bool Batch::ComputeAABB(ConstVec3Span in, Vec3 &min, Vec3 &max)
+  {
+    if (in.count == 0)
+      return false;
+
+    float min_x = in.x[0], min_y = in.y[0], min_z = in.z[0];
+    float max_x = min_x, max_y = min_y, max_z = min_z;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    if (in.count >= 8)
+    {
+      __m256 vmin_x = _mm256_loadu_ps(in.x), vmax_x = vmin_x;
+      __m256 vmin_y = _mm256_loadu_ps(in.y), vmax_y = vmin_y;
+      __m256 vmin_z = _mm256_loadu_ps(in.z), vmax_z = vmin_z;
+
+      for (i = 8; i + 8 <= in.count; i += 8)
+      {
+        __m256 x = _mm256_loadu_ps(in.x + i);
+        __m256 y = _mm256_loadu_ps(in.y + i);
+        __m256 z = _mm256_loadu_ps(in.z + i);
+        vmin_x = _mm256_min_ps(vmin_x, x);
+        vmax_x = _mm256_max_ps(vmax_x, x);
+        vmin_y = _mm256_min_ps(vmin_y, y);
+        vmax_y = _mm256_max_ps(vmax_y, y);
+        vmin_z = _mm256_min_ps(vmin_z, z);
+        vmax_z = _mm256_max_ps(vmax_z, z);
+      }
+
+      float lanes[6][8];
+      _mm256_storeu_ps(lanes[0], vmin_x);
+      _mm256_storeu_ps(lanes[1], vmin_y);
+      _mm256_storeu_ps(lanes[2], vmin_z);
+      _mm256_storeu_ps(lanes[3], vmax_x);
+      _mm256_storeu_ps(lanes[4], vmax_y);
+      _mm256_storeu_ps(lanes[5], vmax_z);
+
+      for (size_t l = 0; l < 8; l++)
+      {
+        min_x = std::min(min_x, lanes[0][l]);
+        min_y = std::min(min_y, lanes[1][l]);
+        min_z = std::min(min_z, lanes[2][l]);
+        max_x = std::max(max_x, lanes[3][l]);
+        max_y = std::max(max_y, lanes[4][l]);
+        max_z = std::max(max_z, lanes[5][l]);
+      }
+    }
+#endif
+
+    for (; i < in.count; i++)
+    {
+      min_x = std::min(min_x, in.x[i]);
+      min_y = std::min(min_y, in.y[i]);
+      min_z = std::min(min_z, in.z[i]);
+      max_x = std::max(max_x, in.x[i]);
+      max_y = std::max(max_y, in.y[i]);
+      max_z = std::max(max_z, in.z[i]);
+    }
+
+    min = Vec3(min_x, min_y, min_z);
+    max = Vec3(max_x, max_y, max_z);
+
+    return true;
+  }
+
+  void Batch::Normalize(ConstVec3Span in, Vec3Span out)
+  {
+    size_t i = 0;
+
+#if defined(__AVX__)
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    for (; i + 8 <= in.count; i += 8)
+    {
+      __m256 x = _mm256_loadu_ps(in.x + i);
+      __m256 y = _mm256_loadu_ps(in.y + i);
+      __m256 z = _mm256_loadu_ps(in.z + i);
+
+      __m256 sqr = Madd(x, x, Madd(y, y, _mm256_mul_ps(z, z)));
+      __m256 rec_len = _mm256_div_ps(one, _mm256_sqrt_ps(sqr));
+      rec_len = _mm256_and_ps(rec_len, _mm256_cmp_ps(sqr, zero, _CMP_GT_OQ));
+
+      _mm256_storeu_ps(out.x + i, _mm256_mul_ps(x, rec_len));
+      _mm256_storeu_ps(out.y + i, _mm256_mul_ps(y, rec_len));
+      _mm256_storeu_ps(out.z + i, _mm256_mul_ps(z, rec_len));
+    }
+#endif
+
+    for (; i < in.count; i++)
+    {
+      float x = in.x[i], y = in.y[i], z = in.z[i];
+      float sqr = (x * x) + (y * y) + (z * z);
+      float rec_len = (sqr > 0.0f) ? (1.0f / sqrtf(sqr)) : 0.0f;
+
+      out.x[i] = x * rec_len;
+      out.y[i] = y * rec_len;
+      out.z[i] = z * rec_len;
+    }
+  }
+
+  void Batch::Dot(ConstVec3Span a, ConstVec3Span b, float *out)
+  {
+    size_t i = 0;
+
+#if defined(__AVX__)
+    for (; i + 8 <= a.count; i += 8)
+    {
+      __m256 r = _mm256_mul_ps(_mm256_loadu_ps(a.z + i), _mm256_loadu_ps(b.z + i));
+      r = Madd(_mm256_loadu_ps(a.y + i), _mm256_loadu_ps(b.y + i), r);
+      r = Madd(_mm256_loadu_ps(a.x + i), _mm256_loadu_ps(b.x + i), r);
+      _mm256_storeu_ps(out + i, r);
+    }
+#endif
+
+    for (; i < a.count; i++)
+      out[i] = (a.x[i] * b.x[i]) + (a.y[i] * b.y[i]) + (a.z[i] * b.z[i]);
+  }
+
+  void Batch::Cross(ConstVec3Span a, ConstVec3Span b, Vec3Span out)
+  {
+    size_t i = 0;
+
+#if defined(__AVX__)
+    for (; i + 8 <= a.count; i += 8)
+    {
+      __m256 ax = _mm256_loadu_ps(a.x + i), ay = _mm256_loadu_ps(a.y + i), az = _mm256_loadu_ps(a.z + i);
+      __m256 bx = _mm256_loadu_ps(b.x + i), by = _mm256_loadu_ps(b.y + i), bz = _mm256_loadu_ps(b.z + i);
+
+      _mm256_storeu_ps(out.x + i, _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by)));
+      _mm256_storeu_ps(out.y + i, _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz)));
+      _mm256_storeu_ps(out.z + i, _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx)));
+    }
+#endif
+
+    for (; i < a.count; i++)
+    {
+      float ax = a.x[i], ay = a.y[i], az = a.z[i];
+      float bx = b.x[i], by = b.y[i], bz = b.z[i];
+
+      out.x[i] = ay * bz - az * by;
+      out.y[i] = az * bx - ax * bz;
+      out.z[i] = ax * by - ay * bx;
+    }
+  }
+
+  size_t Batch::ClassifyAABBs(const Frustum &frustum, ConstVec3Span centers, ConstVec3Span extents, Frustum::Result *out)
+  {
+    size_t visible = 0;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    __m256 px[Frustum::MaxPlanes], py[Frustum::MaxPlanes], pz[Frustum::MaxPlanes], pw[Frustum::MaxPlanes];
+    __m256 ax[Frustum::MaxPlanes], ay[Frustum::MaxPlanes], az[Frustum::MaxPlanes];
+    for (int p = 0; p < Frustum::MaxPlanes; p++)
+    {
+      const Vec4 &plane = frustum.planes[p];
+      px[p] = _mm256_set1_ps(plane.x), py[p] = _mm256_set1_ps(plane.y), pz[p] = _mm256_set1_ps(plane.z), pw[p] = _mm256_set1_ps(plane.w);
+      ax[p] = _mm256_set1_ps(std::abs(plane.x)), ay[p] = _mm256_set1_ps(std::abs(plane.y)), az[p] = _mm256_set1_ps(std::abs(plane.z));
+    }
+
+    for (; i + 8 <= centers.count; i += 8)
+    {
+      __m256 cx = _mm256_loadu_ps(centers.x + i), cy = _mm256_loadu_ps(centers.y + i), cz = _mm256_loadu_ps(centers.z + i);
+      __m256 ex = _mm256_loadu_ps(extents.x + i), ey = _mm256_loadu_ps(extents.y + i), ez = _mm256_loadu_ps(extents.z + i);
+      __m256 outside = _mm256_setzero_ps(), intersect = _mm256_setzero_ps();
+
+      for (int p = 0; p < Frustum::MaxPlanes; p++)
+      {
+        __m256 dist = Madd(px[p], cx, Madd(py[p], cy, Madd(pz[p], cz, pw[p])));
+        __m256 radius = Madd(ax[p], ex, Madd(ay[p], ey, _mm256_mul_ps(az[p], ez)));
+
+        // dist < -radius, dist < radius
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dist, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+        intersect = _mm256_or_ps(intersect, _mm256_cmp_ps(dist, radius, _CMP_LT_OQ));
+      }
+
+      visible += StoreResults(outside, intersect, out + i);
+    }
+#endif
+
+    for (; i < centers.count; i++)
+    {
+      out[i] = frustum.Classify(AABB::FromCenterExtents(centers.get(i), extents.get(i)));
+      if (out[i] != Frustum::Result::Outside)
+        visible++;
+    }
+
+    return visible;
+  }
+
+  size_t Batch::ClassifySpheres(const Frustum &frustum, ConstVec3Span centers, const float *radii, Frustum::Result *out)
+  {
+    size_t visible = 0;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    __m256 px[Frustum::MaxPlanes], py[Frustum::MaxPlanes], pz[Frustum::MaxPlanes], pw[Frustum::MaxPlanes];
+    for (int p = 0; p < Frustum::MaxPlanes; p++)
+    {
+      const Vec4 &plane = frustum.planes[p];
+      px[p] = _mm256_set1_ps(plane.x), py[p] = _mm256_set1_ps(plane.y), pz[p] = _mm256_set1_ps(plane.z), pw[p] = _mm256_set1_ps(plane.w);
+    }
+
+    for (; i + 8 <= centers.count; i += 8)
+    {
+      __m256 cx = _mm256_loadu_ps(centers.x + i), cy = _mm256_loadu_ps(centers.y + i), cz = _mm256_loadu_ps(centers.z + i);
+      __m256 radius = _mm256_loadu_ps(radii + i);
+      __m256 outside = _mm256_setzero_ps(), intersect = _mm256_setzero_ps();
+
+      for (int p = 0; p < Frustum::MaxPlanes; p++)
+      {
+        __m256 dist = Madd(px[p], cx, Madd(py[p], cy, Madd(pz[p], cz, pw[p])));
+
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dist, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+        intersect = _mm256_or_ps(intersect, _mm256_cmp_ps(dist, radius, _CMP_LT_OQ));
+      }
+
+      visible += StoreResults(outside, intersect, out + i);
+    }
+#endif
+
+    for (; i < centers.count; i++)
+    {
+      out[i] = frustum.Classify(Sphere(centers.get(i), radii[i]));
+      if (out[i] != Frustum::Result::Outside)
+        visible++;
+    }
+
+    return visible;
+  }
+}
+
+#endif /* __BATCH_H__ */
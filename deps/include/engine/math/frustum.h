@@ -0,0 +1,224 @@
+/**
+ * @author Javier Guinot Almenar <guinotal@esat-alumni.com>
+ *
+ * @file frustum.h
+ *
+ * @brief View frustum Class Definition.
+ * Six planes extracted from a view-projection matrix. The planes
+ * point inwards and are normalized, so dot(normal, p) + w is the
+ * signed distance of p to the plane.
+ *
+ */
+
+#include "mathlib.h"
+
+#ifndef __FRUSTUM_H__
+#define __FRUSTUM_H__ 1
+
+namespace Math
+{
+  class Frustum
+  {
+  public:
+    enum Plane
+    {
+      Left = 0,
+      Right,
+      Bottom,
+      Top,
+      Near,
+      Far,
+      MaxPlanes,
+    };
+
+    enum class Result : unsigned char
+    {
+      Outside = 0,
+      Intersect,
+      Inside,
+    };
+
+    // Console
+    ///////////////////////////////////////////////////////////////////////////
+    inline void print(unsigned d = 5, const char *name = "Frustum") const
+    {
+      fprintf(stdout, "%s:\n", name);
+      for (int i = 0; i < MaxPlanes; i++)
+        this->planes[i].print(d, "  plane");
+    }
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Constructors
+    ///////////////////////////////////////////////////////////////////////////
+    inline Frustum();
+    inline Frustum(const Frustum &other);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Operators
+    ///////////////////////////////////////////////////////////////////////////
+    inline void operator=(const Frustum &other);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Static Methods
+    ///////////////////////////////////////////////////////////////////////////
+    /*
+      Takes the matrices the way the shaders get them (u_v_matrix, u_p_matrix),
+      with row vectors clip = point * view_projection, so use view * projection.
+      A model matrix can be added in front to get the frustum in local space.
+    */
+    inline static Frustum FromMatrix(const Mat4 &view_projection);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Methods
+    ///////////////////////////////////////////////////////////////////////////
+    inline float Distance(Plane plane, Vec3 point) const;
+
+    inline bool Contains(Vec3 point) const;
+
+    inline Result Classify(AABB box) const;
+    inline Result Classify(Sphere sphere) const;
+
+    // Cheaper than Classify when Inside and Intersect do not matter
+    inline bool IsVisible(AABB box) const;
+    inline bool IsVisible(Sphere sphere) const;
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Attributes
+    ///////////////////////////////////////////////////////////////////////////
+    Vec4 planes[MaxPlanes]; // xyz normal, w distance
+    ///////////////////////////////////////////////////////////////////////////
+  };
+
+  // Implementation
+  ///////////////////////////////////////////////////////////////////////////////
+
+  // Constructors
+  Frustum::Frustum()
+  {
+    for (int i = 0; i < MaxPlanes; i++)
+      this->planes[i] = Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+  }
+
+  Frustum::Frustum(const Frustum &other)
+  {
+    for (int i = 0; i < MaxPlanes; i++)
+      this->planes[i] = other.planes[i];
+  }
+
+  // Operators
+  void Frustum::operator=(const Frustum &other)
+  {
+    for (int i = 0; i < MaxPlanes; i++)
+      this->planes[i] = other.planes[i];
+  }
+
+  // Static Methods
+  Frustum Frustum::FromMatrix(const Mat4 &view_projection)
+  {
+    // clip.x = dot(point, column 0)... so the planes are sums of columns
+    Vec4 c0 = view_projection.GetColumn(0);
+    Vec4 c1 = view_projection.GetColumn(1);
+    Vec4 c2 = view_projection.GetColumn(2);
+    Vec4 c3 = view_projection.GetColumn(3);
+
+    Frustum ret;
+    ret.planes[Left] = c3 + c0;
+    ret.planes[Right] = c3 - c0;
+    ret.planes[Bottom] = c3 + c1;
+    ret.planes[Top] = c3 - c1;
+    ret.planes[Near] = c3 + c2;
+    ret.planes[Far] = c3 - c2;
+
+    for (int i = 0; i < MaxPlanes; i++)
+    {
+      Vec4 &p = ret.planes[i];
+      float len = sqrtf((p.x * p.x) + (p.y * p.y) + (p.z * p.z));
+      if (len > 0.0f)
+        p = p * (1.0f / len);
+    }
+
+    return ret;
+  }
+
+  // Methods
+  float Frustum::Distance(Plane plane, Vec3 point) const
+  {
+    const Vec4 &p = this->planes[plane];
+
+    return (p.x * point.x) + (p.y * point.y) + (p.z * point.z) + p.w;
+  }
+
+  bool Frustum::Contains(Vec3 point) const
+  {
+    for (int i = 0; i < MaxPlanes; i++)
+      if (Distance(static_cast<Plane>(i), point) < 0.0f)
+        return false;
+
+    return true;
+  }
+
+  Frustum::Result Frustum::Classify(AABB box) const
+  {
+    Vec3 c = box.Center(), e = box.Extents();
+    Result ret = Result::Inside;
+
+    for (int i = 0; i < MaxPlanes; i++)
+    {
+      const Vec4 &p = this->planes[i];
+      float dist = (p.x * c.x) + (p.y * c.y) + (p.z * c.z) + p.w;
+      float radius = (std::abs(p.x) * e.x) + (std::abs(p.y) * e.y) + (std::abs(p.z) * e.z);
+
+      if (dist < -radius)
+        return Result::Outside;
+      if (dist < radius)
+        ret = Result::Intersect;
+    }
+
+    return ret;
+  }
+
+  Frustum::Result Frustum::Classify(Sphere sphere) const
+  {
+    Result ret = Result::Inside;
+
+    for (int i = 0; i < MaxPlanes; i++)
+    {
+      float dist = Distance(static_cast<Plane>(i), sphere.center);
+
+      if (dist < -sphere.radius)
+        return Result::Outside;
+      if (dist < sphere.radius)
+        ret = Result::Intersect;
+    }
+
+    return ret;
+  }
+
+  bool Frustum::IsVisible(AABB box) const
+  {
+    Vec3 c = box.Center(), e = box.Extents();
+
+    for (int i = 0; i < MaxPlanes; i++)
+    {
+      const Vec4 &p = this->planes[i];
+      float dist = (p.x * c.x) + (p.y * c.y) + (p.z * c.z) + p.w;
+      float radius = (std::abs(p.x) * e.x) + (std::abs(p.y) * e.y) + (std::abs(p.z) * e.z);
+
+      if (dist < -radius)
+        return false;
+    }
+
+    return true;
+  }
+
+  bool Frustum::IsVisible(Sphere sphere) const
+  {
+    for (int i = 0; i < MaxPlanes; i++)
+      if (Distance(static_cast<Plane>(i), sphere.center) < -sphere.radius)
+        return false;
+
+    return true;
+  }
+}
+
+#endif /* __FRUSTUM_H__ */
@@ -146,13 +146,7 @@ namespace Math
 
   Vec3 MathUtils::Rotate3dPoint(Vec3 rot, Vec3 point)
   {
-    Mat4 model = Mat4::Identity();
-    if (rot.x != 0.0f)
-      model *= Mat4::RotateX((rot.x * static_cast<float>(M_PI * REC_180)));
-    if (rot.y != 0.0f)
-      model *= Mat4::RotateY((rot.y * static_cast<float>(M_PI * REC_180)));
-    if (rot.z != 0.0f)
-      model *= Mat4::RotateZ((rot.z * static_cast<float>(M_PI * REC_180)));
+    Mat4 model = Mat4::Rotate(rot * static_cast<float>(M_PI * REC_180));
 
     return Mat4TransformVec3(model, point);
   }
@@ -160,13 +154,7 @@ namespace Math
   Vec3 MathUtils::OrbitPoint(Vec3 orbit_centre, Vec3 orbit, Vec3 point)
   {
 
-    Mat4 model = Mat4::Identity();
-    if (orbit.x != 0)
-      model *= Mat4::RotateX((orbit.x * static_cast<float>(M_PI * REC_180)));
-    if (orbit.y != 0)
-      model *= Mat4::RotateY((orbit.y * static_cast<float>(M_PI * REC_180)));
-    if (orbit.z != 0)
-      model *= Mat4::RotateZ((orbit.z * static_cast<float>(M_PI * REC_180)));
+    Mat4 model = Mat4::Rotate(orbit * static_cast<float>(M_PI * REC_180));
 
     Vec3 ret(point);
     ret -= orbit_centre;
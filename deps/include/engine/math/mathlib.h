@@ -38,6 +38,14 @@
 #include "matrix_3.h"
 #include "matrix_4.h"
 
+#include "quaternion.h"
+
 #include "math_utils.h"
 
+#include "aabb.h"
+#include "sphere.h"
+#include "frustum.h"
+
+#include "batch.h"
+
 #endif /* __MATHLIB_H__ */
@@ -107,6 +107,9 @@ namespace Math
     inline static Mat4 Rotate(Vec3 radians);
     inline static Mat4 Rotate(float radX, float radY, float radZ);
 
+    // Same result as Rotate(rotation) * Scale(scale) * Translate(translate) (Transform component order)
+    inline static Mat4 TRS(Vec3 translate, Vec3 rotation, Vec3 scale);
+
     inline static Mat4 Transform(Vec3 rotation = Vec3::zero, Vec3 scale = Vec3::one, Vec3 translate = Vec3::zero);
     inline static Mat4 Transform(float rotX = 0, float rotY = 0, float rotZ = 0,
                                  float scaleX = 1, float scaleY = 1, float scaleZ = 1,
@@ -120,6 +123,9 @@ namespace Math
     inline static Mat4 OrthoMatrix(float right, float left,
                                    float top, float bottom,
                                    float near, float far);
+
+    // Inverse transpose of the model 3x3, use it with Mat3TransformVec3 for normals
+    inline static Mat3 NormalMatrix(const Mat4 &model);
     ///////////////////////////////////////////////////////////////////////////
 
     // Methods
@@ -131,7 +137,15 @@ namespace Math
 
     inline Mat4 Adjoint() const;
 
+    // Last column is (0, 0, 0, 1), any TRS or view matrix
+    inline bool IsAffine() const;
+
+    // Uses the affine or general path depending on the matrix
     inline Mat4 Inverse() const;
+    // Only valid if IsAffine()
+    inline Mat4 InverseAffine() const;
+    // Only valid for rotation + translation (view matrices, unscaled TRS)
+    inline Mat4 InverseOrthonormal() const;
 
     inline Mat4 Transpose() const;
     ///////////////////////////////////////////////////////////////////////////
@@ -519,8 +533,15 @@ namespace Math
     return Mat4(ret).Transpose();
   }
 
+  bool Mat4::IsAffine() const
+  {
+    return (this->m[3] == 0.0f && this->m[7] == 0.0f && this->m[11] == 0.0f && this->m[15] == 1.0f);
+  }
+
   Mat4 Mat4::Inverse() const
   {
+    if (this->IsAffine())
+      return this->InverseAffine();
 
     Mat4 ret = this->Adjoint();
     float det = this->Determinant();
@@ -533,6 +554,83 @@ namespace Math
     return ret;
   }
 
+  Mat4 Mat4::InverseAffine() const
+  {
+    // Cofactors of the upper 3x3
+    float c0 = this->m[5] * this->m[10] - this->m[6] * this->m[9];
+    float c1 = this->m[6] * this->m[8] - this->m[4] * this->m[10];
+    float c2 = this->m[4] * this->m[9] - this->m[5] * this->m[8];
+
+    float det = this->m[0] * c0 + this->m[1] * c1 + this->m[2] * c2;
+    if (det == 0)
+      return Mat4::zero;
+
+    float rec_det = 1.0f / det;
+
+    float r[9] = {
+        c0 * rec_det,
+        (this->m[2] * this->m[9] - this->m[1] * this->m[10]) * rec_det,
+        (this->m[1] * this->m[6] - this->m[2] * this->m[5]) * rec_det,
+        c1 * rec_det,
+        (this->m[0] * this->m[10] - this->m[2] * this->m[8]) * rec_det,
+        (this->m[2] * this->m[4] - this->m[0] * this->m[6]) * rec_det,
+        c2 * rec_det,
+        (this->m[1] * this->m[8] - this->m[0] * this->m[9]) * rec_det,
+        (this->m[0] * this->m[5] - this->m[1] * this->m[4]) * rec_det};
+
+    float tx = this->m[12], ty = this->m[13], tz = this->m[14];
+
+    float ret[16] = {
+        r[0], r[1], r[2], 0.0f,
+        r[3], r[4], r[5], 0.0f,
+        r[6], r[7], r[8], 0.0f,
+        -(tx * r[0] + ty * r[3] + tz * r[6]), -(tx * r[1] + ty * r[4] + tz * r[7]), -(tx * r[2] + ty * r[5] + tz * r[8]), 1.0f};
+
+    return Mat4(ret);
+  }
+
+  Mat4 Mat4::InverseOrthonormal() const
+  {
+    float tx = this->m[12], ty = this->m[13], tz = this->m[14];
+
+    // The rotation inverse is its transpose
+    float ret[16] = {
+        this->m[0], this->m[4], this->m[8], 0.0f,
+        this->m[1], this->m[5], this->m[9], 0.0f,
+        this->m[2], this->m[6], this->m[10], 0.0f,
+        -(tx * this->m[0] + ty * this->m[1] + tz * this->m[2]),
+        -(tx * this->m[4] + ty * this->m[5] + tz * this->m[6]),
+        -(tx * this->m[8] + ty * this->m[9] + tz * this->m[10]), 1.0f};
+
+    return Mat4(ret);
+  }
+
+  Mat3 Mat4::NormalMatrix(const Mat4 &model)
+  {
+    const float *a = model.m;
+
+    // Cofactor matrix of the 3x3 divided by the determinant is the inverse transpose
+    float c[9] = {
+        a[5] * a[10] - a[6] * a[9],
+        a[6] * a[8] - a[4] * a[10],
+        a[4] * a[9] - a[5] * a[8],
+        a[2] * a[9] - a[1] * a[10],
+        a[0] * a[10] - a[2] * a[8],
+        a[1] * a[8] - a[0] * a[9],
+        a[1] * a[6] - a[2] * a[5],
+        a[2] * a[4] - a[0] * a[6],
+        a[0] * a[5] - a[1] * a[4]};
+
+    float det = a[0] * c[0] + a[1] * c[1] + a[2] * c[2];
+    if (det == 0)
+      return Mat3::zero;
+
+    Mat3 ret(c);
+    ret /= det;
+
+    return ret;
+  }
+
   Mat4 Mat4::Transpose() const
   {
     float f[16] = {
@@ -641,12 +739,38 @@ namespace Math
 
   Mat4 Mat4::Rotate(Vec3 radians)
   {
-    return RotateX(radians.x) * RotateY(radians.y) * RotateZ(radians.z);
+    return Rotate(radians.x, radians.y, radians.z);
   }
 
   Mat4 Mat4::Rotate(float radX, float radY, const float radZ)
   {
-    return RotateX(radX) * RotateY(radY) * RotateZ(radZ);
+    // Expanded RotateX * RotateY * RotateZ
+    float cx = std::cos(radX), sx = std::sin(radX);
+    float cy = std::cos(radY), sy = std::sin(radY);
+    float cz = std::cos(radZ), sz = std::sin(radZ);
+
+    float rot[16] = {
+        cy * cz, cy * sz, -sy, 0,
+        sx * sy * cz - cx * sz, sx * sy * sz + cx * cz, sx * cy, 0,
+        cx * sy * cz + sx * sz, cx * sy * sz - sx * cz, cx * cy, 0,
+        0, 0, 0, 1};
+
+    return Mat4(rot);
+  }
+
+  Mat4 Mat4::TRS(Vec3 translate, Vec3 rotation, Vec3 scale)
+  {
+    float cx = std::cos(rotation.x), sx = std::sin(rotation.x);
+    float cy = std::cos(rotation.y), sy = std::sin(rotation.y);
+    float cz = std::cos(rotation.z), sz = std::sin(rotation.z);
+
+    float trs[16] = {
+        cy * cz * scale.x, cy * sz * scale.y, -sy * scale.z, 0,
+        (sx * sy * cz - cx * sz) * scale.x, (sx * sy * sz + cx * cz) * scale.y, sx * cy * scale.z, 0,
+        (cx * sy * cz + sx * sz) * scale.x, (cx * sy * sz - sx * cz) * scale.y, cx * cy * scale.z, 0,
+        translate.x, translate.y, translate.z, 1};
+
+    return Mat4(trs);
   }
 
   Mat4 Mat4::Transform(Vec3 rotate,
@@ -0,0 +1,252 @@
+/**
+ * @author Javier Guinot Almenar <guinotal@esat-alumni.com>
+ *
+ * @file quaternion.h
+ *
+ * @brief Quaternion Class Definition.
+ * Unit quaternions are used to store rotations. The conversions
+ * follow the same conventions as Mat4::Rotate, so
+ * Quat::FromEuler(r).ToMat4() == Mat4::Rotate(r).
+ *
+ */
+
+#include "mathlib.h"
+
+#ifndef __QUATERNION_H__
+#define __QUATERNION_H__ 1
+
+namespace Math
+{
+  class Quat
+  {
+  public:
+    // Console
+    ///////////////////////////////////////////////////////////////////////////
+    inline void print(unsigned d = 5, const char *name = "Quat") const { fprintf(stdout, "%s: %.*f, %.*f, %.*f, %.*f\n", name, d, this->x, d, this->y, d, this->z, d, this->w); }
+    // This it to use with std strings and the operator <<
+    inline friend std::ostream &operator<<(std::ostream &os, Quat q) { return (os << "(" << q.x << ", " << q.y << ", " << q.z << ", " << q.w << ")"); }
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Constructors
+    ///////////////////////////////////////////////////////////////////////////
+    inline Quat();
+    inline Quat(float x, float y, float z, float w);
+    inline Quat(const Quat &other);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Operators
+    ///////////////////////////////////////////////////////////////////////////
+    inline void operator=(Quat other);
+
+    // a * b rotates by b first and then by a
+    inline Quat operator*(Quat other) const;
+    inline Quat &operator*=(Quat other);
+
+    inline bool operator==(Quat other) const;
+    inline bool operator!=(Quat other) const;
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Static Methods
+    ///////////////////////////////////////////////////////////////////////////
+    inline static Quat Identity();
+
+    // Axis must be normalized
+    inline static Quat FromAxisAngle(Vec3 axis, float radians);
+    // Same rotation as Mat4::Rotate(radians)
+    inline static Quat FromEuler(Vec3 radians);
+
+    inline static float DotProduct(Quat a, Quat b);
+    inline static Quat Slerp(Quat a, Quat b, float t);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Methods
+    ///////////////////////////////////////////////////////////////////////////
+    inline float Magnitude() const;
+    inline Quat Normalized() const;
+    inline Quat Conjugate() const;
+
+    inline Vec3 Rotate(Vec3 v) const;
+
+    inline Mat4 ToMat4() const;
+    // Angles that give the same rotation with Mat4::Rotate
+    inline Vec3 ToEuler() const;
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Attributes
+    ///////////////////////////////////////////////////////////////////////////
+    float x, y, z, w;
+    ///////////////////////////////////////////////////////////////////////////
+  };
+
+  // Implementation
+  ///////////////////////////////////////////////////////////////////////////////
+
+  // Constructors
+  Quat::Quat() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) {}
+  Quat::Quat(float a, float b, float c, float d) : x(a), y(b), z(c), w(d) {}
+  Quat::Quat(const Quat &other) : x(other.x), y(other.y), z(other.z), w(other.w) {}
+
+  // Operators
+  void Quat::operator=(Quat other)
+  {
+    this->x = other.x;
+    this->y = other.y;
+    this->z = other.z;
+    this->w = other.w;
+  }
+
+  Quat Quat::operator*(Quat other) const
+  {
+    return Quat(this->w * other.x + this->x * other.w + this->y * other.z - this->z * other.y,
+                this->w * other.y - this->x * other.z + this->y * other.w + this->z * other.x,
+                this->w * other.z + this->x * other.y - this->y * other.x + this->z * other.w,
+                this->w * other.w - this->x * other.x - this->y * other.y - this->z * other.z);
+  }
+
+  Quat &Quat::operator*=(Quat other)
+  {
+    (*this) = (*this) * other;
+
+    return (*this);
+  }
+
+  bool Quat::operator==(Quat other) const
+  {
+    return (this->x == other.x && this->y == other.y && this->z == other.z && this->w == other.w);
+  }
+
+  bool Quat::operator!=(Quat other) const
+  {
+    return !((*this) == other);
+  }
+
+  // Static Methods
+  Quat Quat::Identity()
+  {
+    return Quat(0.0f, 0.0f, 0.0f, 1.0f);
+  }
+
+  Quat Quat::FromAxisAngle(Vec3 axis, float radians)
+  {
+    float half = radians * 0.5f;
+    float sin_ = std::sin(half);
+
+    return Quat(axis.x * sin_, axis.y * sin_, axis.z * sin_, std::cos(half));
+  }
+
+  Quat Quat::FromEuler(Vec3 radians)
+  {
+    // Mat4::Rotate applies X, then Y, then Z
+    float cx = std::cos(radians.x * 0.5f), sx = std::sin(radians.x * 0.5f);
+    float cy = std::cos(radians.y * 0.5f), sy = std::sin(radians.y * 0.5f);
+    float cz = std::cos(radians.z * 0.5f), sz = std::sin(radians.z * 0.5f);
+
+    return Quat(sx * cy * cz - cx * sy * sz,
+                cx * sy * cz + sx * cy * sz,
+                cx * cy * sz - sx * sy * cz,
+                cx * cy * cz + sx * sy * sz);
+  }
+
+  float Quat::DotProduct(Quat a, Quat b)
+  {
+    return (a.x * b.x) + (a.y * b.y) + (a.z * b.z) + (a.w * b.w);
+  }
+
+  Quat Quat::Slerp(Quat a, Quat b, float t)
+  {
+    float cos_ = DotProduct(a, b);
+
+    // Take the short way
+    if (cos_ < 0.0f)
+    {
+      b = Quat(-b.x, -b.y, -b.z, -b.w);
+      cos_ = -cos_;
+    }
+
+    float wa = 1.0f - t, wb = t;
+    if (cos_ < 0.9995f)
+    {
+      float angle = std::acos(cos_);
+      float rec_sin = 1.0f / std::sin(angle);
+      wa = std::sin(wa * angle) * rec_sin;
+      wb = std::sin(wb * angle) * rec_sin;
+    }
+
+    return Quat(a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb, a.w * wa + b.w * wb).Normalized();
+  }
+
+  // Methods
+  float Quat::Magnitude() const
+  {
+    return sqrtf((this->x * this->x) + (this->y * this->y) + (this->z * this->z) + (this->w * this->w));
+  }
+
+  Quat Quat::Normalized() const
+  {
+    float magn = Magnitude();
+    if (magn == 0.0f)
+      return Identity();
+
+    float rec_magn = 1.0f / magn;
+
+    return Quat(this->x * rec_magn, this->y * rec_magn, this->z * rec_magn, this->w * rec_magn);
+  }
+
+  Quat Quat::Conjugate() const
+  {
+    return Quat(-this->x, -this->y, -this->z, this->w);
+  }
+
+  Vec3 Quat::Rotate(Vec3 v) const
+  {
+    Vec3 u(this->x, this->y, this->z);
+    Vec3 t = Vec3::CrossProduct(u, v) * 2.0f;
+
+    return v + t * this->w + Vec3::CrossProduct(u, t);
+  }
+
+  Mat4 Quat::ToMat4() const
+  {
+    float xx = this->x * this->x, yy = this->y * this->y, zz = this->z * this->z;
+    float xy = this->x * this->y, xz = this->x * this->z, yz = this->y * this->z;
+    float wx = this->w * this->x, wy = this->w * this->y, wz = this->w * this->z;
+
+    float rot[16] = {
+        1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f,
+        2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f,
+        2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f};
+
+    return Mat4(rot);
+  }
+
+  Vec3 Quat::ToEuler() const
+  {
+    float xx = this->x * this->x, yy = this->y * this->y, zz = this->z * this->z;
+    float xy = this->x * this->y, xz = this->x * this->z, yz = this->y * this->z;
+    float wx = this->w * this->x, wy = this->w * this->y, wz = this->w * this->z;
+
+    // m2 = -sin(y)
+    float sin_y = -2.0f * (xz - wy);
+    sin_y = (sin_y > 1.0f) ? 1.0f : ((sin_y < -1.0f) ? -1.0f : sin_y);
+
+    Vec3 ret;
+    ret.y = std::asin(sin_y);
+
+    if (std::abs(sin_y) < 0.9999f)
+    {
+      ret.x = std::atan2(2.0f * (yz + wx), 1.0f - 2.0f * (xx + yy)); // m6, m10
+      ret.z = std::atan2(2.0f * (xy + wz), 1.0f - 2.0f * (yy + zz)); // m1, m0
+    }
+    else
+    {
+      // Gimbal lock, keep z at 0 and put everything in x
+      ret.x = std::atan2(2.0f * (xy - wz) * sin_y, 1.0f - 2.0f * (xx + zz)); // m4, m5
+      ret.z = 0.0f;
+    }
+
+    return ret;
+  }
+}
+
+#endif /* __QUATERNION_H__ */
@@ -0,0 +1,129 @@
+/**
+ * @author Javier Guinot Almenar <guinotal@esat-alumni.com>
+ *
+ * @file sphere.h
+ *
+ * @brief Bounding sphere Class Definition.
+ *
+ */
+
+#include <algorithm>
+
+#include "mathlib.h"
+
+#ifndef __SPHERE_H__
+#define __SPHERE_H__ 1
+
+namespace Math
+{
+  class Sphere
+  {
+  public:
+    // Console
+    ///////////////////////////////////////////////////////////////////////////
+    inline void print(unsigned d = 5, const char *name = "Sphere") const { fprintf(stdout, "%s: (%.*f, %.*f, %.*f) r %.*f\n", name, d, this->center.x, d, this->center.y, d, this->center.z, d, this->radius); }
+    // This it to use with std strings and the operator <<
+    inline friend std::ostream &operator<<(std::ostream &os, Sphere s) { return (os << "[" << s.center << ", " << s.radius << "]"); }
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Constructors
+    ///////////////////////////////////////////////////////////////////////////
+    inline Sphere();
+    inline Sphere(Vec3 center, float radius);
+    inline Sphere(const Sphere &other);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Operators
+    ///////////////////////////////////////////////////////////////////////////
+    inline void operator=(Sphere other);
+
+    inline bool operator==(Sphere other) const;
+    inline bool operator!=(Sphere other) const;
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Static Methods
+    ///////////////////////////////////////////////////////////////////////////
+    // Sphere around the box, not the smallest one for the points inside
+    inline static Sphere FromAABB(AABB box);
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Methods
+    ///////////////////////////////////////////////////////////////////////////
+    inline bool Contains(Vec3 point) const;
+    inline bool Intersects(Sphere other) const;
+    inline bool Intersects(AABB box) const;
+
+    // Sphere that holds this one after being transformed by m (row vector, affine)
+    inline Sphere Transformed(const Mat4 &m) const;
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Attributes
+    ///////////////////////////////////////////////////////////////////////////
+    Vec3 center;
+    float radius;
+    ///////////////////////////////////////////////////////////////////////////
+  };
+
+  // Implementation
+  ///////////////////////////////////////////////////////////////////////////////
+
+  // Constructors
+  Sphere::Sphere() : center(0.0f, 0.0f, 0.0f), radius(0.0f) {}
+  Sphere::Sphere(Vec3 c, float r) : center(c), radius(r) {}
+  Sphere::Sphere(const Sphere &other) : center(other.center), radius(other.radius) {}
+
+  // Operators
+  void Sphere::operator=(Sphere other)
+  {
+    this->center = other.center;
+    this->radius = other.radius;
+  }
+
+  bool Sphere::operator==(Sphere other) const { return (this->center == other.center && this->radius == other.radius); }
+  bool Sphere::operator!=(Sphere other) const { return !((*this) == other); }
+
+  // Static Methods
+  Sphere Sphere::FromAABB(AABB box)
+  {
+    if (box.IsEmpty())
+      return Sphere();
+
+    return Sphere(box.Center(), box.Extents().Magnitude());
+  }
+
+  // Methods
+  bool Sphere::Contains(Vec3 point) const { return (point - this->center).SqrMagnitude() <= (this->radius * this->radius); }
+
+  bool Sphere::Intersects(Sphere other) const
+  {
+    float dist = this->radius + other.radius;
+
+    return (this->center - other.center).SqrMagnitude() <= (dist * dist);
+  }
+
+  bool Sphere::Intersects(AABB box) const
+  {
+    Vec3 closest(std::clamp(this->center.x, box.min.x, box.max.x),
+                 std::clamp(this->center.y, box.min.y, box.max.y),
+                 std::clamp(this->center.z, box.min.z, box.max.z));
+
+    return Contains(closest);
+  }
+
+  Sphere Sphere::Transformed(const Mat4 &m) const
+  {
+    const float *f = m.m;
+    Vec3 c((f[0] * this->center.x) + (f[4] * this->center.y) + (f[8] * this->center.z) + f[12],
+           (f[1] * this->center.x) + (f[5] * this->center.y) + (f[9] * this->center.z) + f[13],
+           (f[2] * this->center.x) + (f[6] * this->center.y) + (f[10] * this->center.z) + f[14]);
+
+    // The biggest axis scale keeps the whole sphere inside
+    float sx = (f[0] * f[0]) + (f[1] * f[1]) + (f[2] * f[2]);
+    float sy = (f[4] * f[4]) + (f[5] * f[5]) + (f[6] * f[6]);
+    float sz = (f[8] * f[8]) + (f[9] * f[9]) + (f[10] * f[10]);
+
+    return Sphere(c, this->radius * sqrtf(std::max(sx, std::max(sy, sz))));
+  }
+}
+
+#endif /* __SPHERE_H__ */
@@ -129,7 +129,13 @@ struct DrawConfig
  */
 class Mesh
 {
-  friend class JAM_Engine; ///< Friend class.
+  friend class JAM_Engine;      ///< Friend class.
+  friend class Renderer;        ///< Friend class.
+  friend class MeshPool;        ///< Friend class.
+  friend class OcclusionBuffer; ///< Friend class.
+  friend class PVS;             ///< Friend class.
+  friend class Meshlets;        ///< Friend class.
+  friend class AssetWatcher;    ///< Friend class.
 
 public:
   /**
@@ -0,0 +1,130 @@
+#include <array>
+#include <map>
+#include <unordered_map>
+
+#include "mesh.h"
+#include "types.h"
+
+#ifndef __MESH_POOL_H__
+#define __MESH_POOL_H__ 1
+
+/**
+ * @class MeshPool
+ *
+ * @brief Shared vertex, index and material buffers for many meshes.
+ *
+ * Every mesh has the same vertex format, so their data can be copied into
+ * the same buffers and drawn with one vertex array. Meshes drawn from the pool
+ * can be merged into a single glMultiDrawElementsIndirect.
+ */
+class MeshPool
+{
+public:
+  /**
+   * @struct Range
+   *
+   * @brief Place of a mesh inside the pool.
+   */
+  struct Range
+  {
+    u32 first_index_ = 0;              ///< First index in the index buffer.
+    u32 index_count_ = 0;              ///< Number of indices.
+    s32 base_vertex_ = 0;              ///< Value added to every index.
+    const Vertex *vertices_ = nullptr; ///< Vertices of the mesh when it was added.
+  };
+
+  /**
+   * @brief Constructor, the buffers are created with the first mesh.
+   */
+  MeshPool();
+
+  /**
+   * @brief Destructor.
+   */
+  ~MeshPool();
+
+  /**
+   * @brief Releases the buffers and forgets every mesh.
+   */
+  void free();
+
+  /**
+   * @brief Copies a mesh into the pool if it's not there yet.
+   *
+   * @param mesh Mesh to add.
+   *
+   * @return Place of the mesh, nullptr if the mesh has not finished loading.
+   */
+  const Range *add(const Mesh *mesh);
+
+  /**
+   * @brief Gets the place of a mesh already in the pool.
+   *
+   * @param mesh Mesh to find.
+   *
+   * @return Place of the mesh, nullptr if it's not in the pool.
+   */
+  const Range *find(const Mesh *mesh) const;
+
+  /**
+   * @brief Gets an index for the material textures of a mesh.
+   * Meshes with the same textures get the same index, so they can be drawn
+   * with the same texture binds.
+   *
+   * @param mesh Mesh to check.
+   *
+   * @return Texture set index, 0 while the mesh textures are not loaded.
+   */
+  u32 textureSet(const Mesh *mesh);
+
+  /**
+   * @brief Binds the vertex array of the pool.
+   */
+  void bind() const;
+
+  /**
+   * @brief Gets the material storage buffer, it goes in VERTEX_MATERIAL_BIND.
+   *
+   * @return Buffer identifier.
+   */
+  u32 materials() const;
+
+  /**
+   * @brief Gets the number of vertices in the pool.
+   *
+   * @return Total vertices.
+   */
+  u32 verticesSize() const;
+
+  /**
+   * @brief Gets the number of indices in the pool.
+   *
+   * @return Total indices.
+   */
+  u32 indicesSize() const;
+
+private:
+  u32 VAO, VBO, EBO, SSBO; ///< Shared vertex array, vertex, index and material buffers.
+
+  u32 vertices_size_, vertices_capacity_; ///< Vertices used and allocated.
+  u32 indices_size_, indices_capacity_;   ///< Indices used and allocated.
+
+  std::unordered_map<const Mesh *, Range> ranges_;     ///< Place of every mesh.
+  std::unordered_map<const Mesh *, u32> texture_sets_; ///< Texture set of every loaded mesh.
+  std::map<std::array<u32, 13>, u32> texture_set_ids_; ///< Index of every different texture set.
+
+  /**
+   * @brief Grows the buffers keeping their content.
+   *
+   * @param vertices Vertices needed.
+   * @param indices Indices needed.
+   */
+  void reserve(u32 vertices, u32 indices);
+
+  /**
+   * @brief Sets the vertex format in the vertex array, same as Mesh, and attaches the current buffers.
+   */
+  void setupVertexArray();
+};
+
+#endif /* __MESH_POOL_H__ */
@@ -0,0 +1,163 @@
+#include <vector>
+
+#include "math/mathlib.h"
+#include "mesh.h"
+#include "types.h"
+
+#ifndef __MESHLETS_H__
+#define __MESHLETS_H__ 1
+
+/**
+ * @class Meshlets
+ *
+ * @brief Splits a mesh in small clusters of triangles that are culled on their own.
+ *
+ * The triangles are grouped in clusters of up to a hundred or so neighbour
+ * triangles, and the index array of the mesh is reordered so every cluster is
+ * a contiguous range. The mesh still draws the same with one call, and the
+ * visible clusters can be drawn with one glMultiDrawElements over the same
+ * index buffer.
+ *
+ * Every cluster keeps a bounding sphere for the frustum test and a cone with
+ * the normals of its triangles, so clusters that only have back faces from
+ * the camera are skipped too.
+ *
+ * Building is slow for big meshes, the clusters and the new index order are
+ * cached in a file next to the mesh and reused while the mesh does not change.
+ */
+class Meshlets
+{
+public:
+  /**
+   * @struct Meshlet
+   *
+   * @brief Cluster of triangles in local space.
+   */
+  struct Meshlet
+  {
+    Math::Vec3 center_;    ///< Center of the bounding sphere.
+    f32 radius_;           ///< Radius of the bounding sphere.
+    Math::Vec3 cone_axis_; ///< Average normal of the triangles.
+    f32 cone_cutoff_;      ///< Sine of the cone angle, 1 if the normals are too spread to cull.
+    u32 first_index_;      ///< First index in the mesh indices.
+    u32 index_count_;      ///< Indices of the cluster.
+  };
+
+  /**
+   * @struct Range
+   *
+   * @brief Consecutive visible clusters, drawn as one range of indices.
+   */
+  struct Range
+  {
+    u32 first_index_; ///< First index in the mesh indices.
+    u32 index_count_; ///< Indices of the range.
+  };
+
+  static const u32 k_max_triangles = 128; ///< Default triangles of a full cluster.
+
+  /**
+   * @brief Constructor.
+   */
+  Meshlets();
+
+  /**
+   * @brief Destructor.
+   */
+  ~Meshlets();
+
+  /**
+   * @brief Forgets the clusters, the mesh keeps its index order.
+   */
+  void free();
+
+  /**
+   * @brief Builds the clusters and reorders the mesh indices.
+   * Call it before the mesh is drawn or added to a pool, or tell the renderer with Renderer::SetMeshlets.
+   *
+   * @param mesh Mesh to split.
+   * @param max_triangles Triangles of a full cluster.
+   *
+   * @return False if the mesh has not finished loading.
+   */
+  boolean build(Mesh *mesh, u32 max_triangles = k_max_triangles);
+
+  /**
+   * @brief Saves the clusters and the index order of the mesh in a binary file.
+   *
+   * @param file Path of the file.
+   */
+  void save(const char *file) const;
+
+  /**
+   * @brief Loads clusters saved for a mesh and applies their index order.
+   *
+   * @param mesh Mesh the file was saved from.
+   * @param file Path of the file.
+   *
+   * @return False if the file is not a meshlet file or the mesh is not the same.
+   */
+  boolean load(Mesh *mesh, const char *file);
+
+  /**
+   * @brief Loads the cache next to the mesh file, or builds and saves it.
+   *
+   * @param mesh Mesh to split.
+   * @param mesh_file Path the mesh was loaded from, the cache is that path plus ".meshlets".
+   * @param max_triangles Triangles of a full cluster if it has to build them.
+   *
+   * @return False if the mesh has not finished loading.
+   */
+  boolean loadOrBuild(Mesh *mesh, const char *mesh_file, u32 max_triangles = k_max_triangles);
+
+  /**
+   * @brief Gets the clusters that can be seen, consecutive ones merged in the same range.
+   * The cone test is only right with back face culling and a model matrix without shear.
+   *
+   * @param frustum World frustum.
+   * @param view_pos Camera position.
+   * @param model_mat Model matrix of the mesh.
+   * @param cone_test True to also skip the clusters facing away from the camera.
+   * @param ranges Output with the index ranges to draw, cleared first.
+   *
+   * @return Clusters that can be seen.
+   */
+  u32 cull(const Math::Frustum &frustum, Math::Vec3 view_pos, const Math::Mat4 &model_mat, boolean cone_test, std::vector<Range> &ranges) const;
+
+  /**
+   * @brief Gets the mesh the clusters were built for.
+   *
+   * @return Mesh, nullptr before build or load.
+   */
+  const Mesh *mesh() const;
+
+  /**
+   * @brief Gets the number of clusters.
+   *
+   * @return Clusters.
+   */
+  u32 size() const;
+
+  /**
+   * @brief Gets a cluster.
+   *
+   * @param index Cluster index.
+   *
+   * @return Cluster.
+   */
+  const Meshlet &get(u32 index) const;
+
+private:
+  const Mesh *mesh_;              ///< Mesh the clusters belong to.
+  std::vector<Meshlet> meshlets_; ///< Clusters in index order.
+
+  /**
+   * @brief Computes the sphere and the normal cone of a cluster.
+   *
+   * @param mesh Mesh of the cluster.
+   * @param meshlet Cluster with its index range set.
+   */
+  static void computeBounds(const Mesh *mesh, Meshlet &meshlet);
+};
+
+#endif /* __MESHLETS_H__ */
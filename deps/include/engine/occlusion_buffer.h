@@ -0,0 +1,179 @@
+#include <vector>
+
+#include "math/mathlib.h"
+#include "math/aabb.h"
+#include "mesh.h"
+#include "types.h"
+
+#ifndef __OCCLUSION_BUFFER_H__
+#define __OCCLUSION_BUFFER_H__ 1
+
+/**
+ * @class OcclusionBuffer
+ *
+ * @brief Small CPU depth buffer to skip the objects hidden behind others.
+ *
+ * A few low poly occluders are rasterized into it every frame, then the
+ * bounds of the objects are tested against it before they are queued.
+ * Everything happens in the CPU, so it works without a window.
+ *
+ * Depths are 1/w, which interpolates linearly in screen space, so a bigger
+ * value is closer and the cleared buffer (0) is infinitely far. There is no
+ * depth per pixel: every tile of 8x4 pixels keeps a reference depth for the
+ * whole tile, and a coverage mask with a working depth for the pixels the
+ * last triangles covered. A full mask turns the working depth into the
+ * reference. Tiles are grouped in blocks of 4x4 that keep the farthest
+ * reference below them, so big boxes are rejected in a few steps.
+ *
+ * Coverage is computed 8 pixels at a time with AVX, and the screen is split
+ * in bands of tile rows that the task manager rasterizes in parallel.
+ */
+class OcclusionBuffer
+{
+public:
+  static const u32 k_tile_width = 8;  ///< Pixels in a tile row, one AVX register.
+  static const u32 k_tile_height = 4; ///< Rows in a tile.
+  static const u32 k_block_tiles = 4; ///< Tiles in each side of a block.
+
+  /**
+   * @brief Constructor, the buffer is empty until resize.
+   */
+  OcclusionBuffer();
+
+  /**
+   * @brief Destructor.
+   */
+  ~OcclusionBuffer();
+
+  /**
+   * @brief Sets the resolution, rounded up to whole blocks.
+   *
+   * @param width Width in pixels.
+   * @param height Height in pixels.
+   */
+  void resize(u32 width, u32 height);
+
+  /**
+   * @brief Clears the buffer and the occluders of the last frame.
+   *
+   * @param view_projection View and projection matrix of the camera.
+   */
+  void begin(const Math::Mat4 &view_projection);
+
+  /**
+   * @brief Adds a triangle list occluder.
+   * Triangles that cross the near plane are clipped against it.
+   *
+   * @param positions First position, three floats.
+   * @param stride Bytes from one position to the next one.
+   * @param vertex_count Number of positions.
+   * @param indices Triangle indices.
+   * @param index_count Number of indices.
+   * @param model_mat Model matrix of the occluder.
+   */
+  void addOccluder(const void *positions, size_t stride, u32 vertex_count, const u32 *indices, u32 index_count, const Math::Mat4 &model_mat);
+
+  /**
+   * @brief Adds every triangle of a mesh as an occluder, use it with low poly meshes.
+   *
+   * @param mesh Mesh to add, skipped until it has finished loading.
+   * @param model_mat Model matrix of the occluder.
+   */
+  void addOccluder(const Mesh *mesh, const Math::Mat4 &model_mat);
+
+  /**
+   * @brief Rasterizes the occluders and builds the depth hierarchy.
+   *
+   * @param threaded True to split the bands between the task manager threads.
+   */
+  void rasterize(boolean threaded = true);
+
+  /**
+   * @brief Tests some bounds against the rasterized occluders.
+   *
+   * @param bounds World bounds.
+   *
+   * @return False only if every pixel the bounds cover is closer than them.
+   */
+  boolean isVisible(const Math::AABB &bounds) const;
+
+  /**
+   * @brief Gets the width in pixels.
+   *
+   * @return Width.
+   */
+  u32 width() const;
+
+  /**
+   * @brief Gets the height in pixels.
+   *
+   * @return Height.
+   */
+  u32 height() const;
+
+  /**
+   * @brief Gets the depth of a pixel, the row 0 is the bottom one.
+   *
+   * @param x Column.
+   * @param y Row.
+   *
+   * @return 1/w that every occluder of the pixel is closer than, 0 if nothing covers it.
+   */
+  f32 depth(u32 x, u32 y) const;
+
+  /**
+   * @brief Gets the triangles added this frame.
+   *
+   * @return Triangles that reached the screen.
+   */
+  u32 triangles() const;
+
+private:
+  /**
+   * @struct Triangle
+   *
+   * @brief Triangle in screen space.
+   */
+  struct Triangle
+  {
+    f32 a_[3], b_[3], c_[3]; ///< Edge functions, a * x + b * y + c >= 0 inside.
+    f32 z_a_, z_b_, z_c_;    ///< Plane of 1/w, a * x + b * y + c.
+    f32 z_min_, z_max_;      ///< Farthest and closest vertex.
+    s32 min_x_, max_x_;      ///< Columns it can cover.
+    s32 min_y_, max_y_;      ///< Rows it can cover.
+  };
+
+  u32 width_, height_;              ///< Pixels.
+  u32 tiles_x_, tiles_y_;           ///< Tiles.
+  u32 blocks_x_, blocks_y_;         ///< Blocks.
+  std::vector<f32> tile_depth_;     ///< Reference 1/w of every tile, no pixel is farther.
+  std::vector<f32> tile_working_;   ///< Farthest 1/w of the masked pixels of every tile.
+  std::vector<u32> tile_mask_;      ///< Pixels of every tile in the working layer, bit y * 8 + x.
+  std::vector<f32> block_depth_;    ///< Farthest 1/w of every block.
+  std::vector<Triangle> triangles_; ///< Triangles of the frame.
+  Math::Mat4 view_projection_;      ///< Camera of the frame.
+
+  /**
+   * @brief Sets up a triangle in screen space and keeps it for rasterize.
+   *
+   * @param v0 First vertex, x and y in pixels and 1/w.
+   * @param v1 Second vertex.
+   * @param v2 Third vertex.
+   */
+  void addTriangle(const f32 *v0, const f32 *v1, const f32 *v2);
+
+  /**
+   * @brief Rasterizes the triangles in some rows and updates their tiles.
+   *
+   * @param first_row First row, multiple of the tile height.
+   * @param end_row One past the last row, multiple of the tile height.
+   */
+  void rasterizeBand(u32 first_row, u32 end_row);
+
+  /**
+   * @brief Builds the farthest depth of every block.
+   */
+  void buildBlocks();
+};
+
+#endif /* __OCCLUSION_BUFFER_H__ */
@@ -0,0 +1,132 @@
+#include <string>
+
+#include "types.h"
+
+#ifndef __PROGRAM_CACHE_H__
+#define __PROGRAM_CACHE_H__ 1
+
+/**
+ * @class ProgramCache
+ *
+ * @brief Keeps the linked shader programs on disk and loads them on the next start.
+ *
+ * Every program is saved with glGetProgramBinary in a file named after a hash
+ * of its full sources, preludes included, and of the vendor, renderer and
+ * version strings of the driver. The next start creates the program with
+ * glProgramBinary and skips the compile and link.
+ *
+ * A new driver or an edited shader gives another name, so the old file is
+ * not used. A file the driver rejects is compiled again and overwritten.
+ *
+ * Programs can also be built without waiting. With
+ * GL_KHR_parallel_shader_compile the driver compiles them on its own threads,
+ * without it a hidden context shared with the window compiles them on a
+ * worker thread, and PollProgram tells when they can be used.
+ *
+ * Shader calls it for every program it builds. The shadow program of the
+ * engine archive is still built by the engine, without the cache.
+ */
+class ProgramCache
+{
+public:
+  /**
+   * @enum Status
+   *
+   * @brief State of a program built with CreateProgramAsync.
+   */
+  enum class Status
+  {
+    Compiling, ///< Still compiling or linking, using it would wait.
+    Ready,     ///< Linked and ready to use.
+    Failed,    ///< Compile or link errors, they were sent to the error log.
+  };
+
+  /**
+   * @struct Stats
+   *
+   * @brief Programs created since the start.
+   */
+  struct Stats
+  {
+    u32 loaded_ = 0;   ///< Programs created from a cached binary.
+    u32 compiled_ = 0; ///< Programs compiled from source.
+    u32 rejected_ = 0; ///< Cached binaries the driver did not accept.
+    u32 pending_ = 0;  ///< Programs still compiling.
+  };
+
+  /**
+   * @brief Creates a program from the cache, or compiles and links it and saves it.
+   *
+   * @param fragment_source Fragment shader source code, may be null.
+   * @param vertex_source Vertex shader source code, may be null.
+   *
+   * @return Shader program identifier.
+   */
+  static u32 CreateProgram(const byte *fragment_source, const byte *vertex_source);
+
+  /**
+   * @brief Creates a program from the cache, or starts compiling it without waiting.
+   * Nothing asks the driver for the program until PollProgram says it is ready.
+   *
+   * @param fragment_source Fragment shader source code, may be null.
+   * @param vertex_source Vertex shader source code, may be null.
+   *
+   * @return Shader program identifier.
+   */
+  static u32 CreateProgramAsync(const byte *fragment_source, const byte *vertex_source);
+
+  /**
+   * @brief Checks a program of CreateProgramAsync without waiting for it.
+   * The first call that finds it done checks the errors and saves it in the cache.
+   *
+   * @param program Shader program identifier.
+   *
+   * @return State of the program, Ready for programs not built here.
+   */
+  static Status PollProgram(u32 program);
+
+  /**
+   * @brief Deletes a program, one still compiling on the worker is deleted when it ends.
+   *
+   * @param program Shader program identifier.
+   */
+  static void DeleteProgram(u32 program);
+
+  /**
+   * @brief Sets the folder of the cached programs, "shader_cache" next to the executable by default.
+   *
+   * @param directory Folder path, created when the first program is saved.
+   */
+  static void SetDirectory(const byte *directory);
+
+  /**
+   * @brief Turns the cache on or off, off always compiles and saves nothing.
+   *
+   * @param active True to use the cache.
+   */
+  static void SetActive(boolean active);
+
+  /**
+   * @brief Gets the programs created since the start.
+   *
+   * @return Stats.
+   */
+  static Stats GetStats();
+
+private:
+  /**
+   * @brief Private constructor.
+   *
+   * Not intended to be instantiated.
+   */
+  ProgramCache();
+
+  /**
+   * @brief Private destructor.
+   *
+   * Not intended to be instantiated.
+   */
+  ~ProgramCache();
+};
+
+#endif /* __PROGRAM_CACHE_H__ */
@@ -0,0 +1,227 @@
+#include <unordered_map>
+#include <vector>
+
+#include "math/mathlib.h"
+#include "math/aabb.h"
+#include "entity.h"
+#include "mesh.h"
+#include "types.h"
+
+#ifndef __PVS_H__
+#define __PVS_H__ 1
+
+/**
+ * @class PVS
+ *
+ * @brief Potentially visible set of a static scene.
+ *
+ * The world is split in a grid of cells. The baker casts rays from random
+ * points of every cell to random points of every object bounds, against the
+ * triangles of the occluders, and marks the object visible from the cell if
+ * any ray gets there. Objects whose bounds touch the cell are always visible.
+ *
+ * The result is one row of bits per cell, so the visible set of the camera
+ * cell is found with one division and read with one bit test per object.
+ * Positions outside the grid see everything.
+ */
+class PVS
+{
+public:
+  /**
+   * @struct BakeSettings
+   *
+   * @brief Grid and quality of the bake.
+   */
+  struct BakeSettings
+  {
+    Math::AABB world_;                        ///< Space split in cells, the bounds of the objects if it's empty.
+    Math::Vec3 cell_size_ = Math::Vec3(8.0f); ///< Size of a cell.
+    u32 rays_ = 64;                           ///< Rays from a cell to an object before it's hidden.
+    boolean threaded_ = true;                 ///< Split the cells between the task manager threads.
+  };
+
+  /**
+   * @brief Constructor.
+   */
+  PVS();
+
+  /**
+   * @brief Destructor.
+   */
+  ~PVS();
+
+  /**
+   * @brief Forgets the objects, the occluders and the baked cells.
+   */
+  void free();
+
+  /**
+   * @brief Adds an entity tree with its world bounds.
+   *
+   * @param root_node Root node identifier.
+   * @param occluder True to add the triangles of its meshes as occluders.
+   *
+   * @return False if the meshes of the tree have not finished loading.
+   */
+  boolean addEntity(Entity::Id root_node, boolean occluder);
+
+  /**
+   * @brief Adds a triangle list that blocks the rays of the bake.
+   *
+   * @param positions First position, three floats.
+   * @param stride Bytes from one position to the next one.
+   * @param vertex_count Number of positions.
+   * @param indices Triangle indices.
+   * @param index_count Number of indices.
+   * @param model_mat Model matrix of the occluder.
+   */
+  void addOccluder(const void *positions, size_t stride, u32 vertex_count, const u32 *indices, u32 index_count, const Math::Mat4 &model_mat);
+
+  /**
+   * @brief Computes the visibility of every object from every cell.
+   *
+   * @param settings Grid and quality of the bake.
+   */
+  void bake(const BakeSettings &settings);
+
+  /**
+   * @brief Saves the cells and the visibility bits in a binary file.
+   *
+   * @param file Path of the file.
+   */
+  void save(const char *file) const;
+
+  /**
+   * @brief Loads a baked file, the objects and occluders are not needed after it.
+   *
+   * @param file Path of the file.
+   *
+   * @return False if the file is not a PVS file.
+   */
+  boolean load(const char *file);
+
+  /**
+   * @brief Gets the cell of a position.
+   *
+   * @param position World position.
+   *
+   * @return Cell index, -1 outside the grid.
+   */
+  s32 cellIndex(Math::Vec3 position) const;
+
+  /**
+   * @brief Gets the visibility row of a position.
+   *
+   * @param position World position.
+   *
+   * @return One bit per object, nullptr outside the grid.
+   */
+  const u64 *cellBits(Math::Vec3 position) const;
+
+  /**
+   * @brief Gets the bit of an entity in the rows.
+   *
+   * @param entity_id Entity identifier.
+   *
+   * @return Object index, -1 if it was not baked.
+   */
+  s32 objectIndex(Entity::Id entity_id) const;
+
+  /**
+   * @brief Checks if an entity can be seen from a position.
+   *
+   * @param position World position.
+   * @param entity_id Entity identifier.
+   *
+   * @return False only if the bake found it hidden from that cell.
+   */
+  boolean isVisible(Math::Vec3 position, Entity::Id entity_id) const;
+
+  /**
+   * @brief Gets the number of cells.
+   *
+   * @return Cells of the grid.
+   */
+  u32 cells() const;
+
+  /**
+   * @brief Gets the number of objects.
+   *
+   * @return Baked objects.
+   */
+  u32 objects() const;
+
+private:
+  /**
+   * @struct Triangle
+   *
+   * @brief Occluder triangle in world space.
+   */
+  struct Triangle
+  {
+    Math::Vec3 a_, b_, c_; ///< Vertices.
+    s32 owner_;            ///< Object it belongs to, -1 for plain occluders.
+  };
+
+  /**
+   * @struct Node
+   *
+   * @brief Node of the triangle hierarchy, leaves have count_ > 0.
+   */
+  struct Node
+  {
+    Math::AABB bounds_; ///< Bounds of every triangle below.
+    u32 first_;         ///< First child node, or first triangle in a leaf.
+    u32 count_;         ///< Triangles of a leaf, 0 in the inner nodes.
+  };
+
+  Math::Vec3 origin_;                           ///< Minimum corner of the grid.
+  Math::Vec3 cell_size_;                        ///< Size of a cell.
+  u32 cells_x_, cells_y_, cells_z_;             ///< Cells in every axis.
+  u32 row_words_;                               ///< 64 bit words of a cell row.
+  std::vector<u64> bits_;                       ///< Visibility rows, one per cell.
+  std::vector<Entity::Id> object_ids_;          ///< Entity of every object bit.
+  std::vector<Math::AABB> object_bounds_;       ///< World bounds of every object, only to bake.
+  std::unordered_map<Entity::Id, s32> indices_; ///< Object index of every entity.
+  std::vector<Triangle> triangles_;             ///< Occluder triangles, only to bake.
+  std::vector<Node> nodes_;                     ///< Triangle hierarchy, only to bake.
+
+  /**
+   * @brief Adds the meshes of an entity tree as occluders.
+   *
+   * @param node_id Node identifier.
+   * @param father_mat Transformation matrix.
+   * @param owner Object index of the tree.
+   */
+  void addTreeMeshes(Entity::Id node_id, Math::Mat4 father_mat, s32 owner);
+
+  /**
+   * @brief Builds the triangle hierarchy splitting by the middle of the longest axis.
+   *
+   * @param node_index Node to split.
+   * @param first First triangle of the node.
+   * @param count Triangles of the node.
+   */
+  void buildNode(u32 node_index, u32 first, u32 count);
+
+  /**
+   * @brief Finds the closest triangle between two points.
+   *
+   * @param from Start point.
+   * @param to End point.
+   *
+   * @return Owner of the closest triangle, -2 if nothing is in the way.
+   */
+  s32 closestHit(Math::Vec3 from, Math::Vec3 to) const;
+
+  /**
+   * @brief Bakes the rows of some cells.
+   *
+   * @param first First cell.
+   * @param end One past the last cell.
+   * @param rays Rays from a cell to an object.
+   */
+  void bakeCells(u32 first, u32 end, u32 rays);
+};
+
+#endif /* __PVS_H__ */
@@ -0,0 +1,329 @@
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+#ifndef __RENDER_GRAPH_H__
+#define __RENDER_GRAPH_H__ 1
+
+/**
+ * @class RenderGraph
+ *
+ * @brief Frame described as passes that declare the resources they read and write.
+ *
+ * The graph is declared again every frame: clear, the resources, the passes
+ * with their reads and writes, and the outputs. Passes run in the order they
+ * were added. Compile walks them backwards from the outputs and drops every
+ * pass whose writes nobody reads, unless it is kept.
+ *
+ * Transient textures are only described, the graph gives them a GL texture
+ * from its pool for the passes between their first and last use. Transients
+ * whose uses do not overlap share a texture when they have the same size and
+ * format, OpenGL has no way to place textures of other formats in the same
+ * memory. The pool keeps its textures between frames.
+ *
+ * Writes from image stores and storage buffers are not seen by the next
+ * reads until a barrier, compile finds the barrier bits every pass needs from
+ * the accesses it declared and execute issues them. A pass that renders to
+ * textures gets a framebuffer with them attached, bound with the viewport of
+ * the first one while it runs.
+ *
+ * Imported resources are owned outside, like the targets of a Camera or the
+ * maps of the ShadowsManager. They can also be imported without a texture,
+ * just to order the passes that use them.
+ */
+class RenderGraph
+{
+public:
+  typedef u32 Resource;
+
+  /**
+   * @brief How a pass uses a resource.
+   */
+  enum class Access : u32
+  {
+    Sampled = 0, ///< Read through a sampler.
+    Attachment,  ///< Attached to the framebuffer of the pass.
+    Image,       ///< Image load and store.
+    Storage,     ///< Shader storage buffer.
+    Indirect,    ///< Indirect draw or dispatch arguments.
+  };
+
+  /**
+   * @struct TextureDesc
+   *
+   * @brief Size and format of a texture.
+   */
+  struct TextureDesc
+  {
+    u32 width_ = 0;  ///< Width in pixels.
+    u32 height_ = 0; ///< Height in pixels.
+    u32 format_ = 0; ///< Internal format, like GL_RGBA8 or GL_DEPTH_COMPONENT32F.
+    u32 levels_ = 1; ///< Mip levels.
+  };
+
+  /**
+   * @typedef ExecuteFunction
+   *
+   * @brief Records the commands of a pass, the textures of its resources are given by texture.
+   */
+  typedef void (*ExecuteFunction)(const RenderGraph &graph, void *data);
+
+  /**
+   * @struct Stats
+   *
+   * @brief Last compiled frame.
+   */
+  struct Stats
+  {
+    u32 passes_ = 0;     ///< Passes run.
+    u32 culled_ = 0;     ///< Passes dropped because nothing read their writes.
+    u32 barriers_ = 0;   ///< glMemoryBarrier calls.
+    u32 transients_ = 0; ///< Transient textures used by the passes run.
+    u32 textures_ = 0;   ///< Pool textures they were placed in.
+    u64 bytes_ = 0;      ///< Memory of those pool textures.
+    u64 saved_ = 0;      ///< Memory the shared textures saved.
+  };
+
+  /**
+   * @brief Constructor.
+   */
+  RenderGraph();
+
+  /**
+   * @brief Destructor.
+   */
+  ~RenderGraph();
+
+  /**
+   * @brief Deletes the pool textures and the framebuffers.
+   */
+  void free();
+
+  /**
+   * @brief Forgets the passes and resources of the frame, the pool textures stay.
+   */
+  void clear();
+
+  /**
+   * @brief Describes a texture that only lives in this frame.
+   *
+   * @param name Name for the errors.
+   * @param desc Size and format.
+   *
+   * @return Resource handle.
+   */
+  Resource create(const std::string &name, const TextureDesc &desc);
+
+  /**
+   * @brief Adds a resource owned outside the graph.
+   *
+   * @param name Name for the errors.
+   * @param texture Texture identifier, 0 if it is not a texture.
+   * @param desc Size and format of the texture, needed to attach it, empty if it is not a texture.
+   *
+   * @return Resource handle.
+   */
+  Resource import(const std::string &name, u32 texture, const TextureDesc &desc);
+
+  /**
+   * @brief Adds a pass, it runs after the passes added before it.
+   *
+   * @param name Name for the errors.
+   * @param execute Function that records the pass.
+   * @param data Pointer given to the function.
+   *
+   * @return Pass index.
+   */
+  u32 addPass(const std::string &name, ExecuteFunction execute, void *data = nullptr);
+
+  /**
+   * @brief Declares that a pass reads a resource written by an earlier pass, or imported.
+   *
+   * @param pass Pass index.
+   * @param resource Resource handle.
+   * @param access How it is read.
+   */
+  void read(u32 pass, Resource resource, Access access);
+
+  /**
+   * @brief Declares that a pass writes a resource.
+   * A write that keeps the old content, like blending, is also a read.
+   *
+   * @param pass Pass index.
+   * @param resource Resource handle.
+   * @param access How it is written.
+   */
+  void write(u32 pass, Resource resource, Access access);
+
+  /**
+   * @brief Keeps a pass even if nothing reads its writes, e.g. a read back to the CPU.
+   *
+   * @param pass Pass index.
+   */
+  void keep(u32 pass);
+
+  /**
+   * @brief Marks a resource as a result of the frame, its last writer is never culled.
+   *
+   * @param resource Resource handle.
+   */
+  void output(Resource resource);
+
+  /**
+   * @brief Culls the passes, places the transient textures and finds the barriers.
+   * Execute compiles on its own if the graph changed.
+   */
+  void compile();
+
+  /**
+   * @brief Runs the passes that were not culled.
+   */
+  void execute();
+
+  /**
+   * @brief Gets the GL texture of a resource, valid in the execute functions.
+   *
+   * @param resource Resource handle.
+   *
+   * @return Texture identifier, 0 if it has none.
+   */
+  u32 texture(Resource resource) const;
+
+  /**
+   * @brief Gets the size and format of a resource.
+   *
+   * @param resource Resource handle.
+   *
+   * @return Texture description.
+   */
+  TextureDesc desc(Resource resource) const;
+
+  /**
+   * @brief Gets the last compiled frame.
+   *
+   * @return Stats.
+   */
+  Stats getStats() const;
+
+private:
+  /**
+   * @struct Use
+   *
+   * @brief Resource declared by a pass.
+   */
+  struct Use
+  {
+    Resource resource_; ///< Resource handle.
+    Access access_;     ///< How it is used.
+  };
+
+  /**
+   * @struct PassData
+   *
+   * @brief Pass of the frame.
+   */
+  struct PassData
+  {
+    std::string name_;         ///< Name for the errors.
+    ExecuteFunction execute_;  ///< Records the pass.
+    void *data_;               ///< Pointer given to execute_.
+    std::vector<Use> reads_;   ///< Resources read.
+    std::vector<Use> writes_;  ///< Resources written.
+    boolean keep_;             ///< Never culled.
+    boolean alive_;            ///< Not culled in the last compile.
+    u32 barriers_;             ///< glMemoryBarrier bits before it runs.
+    u32 framebuffer_;          ///< Framebuffer with its attachments, 0 for none.
+  };
+
+  /**
+   * @struct ResourceData
+   *
+   * @brief Resource of the frame.
+   */
+  struct ResourceData
+  {
+    std::string name_;   ///< Name for the errors.
+    TextureDesc desc_;   ///< Size and format.
+    u32 texture_;        ///< Imported texture, or the pool one while the frame runs.
+    boolean imported_;   ///< Owned outside the graph.
+    boolean output_;     ///< Result of the frame.
+    u32 first_;          ///< First pass run that uses it.
+    u32 last_;           ///< Last pass run that uses it.
+    u32 slot_;           ///< Pool texture, or UINT32_MAX.
+  };
+
+  /**
+   * @struct PoolTexture
+   *
+   * @brief Texture kept between frames for the transients.
+   */
+  struct PoolTexture
+  {
+    u32 texture_;      ///< Texture identifier.
+    TextureDesc desc_; ///< Size and format.
+    u32 busy_until_;   ///< Last pass of the transient placed in it, UINT32_MAX if free.
+    u32 unused_;       ///< Compiles since a transient was placed in it.
+  };
+
+  /**
+   * @struct CachedFramebuffer
+   *
+   * @brief Framebuffer for a set of attachments.
+   */
+  struct CachedFramebuffer
+  {
+    u32 framebuffer_;              ///< Framebuffer identifier.
+    std::vector<u32> attachments_; ///< Attached textures, colours first in declared order and the depth last.
+    u32 unused_;                   ///< Compiles since a pass used it.
+  };
+
+  std::vector<PassData> passes_;
+  std::vector<ResourceData> resources_;
+  std::vector<PoolTexture> pool_;
+  std::vector<CachedFramebuffer> framebuffers_;
+  boolean compiled_; ///< Nothing changed since the last compile.
+  Stats stats_;
+
+  /**
+   * @brief Checks a pass index and a resource handle, UINT32_MAX skips the check.
+   *
+   * @param pass Pass index.
+   * @param resource Resource handle.
+   * @param function Caller, for the error.
+   *
+   * @return True if both exist.
+   */
+  boolean valid(u32 pass, Resource resource, const byte *function) const;
+
+  /**
+   * @brief Marks the passes needed by the outputs and the kept passes.
+   */
+  void cull();
+
+  /**
+   * @brief Places every transient used by the passes run in a pool texture.
+   */
+  void placeTransients();
+
+  /**
+   * @brief Finds the barrier bits of every pass run.
+   */
+  void findBarriers();
+
+  /**
+   * @brief Gets the framebuffer for the attachments written by a pass, created the first time.
+   *
+   * @param pass Pass to attach.
+   *
+   * @return Framebuffer identifier, 0 if it writes no attached texture.
+   */
+  u32 findFramebuffer(const PassData &pass);
+
+  /**
+   * @brief Deletes the pool textures and framebuffers not used for a while.
+   */
+  void trim();
+};
+
+#endif /* __RENDER_GRAPH_H__ */
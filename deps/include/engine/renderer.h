@@ -0,0 +1,309 @@
+#include "math/mathlib.h"
+#include "camera.h"
+#include "entity.h"
+#include "gpu_culling.h"
+#include "light.h"
+#include "mesh.h"
+#include "meshlets.h"
+#include "occlusion_buffer.h"
+#include "pvs.h"
+#include "scene_bvh.h"
+#include "types.h"
+
+#include <span>
+
+#ifndef __RENDERER_H__
+#define __RENDERER_H__ 1
+
+/**
+ * @struct RenderQuery
+ *
+ * @brief Entities taken by Renderer::RenderAll and Renderer::RenderShadowAll.
+ */
+struct RenderQuery
+{
+  boolean roots_only_ = true;               ///< Skip the entities that are children of another one.
+  boolean (*filter_)(Entity::Id) = nullptr; ///< Skip the entities it returns false for, null takes all.
+};
+
+/**
+ * @class Renderer
+ *
+ * @brief Visibility layer on top of the JAM_Engine render passes.
+ * Culls, sorts and batches the entity trees, the notes are in docs/rendering.md.
+ */
+class Renderer
+{
+public:
+  /**
+   * @struct Stats
+   *
+   * @brief Counters of one frame, a frame ends with EndRender.
+   */
+  struct Stats
+  {
+    u32 draws_ = 0;               ///< Entity trees sent to the main pass.
+    u32 culled_ = 0;              ///< Entity trees skipped in the main pass.
+    u32 shadow_draws_ = 0;        ///< Entity trees sent to the shadow passes.
+    u32 shadow_culled_ = 0;       ///< Entity trees skipped in the shadow passes.
+    u32 shader_binds_ = 0;        ///< Programs set up in the main pass.
+    u32 texture_binds_ = 0;       ///< Material textures bound in the main pass.
+    u32 instanced_draws_ = 0;     ///< Instanced draw calls in the main pass.
+    u32 instances_ = 0;           ///< Entity trees drawn by the instanced calls.
+    u32 multi_draws_ = 0;         ///< Multi draw indirect calls in the main pass.
+    u32 multi_draw_commands_ = 0; ///< Commands sent by the multi draw calls.
+    u32 occluded_ = 0;            ///< Entity trees hidden by the occluders.
+    u32 pvs_culled_ = 0;          ///< Entity trees hidden by the potentially visible set.
+    u32 gpu_cull_instances_ = 0;  ///< Entity trees sent to the GPU culling.
+    u32 meshlets_drawn_ = 0;      ///< Mesh clusters drawn in the main pass.
+    u32 meshlets_culled_ = 0;     ///< Mesh clusters skipped in the main pass.
+    u32 gl_calls_ = 0;            ///< Tracked GL state calls that reached the driver.
+    u32 gl_calls_skipped_ = 0;    ///< Tracked GL state calls dropped because they changed nothing.
+    u32 programs_compiling_ = 0;  ///< Shader programs still compiling at the end of the frame.
+  };
+
+  /**
+   * @brief Gets the local bounds of a mesh.
+   * They are computed once from the vertices when the mesh has finished loading.
+   *
+   * @param mesh Mesh to check.
+   *
+   * @return Mesh bounds, empty if the mesh is not loaded yet.
+   */
+  static Math::AABB GetMeshBounds(const Mesh *mesh);
+
+  /**
+   * @brief Gets the world bounds of an entity and all its children.
+   *
+   * @param root_node Root node identifier.
+   * @param father_mat Transformation matrix.
+   * @param bounds Output with the world bounds.
+   *
+   * @return False if any mesh of the tree has no bounds yet, so it can not be culled.
+   */
+  static boolean GetWorldBounds(Entity::Id root_node, Math::Mat4 father_mat, Math::AABB &bounds);
+
+  /**
+   * @brief Enables or disables the culling, disabled it renders everything like JAM_Engine.
+   *
+   * @param active True to cull.
+   */
+  static void SetCulling(boolean active);
+
+  /**
+   * @brief Enables or disables the multi draw with the shared mesh buffers.
+   * Disabling it releases the shared buffers.
+   *
+   * @param active True to use the multi draw.
+   */
+  static void SetMultiDraw(boolean active);
+
+  /**
+   * @brief Enables or disables the GPU culling of the multi draw buckets, it does nothing without the multi draw.
+   * Disabling it releases the compute programs, buffers and the depth pyramid.
+   *
+   * @param active True to cull in the GPU.
+   */
+  static void SetGPUCulling(boolean active);
+
+  /**
+   * @brief Sets the occlusion buffer of the main pass, it must be rasterized before the trees are sent.
+   *
+   * @param buffer Occlusion buffer, null to stop using it.
+   */
+  static void SetOcclusion(const OcclusionBuffer *buffer);
+
+  /**
+   * @brief Sets the potentially visible set of the main pass, read with the camera position of BeginRender.
+   *
+   * @param pvs Baked set, null to stop using it.
+   */
+  static void SetPVS(const PVS *pvs);
+
+  /**
+   * @brief Enables or disables recording ahead: EndRender records the views drawn from a hierarchy for the next frame.
+   * Only the culling runs in the task manager. The visible trees lag the camera by a frame, their matrices and bounds do not.
+   *
+   * @param active True to record the views in EndRender.
+   */
+  static void SetPipelined(boolean active);
+
+  /**
+   * @brief Sets the clusters of a mesh, the main pass culls them when the mesh is not instanced.
+   * The index buffer of the mesh is updated if it was created before the clusters.
+   *
+   * @param mesh Mesh the clusters were built for.
+   * @param meshlets Clusters of the mesh, null to draw it whole again.
+   */
+  static void SetMeshlets(const Mesh *mesh, const Meshlets *meshlets);
+
+  /**
+   * @brief Forgets the bounds and clusters of a mesh whose data changed, and releases the shared buffers.
+   * The shared buffers are made again with every mesh in the next multi draw.
+   *
+   * @param mesh Mesh loaded again.
+   */
+  static void InvalidateMesh(const Mesh *mesh);
+
+  /**
+   * @brief Sets the selected entity every program reads as u_selected_id from the frame block.
+   *
+   * @param id Selected entity, UINT32_MAX for none.
+   */
+  static void SetSelectedEntity(Entity::Id id);
+
+  /**
+   * @brief Starts culling the hierarchy for a light in the task manager, the render world is extracted first if needed.
+   * RenderShadow with the same hierarchy after BeginRenderShadow of the same light draws it.
+   *
+   * @param light_id Light identifier.
+   * @param light_type Type of the light.
+   * @param scene Hierarchy updated this frame.
+   */
+  static void RecordShadow(u32 light_id, LightType light_type, const SceneBVH &scene);
+
+  /**
+   * @brief Starts culling the hierarchy for a camera in the task manager, the render world is extracted first if needed.
+   * Render with the same hierarchy after BeginRender of the same camera draws it.
+   *
+   * @param camera Camera of the view, read now.
+   * @param scene Hierarchy updated this frame.
+   */
+  static void Record(Camera *camera, const SceneBVH &scene);
+
+  /**
+   * @brief Prepares the render shadow and the light frustums.
+   *
+   * @param light_id Light identifier.
+   * @param light_type Type of the light.
+   */
+  static void BeginRenderShadow(u32 light_id, LightType light_type);
+
+  /**
+   * @brief Queues the tree in the shadow pass if any light frustum can see it.
+   *
+   * @param root_node Root node identifier.
+   * @param father_mat Transformation matrix.
+   */
+  static void RenderShadow(Entity::Id root_node, Math::Mat4 father_mat = Math::Mat4::Identity());
+
+  /**
+   * @brief Queues in the shadow pass every tree that any light frustum can see.
+   *
+   * @param root_nodes Root node identifiers.
+   * @param father_mat Transformation matrix of every tree.
+   */
+  static void RenderShadow(std::span<const Entity::Id> root_nodes, Math::Mat4 father_mat = Math::Mat4::Identity());
+
+  /**
+   * @brief Queues in the shadow pass every entity of the query that any light frustum can see.
+   *
+   * @param query Entities to take.
+   * @param father_mat Transformation matrix of every tree.
+   */
+  static void RenderShadowAll(RenderQuery query = RenderQuery(), Math::Mat4 father_mat = Math::Mat4::Identity());
+
+  /**
+   * @brief Queues in the shadow pass the trees of the hierarchy that any light frustum can see.
+   * Takes the list recorded for the light if there is one.
+   *
+   * @param scene Hierarchy updated this frame.
+   */
+  static void RenderShadow(const SceneBVH &scene);
+
+  /**
+   * @brief Draws the sorted shadow queue and ends the render shadow.
+   */
+  static void EndRenderShadow();
+
+  /**
+   * @brief Prepares the render and the camera frustum.
+   *
+   * @param camera Pointer to the camera object to use for rendering.
+   */
+  static void BeginRender(Camera *camera);
+
+  /**
+   * @brief Queues the tree if the camera can see it.
+   *
+   * @param root_node Root node identifier.
+   * @param father_mat Transformation matrix.
+   */
+  static void Render(Entity::Id root_node, Math::Mat4 father_mat = Math::Mat4::Identity());
+
+  /**
+   * @brief Queues every tree the camera can see.
+   *
+   * @param root_nodes Root node identifiers.
+   * @param father_mat Transformation matrix of every tree.
+   */
+  static void Render(std::span<const Entity::Id> root_nodes, Math::Mat4 father_mat = Math::Mat4::Identity());
+
+  /**
+   * @brief Queues every entity of the query the camera can see.
+   *
+   * @param query Entities to take.
+   * @param father_mat Transformation matrix of every tree.
+   */
+  static void RenderAll(RenderQuery query = RenderQuery(), Math::Mat4 father_mat = Math::Mat4::Identity());
+
+  /**
+   * @brief Queues the trees of the hierarchy the camera can see.
+   * Takes the list recorded for the camera if there is one.
+   *
+   * @param scene Hierarchy updated this frame.
+   */
+  static void Render(const SceneBVH &scene);
+
+  /**
+   * @brief Draws the sorted queue, ends the render and closes the frame stats.
+   */
+  static void EndRender();
+
+  /**
+   * @brief Draws a mesh several times reading the instance buffer.
+   *
+   * @param mesh Mesh to draw.
+   * @param config Draw configuration.
+   * @param first_instance First instance in the buffer.
+   * @param instance_count Number of instances.
+   *
+   * @return False if the mesh buffers are not created yet.
+   */
+  static boolean DrawInstanced(const Mesh *mesh, DrawConfig config, u32 first_instance, u32 instance_count);
+
+  /**
+   * @brief Draws some ranges of the mesh indices with one call.
+   *
+   * @param mesh Mesh to draw.
+   * @param config Draw configuration.
+   * @param ranges Index ranges, usually the visible clusters of the mesh.
+   *
+   * @return False if the mesh buffers are not created yet.
+   */
+  static boolean DrawRanges(const Mesh *mesh, DrawConfig config, std::span<const Meshlets::Range> ranges);
+
+  /**
+   * @brief Gets the stats of the last finished frame.
+   *
+   * @return Frame stats.
+   */
+  static Stats GetStats();
+
+private:
+  /**
+   * @brief Private constructor.
+   *
+   * Not intended to be instantiated.
+   */
+  Renderer();
+
+  /**
+   * @brief Private destructor.
+   *
+   * Not intended to be instantiated.
+   */
+  ~Renderer();
+};
+
+#endif /* __RENDERER_H__ */
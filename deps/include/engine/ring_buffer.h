@@ -0,0 +1,146 @@
+#include "types.h"
+
+#ifndef __RING_BUFFER_H__
+#define __RING_BUFFER_H__ 1
+
+/**
+ * @class RingBuffer
+ *
+ * @brief Persistently mapped buffer the per frame data is written to from the CPU.
+ *
+ * The buffer is created with glNamedBufferStorage and mapped once, persistent
+ * and coherent, and it is split in three regions, one per frame in flight.
+ * Every upload takes the next free bytes of the region of the frame and is
+ * bound with glBindBufferRange, so there is no map, no orphaning and no
+ * glBufferSubData the driver has to wait for. The end of a frame puts a fence
+ * after its commands, and a region is only written again once its fence has
+ * passed, three frames later.
+ *
+ * A frame that needs more than a region gets a buffer twice as big, the old
+ * one is deleted when its last fence passes, so the ranges already bound stay
+ * valid.
+ *
+ * The renderer instances and indirect commands, the GPU culling input, the
+ * frame and view uniform blocks and the light storage buffers are written
+ * here. The renderer ends the frame in EndRender. Needs OpenGL 4.5, older
+ * contexts use the old buffers.
+ */
+class RingBuffer
+{
+public:
+  /**
+   * @struct Slice
+   *
+   * @brief Bytes given by Allocate, valid until the end of the frame.
+   */
+  struct Slice
+  {
+    u32 buffer_ = 0;         ///< Buffer to bind, 0 when nothing was given.
+    u32 offset_ = 0;         ///< Offset in the buffer, aligned for uniform and storage bindings.
+    u32 size_ = 0;           ///< Size in bytes.
+    void *data_ = nullptr;   ///< Mapped memory to write to.
+    u32 frame_ = 0;          ///< Frame it was given in.
+  };
+
+  /**
+   * @struct Stats
+   *
+   * @brief Use of the ring in the last frame.
+   */
+  struct Stats
+  {
+    u32 used_ = 0;     ///< Bytes written in the last frame.
+    u32 capacity_ = 0; ///< Bytes of every frame region.
+    u32 waits_ = 0;    ///< Frames that waited for the GPU before writing, since the start.
+    u32 grows_ = 0;    ///< Times the buffer grew, since the start.
+  };
+
+  /**
+   * @brief Checks if the ring can be used, it is created with the first call.
+   *
+   * @return False without OpenGL 4.5 or when it is turned off.
+   */
+  static boolean Active();
+
+  /**
+   * @brief Takes bytes of the region of the frame.
+   *
+   * @param size Size in bytes, more than 0.
+   * @param slice Output with the bytes taken.
+   *
+   * @return False if the ring is not active, the caller uses its own buffer.
+   */
+  static boolean Allocate(u32 size, Slice &slice);
+
+  /**
+   * @brief Takes bytes of the region of the frame and copies data in them.
+   *
+   * @param data Data to copy.
+   * @param size Size in bytes, more than 0.
+   * @param slice Output with the bytes taken.
+   *
+   * @return False if the ring is not active, the caller uses its own buffer.
+   */
+  static boolean Upload(const void *data, u32 size, Slice &slice);
+
+  /**
+   * @brief Checks if a slice was given in this frame, an older one may be written again soon.
+   *
+   * @param slice Slice to check.
+   *
+   * @return True if it can stay bound for this frame.
+   */
+  static boolean Current(const Slice &slice);
+
+  /**
+   * @brief Binds a slice to an indexed uniform or storage binding.
+   *
+   * @param target GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER.
+   * @param index Binding index.
+   * @param slice Slice to bind.
+   */
+  static void BindRange(u32 target, u32 index, const Slice &slice);
+
+  /**
+   * @brief Writes the lights of the engine to the ring and binds them in place of the engine buffers.
+   * Only the first call of every frame does the work.
+   */
+  static void UploadLights();
+
+  /**
+   * @brief Fences the commands of the frame and moves to the next region.
+   * Called from Renderer::EndRender.
+   */
+  static void EndFrame();
+
+  /**
+   * @brief Turns the ring on or off, off releases it and the callers use their own buffers.
+   *
+   * @param active True to use the ring.
+   */
+  static void SetActive(boolean active);
+
+  /**
+   * @brief Gets the use of the ring in the last frame.
+   *
+   * @return Stats.
+   */
+  static Stats GetStats();
+
+private:
+  /**
+   * @brief Private constructor.
+   *
+   * Not intended to be instantiated.
+   */
+  RingBuffer();
+
+  /**
+   * @brief Private destructor.
+   *
+   * Not intended to be instantiated.
+   */
+  ~RingBuffer();
+};
+
+#endif /* __RING_BUFFER_H__ */
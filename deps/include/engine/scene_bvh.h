@@ -0,0 +1,238 @@
+#include <unordered_map>
+#include <vector>
+
+#include "math/mathlib.h"
+#include "math/aabb.h"
+#include "math/frustum.h"
+#include "math/sphere.h"
+#include "entity.h"
+#include "types.h"
+
+#ifndef __SCENE_BVH_H__
+#define __SCENE_BVH_H__ 1
+
+/**
+ * @class SceneBVH
+ *
+ * @brief Bounding volume hierarchy over entity trees.
+ *
+ * Static trees go in a tree built with the surface area heuristic, it's only
+ * built again when a static tree is added or removed. Dynamic trees go in a
+ * second tree that is refitted in update, and only the trees whose root
+ * transform has changed get their bounds computed again.
+ *
+ * Trees whose meshes are still loading have no bounds yet, they are kept
+ * aside and every frustum query returns them, like the culling does.
+ */
+class SceneBVH
+{
+public:
+  /**
+   * @brief Constructor.
+   */
+  SceneBVH();
+
+  /**
+   * @brief Destructor.
+   */
+  ~SceneBVH();
+
+  /**
+   * @brief Adds an entity tree, the bounds are read in the next update.
+   *
+   * @param root_node Root node identifier.
+   * @param is_static True if the tree is not going to move.
+   */
+  void insert(Entity::Id root_node, boolean is_static);
+
+  /**
+   * @brief Removes an entity tree.
+   *
+   * @param root_node Root node identifier.
+   */
+  void remove(Entity::Id root_node);
+
+  /**
+   * @brief Removes every tree.
+   */
+  void clear();
+
+  /**
+   * @brief Reads the bounds of the moved and new trees, refits the dynamic
+   * tree and builds again the trees that have changed. Call it once per frame
+   * before the queries.
+   */
+  void update();
+
+  /**
+   * @brief Gets the number of trees.
+   *
+   * @return Trees in the hierarchy.
+   */
+  u32 size() const;
+
+  /**
+   * @brief Gets the trees a frustum can see, with the ones without bounds.
+   *
+   * @param frustum Frustum to test.
+   * @param result Output, the trees are added at the end.
+   */
+  void query(const Math::Frustum &frustum, std::vector<Entity::Id> &result) const;
+
+  /**
+   * @brief Gets the trees that touch a sphere, e.g. the ones a light reaches.
+   *
+   * @param sphere Sphere to test.
+   * @param result Output, the trees are added at the end.
+   */
+  void query(Math::Sphere sphere, std::vector<Entity::Id> &result) const;
+
+  /**
+   * @brief Gets the trees that touch a box.
+   *
+   * @param box Box to test.
+   * @param result Output, the trees are added at the end.
+   */
+  void query(Math::AABB box, std::vector<Entity::Id> &result) const;
+
+  /**
+   * @brief Gets the trees whose bounds touch the bounds of another one.
+   *
+   * @param root_node Root node identifier.
+   * @param result Output, the trees are added at the end.
+   */
+  void overlaps(Entity::Id root_node, std::vector<Entity::Id> &result) const;
+
+  /**
+   * @brief Finds the closest tree bounds hit by a ray.
+   *
+   * @param origin Ray origin.
+   * @param direction Ray direction.
+   * @param max_distance Ray length.
+   * @param hit Output with the tree hit.
+   * @param distance Output with the distance to the bounds.
+   *
+   * @return False if nothing is hit.
+   */
+  boolean raycast(Math::Vec3 origin, Math::Vec3 direction, f32 max_distance, Entity::Id &hit, f32 &distance) const;
+
+  /**
+   * @brief Gets the world bounds of a tree, as they were in the last update.
+   *
+   * @param root_node Root node identifier.
+   * @param bounds Output with the bounds.
+   *
+   * @return False if the tree is not in the hierarchy or has no bounds yet.
+   */
+  boolean getBounds(Entity::Id root_node, Math::AABB &bounds) const;
+
+  /**
+   * @brief Gets every tree of the hierarchy.
+   *
+   * @param result Output, the trees are added at the end.
+   */
+  void entities(std::vector<Entity::Id> &result) const;
+
+private:
+  /**
+   * @struct Object
+   *
+   * @brief Entity tree in the hierarchy.
+   */
+  struct Object
+  {
+    Entity::Id id_;      ///< Root node of the tree.
+    Math::AABB bounds_;  ///< World bounds of the whole tree.
+    Math::Mat4 matrix_;  ///< Root transform when the bounds were read.
+    boolean is_static_;  ///< Goes in the static tree.
+    boolean has_bounds_; ///< Bounds are ready, false while the meshes load.
+  };
+
+  /**
+   * @struct Node
+   *
+   * @brief Node of a tree, leaves have count_ > 0.
+   */
+  struct Node
+  {
+    Math::AABB bounds_; ///< Bounds of every object below.
+    u32 first_;         ///< First child node, or first object index in a leaf.
+    u32 count_;         ///< Objects of a leaf, 0 in the inner nodes.
+  };
+
+  /**
+   * @struct Tree
+   *
+   * @brief Nodes and object indices, the children of a node go together and after it.
+   */
+  struct Tree
+  {
+    std::vector<Node> nodes_;  ///< Nodes, the root is the first one.
+    std::vector<u32> objects_; ///< Object indices, the leaves point to ranges of it.
+    f32 build_cost_ = 0.0f;    ///< SAH cost after the build, to know when a refit is too loose.
+    boolean dirty_ = false;    ///< The objects have changed, build it again.
+  };
+
+  std::vector<Object> objects_;                    ///< Every tree of the hierarchy.
+  std::unordered_map<Entity::Id, u32> object_ids_; ///< Object index of every root node.
+  std::vector<u32> unbounded_;                     ///< Objects without bounds yet.
+
+  Tree static_tree_;  ///< Static trees.
+  Tree dynamic_tree_; ///< Dynamic trees.
+
+  std::vector<Entity::Id> scratch_ids_;  ///< Dynamic root nodes read in update.
+  std::vector<size_t> scratch_internal_; ///< Internal identifiers of the dynamic root nodes.
+
+  /**
+   * @brief Reads the world bounds of an object.
+   *
+   * @param object Object to update.
+   */
+  void readBounds(Object &object);
+
+  /**
+   * @brief Builds a tree with the objects of one kind that have bounds.
+   *
+   * @param tree Tree to build.
+   * @param is_static Kind of object.
+   */
+  void build(Tree &tree, boolean is_static);
+
+  /**
+   * @brief Splits a node with the binned surface area heuristic.
+   *
+   * @param tree Tree being built.
+   * @param node_index Node to split.
+   * @param first First object index of the node.
+   * @param count Objects in the node.
+   */
+  void split(Tree &tree, u32 node_index, u32 first, u32 count);
+
+  /**
+   * @brief Updates the node bounds from the object bounds, children first.
+   *
+   * @param tree Tree to refit.
+   */
+  void refit(Tree &tree);
+
+  /**
+   * @brief Gets the SAH cost of a tree, the sum of the node areas over the root area.
+   *
+   * @param tree Tree to check.
+   *
+   * @return Cost of the tree.
+   */
+  f32 cost(const Tree &tree) const;
+
+  /**
+   * @brief Walks a tree calling visit in every object of the nodes test accepts.
+   *
+   * @param tree Tree to walk.
+   * @param test Node test, returns Outside, Intersect or Inside.
+   * @param visit Called with every object that passes, and all the objects below an inside node.
+   */
+  template <typename Test, typename Visit>
+  void walk(const Tree &tree, Test test, Visit visit) const;
+};
+
+#endif /* __SCENE_BVH_H__ */
@@ -1,3 +1,5 @@
+#include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include "math/mathlib.h"
@@ -10,6 +12,7 @@
  * @class Shader
  *
  * @brief Class that represents and manages graphic material.
+ * Uniform blocks, async programs and shader features are described in docs/rendering.md.
  */
 class Shader
 {
@@ -19,6 +22,26 @@ public:
    */
   typedef uint32_t Id;
 
+  /**
+   * @struct UniformSlot
+   *
+   * @brief Location of a uniform and the last value given to it.
+   */
+  struct UniformSlot
+  {
+    s32 location_;          ///< Location in the program, -1 if the program does not use it.
+    s32 fallback_location_; ///< Location in the fallback program while it draws, -1 otherwise.
+    u32 block_;             ///< Member of the frame or view block with the same name, 0 if none.
+    u32 type_;              ///< GL type of the last value.
+    u32 size_;              ///< Bytes of the last value, 0 if it is not known.
+    u32 value_[16];         ///< Last value given to the uniform.
+  };
+
+  /**
+   * @brief Handle of a uniform, valid until free, also after rechargeShader.
+   */
+  typedef UniformSlot *Uniform;
+
   /**
    * @brief Shader constructor.
    */
@@ -52,6 +75,7 @@ public:
 
   /**
    * @brief Reloads the shader associated with the material.
+   * The old program keeps drawing until the new one is compiled.
    */
   void rechargeShader();
 
@@ -137,26 +161,173 @@ public:
    */
   void setMat4(const byte *uniform_name, Math::Mat4 matrix);
 
+  /**
+   * @brief Gets the handle of a uniform, it can be asked before the shader is loaded.
+   *
+   * @param uniform_name Uniform name in the shader.
+   *
+   * @return Handle of the uniform in this shader.
+   */
+  Uniform getUniform(const byte *uniform_name);
+
+  /**
+   * @brief Assigns a int value to a uniform in the shader.
+   *
+   * @param uniform Handle from getUniform of this shader.
+   * @param value int value to assign.
+   */
+  void setU32(Uniform uniform, u32 value);
+
+  /**
+   * @brief Assigns a float value to a uniform in the shader.
+   *
+   * @param uniform Handle from getUniform of this shader.
+   * @param value Float value to assign.
+   */
+  void setF32(Uniform uniform, f32 value);
+
+  /**
+   * @brief Assigns a Vector2 to a uniform in the shader.
+   *
+   * @param uniform Handle from getUniform of this shader.
+   * @param value Vector2 components to be assigned.
+   */
+  void setVec2(Uniform uniform, Math::Vec2 value);
+
+  /**
+   * @brief Assigns a Vector3 to a uniform in the shader.
+   *
+   * @param uniform Handle from getUniform of this shader.
+   * @param value Vector3 components to be assigned.
+   */
+  void setVec3(Uniform uniform, Math::Vec3 value);
+
+  /**
+   * @brief Assigns a Vector4 to a uniform in the shader.
+   *
+   * @param uniform Handle from getUniform of this shader.
+   * @param value Vector4 components to be assigned.
+   */
+  void setVec4(Uniform uniform, Math::Vec4 value);
+
+  /**
+   * @brief Assigns a 2x2 matrix to a uniform in the shader.
+   *
+   * @param uniform Handle from getUniform of this shader.
+   * @param matrix 2x2 matrix to assign.
+   */
+  void setMat2(Uniform uniform, Math::Mat2 matrix);
+
+  /**
+   * @brief Assigns a 3x3 matrix to a uniform in the shader.
+   *
+   * @param uniform Handle from getUniform of this shader.
+   * @param matrix 3x3 matrix to assign.
+   */
+  void setMat3(Uniform uniform, Math::Mat3 matrix);
+
+  /**
+   * @brief Assigns a 4x4 matrix to a uniform in the shader.
+   *
+   * @param uniform Handle from getUniform of this shader.
+   * @param matrix 4x4 matrix to assign.
+   */
+  void setMat4(Uniform uniform, Math::Mat4 matrix);
+
   /**
    * @brief Activate the use of the material, configuring the shader and the uniforms.
    */
   void use() const;
 
+  /**
+   * @brief Writes the view block, the camera every program draws with.
+   *
+   * @param view View matrix.
+   * @param projection Projection matrix.
+   * @param camera_pos Camera position.
+   * @param camera_dir Camera direction.
+   */
+  static void SetViewBlock(Math::Mat4 view, Math::Mat4 projection, Math::Vec3 camera_pos, Math::Vec3 camera_dir);
+
+  /**
+   * @brief Writes the time of the frame block.
+   *
+   * @param time Time since the first frame.
+   * @param delta_time Time of the last frame.
+   * @param frame Frame counter.
+   */
+  static void SetFrameBlock(f32 time, f32 delta_time, u32 frame);
+
+  /**
+   * @brief Writes the selected entity of the frame block, read by the shaders as u_selected_id.
+   *
+   * @param selected_id Selected entity, UINT32_MAX for none.
+   */
+  static void SetSelectedId(u32 selected_id);
+
+  /**
+   * @brief Binds the frame and view blocks to their binding points, creating them the first time.
+   */
+  static void BindBlocks();
+
+  /**
+   * @brief Swaps in the programs that finished compiling, the renderer calls it every frame.
+   */
+  static void PollPrograms();
+
 private:
+  /**
+   * @brief Hash of the uniform names, finds them without building a string.
+   */
+  struct UniformHash
+  {
+    using is_transparent = void;
+    size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+  };
+
   u32 program_id_;                   ///< Shader program identifier.
   boolean has_shader_;               ///< Indicates if the material has a shader.
   byte *fragmentPath_, *vertexPath_; ///< Shader file paths.
 
-  std::unordered_map<std::string, s32> uniforms_; ///< Map uniform names to their locations.
+  std::unordered_map<std::string, UniformSlot, UniformHash, std::equal_to<>> uniforms_; ///< Map uniform names to their handles.
+
+  /**
+   * @brief Asks the locations of every handle to the program and sends their last values.
+   */
+  void resolveUniforms();
+
+  /**
+   * @brief Asks the locations of a uniform to the program, or to the fallback while it draws.
+   *
+   * @param uniform_name Uniform name in the shader.
+   * @param slot Slot of the uniform.
+   */
+  void locate(const byte *uniform_name, UniformSlot &slot) const;
+
+  /**
+   * @brief Takes the compiling program of this shader if it is ready.
+   *
+   * @return True if the program was taken and the handles resolved.
+   */
+  boolean pollProgram();
 
   /**
-   * @brief Gets the location of a uniform in the shader.
+   * @brief Keeps a new value of a uniform and sends it if it changed.
+   * Names of the frame and view blocks write the block instead.
    *
-   * @param uniform_name Uniform name.
+   * @param uniform Uniform handle.
+   * @param type GL type of the value.
+   * @param value Value to assign.
+   * @param size Bytes of the value.
+   */
+  void setValue(Uniform uniform, u32 type, const void *value, u32 size);
+
+  /**
+   * @brief Sends the last value of a uniform to the program, and to the fallback while it draws.
    *
-   * @return Location of the uniform in the shader.
+   * @param slot Slot of the uniform.
    */
-  s32 getUniformLocation(const byte *uniform_name);
+  void upload(const UniformSlot &slot) const;
 };
 
 #endif /* __MATERIAL_H__ */
@@ -36,6 +36,13 @@ public:
    */
   void free();
 
+  /**
+   * @brief Gets the number of threads in the pool.
+   *
+   * @return Worker threads, 0 with a single core.
+   */
+  u32 workerCount() const { return static_cast<u32>(threads_.size()); }
+
   /**
    * @brief Enqueues a task with specified arguments for execution.
    *
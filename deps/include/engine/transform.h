@@ -36,6 +36,7 @@ public:
 
   /**
    * @brief Gets the combined transformation matrix incorporating rotation, scaling, translation, and orbiting.
+   * Composed from the matrices kept by every change, the orbit product is skipped while it is the identity.
    *
    * @return 4x4 transformation matrix.
    */
@@ -55,6 +56,20 @@ public:
    */
   Math::Vec3 getRotate() const;
 
+  /**
+   * @brief Sets the rotation, replacing the current one.
+   *
+   * @param rotation Unit quaternion with the new rotation.
+   */
+  void setRotation(Math::Quat rotation);
+
+  /**
+   * @brief Gets the current rotation.
+   *
+   * @return Unit quaternion with the rotation.
+   */
+  Math::Quat getRotation() const;
+
   /**
    * @brief Gets the rotation transformation matrix.
    *
@@ -0,0 +1,605 @@
+#include <engine/jam_engine.h>
+#include <engine/asset_watcher.h>
+#include <engine/gl_state.h>
+#include <engine/renderer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @enum AssetKind
+ *
+ * @brief Upload call an asset came from.
+ */
+enum class AssetKind
+{
+  k_Shader,
+  k_Mesh,
+  k_Texture,
+  k_TexturesArray,
+};
+
+/**
+ * @struct WatchedAsset
+ *
+ * @brief Asset uploaded through JAM_Engine and the files it was read from.
+ */
+struct WatchedAsset
+{
+  AssetKind kind_ = AssetKind::k_Shader; ///< Upload call.
+  u32 id_ = 0;                           ///< Identifier given by the upload.
+  std::vector<std::string> paths_;       ///< Paths as given to the upload, the layers of a textures array.
+  std::vector<std::string> files_;       ///< Canonical paths of the files, the mtl libraries of a mesh after its obj.
+  boolean normalize_ = false;            ///< Meshes, center and normalize.
+
+  std::vector<Texture::Wrap> wrap_s_;  ///< Meshes and textures, wrap modes for the S axis, empty for the defaults.
+  std::vector<Texture::Wrap> wrap_t_;  ///< Meshes and textures, wrap modes for the T axis, empty for the defaults.
+  std::vector<Texture::Filter> min_f_;  ///< Meshes and textures, minification filters, empty for the defaults.
+  std::vector<Texture::Filter> mag_f_;  ///< Meshes and textures, magnification filters, empty for the defaults.
+  TexturesArray::Wrap array_wrap_[2] = {TexturesArray::Wrap::Repeat, TexturesArray::Wrap::Repeat};          ///< Textures arrays, wrap modes.
+  TexturesArray::Filter array_filter_[2] = {TexturesArray::Filter::Linear, TexturesArray::Filter::Linear}; ///< Textures arrays, filters.
+};
+
+/**
+ * @struct Reload
+ *
+ * @brief Asset being read again in the task manager into a new object.
+ */
+struct Reload
+{
+  WatchedAsset *asset_ = nullptr;        ///< Asset to swap.
+  std::future<void> task_;               ///< Read in the task manager.
+  std::unique_ptr<Mesh> mesh_;           ///< New mesh.
+  std::unique_ptr<Texture> texture_;     ///< New texture.
+  std::unique_ptr<TexturesArray> array_; ///< New textures array.
+  boolean again_ = false;                ///< A file changed again while reading, read it once more.
+};
+
+struct WatcherData
+{
+  s32 fd_ = -1;                                            ///< inotify instance.
+  std::unordered_map<s32, std::filesystem::path> watches_; ///< Watched folder of every watch descriptor.
+  std::vector<std::unique_ptr<WatchedAsset>> assets_;      ///< Uploaded assets.
+  std::vector<std::unique_ptr<Reload>> reloads_;           ///< Reads not swapped yet.
+  void (*mesh_reloaded_)(Mesh *mesh) = nullptr;            ///< Called after a mesh swap.
+  AssetWatcher::Stats stats_;                              ///< Reloads since the start.
+
+  ~WatcherData() { AssetWatcher::Stop(); }
+};
+
+static WatcherData s_watcher;
+
+static std::string Canonical(const std::filesystem::path &path)
+{
+  std::error_code error;
+  std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+  return error ? path.lexically_normal().string() : canonical.string();
+}
+
+// Only the header is read, the exporters write the mtllib lines before the vertices
+static void ReadMaterialLibraries(WatchedAsset &asset)
+{
+  asset.files_.resize(1);
+
+  std::ifstream file(asset.paths_[0]);
+  std::filesystem::path folder = std::filesystem::path(asset.paths_[0]).parent_path();
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.rfind("v ", 0) == 0 || line.rfind("f ", 0) == 0)
+      break;
+
+    if (line.rfind("mtllib ", 0) != 0)
+      continue;
+
+    std::string name = line.substr(7);
+    while (!name.empty() && (name.back() == '\r' || name.back() == ' '))
+      name.pop_back();
+
+    if (!name.empty())
+      asset.files_.push_back(Canonical(folder / name));
+  }
+}
+
+static WatchedAsset *Register(AssetKind kind, u32 id)
+{
+  for (auto &asset : s_watcher.assets_)
+  {
+    if (asset->kind_ == kind && asset->id_ == id)
+      return nullptr;
+  }
+
+  auto asset = std::make_unique<WatchedAsset>();
+  asset->kind_ = kind;
+  asset->id_ = id;
+  s_watcher.assets_.push_back(std::move(asset));
+
+  return s_watcher.assets_.back().get();
+}
+
+static void AddPath(WatchedAsset &asset, const byte *path)
+{
+  if (!path)
+    return;
+
+  asset.paths_.push_back(path);
+  asset.files_.push_back(Canonical(path));
+}
+
+static boolean ReadsFile(const WatchedAsset &asset, const std::string &file)
+{
+  return std::find(asset.files_.begin(), asset.files_.end(), file) != asset.files_.end();
+}
+
+template <typename T>
+static std::vector<T> Settings(const T *values, size_t count)
+{
+  return values ? std::vector<T>(values, values + count) : std::vector<T>();
+}
+
+template <typename T>
+static T *Settings(std::vector<T> &values) { return values.empty() ? nullptr : values.data(); }
+///////////////////////////////////////////////////////////////////////////////
+
+// Reloads
+///////////////////////////////////////////////////////////////////////////////
+static void StartReload(WatchedAsset &asset)
+{
+  for (auto &pending : s_watcher.reloads_)
+  {
+    if (pending->asset_ == &asset)
+    {
+      pending->again_ = true;
+      return;
+    }
+  }
+
+  switch (asset.kind_)
+  {
+  case AssetKind::k_Shader:
+  {
+    // Already compiled without waiting, the old program is used until it is ready
+    Shader *shader = JAM_Engine::GetShader(asset.id_);
+    if (shader)
+    {
+      shader->rechargeShader();
+      s_watcher.stats_.shaders_++;
+    }
+    return;
+  }
+  case AssetKind::k_Mesh:
+  {
+    Mesh *mesh = JAM_Engine::GetMesh(asset.id_);
+    if (!mesh || !mesh->hasMesh())
+      return;
+
+    ReadMaterialLibraries(asset);
+
+    auto reload = std::make_unique<Reload>();
+    reload->asset_ = &asset;
+    reload->mesh_ = std::make_unique<Mesh>();
+    Mesh *fresh = reload->mesh_.get();
+    reload->task_ = TM->enqueue([fresh, &asset]()
+                                { fresh->loadMesh(asset.paths_[0], asset.normalize_, Settings(asset.wrap_s_), Settings(asset.wrap_t_), Settings(asset.min_f_), Settings(asset.mag_f_)); });
+    s_watcher.reloads_.push_back(std::move(reload));
+    return;
+  }
+  case AssetKind::k_Texture:
+  {
+    if (!JAM_Engine::GetTexture(asset.id_))
+      return;
+
+    auto reload = std::make_unique<Reload>();
+    reload->asset_ = &asset;
+    reload->texture_ = std::make_unique<Texture>(asset.wrap_s_[0], asset.wrap_t_[0], asset.min_f_[0], asset.mag_f_[0]);
+    Texture *fresh = reload->texture_.get();
+    reload->task_ = TM->enqueue([fresh, &asset]()
+                                { fresh->loadTexture(asset.paths_[0]); });
+    s_watcher.reloads_.push_back(std::move(reload));
+    return;
+  }
+  case AssetKind::k_TexturesArray:
+  {
+    if (!JAM_Engine::GetTexturesArray(asset.id_))
+      return;
+
+    // Every layer is read again, the array is uploaded whole
+    auto reload = std::make_unique<Reload>();
+    reload->asset_ = &asset;
+    reload->array_ = std::make_unique<TexturesArray>(asset.array_wrap_[0], asset.array_wrap_[1], asset.array_filter_[0], asset.array_filter_[1]);
+    TexturesArray *fresh = reload->array_.get();
+    reload->task_ = TM->enqueue([fresh, &asset]()
+                                { fresh->loadTexture(asset.paths_.data(), asset.paths_.size()); });
+    s_watcher.reloads_.push_back(std::move(reload));
+    return;
+  }
+  }
+}
+
+static void DeleteTexture(u32 id)
+{
+  if (id != UINT32_MAX && id != 0)
+    GLState::DeleteTextures(1, &id);
+}
+
+static void FailReload(const WatchedAsset &asset)
+{
+  JAM_Engine::AddError("Could not reload " + asset.paths_[0], __func__, std::to_string(__LINE__));
+}
+
+// The new object is swapped in, and the old data left in the reload is freed
+static void SwapReload(Reload &reload)
+{
+  switch (reload.asset_->kind_)
+  {
+  case AssetKind::k_Texture:
+  {
+    Texture &old = *reload.texture_;
+    if (!old.hasTexture())
+    {
+      FailReload(*reload.asset_);
+      old.free();
+      return;
+    }
+
+    std::swap(*JAM_Engine::GetTexture(reload.asset_->id_), old);
+    DeleteTexture(old.id());
+    old.free();
+    s_watcher.stats_.textures_++;
+    return;
+  }
+  case AssetKind::k_TexturesArray:
+  {
+    TexturesArray &old = *reload.array_;
+    if (!old.hasTexture())
+    {
+      FailReload(*reload.asset_);
+      old.free();
+      return;
+    }
+
+    std::swap(*JAM_Engine::GetTexturesArray(reload.asset_->id_), old);
+    DeleteTexture(old.id());
+    old.free();
+    s_watcher.stats_.textures_++;
+    return;
+  }
+  case AssetKind::k_Shader:
+  case AssetKind::k_Mesh:
+    return;
+  }
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// Events
+///////////////////////////////////////////////////////////////////////////////
+#ifdef __linux__
+const u32 k_watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+static void AddWatch(const std::filesystem::path &directory)
+{
+  s32 wd = inotify_add_watch(s_watcher.fd_, directory.c_str(), k_watch_mask);
+  if (wd < 0)
+  {
+    JAM_Engine::AddError("Could not watch " + directory.string(), __func__, std::to_string(__LINE__));
+    return;
+  }
+
+  s_watcher.watches_[wd] = directory;
+}
+
+static void AddWatches(const std::filesystem::path &directory)
+{
+  AddWatch(directory);
+
+  std::error_code error;
+  for (auto it = std::filesystem::recursive_directory_iterator(directory, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+  {
+    if (it->is_directory(error))
+      AddWatch(it->path());
+  }
+}
+
+// Editors save in place (close write) or write a temporary file and rename
+// it over the old one (moved to), a file saved many times counts once
+static void ReadEvents(std::unordered_set<std::string> &changed)
+{
+  alignas(struct inotify_event) byte buffer[4096];
+  for (;;)
+  {
+    ssize_t length = read(s_watcher.fd_, buffer, sizeof(buffer));
+    if (length <= 0)
+      return;
+
+    for (ssize_t offset = 0; offset < length;)
+    {
+      const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+      offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+
+      if (event->mask & IN_IGNORED)
+      {
+        s_watcher.watches_.erase(event->wd);
+        continue;
+      }
+
+      auto watch = s_watcher.watches_.find(event->wd);
+      if (watch == s_watcher.watches_.end() || event->len == 0)
+        continue;
+
+      std::filesystem::path path = watch->second / event->name;
+      if (event->mask & IN_ISDIR)
+      {
+        if (event->mask & (IN_CREATE | IN_MOVED_TO))
+          AddWatches(path);
+      }
+      else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+        changed.insert(Canonical(path));
+    }
+  }
+}
+#endif
+///////////////////////////////////////////////////////////////////////////////
+
+boolean AssetWatcher::Start(const byte *directory)
+{
+#ifdef __linux__
+  if (s_watcher.fd_ >= 0)
+    return true;
+
+  std::error_code error;
+  if (!directory || !std::filesystem::is_directory(directory, error))
+  {
+    JAM_Engine::AddError(std::string("Not a folder ") + (directory ? directory : "null"), __func__, std::to_string(__LINE__));
+    return false;
+  }
+
+  s_watcher.fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (s_watcher.fd_ < 0)
+  {
+    JAM_Engine::AddError("inotify is not available", __func__, std::to_string(__LINE__));
+    return false;
+  }
+
+  AddWatches(Canonical(directory));
+
+  return true;
+#else
+  (void)directory;
+  return false;
+#endif
+}
+
+void AssetWatcher::Stop()
+{
+#ifdef __linux__
+  if (s_watcher.fd_ >= 0)
+    close(s_watcher.fd_);
+#endif
+  s_watcher.fd_ = -1;
+  s_watcher.watches_.clear();
+
+  // The task manager still writes in the new objects
+  for (auto &reload : s_watcher.reloads_)
+  {
+    reload->task_.wait();
+    if (reload->mesh_)
+      reload->mesh_->free();
+    if (reload->texture_)
+      reload->texture_->free();
+    if (reload->array_)
+      reload->array_->free();
+  }
+  s_watcher.reloads_.clear();
+}
+
+void AssetWatcher::Update()
+{
+#ifdef __linux__
+  if (s_watcher.fd_ >= 0)
+  {
+    std::unordered_set<std::string> changed;
+    ReadEvents(changed);
+
+    for (auto &asset : s_watcher.assets_)
+    {
+      // The material textures are only known once the mesh is loaded
+      Mesh *mesh = (asset->kind_ == AssetKind::k_Mesh) ? JAM_Engine::GetMesh(asset->id_) : nullptr;
+      boolean files = false;
+      boolean textures = false;
+      for (const std::string &file : changed)
+      {
+        files = files || ReadsFile(*asset, file);
+        textures = textures || UsesTexture(mesh, file);
+      }
+
+      if (files)
+        StartReload(*asset);
+      else if (textures)
+        ReloadMaterialTextures(mesh);
+    }
+  }
+#endif
+
+  FinishReloads();
+
+  s_watcher.stats_.pending_ = static_cast<u32>(s_watcher.reloads_.size());
+}
+
+Shader::Id AssetWatcher::UploadShader(const byte *fragment, const byte *vertex)
+{
+  Shader::Id id = JAM_Engine::UploadShader(fragment, vertex);
+
+  WatchedAsset *asset = Register(AssetKind::k_Shader, id);
+  if (asset)
+  {
+    AddPath(*asset, fragment);
+    AddPath(*asset, vertex);
+  }
+
+  return id;
+}
+
+Mesh::Id AssetWatcher::UploadMesh(const byte *path, boolean center, Texture::Wrap *wrapS, Texture::Wrap *wrapT, Texture::Filter *minF, Texture::Filter *magF)
+{
+  Mesh::Id id = JAM_Engine::UploadMesh(path, center, wrapS, wrapT, minF, magF);
+
+  WatchedAsset *asset = Register(AssetKind::k_Mesh, id);
+  if (asset && path)
+  {
+    AddPath(*asset, path);
+    asset->normalize_ = center;
+    asset->wrap_s_ = Settings(wrapS, 13);
+    asset->wrap_t_ = Settings(wrapT, 13);
+    asset->min_f_ = Settings(minF, 13);
+    asset->mag_f_ = Settings(magF, 13);
+    ReadMaterialLibraries(*asset);
+  }
+
+  return id;
+}
+
+Texture::Id AssetWatcher::UploadTexture(const byte *path, Texture::Wrap wrapS, Texture::Wrap wrapT, Texture::Filter minF, Texture::Filter magF)
+{
+  Texture::Id id = JAM_Engine::UploadTexture(path, wrapS, wrapT, minF, magF);
+
+  WatchedAsset *asset = Register(AssetKind::k_Texture, id);
+  if (asset)
+  {
+    AddPath(*asset, path);
+    asset->wrap_s_ = {wrapS};
+    asset->wrap_t_ = {wrapT};
+    asset->min_f_ = {minF};
+    asset->mag_f_ = {magF};
+  }
+
+  return id;
+}
+
+TexturesArray::Id AssetWatcher::UploadTexturesArray(const std::string *paths, const size_t &files_count, TexturesArray::Wrap wrapS, TexturesArray::Wrap wrapT,
+                                                    TexturesArray::Filter minF, TexturesArray::Filter magF)
+{
+  TexturesArray::Id id = JAM_Engine::UploadTexturesArray(paths, files_count, wrapS, wrapT, minF, magF);
+
+  WatchedAsset *asset = Register(AssetKind::k_TexturesArray, id);
+  if (asset)
+  {
+    for (size_t i = 0; i < files_count; i++)
+      AddPath(*asset, paths[i].c_str());
+    asset->array_wrap_[0] = wrapS;
+    asset->array_wrap_[1] = wrapT;
+    asset->array_filter_[0] = minF;
+    asset->array_filter_[1] = magF;
+  }
+
+  return id;
+}
+
+void AssetWatcher::SetMeshCallback(void (*mesh_reloaded)(Mesh *mesh)) { s_watcher.mesh_reloaded_ = mesh_reloaded; }
+
+AssetWatcher::Stats AssetWatcher::GetStats() { return s_watcher.stats_; }
+
+boolean AssetWatcher::UsesTexture(const Mesh *mesh, const std::string &file)
+{
+  if (!mesh || !mesh->hasMesh())
+    return false;
+
+  for (const auto &textures : mesh->textures_path_)
+  {
+    for (const auto &texture : textures)
+    {
+      if (Canonical(texture.first) == file)
+        return true;
+    }
+  }
+
+  return false;
+}
+
+void AssetWatcher::FinishReloads()
+{
+  std::vector<WatchedAsset *> again;
+  for (auto it = s_watcher.reloads_.begin(); it != s_watcher.reloads_.end();)
+  {
+    Reload &reload = **it;
+    if (reload.task_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      ++it;
+      continue;
+    }
+
+    if (reload.mesh_)
+      Swap(JAM_Engine::GetMesh(reload.asset_->id_), *reload.mesh_);
+    else
+      SwapReload(reload);
+
+    if (reload.again_)
+      again.push_back(reload.asset_);
+    it = s_watcher.reloads_.erase(it);
+  }
+
+  for (WatchedAsset *asset : again)
+    StartReload(*asset);
+}
+
+void AssetWatcher::Swap(Mesh *mesh, Mesh &fresh)
+{
+  if (!fresh.hasMesh())
+  {
+    JAM_Engine::AddError("Could not reload a mesh", __func__, std::to_string(__LINE__));
+    fresh.free();
+    return;
+  }
+
+  std::swap(*mesh, fresh);
+
+  // The buffers and textures of the new data are created in the next render
+  if (fresh.VAO != UINT32_MAX)
+    GLState::DeleteVertexArrays(1, &fresh.VAO);
+  const u32 buffers[3] = {fresh.VBO, fresh.EBO, fresh.SSBO};
+  for (u32 buffer : buffers)
+  {
+    if (buffer != UINT32_MAX)
+      GLState::DeleteBuffers(1, &buffer);
+  }
+  for (u32 texture : fresh.texture_ids_)
+    DeleteTexture(texture);
+  fresh.free();
+
+  Renderer::InvalidateMesh(mesh);
+  s_watcher.stats_.meshes_++;
+  if (s_watcher.mesh_reloaded_)
+    s_watcher.mesh_reloaded_(mesh);
+}
+
+// The mesh creates its material texture arrays in the render thread, they
+// are made again from the same files without reading the obj file
+void AssetWatcher::ReloadMaterialTextures(Mesh *mesh)
+{
+  // Not drawn yet, the first render reads the new files
+  if (mesh->VAO == UINT32_MAX)
+    return;
+
+  for (u32 &texture : mesh->texture_ids_)
+  {
+    DeleteTexture(texture);
+    texture = UINT32_MAX;
+  }
+  mesh->loadTextureBuffers();
+
+  Renderer::InvalidateMesh(mesh);
+  s_watcher.stats_.textures_++;
+}
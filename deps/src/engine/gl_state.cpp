@@ -0,0 +1,319 @@
+#include <engine/gl_state.h>
+#include <engine/jam_engine.h>
+
+#include <cstring>
+
+// Tracked state
+///////////////////////////////////////////////////////////////////////////////
+const u32 k_unknown = UINT32_MAX;
+const u32 k_texture_units = 32;
+const u32 k_texture_targets = 4;
+const u32 k_buffer_targets = 3;
+const u32 k_buffer_bindings = 16;
+const u32 k_capabilities = 3;
+
+static const GLenum texture_targets[k_texture_targets] = {GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D};
+static const GLenum buffer_targets[k_buffer_targets] = {GL_SHADER_STORAGE_BUFFER, GL_UNIFORM_BUFFER, GL_DRAW_INDIRECT_BUFFER};
+static const GLenum capabilities[k_capabilities] = {GL_CULL_FACE, GL_DEPTH_TEST, GL_BLEND};
+
+// Every value is k_unknown until a call sets it
+struct TrackedState
+{
+  u32 program_;
+  u32 vertex_array_;
+  u32 active_unit_;
+  u32 textures_[k_texture_units][k_texture_targets];
+  u32 samplers_[k_texture_units];
+  u32 buffers_[k_buffer_targets];
+  u32 storage_buffers_[k_buffer_bindings];
+  u32 uniform_buffers_[k_buffer_bindings];
+  u32 draw_framebuffer_;
+  u32 read_framebuffer_;
+  u32 capabilities_[k_capabilities];
+  u32 cull_face_;
+  u32 front_face_;
+  u32 depth_func_;
+  u32 depth_mask_;
+  u32 blend_src_;
+  u32 blend_dst_;
+};
+
+static TrackedState UnknownState()
+{
+  TrackedState state;
+  memset(&state, 0xFF, sizeof(state));
+  return state;
+}
+
+static TrackedState s_state = UnknownState();
+static GLState::Stats s_stats;
+///////////////////////////////////////////////////////////////////////////////
+
+// Helpers
+///////////////////////////////////////////////////////////////////////////////
+static boolean Changed(u32 &tracked, u32 value)
+{
+  if (tracked == value)
+  {
+    s_stats.skipped_++;
+    return false;
+  }
+
+  tracked = value;
+  s_stats.issued_++;
+  return true;
+}
+
+static u32 Find(const GLenum *values, u32 count, GLenum value)
+{
+  for (u32 i = 0; i < count; i++)
+    if (values[i] == value)
+      return i;
+
+  return k_unknown;
+}
+
+static u32 *GenericBuffer(GLenum target)
+{
+  u32 index = Find(buffer_targets, k_buffer_targets, target);
+  return (index != k_unknown) ? &s_state.buffers_[index] : nullptr;
+}
+
+static u32 *IndexedBuffer(GLenum target, GLuint index)
+{
+  if (index >= k_buffer_bindings)
+    return nullptr;
+  if (target == GL_SHADER_STORAGE_BUFFER)
+    return &s_state.storage_buffers_[index];
+  if (target == GL_UNIFORM_BUFFER)
+    return &s_state.uniform_buffers_[index];
+
+  return nullptr;
+}
+
+// A deleted name can come back from the next glGen, nothing is assumed about it
+static void Forget(u32 *values, size_t count, const u32 *names, s32 name_count)
+{
+  for (s32 n = 0; n < name_count; n++)
+    for (size_t i = 0; i < count; i++)
+      if (values[i] == names[n])
+        values[i] = k_unknown;
+}
+///////////////////////////////////////////////////////////////////////////////
+
+void GLState::Invalidate() { s_state = UnknownState(); }
+
+void GLState::UseProgram(u32 program)
+{
+  if (Changed(s_state.program_, program))
+    glUseProgram(program);
+}
+
+void GLState::BindVertexArray(u32 array)
+{
+  if (Changed(s_state.vertex_array_, array))
+    glBindVertexArray(array);
+}
+
+void GLState::BindTexture(u32 unit, u32 target, u32 texture)
+{
+  // Until the unit and the target are known the binding can not be placed
+  u32 index = Find(texture_targets, k_texture_targets, target);
+  if (unit >= k_texture_units || index == k_unknown)
+  {
+    s_state.active_unit_ = k_unknown;
+    s_stats.issued_ += 2;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, texture);
+    return;
+  }
+
+  if (s_state.textures_[unit][index] == texture)
+  {
+    s_stats.skipped_ += 2;
+    return;
+  }
+
+  if (Changed(s_state.active_unit_, unit))
+    glActiveTexture(GL_TEXTURE0 + unit);
+
+  s_state.textures_[unit][index] = texture;
+  s_stats.issued_++;
+  glBindTexture(target, texture);
+}
+
+void GLState::BindSampler(u32 unit, u32 sampler)
+{
+  // Sampler binds name the unit, the active one does not change
+  if (unit >= k_texture_units || Changed(s_state.samplers_[unit], sampler))
+    glBindSampler(unit, sampler);
+}
+
+void GLState::BindBuffer(u32 target, u32 buffer)
+{
+  u32 *generic = GenericBuffer(target);
+  if (!generic || Changed(*generic, buffer))
+    glBindBuffer(target, buffer);
+}
+
+void GLState::BindBufferBase(u32 target, u32 index, u32 buffer)
+{
+  // The generic binding changes too, and the caller may use it next
+  u32 *indexed = IndexedBuffer(target, index);
+  u32 *generic = GenericBuffer(target);
+  if (indexed && *indexed == buffer && generic && *generic == buffer)
+  {
+    s_stats.skipped_++;
+    return;
+  }
+
+  if (indexed)
+    *indexed = buffer;
+  if (generic)
+    *generic = buffer;
+  s_stats.issued_++;
+
+  glBindBufferBase(target, index, buffer);
+}
+
+void GLState::BindBufferRange(u32 target, u32 index, u32 buffer, size_t offset, size_t size)
+{
+  // Ranges are not compared, the next bind of the index always reaches the driver
+  u32 *indexed = IndexedBuffer(target, index);
+  if (indexed)
+    *indexed = k_unknown;
+
+  u32 *generic = GenericBuffer(target);
+  if (generic)
+    *generic = buffer;
+  s_stats.issued_++;
+
+  glBindBufferRange(target, index, buffer, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+}
+
+void GLState::BindFramebuffer(u32 target, u32 framebuffer)
+{
+  if (target == GL_FRAMEBUFFER)
+  {
+    if (s_state.draw_framebuffer_ == framebuffer && s_state.read_framebuffer_ == framebuffer)
+    {
+      s_stats.skipped_++;
+      return;
+    }
+
+    s_state.draw_framebuffer_ = framebuffer;
+    s_state.read_framebuffer_ = framebuffer;
+    s_stats.issued_++;
+    glBindFramebuffer(target, framebuffer);
+    return;
+  }
+
+  u32 *tracked = nullptr;
+  if (target == GL_DRAW_FRAMEBUFFER)
+    tracked = &s_state.draw_framebuffer_;
+  else if (target == GL_READ_FRAMEBUFFER)
+    tracked = &s_state.read_framebuffer_;
+
+  if (!tracked || Changed(*tracked, framebuffer))
+    glBindFramebuffer(target, framebuffer);
+}
+
+void GLState::SetCapability(u32 capability, boolean enabled)
+{
+  u32 index = Find(capabilities, k_capabilities, capability);
+  if (index != k_unknown && !Changed(s_state.capabilities_[index], enabled ? 1u : 0u))
+    return;
+
+  if (enabled)
+    glEnable(capability);
+  else
+    glDisable(capability);
+}
+
+void GLState::CullFace(u32 mode)
+{
+  if (Changed(s_state.cull_face_, mode))
+    glCullFace(mode);
+}
+
+void GLState::FrontFace(u32 mode)
+{
+  if (Changed(s_state.front_face_, mode))
+    glFrontFace(mode);
+}
+
+void GLState::DepthFunc(u32 func)
+{
+  if (Changed(s_state.depth_func_, func))
+    glDepthFunc(func);
+}
+
+void GLState::DepthMask(boolean write)
+{
+  if (Changed(s_state.depth_mask_, write ? 1u : 0u))
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLState::BlendFunc(u32 source, u32 destination)
+{
+  if (s_state.blend_src_ == source && s_state.blend_dst_ == destination)
+  {
+    s_stats.skipped_++;
+    return;
+  }
+
+  s_state.blend_src_ = source;
+  s_state.blend_dst_ = destination;
+  s_stats.issued_++;
+  glBlendFunc(source, destination);
+}
+
+void GLState::DeleteProgram(u32 program)
+{
+  glDeleteProgram(program);
+  Forget(&s_state.program_, 1, &program, 1);
+}
+
+void GLState::DeleteBuffers(s32 count, const u32 *buffers)
+{
+  glDeleteBuffers(count, buffers);
+
+  Forget(s_state.buffers_, k_buffer_targets, buffers, count);
+  Forget(s_state.storage_buffers_, k_buffer_bindings, buffers, count);
+  Forget(s_state.uniform_buffers_, k_buffer_bindings, buffers, count);
+}
+
+void GLState::DeleteVertexArrays(s32 count, const u32 *arrays)
+{
+  glDeleteVertexArrays(count, arrays);
+  Forget(&s_state.vertex_array_, 1, arrays, count);
+}
+
+void GLState::DeleteTextures(s32 count, const u32 *textures)
+{
+  glDeleteTextures(count, textures);
+  Forget(&s_state.textures_[0][0], k_texture_units * k_texture_targets, textures, count);
+}
+
+void GLState::DeleteSamplers(s32 count, const u32 *samplers)
+{
+  glDeleteSamplers(count, samplers);
+  Forget(s_state.samplers_, k_texture_units, samplers, count);
+}
+
+void GLState::DeleteFramebuffers(s32 count, const u32 *framebuffers)
+{
+  glDeleteFramebuffers(count, framebuffers);
+  Forget(&s_state.draw_framebuffer_, 1, framebuffers, count);
+  Forget(&s_state.read_framebuffer_, 1, framebuffers, count);
+}
+
+u32 GLState::GetBoundBuffer(u32 target, u32 index)
+{
+  u32 *indexed = IndexedBuffer(target, index);
+  return indexed ? *indexed : k_unknown;
+}
+
+GLState::Stats GLState::GetStats() { return s_stats; }
+
+void GLState::ResetStats() { s_stats = Stats(); }
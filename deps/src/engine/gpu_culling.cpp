@@ -0,0 +1,599 @@
+#include <engine/gpu_culling.h>
+#include <engine/gl_state.h>
+#include <engine/jam_engine.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+// Buffers
+///////////////////////////////////////////////////////////////////////////////
+const u32 k_instance_buffer = 0;
+const u32 k_command_buffer = 1;
+const u32 k_culled_buffer = 2;
+const u32 k_draw_buffer = 3;
+const u32 k_count_buffer = 4;
+const u32 k_buffer_count = 5;
+
+// Size of InstanceData in the vertex prelude (std430)
+const size_t k_instance_data_size = 80;
+
+// Only bound by the compute programs, the draws use the lower units
+const u32 k_pyramid_texture_unit = 31;
+
+const u32 k_cull_group_size = 64;
+const u32 k_pyramid_group_size = 8;
+
+static_assert(sizeof(GPUCulling::Instance) == 48, "Instance must match the std430 layout");
+static_assert(sizeof(GPUCulling::Command) == 32, "Command must match the std430 layout");
+///////////////////////////////////////////////////////////////////////////////
+
+// Compute shaders
+///////////////////////////////////////////////////////////////////////////////
+static const std::string cull_structs = R"(
+  struct CullInstance
+  {
+    vec3 min_;
+    uint command_;
+    vec3 max_;
+    uint source_;
+    uint always_visible_;
+    uint padding_0_;
+    uint padding_1_;
+    uint padding_2_;
+  };
+
+  struct CullCommand
+  {
+    uint count_;
+    uint instance_count_;
+    uint first_index_;
+    int base_vertex_;
+    uint base_instance_;
+    uint bucket_;
+    uint bucket_first_;
+    uint padding_;
+  };
+
+  struct InstanceData
+  {
+    mat4 m_matrix;
+    uint entity_id;
+  };
+)";
+
+static const std::string cull_source = R"(
+  layout(local_size_x = 64) in;
+
+  layout(std430, binding = CULL_INSTANCE_BIND) readonly buffer Cull_Instances
+  {
+    CullInstance cull_instances[];
+  };
+
+  layout(std430, binding = CULL_COMMAND_BIND) buffer Cull_Commands
+  {
+    CullCommand cull_commands[];
+  };
+
+  layout(std430, binding = INSTANCE_BIND) readonly buffer Instance_Data
+  {
+    InstanceData instances[];
+  };
+
+  layout(std430, binding = CULLED_INSTANCE_BIND) writeonly buffer Culled_Instances
+  {
+    InstanceData culled_instances[];
+  };
+
+  uniform uint u_count;
+  uniform mat4 u_view_projection;
+  uniform mat4 u_pyramid_view_projection;
+  uniform uint u_pyramid_levels;
+  uniform ivec2 u_pyramid_size;
+  uniform sampler2D u_pyramid;
+
+  vec3 Corner(vec3 min_corner, vec3 max_corner, int index)
+  {
+    return vec3((index & 1) != 0 ? max_corner.x : min_corner.x,
+                (index & 2) != 0 ? max_corner.y : min_corner.y,
+                (index & 4) != 0 ? max_corner.z : min_corner.z);
+  }
+
+  // Outside if every corner is outside the same clip plane
+  bool InFrustum(vec3 min_corner, vec3 max_corner)
+  {
+    uint outside = 0x3Fu;
+    for (int i = 0; i < 8; i++)
+    {
+      vec4 clip = u_view_projection * vec4(Corner(min_corner, max_corner, i), 1.0);
+      uint planes = 0u;
+      planes |= (clip.x < -clip.w) ? 0x01u : 0u;
+      planes |= (clip.x >  clip.w) ? 0x02u : 0u;
+      planes |= (clip.y < -clip.w) ? 0x04u : 0u;
+      planes |= (clip.y >  clip.w) ? 0x08u : 0u;
+      planes |= (clip.z < -clip.w) ? 0x10u : 0u;
+      planes |= (clip.z >  clip.w) ? 0x20u : 0u;
+      outside &= planes;
+    }
+    return outside == 0u;
+  }
+
+  // Hidden if the closest point of the bounds is behind the farthest depth
+  // of every texel they cover, read at the level where they cover 2x2 texels
+  bool IsOccluded(vec3 min_corner, vec3 max_corner)
+  {
+    if (u_pyramid_levels == 0u)
+      return false;
+
+    vec3 ndc_min = vec3(1.0);
+    vec3 ndc_max = vec3(-1.0);
+    for (int i = 0; i < 8; i++)
+    {
+      vec4 clip = u_pyramid_view_projection * vec4(Corner(min_corner, max_corner, i), 1.0);
+      if (clip.w <= 0.0)
+        return false;
+
+      vec3 ndc = clip.xyz / clip.w;
+      ndc_min = min(ndc_min, ndc);
+      ndc_max = max(ndc_max, ndc);
+    }
+
+    vec2 uv_min = clamp(ndc_min.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uv_max = clamp(ndc_max.xy * 0.5 + 0.5, 0.0, 1.0);
+    float depth = ndc_min.z * 0.5 + 0.5;
+
+    vec2 extent = (uv_max - uv_min) * vec2(u_pyramid_size);
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, int(u_pyramid_levels) - 1);
+    ivec2 size = max(u_pyramid_size >> level, ivec2(1));
+
+    ivec2 a = clamp(ivec2(uv_min * vec2(size)), ivec2(0), size - 1);
+    ivec2 b = clamp(ivec2(uv_max * vec2(size)), ivec2(0), size - 1);
+    float farthest = max(max(texelFetch(u_pyramid, a, level).r, texelFetch(u_pyramid, ivec2(b.x, a.y), level).r),
+                         max(texelFetch(u_pyramid, ivec2(a.x, b.y), level).r, texelFetch(u_pyramid, b, level).r));
+
+    return depth > farthest;
+  }
+
+  void main()
+  {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= u_count)
+      return;
+
+    CullInstance item = cull_instances[index];
+    if (item.always_visible_ == 0u && (!InFrustum(item.min_, item.max_) || IsOccluded(item.min_, item.max_)))
+      return;
+
+    uint slot = atomicAdd(cull_commands[item.command_].instance_count_, 1u);
+    culled_instances[cull_commands[item.command_].base_instance_ + slot] = instances[item.source_];
+  }
+)";
+
+static const std::string compact_source = R"(
+  layout(local_size_x = 64) in;
+
+  layout(std430, binding = CULL_COMMAND_BIND) readonly buffer Cull_Commands
+  {
+    CullCommand cull_commands[];
+  };
+
+  // DrawElementsIndirectCommand, five words without padding
+  layout(std430, binding = CULL_DRAW_COMMAND_BIND) writeonly buffer Draw_Commands
+  {
+    uint draw_commands[];
+  };
+
+  layout(std430, binding = CULL_DRAW_COUNT_BIND) buffer Draw_Counts
+  {
+    uint draw_counts[];
+  };
+
+  uniform uint u_count;
+
+  void main()
+  {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= u_count)
+      return;
+
+    CullCommand command = cull_commands[index];
+    if (command.instance_count_ == 0u)
+      return;
+
+    uint slot = atomicAdd(draw_counts[command.bucket_], 1u);
+    uint offset = (command.bucket_first_ + slot) * 5u;
+    draw_commands[offset + 0u] = command.count_;
+    draw_commands[offset + 1u] = command.instance_count_;
+    draw_commands[offset + 2u] = command.first_index_;
+    draw_commands[offset + 3u] = uint(command.base_vertex_);
+    draw_commands[offset + 4u] = command.base_instance_;
+  }
+)";
+
+static const std::string downsample_source = R"(
+  layout(local_size_x = 8, local_size_y = 8) in;
+
+  layout(r32f, binding = 0) uniform writeonly image2D u_destination;
+  uniform sampler2D u_source;
+  uniform int u_source_level;
+  uniform ivec2 u_source_size;
+  uniform ivec2 u_destination_size;
+  uniform uint u_copy;
+
+  void main()
+  {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, u_destination_size)))
+      return;
+
+    if (u_copy != 0u)
+    {
+      imageStore(u_destination, texel, vec4(texelFetch(u_source, texel, 0).r));
+      return;
+    }
+
+    // The last texel of an odd level also takes the column or row left over
+    ivec2 first = texel * 2;
+    ivec2 last = first + ivec2(1) + ivec2(equal(texel, u_destination_size - 1)) * (u_source_size & 1);
+    last = min(last, u_source_size - 1);
+
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+      for (int x = first.x; x <= last.x; x++)
+        farthest = max(farthest, texelFetch(u_source, ivec2(x, y), u_source_level).r);
+
+    imageStore(u_destination, texel, vec4(farthest));
+  }
+)";
+///////////////////////////////////////////////////////////////////////////////
+
+// Helpers
+///////////////////////////////////////////////////////////////////////////////
+static u32 CreateComputeProgram(const std::string &source)
+{
+  std::string full_source = "#version 430 core\n" + binds + cull_structs + source;
+  u32 shader = GPU->CompileShader(GL_COMPUTE_SHADER, full_source.c_str());
+
+  s32 compiled = 0;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+  if (!compiled)
+  {
+    glDeleteShader(shader);
+    return 0;
+  }
+
+  u32 program = glCreateProgram();
+  glAttachShader(program, shader);
+  glLinkProgram(program);
+  glDeleteShader(shader);
+
+  s32 linked = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (!linked)
+  {
+    byte log[512];
+    glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+    JAM_Engine::AddError(log, __func__, std::to_string(__LINE__));
+
+    glDeleteProgram(program);
+    return 0;
+  }
+
+  return program;
+}
+
+static u32 GroupCount(u32 count, u32 group_size) { return (count + group_size - 1) / group_size; }
+///////////////////////////////////////////////////////////////////////////////
+
+GPUCulling::GPUCulling()
+    : cull_program_(0), compact_program_(0), downsample_program_(0), failed_(false), draw_count_(false), depth_texture_(0), depth_framebuffer_(0), depth_format_(0),
+      pyramid_texture_(0), pyramid_width_(0), pyramid_height_(0), pyramid_levels_(0)
+{
+  memset(buffers_, 0, sizeof(buffers_));
+  memset(buffer_capacity_, 0, sizeof(buffer_capacity_));
+}
+
+GPUCulling::~GPUCulling() {}
+
+boolean GPUCulling::init()
+{
+  if (cull_program_ != 0)
+    return true;
+
+  if (failed_)
+    return false;
+
+  s32 major = 0, minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  if (major < 4 || (major == 4 && minor < 3))
+  {
+    failed_ = true;
+    return false;
+  }
+  draw_count_ = major > 4 || minor >= 6;
+
+  cull_program_ = CreateComputeProgram(cull_source);
+  compact_program_ = CreateComputeProgram(compact_source);
+  downsample_program_ = CreateComputeProgram(downsample_source);
+
+  if (cull_program_ == 0 || compact_program_ == 0 || downsample_program_ == 0)
+  {
+    free();
+    failed_ = true;
+    return false;
+  }
+
+  glGenBuffers(k_buffer_count, buffers_);
+
+  return true;
+}
+
+void GPUCulling::free()
+{
+  u32 programs[3] = {cull_program_, compact_program_, downsample_program_};
+  for (u32 program : programs)
+    if (program != 0)
+      GLState::DeleteProgram(program);
+
+  for (u32 buffer : buffers_)
+    if (buffer != 0)
+      GLState::DeleteBuffers(1, &buffer);
+
+  if (depth_texture_ != 0)
+    GLState::DeleteTextures(1, &depth_texture_);
+  if (depth_framebuffer_ != 0)
+    GLState::DeleteFramebuffers(1, &depth_framebuffer_);
+  if (pyramid_texture_ != 0)
+    GLState::DeleteTextures(1, &pyramid_texture_);
+
+  cull_program_ = compact_program_ = downsample_program_ = 0;
+  memset(buffers_, 0, sizeof(buffers_));
+  memset(buffer_capacity_, 0, sizeof(buffer_capacity_));
+  instance_slice_ = command_slice_ = RingBuffer::Slice();
+  depth_texture_ = depth_framebuffer_ = pyramid_texture_ = 0;
+  depth_format_ = 0;
+  pyramid_width_ = pyramid_height_ = pyramid_levels_ = 0;
+  failed_ = false;
+}
+
+void GPUCulling::upload(u32 index, const void *data, size_t size)
+{
+  // Orphan the old storage so the driver does not wait for the last frame
+  GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, buffers_[index]);
+  if (size > buffer_capacity_[index])
+    buffer_capacity_[index] = size;
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(buffer_capacity_[index]), nullptr, GL_STREAM_DRAW);
+  if (data && size > 0)
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, static_cast<GLsizeiptr>(size), data);
+  GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GPUCulling::cull(const std::vector<Instance> &instances, const std::vector<Command> &commands, u32 bucket_count, u32 output_count,
+                      const Math::Mat4 &view_projection)
+{
+  if (!init() || instances.empty())
+    return;
+
+  u32 instance_count = static_cast<u32>(instances.size());
+  u32 command_count = static_cast<u32>(commands.size());
+
+  // The inputs written by the CPU go to the ring, the GPU writes the rest
+  if (!RingBuffer::Upload(instances.data(), static_cast<u32>(sizeof(Instance) * instance_count), instance_slice_) ||
+      !RingBuffer::Upload(commands.data(), static_cast<u32>(sizeof(Command) * command_count), command_slice_))
+  {
+    instance_slice_ = command_slice_ = RingBuffer::Slice();
+    upload(k_instance_buffer, instances.data(), sizeof(Instance) * instance_count);
+    upload(k_command_buffer, commands.data(), sizeof(Command) * command_count);
+  }
+  upload(k_culled_buffer, nullptr, k_instance_data_size * output_count);
+  upload(k_draw_buffer, nullptr, sizeof(u32) * 5 * command_count);
+
+  // Every bucket starts with no commands
+  GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, buffers_[k_count_buffer]);
+  if (sizeof(u32) * bucket_count > buffer_capacity_[k_count_buffer])
+    buffer_capacity_[k_count_buffer] = sizeof(u32) * bucket_count;
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(buffer_capacity_[k_count_buffer]), nullptr, GL_STREAM_DRAW);
+  u32 zero = 0;
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+  GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  if (instance_slice_.buffer_ != 0)
+  {
+    RingBuffer::BindRange(GL_SHADER_STORAGE_BUFFER, CULL_INSTANCE_BIND, instance_slice_);
+    RingBuffer::BindRange(GL_SHADER_STORAGE_BUFFER, CULL_COMMAND_BIND, command_slice_);
+  }
+  else
+  {
+    GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_INSTANCE_BIND, buffers_[k_instance_buffer]);
+    GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMMAND_BIND, buffers_[k_command_buffer]);
+  }
+  GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULLED_INSTANCE_BIND, buffers_[k_culled_buffer]);
+  GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_DRAW_COMMAND_BIND, buffers_[k_draw_buffer]);
+  GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_DRAW_COUNT_BIND, buffers_[k_count_buffer]);
+
+  GLState::BindTexture(k_pyramid_texture_unit, GL_TEXTURE_2D, pyramid_texture_);
+
+  GLState::UseProgram(cull_program_);
+  glUniform1ui(glGetUniformLocation(cull_program_, "u_count"), instance_count);
+  glUniformMatrix4fv(glGetUniformLocation(cull_program_, "u_view_projection"), 1, GL_FALSE, view_projection.m);
+  glUniformMatrix4fv(glGetUniformLocation(cull_program_, "u_pyramid_view_projection"), 1, GL_FALSE, pyramid_view_projection_.m);
+  glUniform1ui(glGetUniformLocation(cull_program_, "u_pyramid_levels"), pyramid_levels_);
+  glUniform2i(glGetUniformLocation(cull_program_, "u_pyramid_size"), static_cast<s32>(pyramid_width_), static_cast<s32>(pyramid_height_));
+  glUniform1i(glGetUniformLocation(cull_program_, "u_pyramid"), static_cast<s32>(k_pyramid_texture_unit));
+  glDispatchCompute(GroupCount(instance_count, k_cull_group_size), 1, 1);
+
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  if (draw_count_)
+  {
+    GLState::UseProgram(compact_program_);
+    glUniform1ui(glGetUniformLocation(compact_program_, "u_count"), command_count);
+    glDispatchCompute(GroupCount(command_count, k_cull_group_size), 1, 1);
+  }
+
+  // The draws read the commands, the counts and the compacted instances
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void GPUCulling::draw(u32 mode, u32 bucket, u32 first_command, u32 command_count) const
+{
+  if (cull_program_ == 0)
+    return;
+
+  GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BIND, buffers_[k_culled_buffer]);
+
+  if (draw_count_)
+  {
+    GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers_[k_draw_buffer]);
+    GLState::BindBuffer(GL_PARAMETER_BUFFER, buffers_[k_count_buffer]);
+    glMultiDrawElementsIndirectCount(mode, GL_UNSIGNED_INT, reinterpret_cast<const void *>(sizeof(u32) * 5 * first_command),
+                                     static_cast<GLintptr>(sizeof(u32) * bucket), static_cast<GLsizei>(command_count), 0);
+    GLState::BindBuffer(GL_PARAMETER_BUFFER, 0);
+  }
+  else
+  {
+    // The cull commands start with a DrawElementsIndirectCommand
+    size_t offset = sizeof(Command) * first_command;
+    if (command_slice_.buffer_ != 0)
+    {
+      GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, command_slice_.buffer_);
+      offset += command_slice_.offset_;
+    }
+    else
+      GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers_[k_command_buffer]);
+    glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, reinterpret_cast<const void *>(offset),
+                                static_cast<GLsizei>(command_count), sizeof(Command));
+  }
+}
+
+void GPUCulling::resizePyramid(u32 width, u32 height, s32 format)
+{
+  if (width == pyramid_width_ && height == pyramid_height_ && format == depth_format_ && pyramid_texture_ != 0)
+    return;
+
+  if (depth_texture_ != 0)
+    GLState::DeleteTextures(1, &depth_texture_);
+  if (pyramid_texture_ != 0)
+    GLState::DeleteTextures(1, &pyramid_texture_);
+  if (depth_framebuffer_ == 0)
+    glGenFramebuffers(1, &depth_framebuffer_);
+
+  // Same format as the attachment, so it can be blitted
+  glGenTextures(1, &depth_texture_);
+  GLState::BindTexture(k_pyramid_texture_unit, GL_TEXTURE_2D, depth_texture_);
+  glTexStorage2D(GL_TEXTURE_2D, 1, static_cast<GLenum>(format), static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  u32 levels = 1;
+  while ((width >> levels) > 0 || (height >> levels) > 0)
+    levels++;
+
+  glGenTextures(1, &pyramid_texture_);
+  GLState::BindTexture(k_pyramid_texture_unit, GL_TEXTURE_2D, pyramid_texture_);
+  glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(levels), GL_R32F, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  s32 draw_framebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_framebuffer);
+  GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, depth_framebuffer_);
+  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture_, 0);
+  GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<u32>(draw_framebuffer));
+
+  pyramid_width_ = width;
+  pyramid_height_ = height;
+  depth_format_ = format;
+  // Nothing to test against until it is built
+  pyramid_levels_ = 0;
+}
+
+void GPUCulling::buildPyramid(const Math::Mat4 &view_projection)
+{
+  if (cull_program_ == 0)
+    return;
+
+  s32 framebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+  if (framebuffer == 0)
+  {
+    pyramid_levels_ = 0;
+    return;
+  }
+
+  // The attachment may be a texture or a renderbuffer, the copy works for both
+  s32 type = GL_NONE;
+  s32 name = 0;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &name);
+
+  s32 width = 0, height = 0, format = 0;
+  if (type == GL_TEXTURE)
+  {
+    s32 level = 0;
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_TEXTURE_LEVEL, &level);
+    glGetTextureLevelParameteriv(static_cast<u32>(name), level, GL_TEXTURE_WIDTH, &width);
+    glGetTextureLevelParameteriv(static_cast<u32>(name), level, GL_TEXTURE_HEIGHT, &height);
+    glGetTextureLevelParameteriv(static_cast<u32>(name), level, GL_TEXTURE_INTERNAL_FORMAT, &format);
+  }
+  else if (type == GL_RENDERBUFFER)
+  {
+    glGetNamedRenderbufferParameteriv(static_cast<u32>(name), GL_RENDERBUFFER_WIDTH, &width);
+    glGetNamedRenderbufferParameteriv(static_cast<u32>(name), GL_RENDERBUFFER_HEIGHT, &height);
+    glGetNamedRenderbufferParameteriv(static_cast<u32>(name), GL_RENDERBUFFER_INTERNAL_FORMAT, &format);
+  }
+
+  if (width <= 0 || height <= 0 || format == 0)
+  {
+    pyramid_levels_ = 0;
+    return;
+  }
+
+  u32 pyramid_width = static_cast<u32>(width);
+  u32 pyramid_height = static_cast<u32>(height);
+  resizePyramid(pyramid_width, pyramid_height, format);
+
+  // Copy the depth, multisampled attachments are resolved by the blit
+  s32 read_framebuffer = 0;
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+  GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<u32>(framebuffer));
+  GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, depth_framebuffer_);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<u32>(read_framebuffer));
+  GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<u32>(framebuffer));
+
+  GLState::UseProgram(downsample_program_);
+  glUniform1i(glGetUniformLocation(downsample_program_, "u_source"), static_cast<s32>(k_pyramid_texture_unit));
+
+  u32 levels = 1;
+  while ((pyramid_width >> levels) > 0 || (pyramid_height >> levels) > 0)
+    levels++;
+
+  // Level 0 is the depth itself, every next level the farthest of the last one
+  for (u32 level = 0; level < levels; level++)
+  {
+    u32 source_width = level == 0 ? pyramid_width : std::max(pyramid_width >> (level - 1), 1u);
+    u32 source_height = level == 0 ? pyramid_height : std::max(pyramid_height >> (level - 1), 1u);
+    u32 width_level = std::max(pyramid_width >> level, 1u);
+    u32 height_level = std::max(pyramid_height >> level, 1u);
+
+    GLState::BindTexture(k_pyramid_texture_unit, GL_TEXTURE_2D, level == 0 ? depth_texture_ : pyramid_texture_);
+    glBindImageTexture(0, pyramid_texture_, static_cast<s32>(level), GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+    glUniform1ui(glGetUniformLocation(downsample_program_, "u_copy"), level == 0 ? 1u : 0u);
+    glUniform1i(glGetUniformLocation(downsample_program_, "u_source_level"), level == 0 ? 0 : static_cast<s32>(level - 1));
+    glUniform2i(glGetUniformLocation(downsample_program_, "u_source_size"), static_cast<s32>(source_width), static_cast<s32>(source_height));
+    glUniform2i(glGetUniformLocation(downsample_program_, "u_destination_size"), static_cast<s32>(width_level), static_cast<s32>(height_level));
+    glDispatchCompute(GroupCount(width_level, k_pyramid_group_size), GroupCount(height_level, k_pyramid_group_size), 1);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
+
+  glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+  pyramid_levels_ = levels;
+  pyramid_view_projection_ = view_projection;
+}
+
+u32 GPUCulling::pyramidLevels() const { return pyramid_levels_; }
@@ -0,0 +1,192 @@
+#include <engine/gl_state.h>
+#include <engine/jam_engine.h>
+#include <engine/mesh_pool.h>
+
+#include <cstddef>
+#include <vector>
+
+// First allocation, it doubles when it's full
+const u32 k_min_vertices = 65536;
+const u32 k_min_indices = 196608;
+
+// Creates a buffer of the new size with the content of the old one. Named
+// calls, so no binding is touched
+static u32 GrowBuffer(u32 old_buffer, size_t old_size, size_t new_size)
+{
+  u32 buffer;
+  glCreateBuffers(1, &buffer);
+  glNamedBufferData(buffer, static_cast<GLsizeiptr>(new_size), nullptr, GL_STATIC_DRAW);
+
+  if (old_buffer != 0)
+  {
+    if (old_size > 0)
+      glCopyNamedBufferSubData(old_buffer, buffer, 0, 0, static_cast<GLsizeiptr>(old_size));
+    GLState::DeleteBuffers(1, &old_buffer);
+  }
+
+  return buffer;
+}
+
+MeshPool::MeshPool() : VAO(0), VBO(0), EBO(0), SSBO(0), vertices_size_(0), vertices_capacity_(0), indices_size_(0), indices_capacity_(0) {}
+
+MeshPool::~MeshPool() {}
+
+void MeshPool::free()
+{
+  if (VAO != 0)
+    GLState::DeleteVertexArrays(1, &VAO);
+
+  u32 buffers[3] = {VBO, EBO, SSBO};
+  for (u32 buffer : buffers)
+    if (buffer != 0)
+      GLState::DeleteBuffers(1, &buffer);
+
+  VAO = VBO = EBO = SSBO = 0;
+  vertices_size_ = vertices_capacity_ = 0;
+  indices_size_ = indices_capacity_ = 0;
+
+  ranges_.clear();
+  texture_sets_.clear();
+  texture_set_ids_.clear();
+}
+
+const MeshPool::Range *MeshPool::add(const Mesh *mesh)
+{
+  if (!mesh)
+    return nullptr;
+
+  // Same pointer and same vertices, it's the same mesh. A new mesh in the
+  // memory of a freed one is added again
+  auto it = ranges_.find(mesh);
+  if (it != ranges_.end() && it->second.vertices_ == mesh->vertices_)
+    return &it->second;
+
+  if (!mesh->has_mesh_ || !mesh->vertices_ || !mesh->indices_ || mesh->vertices_size_ == 0 || mesh->indices_size_ == 0)
+    return nullptr;
+
+  reserve(vertices_size_ + mesh->vertices_size_, indices_size_ + mesh->indices_size_);
+
+  glNamedBufferSubData(VBO, static_cast<GLintptr>(sizeof(Vertex) * vertices_size_),
+                       static_cast<GLsizeiptr>(sizeof(Vertex) * mesh->vertices_size_), mesh->vertices_);
+
+  // Materials are read with gl_VertexID, that includes the base vertex
+  if (mesh->vertices_material_)
+  {
+    glNamedBufferSubData(SSBO, static_cast<GLintptr>(sizeof(VertexMaterial) * vertices_size_),
+                         static_cast<GLsizeiptr>(sizeof(VertexMaterial) * mesh->vertices_size_), mesh->vertices_material_);
+  }
+  else
+  {
+    std::vector<VertexMaterial> materials(mesh->vertices_size_);
+    glNamedBufferSubData(SSBO, static_cast<GLintptr>(sizeof(VertexMaterial) * vertices_size_),
+                         static_cast<GLsizeiptr>(sizeof(VertexMaterial) * mesh->vertices_size_), materials.data());
+  }
+
+  glNamedBufferSubData(EBO, static_cast<GLintptr>(sizeof(u32) * indices_size_),
+                       static_cast<GLsizeiptr>(sizeof(u32) * mesh->indices_size_), mesh->indices_);
+
+  Range range;
+  range.first_index_ = indices_size_;
+  range.index_count_ = mesh->indices_size_;
+  range.base_vertex_ = static_cast<s32>(vertices_size_);
+  range.vertices_ = mesh->vertices_;
+
+  vertices_size_ += mesh->vertices_size_;
+  indices_size_ += mesh->indices_size_;
+
+  ranges_[mesh] = range;
+
+  return &ranges_[mesh];
+}
+
+const MeshPool::Range *MeshPool::find(const Mesh *mesh) const
+{
+  auto it = ranges_.find(mesh);
+  if (it == ranges_.end() || it->second.vertices_ != mesh->vertices_)
+    return nullptr;
+
+  return &it->second;
+}
+
+u32 MeshPool::textureSet(const Mesh *mesh)
+{
+  // The texture ids are set when the mesh buffers are created
+  if (!mesh || mesh->VAO == UINT32_MAX)
+    return 0;
+
+  auto it = texture_sets_.find(mesh);
+  if (it != texture_sets_.end())
+    return it->second;
+
+  std::array<u32, 13> textures;
+  for (u32 i = 0; i < 13; i++)
+    textures[i] = mesh->texture_ids_[i];
+
+  auto set = texture_set_ids_.find(textures);
+  u32 index = (set != texture_set_ids_.end()) ? set->second : static_cast<u32>(texture_set_ids_.size() + 1);
+  if (set == texture_set_ids_.end())
+    texture_set_ids_.insert(std::make_pair(textures, index));
+
+  texture_sets_.insert(std::make_pair(mesh, index));
+
+  return index;
+}
+
+void MeshPool::bind() const { GLState::BindVertexArray(VAO); }
+
+u32 MeshPool::materials() const { return SSBO; }
+
+u32 MeshPool::verticesSize() const { return vertices_size_; }
+
+u32 MeshPool::indicesSize() const { return indices_size_; }
+
+void MeshPool::reserve(u32 vertices, u32 indices)
+{
+  boolean changed = false;
+
+  if (vertices > vertices_capacity_)
+  {
+    u32 capacity = (vertices_capacity_ == 0) ? k_min_vertices : vertices_capacity_ * 2;
+    capacity = (capacity < vertices) ? vertices : capacity;
+
+    VBO = GrowBuffer(VBO, sizeof(Vertex) * vertices_size_, sizeof(Vertex) * capacity);
+    SSBO = GrowBuffer(SSBO, sizeof(VertexMaterial) * vertices_size_, sizeof(VertexMaterial) * capacity);
+    vertices_capacity_ = capacity;
+    changed = true;
+  }
+
+  if (indices > indices_capacity_)
+  {
+    u32 capacity = (indices_capacity_ == 0) ? k_min_indices : indices_capacity_ * 2;
+    capacity = (capacity < indices) ? indices : capacity;
+
+    EBO = GrowBuffer(EBO, sizeof(u32) * indices_size_, sizeof(u32) * capacity);
+    indices_capacity_ = capacity;
+    changed = true;
+  }
+
+  if (changed)
+    setupVertexArray();
+}
+
+void MeshPool::setupVertexArray()
+{
+  // Named calls, the bound vertex array and buffers stay as they are
+  if (VAO == 0)
+  {
+    glCreateVertexArrays(1, &VAO);
+
+    const u32 sizes[3] = {3, 3, 2};
+    const u32 offsets[3] = {offsetof(Vertex, position_), offsetof(Vertex, normal_), offsetof(Vertex, texCoords_)};
+    for (u32 i = 0; i < 3; i++)
+    {
+      glEnableVertexArrayAttrib(VAO, i);
+      glVertexArrayAttribFormat(VAO, i, static_cast<GLint>(sizes[i]), GL_FLOAT, GL_FALSE, offsets[i]);
+      glVertexArrayAttribBinding(VAO, i, 0);
+    }
+  }
+
+  // Grown buffers are new names
+  glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(Vertex));
+  glVertexArrayElementBuffer(VAO, EBO);
+}
@@ -0,0 +1,456 @@
+#include <engine/filemanager.h>
+#include <engine/meshlets.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <string>
+
+// File header
+const char k_meshlets_magic[4] = {'J', 'M', 'L', 'T'};
+const u32 k_meshlets_version = 1;
+
+// Cache file next to the mesh
+const char k_cache_extension[] = ".meshlets";
+
+// Below this the normals are too spread for the cone to cull anything
+const f32 k_min_cone_spread = 0.1f;
+
+// Clusters under this fraction of the limit take loose triangles too
+const u32 k_loose_fraction = 4;
+
+static_assert(sizeof(Meshlets::Meshlet) == 40, "Meshlet is saved as it is in memory");
+
+template <typename T>
+static void Append(std::string &data, const T &value) { data.append(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+template <typename T>
+static boolean Read(const std::string &data, size_t &offset, T &value)
+{
+  if (offset + sizeof(T) > data.size())
+    return false;
+
+  memcpy(&value, data.data() + offset, sizeof(T));
+  offset += sizeof(T);
+
+  return true;
+}
+
+// Spreads the low 10 bits so three of them can be interleaved
+static u32 SpreadBits(u32 v)
+{
+  v = (v | (v << 16)) & 0x030000FF;
+  v = (v | (v << 8)) & 0x0300F00F;
+  v = (v | (v << 4)) & 0x030C30C3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+static u32 MortonCode(Math::Vec3 p, const Math::AABB &box)
+{
+  Math::Vec3 size = box.Size();
+  f32 x = (size.x > 0.0f) ? (p.x - box.min.x) / size.x : 0.0f;
+  f32 y = (size.y > 0.0f) ? (p.y - box.min.y) / size.y : 0.0f;
+  f32 z = (size.z > 0.0f) ? (p.z - box.min.z) / size.z : 0.0f;
+
+  u32 ix = static_cast<u32>(std::clamp(x * 1023.0f, 0.0f, 1023.0f));
+  u32 iy = static_cast<u32>(std::clamp(y * 1023.0f, 0.0f, 1023.0f));
+  u32 iz = static_cast<u32>(std::clamp(z * 1023.0f, 0.0f, 1023.0f));
+
+  return (SpreadBits(ix) << 2) | (SpreadBits(iy) << 1) | SpreadBits(iz);
+}
+
+// Same value for any order of the triangles, so the cache can tell if it
+// was saved from the same mesh after the indices were reordered
+static u64 TrianglesHash(const u32 *indices, u32 index_count)
+{
+  u64 hash = 0;
+  for (u32 i = 0; i + 2 < index_count; i += 3)
+  {
+    u32 t[3] = {indices[i], indices[i + 1], indices[i + 2]};
+    std::sort(t, t + 3);
+
+    u64 h = (t[0] * 0x9E3779B97F4A7C15ull) ^ (t[1] * 0xC2B2AE3D27D4EB4Full) ^ (t[2] * 0x165667B19E3779F9ull);
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+    hash += h;
+  }
+
+  return hash;
+}
+
+static Math::Vec3 TransformPoint(const f32 *f, Math::Vec3 p)
+{
+  return Math::Vec3((f[0] * p.x) + (f[4] * p.y) + (f[8] * p.z) + f[12],
+                    (f[1] * p.x) + (f[5] * p.y) + (f[9] * p.z) + f[13],
+                    (f[2] * p.x) + (f[6] * p.y) + (f[10] * p.z) + f[14]);
+}
+
+static Math::Vec3 TransformDirection(const f32 *f, Math::Vec3 d)
+{
+  return Math::Vec3((f[0] * d.x) + (f[4] * d.y) + (f[8] * d.z),
+                    (f[1] * d.x) + (f[5] * d.y) + (f[9] * d.z),
+                    (f[2] * d.x) + (f[6] * d.y) + (f[10] * d.z));
+}
+
+Meshlets::Meshlets() : mesh_(nullptr) {}
+
+Meshlets::~Meshlets() {}
+
+void Meshlets::free()
+{
+  mesh_ = nullptr;
+  meshlets_.clear();
+}
+
+void Meshlets::computeBounds(const Mesh *mesh, Meshlet &meshlet)
+{
+  const u32 *indices = mesh->indices_ + meshlet.first_index_;
+  const Vertex *vertices = mesh->vertices_;
+
+  Math::AABB box;
+  for (u32 i = 0; i < meshlet.index_count_; i++)
+    box.Expand(vertices[indices[i]].position_);
+
+  meshlet.center_ = box.Center();
+  f32 radius = 0.0f;
+  for (u32 i = 0; i < meshlet.index_count_; i++)
+    radius = std::max(radius, (vertices[indices[i]].position_ - meshlet.center_).SqrMagnitude());
+  meshlet.radius_ = std::sqrt(radius);
+
+  // Face normals, turned to the side of the vertex normals so the winding
+  // of the file does not matter
+  std::vector<Math::Vec3> normals;
+  normals.reserve(meshlet.index_count_ / 3);
+  Math::Vec3 axis(0.0f);
+  for (u32 i = 0; i + 2 < meshlet.index_count_; i += 3)
+  {
+    const Vertex &a = vertices[indices[i]];
+    const Vertex &b = vertices[indices[i + 1]];
+    const Vertex &c = vertices[indices[i + 2]];
+
+    Math::Vec3 normal = Math::Vec3::CrossProduct(b.position_ - a.position_, c.position_ - a.position_);
+    f32 length = normal.Magnitude();
+    if (length <= FLT_EPSILON)
+      continue;
+
+    normal /= length;
+    if (Math::Vec3::DotProduct(normal, a.normal_ + b.normal_ + c.normal_) < 0.0f)
+      normal = normal * -1.0f;
+
+    normals.push_back(normal);
+    axis += normal;
+  }
+
+  meshlet.cone_axis_ = Math::Vec3(0.0f, 1.0f, 0.0f);
+  meshlet.cone_cutoff_ = 1.0f;
+
+  f32 axis_length = axis.Magnitude();
+  if (axis_length <= FLT_EPSILON)
+    return;
+
+  axis /= axis_length;
+  f32 min_dot = 1.0f;
+  for (const Math::Vec3 &normal : normals)
+    min_dot = std::min(min_dot, Math::Vec3::DotProduct(normal, axis));
+
+  meshlet.cone_axis_ = axis;
+  if (min_dot > k_min_cone_spread)
+    meshlet.cone_cutoff_ = std::sqrt(1.0f - (min_dot * min_dot));
+}
+
+boolean Meshlets::build(Mesh *mesh, u32 max_triangles)
+{
+  free();
+
+  if (!mesh || !mesh->has_mesh_ || !mesh->indices_ || !mesh->vertices_ || mesh->indices_size_ < 3)
+    return false;
+
+  const u32 *indices = mesh->indices_;
+  const Vertex *vertices = mesh->vertices_;
+  u32 vertex_count = mesh->vertices_size_;
+  u32 triangle_count = mesh->indices_size_ / 3;
+  max_triangles = std::max(max_triangles, 1u);
+
+  for (u32 i = 0; i < triangle_count * 3; i++)
+    if (indices[i] >= vertex_count)
+      return false;
+
+  // Vertices split by the loader (same position, other normal or uv) are
+  // still neighbours, so they are welded by position
+  std::vector<u32> order(vertex_count);
+  std::iota(order.begin(), order.end(), 0u);
+  std::sort(order.begin(), order.end(), [vertices](u32 a, u32 b) {
+    const Math::Vec3 &pa = vertices[a].position_, &pb = vertices[b].position_;
+    if (pa.x != pb.x)
+      return pa.x < pb.x;
+    if (pa.y != pb.y)
+      return pa.y < pb.y;
+    return pa.z < pb.z;
+  });
+
+  std::vector<u32> welded(vertex_count);
+  u32 unique = 0;
+  for (u32 i = 0; i < vertex_count; i++)
+  {
+    if (i > 0 && vertices[order[i]].position_ == vertices[order[i - 1]].position_)
+      welded[order[i]] = unique - 1;
+    else
+      welded[order[i]] = unique++;
+  }
+
+  // Triangles around every welded vertex
+  std::vector<u32> offsets(unique + 1, 0);
+  for (u32 i = 0; i < triangle_count * 3; i++)
+    offsets[welded[indices[i]] + 1]++;
+  for (u32 i = 0; i < unique; i++)
+    offsets[i + 1] += offsets[i];
+
+  std::vector<u32> adjacency(triangle_count * 3);
+  std::vector<u32> cursor(offsets.begin(), offsets.end() - 1);
+  for (u32 i = 0; i < triangle_count * 3; i++)
+    adjacency[cursor[welded[indices[i]]]++] = i / 3;
+
+  // New clusters start from the next triangle along a Morton curve, so they
+  // are next to the last one
+  Math::AABB box;
+  for (u32 i = 0; i < vertex_count; i++)
+    box.Expand(vertices[i].position_);
+
+  std::vector<Math::Vec3> centroids(triangle_count);
+  std::vector<std::pair<u32, u32>> curve(triangle_count);
+  for (u32 t = 0; t < triangle_count; t++)
+  {
+    centroids[t] = (vertices[indices[t * 3]].position_ + vertices[indices[t * 3 + 1]].position_ + vertices[indices[t * 3 + 2]].position_) / 3.0f;
+    curve[t] = std::make_pair(MortonCode(centroids[t], box), t);
+  }
+  std::sort(curve.begin(), curve.end());
+
+  std::vector<u32> new_indices;
+  new_indices.reserve(triangle_count * 3);
+  std::vector<boolean> emitted(triangle_count, false);
+  std::vector<u32> vertex_stamp(unique, UINT32_MAX);
+  std::vector<u32> candidate_stamp(triangle_count, UINT32_MAX);
+  std::vector<u32> candidates;
+  u32 next_seed = 0;
+
+  while (new_indices.size() < static_cast<size_t>(triangle_count) * 3)
+  {
+    u32 meshlet_index = static_cast<u32>(meshlets_.size());
+    Meshlet meshlet = {};
+    meshlet.first_index_ = static_cast<u32>(new_indices.size());
+
+    Math::Vec3 centroid_sum(0.0f);
+    u32 triangles = 0;
+    candidates.clear();
+
+    auto add_triangle = [&](u32 t) {
+      emitted[t] = true;
+      centroid_sum += centroids[t];
+      triangles++;
+
+      for (u32 k = 0; k < 3; k++)
+      {
+        u32 v = indices[t * 3 + k];
+        new_indices.push_back(v);
+
+        u32 w = welded[v];
+        if (vertex_stamp[w] == meshlet_index)
+          continue;
+        vertex_stamp[w] = meshlet_index;
+
+        for (u32 a = offsets[w]; a < offsets[w + 1]; a++)
+        {
+          u32 neighbour = adjacency[a];
+          if (!emitted[neighbour] && candidate_stamp[neighbour] != meshlet_index)
+          {
+            candidate_stamp[neighbour] = meshlet_index;
+            candidates.push_back(neighbour);
+          }
+        }
+      }
+    };
+
+    while (emitted[curve[next_seed].second])
+      next_seed++;
+    add_triangle(curve[next_seed].second);
+
+    while (triangles < max_triangles)
+    {
+      // Most vertices already in the cluster first, then the closest to its center
+      Math::Vec3 center = centroid_sum / static_cast<f32>(triangles);
+      u32 best = UINT32_MAX, best_shared = 0;
+      f32 best_distance = FLT_MAX;
+
+      size_t kept = 0;
+      for (u32 candidate : candidates)
+      {
+        if (emitted[candidate])
+          continue;
+        candidates[kept++] = candidate;
+
+        u32 shared = 0;
+        for (u32 k = 0; k < 3; k++)
+          shared += (vertex_stamp[welded[indices[candidate * 3 + k]]] == meshlet_index) ? 1 : 0;
+
+        f32 distance = (centroids[candidate] - center).SqrMagnitude();
+        if (shared > best_shared || (shared == best_shared && distance < best_distance))
+        {
+          best = candidate;
+          best_shared = shared;
+          best_distance = distance;
+        }
+      }
+      candidates.resize(kept);
+
+      // Nothing connected left, small clusters take the next loose triangle
+      if (best == UINT32_MAX)
+      {
+        if (triangles * k_loose_fraction >= max_triangles)
+          break;
+
+        while (next_seed < triangle_count && emitted[curve[next_seed].second])
+          next_seed++;
+        if (next_seed == triangle_count)
+          break;
+
+        best = curve[next_seed].second;
+      }
+
+      add_triangle(best);
+    }
+
+    meshlet.index_count_ = static_cast<u32>(new_indices.size()) - meshlet.first_index_;
+    meshlets_.push_back(meshlet);
+  }
+
+  // Same triangles, so anything already reading the indices still draws the same
+  memcpy(mesh->indices_, new_indices.data(), new_indices.size() * sizeof(u32));
+  mesh_ = mesh;
+
+  for (Meshlet &meshlet : meshlets_)
+    computeBounds(mesh, meshlet);
+
+  return true;
+}
+
+void Meshlets::save(const char *file) const
+{
+  if (!mesh_)
+    return;
+
+  std::string data;
+  data.append(k_meshlets_magic, sizeof(k_meshlets_magic));
+  Append(data, k_meshlets_version);
+  Append(data, mesh_->vertices_size_);
+  Append(data, mesh_->indices_size_);
+  Append(data, TrianglesHash(mesh_->indices_, mesh_->indices_size_));
+  Append(data, static_cast<u32>(meshlets_.size()));
+
+  data.append(reinterpret_cast<const char *>(meshlets_.data()), meshlets_.size() * sizeof(Meshlet));
+  data.append(reinterpret_cast<const char *>(mesh_->indices_), static_cast<size_t>(mesh_->indices_size_) * sizeof(u32));
+
+  SaveSourceInBinary(file, data);
+}
+
+boolean Meshlets::load(Mesh *mesh, const char *file)
+{
+  free();
+
+  if (!mesh || !mesh->has_mesh_ || !mesh->indices_)
+    return false;
+
+  std::string data = LoadSourceFromBinary(file);
+  if (data.size() < sizeof(k_meshlets_magic) || memcmp(data.data(), k_meshlets_magic, sizeof(k_meshlets_magic)) != 0)
+    return false;
+
+  size_t offset = sizeof(k_meshlets_magic);
+  u32 version = 0, vertex_count = 0, index_count = 0, meshlet_count = 0;
+  u64 hash = 0;
+  boolean ok = Read(data, offset, version) && version == k_meshlets_version && Read(data, offset, vertex_count) &&
+               Read(data, offset, index_count) && Read(data, offset, hash) && Read(data, offset, meshlet_count);
+
+  // The mesh must be the one it was saved from
+  size_t meshlets_size = static_cast<size_t>(meshlet_count) * sizeof(Meshlet);
+  size_t indices_size = static_cast<size_t>(index_count) * sizeof(u32);
+  if (!ok || vertex_count != mesh->vertices_size_ || index_count != mesh->indices_size_ || hash != TrianglesHash(mesh->indices_, mesh->indices_size_) ||
+      data.size() != offset + meshlets_size + indices_size)
+    return false;
+
+  meshlets_.resize(meshlet_count);
+  memcpy(static_cast<void *>(meshlets_.data()), data.data() + offset, meshlets_size);
+
+  for (const Meshlet &meshlet : meshlets_)
+  {
+    if (static_cast<u64>(meshlet.first_index_) + meshlet.index_count_ > index_count)
+    {
+      meshlets_.clear();
+      return false;
+    }
+  }
+
+  memcpy(mesh->indices_, data.data() + offset + meshlets_size, indices_size);
+  mesh_ = mesh;
+
+  return true;
+}
+
+boolean Meshlets::loadOrBuild(Mesh *mesh, const char *mesh_file, u32 max_triangles)
+{
+  std::string cache = std::string(mesh_file) + k_cache_extension;
+  if (load(mesh, cache.c_str()))
+    return true;
+
+  if (!build(mesh, max_triangles))
+    return false;
+
+  save(cache.c_str());
+
+  return true;
+}
+
+u32 Meshlets::cull(const Math::Frustum &frustum, Math::Vec3 view_pos, const Math::Mat4 &model_mat, boolean cone_test, std::vector<Range> &ranges) const
+{
+  ranges.clear();
+
+  // The radius grows with the largest scale of the matrix
+  const f32 *f = model_mat.m;
+  f32 scale = std::sqrt(std::max({(f[0] * f[0]) + (f[1] * f[1]) + (f[2] * f[2]),
+                                  (f[4] * f[4]) + (f[5] * f[5]) + (f[6] * f[6]),
+                                  (f[8] * f[8]) + (f[9] * f[9]) + (f[10] * f[10])}));
+
+  u32 visible = 0;
+  for (const Meshlet &meshlet : meshlets_)
+  {
+    Math::Vec3 center = TransformPoint(f, meshlet.center_);
+    f32 radius = meshlet.radius_ * scale;
+    if (!frustum.IsVisible(Math::Sphere(center, radius)))
+      continue;
+
+    // Every normal points away from the camera, from any point of the sphere
+    if (cone_test && meshlet.cone_cutoff_ < 1.0f)
+    {
+      Math::Vec3 axis = TransformDirection(f, meshlet.cone_axis_).Normalized();
+      Math::Vec3 to_center = center - view_pos;
+      if (Math::Vec3::DotProduct(to_center, axis) >= (meshlet.cone_cutoff_ * to_center.Magnitude()) + radius)
+        continue;
+    }
+
+    visible++;
+    if (!ranges.empty() && ranges.back().first_index_ + ranges.back().index_count_ == meshlet.first_index_)
+      ranges.back().index_count_ += meshlet.index_count_;
+    else
+      ranges.push_back({meshlet.first_index_, meshlet.index_count_});
+  }
+
+  return visible;
+}
+
+const Mesh *Meshlets::mesh() const { return mesh_; }
+
+u32 Meshlets::size() const { return static_cast<u32>(meshlets_.size()); }
+
+const Meshlets::Meshlet &Meshlets::get(u32 index) const { return meshlets_[index]; }
@@ -0,0 +1,441 @@
+#include <engine/occlusion_buffer.h>
+#include <engine/taskmanager.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// Closer than this to the camera plane 1/w is too big to be useful
+const f32 k_min_w = 1e-4f;
+
+// Bands rasterized at the same time
+const u32 k_max_bands = 8;
+
+// Every pixel of a tile in the mask
+const u32 k_full_mask = UINT32_MAX;
+
+// Working depth of a tile with an empty mask
+const f32 k_no_working = FLT_MAX;
+
+struct ClipVertex
+{
+  f32 x_, y_, z_, w_;
+};
+
+// Row vector convention, translation in m[12..14]
+static ClipVertex ToClip(const f32 *m, f32 x, f32 y, f32 z)
+{
+  ClipVertex ret;
+  ret.x_ = (x * m[0]) + (y * m[4]) + (z * m[8]) + m[12];
+  ret.y_ = (x * m[1]) + (y * m[5]) + (z * m[9]) + m[13];
+  ret.z_ = (x * m[2]) + (y * m[6]) + (z * m[10]) + m[14];
+  ret.w_ = (x * m[3]) + (y * m[7]) + (z * m[11]) + m[15];
+
+  return ret;
+}
+
+static boolean BehindNear(const ClipVertex &v) { return (v.w_ < k_min_w || v.z_ < -v.w_); }
+
+// Pixels and 1/w, false if it is too close to the camera plane
+static boolean Project(const ClipVertex &v, f32 width, f32 height, f32 *out)
+{
+  if (v.w_ < k_min_w)
+    return false;
+
+  f32 inv_w = 1.0f / v.w_;
+  out[0] = ((v.x_ * inv_w * 0.5f) + 0.5f) * width;
+  out[1] = ((v.y_ * inv_w * 0.5f) + 0.5f) * height;
+  out[2] = inv_w;
+
+  return true;
+}
+
+// Part of a triangle in front of the near plane, z + w >= 0, up to 4 vertices
+static u32 ClipNear(const ClipVertex *in, ClipVertex *out)
+{
+  u32 count = 0;
+  for (u32 i = 0; i < 3; i++)
+  {
+    const ClipVertex &a = in[i];
+    const ClipVertex &b = in[(i + 1) % 3];
+    f32 da = a.z_ + a.w_, db = b.z_ + b.w_;
+
+    if (da >= 0.0f)
+      out[count++] = a;
+
+    if ((da >= 0.0f) != (db >= 0.0f))
+    {
+      f32 t = da / (da - db);
+      out[count++] = {a.x_ + ((b.x_ - a.x_) * t), a.y_ + ((b.y_ - a.y_) * t), a.z_ + ((b.z_ - a.z_) * t), a.w_ + ((b.w_ - a.w_) * t)};
+    }
+  }
+
+  return count;
+}
+
+// Adds the pixels of a triangle to a tile. A triangle much closer than the
+// working layer starts a new one, and a full mask becomes the reference
+static void MergeTile(u32 mask, f32 depth, f32 &reference, f32 &working, u32 &tile_mask)
+{
+  if (depth - working > working - reference)
+  {
+    working = k_no_working;
+    tile_mask = 0;
+  }
+
+  working = std::min(working, depth);
+  tile_mask |= mask;
+
+  if (tile_mask == k_full_mask)
+  {
+    reference = std::max(reference, working);
+    working = k_no_working;
+    tile_mask = 0;
+  }
+}
+
+static u32 RoundUp(u32 value, u32 multiple) { return ((value + multiple - 1) / multiple) * multiple; }
+
+OcclusionBuffer::OcclusionBuffer() : width_(0), height_(0), tiles_x_(0), tiles_y_(0), blocks_x_(0), blocks_y_(0), view_projection_(Math::Mat4::Identity()) {}
+
+OcclusionBuffer::~OcclusionBuffer() {}
+
+void OcclusionBuffer::resize(u32 width, u32 height)
+{
+  width_ = RoundUp(std::max(width, 1u), k_tile_width * k_block_tiles);
+  height_ = RoundUp(std::max(height, 1u), k_tile_height * k_block_tiles);
+  tiles_x_ = width_ / k_tile_width;
+  tiles_y_ = height_ / k_tile_height;
+  blocks_x_ = tiles_x_ / k_block_tiles;
+  blocks_y_ = tiles_y_ / k_block_tiles;
+
+  size_t tiles = static_cast<size_t>(tiles_x_) * tiles_y_;
+  tile_depth_.assign(tiles, 0.0f);
+  tile_working_.assign(tiles, k_no_working);
+  tile_mask_.assign(tiles, 0);
+  block_depth_.assign(static_cast<size_t>(blocks_x_) * blocks_y_, 0.0f);
+}
+
+void OcclusionBuffer::begin(const Math::Mat4 &view_projection)
+{
+  view_projection_ = view_projection;
+  triangles_.clear();
+
+  std::fill(tile_depth_.begin(), tile_depth_.end(), 0.0f);
+  std::fill(tile_working_.begin(), tile_working_.end(), k_no_working);
+  std::fill(tile_mask_.begin(), tile_mask_.end(), 0u);
+  std::fill(block_depth_.begin(), block_depth_.end(), 0.0f);
+}
+
+void OcclusionBuffer::addOccluder(const void *positions, size_t stride, u32 vertex_count, const u32 *indices, u32 index_count, const Math::Mat4 &model_mat)
+{
+  if (width_ == 0 || !positions || !indices)
+    return;
+
+  Math::Mat4 mvp = model_mat * view_projection_;
+  const f32 w = static_cast<f32>(width_), h = static_cast<f32>(height_);
+
+  // Every vertex once, in clip space and, in front of the near plane, in
+  // pixels and 1/w
+  thread_local std::vector<ClipVertex> clip;
+  thread_local std::vector<f32> screen;
+  thread_local std::vector<u8> behind;
+  clip.resize(vertex_count);
+  screen.resize(static_cast<size_t>(vertex_count) * 3);
+  behind.resize(vertex_count);
+
+  const u_byte *it = reinterpret_cast<const u_byte *>(positions);
+  for (u32 i = 0; i < vertex_count; i++, it += stride)
+  {
+    f32 p[3];
+    memcpy(p, it, sizeof(p));
+
+    clip[i] = ToClip(mvp.m, p[0], p[1], p[2]);
+    behind[i] = BehindNear(clip[i]) || !Project(clip[i], w, h, &screen[i * 3]);
+  }
+
+  for (u32 i = 0; i + 2 < index_count; i += 3)
+  {
+    u32 i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+    if (i0 >= vertex_count || i1 >= vertex_count || i2 >= vertex_count)
+      continue;
+
+    if (!behind[i0] && !behind[i1] && !behind[i2])
+    {
+      addTriangle(&screen[i0 * 3], &screen[i1 * 3], &screen[i2 * 3]);
+      continue;
+    }
+
+    // The part in front of the camera, as a fan
+    ClipVertex corners[3] = {clip[i0], clip[i1], clip[i2]};
+    ClipVertex clipped[4];
+    u32 count = ClipNear(corners, clipped);
+
+    f32 projected[4][3];
+    boolean valid = (count >= 3);
+    for (u32 v = 0; v < count && valid; v++)
+      valid = Project(clipped[v], w, h, projected[v]);
+
+    for (u32 v = 2; valid && v < count; v++)
+      addTriangle(projected[0], projected[v - 1], projected[v]);
+  }
+}
+
+void OcclusionBuffer::addOccluder(const Mesh *mesh, const Math::Mat4 &model_mat)
+{
+  if (!mesh || !mesh->has_mesh_ || !mesh->vertices_ || !mesh->indices_)
+    return;
+
+  addOccluder(&mesh->vertices_[0].position_, sizeof(Vertex), mesh->vertices_size_, mesh->indices_, mesh->indices_size_, model_mat);
+}
+
+void OcclusionBuffer::addTriangle(const f32 *v0, const f32 *v1, const f32 *v2)
+{
+  // Both windings are drawn, counter clockwise from here
+  f32 area = ((v1[0] - v0[0]) * (v2[1] - v0[1])) - ((v2[0] - v0[0]) * (v1[1] - v0[1]));
+  if (std::abs(area) < 1e-6f)
+    return;
+  if (area < 0.0f)
+  {
+    std::swap(v1, v2);
+    area = -area;
+  }
+
+  Triangle tri;
+  tri.min_x_ = std::max(0, static_cast<s32>(std::floor(std::min({v0[0], v1[0], v2[0]}))));
+  tri.max_x_ = std::min(static_cast<s32>(width_) - 1, static_cast<s32>(std::ceil(std::max({v0[0], v1[0], v2[0]}))));
+  tri.min_y_ = std::max(0, static_cast<s32>(std::floor(std::min({v0[1], v1[1], v2[1]}))));
+  tri.max_y_ = std::min(static_cast<s32>(height_) - 1, static_cast<s32>(std::ceil(std::max({v0[1], v1[1], v2[1]}))));
+  if (tri.min_x_ > tri.max_x_ || tri.min_y_ > tri.max_y_)
+    return;
+
+  // Edge i is the one in front of vertex i
+  const f32 *v[3] = {v0, v1, v2};
+  for (u32 e = 0; e < 3; e++)
+  {
+    const f32 *from = v[(e + 1) % 3];
+    const f32 *to = v[(e + 2) % 3];
+    tri.a_[e] = from[1] - to[1];
+    tri.b_[e] = to[0] - from[0];
+    tri.c_[e] = -((tri.a_[e] * from[0]) + (tri.b_[e] * from[1]));
+  }
+
+  f32 inv_area = 1.0f / area;
+  tri.z_a_ = ((tri.a_[0] * v0[2]) + (tri.a_[1] * v1[2]) + (tri.a_[2] * v2[2])) * inv_area;
+  tri.z_b_ = ((tri.b_[0] * v0[2]) + (tri.b_[1] * v1[2]) + (tri.b_[2] * v2[2])) * inv_area;
+  tri.z_c_ = ((tri.c_[0] * v0[2]) + (tri.c_[1] * v1[2]) + (tri.c_[2] * v2[2])) * inv_area;
+  tri.z_min_ = std::min({v0[2], v1[2], v2[2]});
+  tri.z_max_ = std::max({v0[2], v1[2], v2[2]});
+
+  triangles_.push_back(tri);
+}
+
+void OcclusionBuffer::rasterize(boolean threaded)
+{
+  if (width_ == 0)
+    return;
+
+  // With one core the task manager has no workers and the calling thread
+  // rasterizes everything
+  u32 workers = threaded ? TM->workerCount() : 0;
+
+  // Bands of whole tile rows, one for every worker and the calling thread
+  u32 bands = std::min({k_max_bands, tiles_y_, workers + 1});
+  u32 band_rows = ((tiles_y_ + bands - 1) / bands) * k_tile_height;
+
+  // The calling thread takes bands too, so it does not wait for workers
+  // busy with other tasks. A worker that starts late finds none left
+  struct Bands
+  {
+    std::atomic<u32> next_ = 0;
+    std::atomic<u32> done_ = 0;
+  };
+  auto shared = std::make_shared<Bands>();
+  u32 rows = height_;
+  auto run = [this, shared, band_rows, rows]()
+  {
+    for (;;)
+    {
+      u32 first = shared->next_.fetch_add(band_rows, std::memory_order_relaxed);
+      if (first >= rows)
+        return;
+
+      u32 end = std::min(first + band_rows, rows);
+      rasterizeBand(first, end);
+      shared->done_.fetch_add(end - first, std::memory_order_release);
+    }
+  };
+
+  for (u32 i = 1; i < bands; i++)
+    TM->enqueue(run);
+
+  run();
+  while (shared->done_.load(std::memory_order_acquire) < rows)
+    std::this_thread::yield();
+
+  buildBlocks();
+}
+
+void OcclusionBuffer::rasterizeBand(u32 first_row, u32 end_row)
+{
+  const s32 tile_w = static_cast<s32>(k_tile_width), tile_h = static_cast<s32>(k_tile_height);
+
+  for (const Triangle &tri : triangles_)
+  {
+    s32 row_begin = std::max(tri.min_y_, static_cast<s32>(first_row));
+    s32 row_end = std::min(tri.max_y_, static_cast<s32>(end_row) - 1);
+    if (row_begin > row_end)
+      continue;
+
+    for (s32 ty = row_begin / tile_h; ty <= row_end / tile_h; ty++)
+    {
+      for (s32 tx = tri.min_x_ / tile_w; tx <= tri.max_x_ / tile_w; tx++)
+      {
+        size_t tile = (static_cast<size_t>(ty) * tiles_x_) + static_cast<size_t>(tx);
+        f32 x0 = static_cast<f32>(tx * tile_w), y0 = static_cast<f32>(ty * tile_h);
+
+        // Depth of the triangle over the tile, from its plane at the tile
+        // corners, never past its vertices
+        f32 z00 = (tri.z_a_ * x0) + (tri.z_b_ * y0) + tri.z_c_;
+        f32 step_x = tri.z_a_ * static_cast<f32>(tile_w), step_y = tri.z_b_ * static_cast<f32>(tile_h);
+        f32 corners[4] = {z00, z00 + step_x, z00 + step_y, z00 + step_x + step_y};
+        f32 farthest = std::max(tri.z_min_, std::min({corners[0], corners[1], corners[2], corners[3]}));
+        f32 closest = std::min(tri.z_max_, std::max({corners[0], corners[1], corners[2], corners[3]}));
+
+        // Already behind what covers the whole tile
+        if (closest <= tile_depth_[tile])
+          continue;
+
+        u32 mask = 0;
+        for (s32 y = 0; y < tile_h; y++)
+        {
+          f32 py = y0 + static_cast<f32>(y) + 0.5f;
+          f32 e0 = (tri.a_[0] * x0) + (tri.b_[0] * py) + tri.c_[0];
+          f32 e1 = (tri.a_[1] * x0) + (tri.b_[1] * py) + tri.c_[1];
+          f32 e2 = (tri.a_[2] * x0) + (tri.b_[2] * py) + tri.c_[2];
+
+#if defined(__AVX__)
+          const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+          const __m256 zero = _mm256_setzero_ps();
+          __m256 w0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.a_[0]), offsets), _mm256_set1_ps(e0));
+          __m256 w1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.a_[1]), offsets), _mm256_set1_ps(e1));
+          __m256 w2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.a_[2]), offsets), _mm256_set1_ps(e2));
+          __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(w0, zero, _CMP_GE_OQ), _mm256_cmp_ps(w1, zero, _CMP_GE_OQ)),
+                                        _mm256_cmp_ps(w2, zero, _CMP_GE_OQ));
+          u32 row_mask = static_cast<u32>(_mm256_movemask_ps(inside));
+#else
+          u32 row_mask = 0;
+          for (s32 x = 0; x < tile_w; x++)
+          {
+            f32 px = static_cast<f32>(x) + 0.5f;
+            if ((tri.a_[0] * px) + e0 >= 0.0f && (tri.a_[1] * px) + e1 >= 0.0f && (tri.a_[2] * px) + e2 >= 0.0f)
+              row_mask |= 1u << x;
+          }
+#endif
+          mask |= row_mask << (y * tile_w);
+        }
+
+        if (mask != 0)
+          MergeTile(mask, farthest, tile_depth_[tile], tile_working_[tile], tile_mask_[tile]);
+      }
+    }
+  }
+}
+
+void OcclusionBuffer::buildBlocks()
+{
+  for (u32 by = 0; by < blocks_y_; by++)
+  {
+    for (u32 bx = 0; bx < blocks_x_; bx++)
+    {
+      f32 farthest = tile_depth_[(by * k_block_tiles * tiles_x_) + (bx * k_block_tiles)];
+      for (u32 y = 0; y < k_block_tiles; y++)
+        for (u32 x = 0; x < k_block_tiles; x++)
+          farthest = std::min(farthest, tile_depth_[(((by * k_block_tiles) + y) * tiles_x_) + (bx * k_block_tiles) + x]);
+
+      block_depth_[(by * blocks_x_) + bx] = farthest;
+    }
+  }
+}
+
+boolean OcclusionBuffer::isVisible(const Math::AABB &bounds) const
+{
+  if (width_ == 0 || bounds.IsEmpty())
+    return true;
+
+  // Screen rectangle and closest point of the box
+  f32 min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+  f32 closest = 0.0f;
+  const f32 w = static_cast<f32>(width_), h = static_cast<f32>(height_);
+
+  for (u32 i = 0; i < 8; i++)
+  {
+    ClipVertex v = ToClip(view_projection_.m, (i & 1) ? bounds.max.x : bounds.min.x,
+                          (i & 2) ? bounds.max.y : bounds.min.y, (i & 4) ? bounds.max.z : bounds.min.z);
+    // Touching the camera, nothing can be in front of it
+    f32 p[3];
+    if (BehindNear(v) || !Project(v, w, h, p))
+      return true;
+
+    min_x = std::min(min_x, p[0]);
+    max_x = std::max(max_x, p[0]);
+    min_y = std::min(min_y, p[1]);
+    max_y = std::max(max_y, p[1]);
+    closest = std::max(closest, p[2]);
+  }
+
+  // Out of the screen is the frustum culling business
+  if (max_x < 0.0f || max_y < 0.0f || min_x >= w || min_y >= h)
+    return true;
+
+  u32 tx0 = static_cast<u32>(std::max(0.0f, min_x)) / k_tile_width;
+  u32 tx1 = static_cast<u32>(std::min(w - 1.0f, max_x)) / k_tile_width;
+  u32 ty0 = static_cast<u32>(std::max(0.0f, min_y)) / k_tile_height;
+  u32 ty1 = static_cast<u32>(std::min(h - 1.0f, max_y)) / k_tile_height;
+
+  for (u32 by = ty0 / k_block_tiles; by <= ty1 / k_block_tiles; by++)
+  {
+    for (u32 bx = tx0 / k_block_tiles; bx <= tx1 / k_block_tiles; bx++)
+    {
+      // The whole block is closer than the box
+      if (block_depth_[(by * blocks_x_) + bx] > closest)
+        continue;
+
+      u32 y_begin = std::max(ty0, by * k_block_tiles), y_end = std::min(ty1, (by * k_block_tiles) + k_block_tiles - 1);
+      u32 x_begin = std::max(tx0, bx * k_block_tiles), x_end = std::min(tx1, (bx * k_block_tiles) + k_block_tiles - 1);
+      for (u32 ty = y_begin; ty <= y_end; ty++)
+        for (u32 tx = x_begin; tx <= x_end; tx++)
+          if (tile_depth_[(ty * tiles_x_) + tx] <= closest)
+            return true;
+    }
+  }
+
+  return false;
+}
+
+u32 OcclusionBuffer::width() const { return width_; }
+
+u32 OcclusionBuffer::height() const { return height_; }
+
+f32 OcclusionBuffer::depth(u32 x, u32 y) const
+{
+  if (x >= width_ || y >= height_)
+    return 0.0f;
+
+  size_t tile = (static_cast<size_t>(y / k_tile_height) * tiles_x_) + (x / k_tile_width);
+  u32 bit = ((y % k_tile_height) * k_tile_width) + (x % k_tile_width);
+  if ((tile_mask_[tile] >> bit) & 1u)
+    return std::max(tile_depth_[tile], tile_working_[tile]);
+
+  return tile_depth_[tile];
+}
+
+u32 OcclusionBuffer::triangles() const { return static_cast<u32>(triangles_.size()); }
@@ -0,0 +1,497 @@
+#include <engine/gl_state.h>
+#include <engine/jam_engine.h>
+#include <engine/program_cache.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Same value for the KHR and ARB extensions
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Cache file
+///////////////////////////////////////////////////////////////////////////////
+const char k_program_magic[4] = {'J', 'P', 'R', 'G'};
+const u32 k_program_version = 1;
+const char k_program_extension[] = ".bin";
+
+/**
+ * @struct CompileJob
+ *
+ * @brief Program compiled from source, until its errors are checked.
+ */
+struct CompileJob
+{
+  u32 program_ = 0;                    ///< Program being built.
+  u32 shaders_[2] = {0, 0};            ///< Vertex and fragment shaders, 0 if missing.
+  u64 key_ = 0;                        ///< Cache name.
+  u64 check_ = 0;                      ///< Cache check value.
+  std::string path_;                   ///< Cache file, empty to save nothing.
+  boolean discard_ = false;            ///< Deleted while the worker had it.
+  std::atomic<boolean> done_ = false;  ///< Compile and link issued, and finished if the worker had it.
+};
+
+struct CacheData
+{
+  std::string directory_ = "shader_cache"; ///< Folder of the cached programs.
+  std::string driver_;                     ///< Driver strings, read with the first program.
+  boolean active_ = true;                  ///< Cache in use.
+  boolean supported_ = false;              ///< The driver has program binary formats.
+  boolean parallel_ = false;               ///< The driver compiles on its own threads.
+  boolean worker_failed_ = false;          ///< The worker context could not be created.
+  GLFWwindow *worker_context_ = nullptr;   ///< Hidden context shared with the window.
+  ProgramCache::Stats stats_;              ///< Programs created since the start.
+
+  std::unordered_map<u32, std::unique_ptr<CompileJob>> jobs_; ///< Programs not checked yet.
+
+  std::thread worker_;               ///< Compiles in the worker context.
+  std::mutex queue_mutex_;           ///< Guards the queue and the stop flag.
+  std::condition_variable queue_cv_; ///< Wakes the worker.
+  std::deque<CompileJob *> queue_;   ///< Jobs waiting for the worker.
+  boolean stop_ = false;             ///< The worker ends.
+
+  ~CacheData()
+  {
+    if (!worker_.joinable())
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      stop_ = true;
+    }
+    queue_cv_.notify_one();
+    worker_.join();
+  }
+};
+
+static CacheData s_cache;
+
+template <typename T>
+static void Append(std::string &data, const T &value) { data.append(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+template <typename T>
+static boolean Read(const std::string &data, size_t &offset, T &value)
+{
+  if (offset + sizeof(T) > data.size())
+    return false;
+
+  memcpy(&value, data.data() + offset, sizeof(T));
+  offset += sizeof(T);
+  return true;
+}
+
+// FNV-1a, the second basis gives a check value independent of the name
+static u64 Hash(u64 hash, const byte *data, size_t size)
+{
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= static_cast<u_byte>(data[i]);
+    hash *= 0x100000001B3ull;
+  }
+
+  return hash;
+}
+
+static u64 SourcesHash(u64 basis, const byte *fragment_source, const byte *vertex_source)
+{
+  // The separators keep "ab" + "c" and "a" + "bc" apart
+  const byte separator = '\0';
+  u64 hash = Hash(basis, s_cache.driver_.data(), s_cache.driver_.size());
+  hash = Hash(hash, &separator, 1);
+  if (vertex_source)
+    hash = Hash(hash, vertex_source, strlen(vertex_source));
+  hash = Hash(hash, &separator, 1);
+  if (fragment_source)
+    hash = Hash(hash, fragment_source, strlen(fragment_source));
+
+  return hash;
+}
+
+static const byte *GLString(GLenum name)
+{
+  const byte *value = reinterpret_cast<const byte *>(glGetString(name));
+  return value ? value : "";
+}
+
+static void ReadDriver()
+{
+  if (!s_cache.driver_.empty())
+    return;
+
+  s_cache.driver_ = std::string(GLString(GL_VENDOR)) + "\n" + GLString(GL_RENDERER) + "\n" + GLString(GL_VERSION) + "\n" +
+                    GLString(GL_SHADING_LANGUAGE_VERSION);
+
+  s32 formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  s_cache.supported_ = (formats > 0);
+
+  const byte *max_threads_name = nullptr;
+  s32 extensions = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+  for (s32 i = 0; i < extensions && !max_threads_name; i++)
+  {
+    const byte *name = reinterpret_cast<const byte *>(glGetStringi(GL_EXTENSIONS, static_cast<u32>(i)));
+    if (!name)
+      continue;
+
+    if (strcmp(name, "GL_KHR_parallel_shader_compile") == 0)
+      max_threads_name = "glMaxShaderCompilerThreadsKHR";
+    else if (strcmp(name, "GL_ARB_parallel_shader_compile") == 0)
+      max_threads_name = "glMaxShaderCompilerThreadsARB";
+  }
+
+  // Loaded by name, older GLEW builds do not know the extension
+  typedef void(GLAPIENTRY * MaxThreadsProc)(GLuint count);
+  MaxThreadsProc max_threads = max_threads_name ? reinterpret_cast<MaxThreadsProc>(glfwGetProcAddress(max_threads_name)) : nullptr;
+  if (max_threads)
+  {
+    // As many threads as the driver wants
+    max_threads(0xFFFFFFFFu);
+    s_cache.parallel_ = true;
+  }
+}
+
+static std::string CachePath(u64 key)
+{
+  byte name[17];
+  snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+
+  return (std::filesystem::path(s_cache.directory_) / (std::string(name) + k_program_extension)).string();
+}
+
+static boolean LoadProgram(u32 program, const std::string &path, u64 key, u64 check)
+{
+  std::error_code error;
+  if (!std::filesystem::exists(path, error))
+    return false;
+
+  std::string data = LoadSourceFromBinary(path.c_str());
+  if (data.size() < sizeof(k_program_magic) || memcmp(data.data(), k_program_magic, sizeof(k_program_magic)) != 0)
+    return false;
+
+  size_t offset = sizeof(k_program_magic);
+  u32 version = 0, format = 0, size = 0;
+  u64 file_key = 0, file_check = 0;
+  boolean ok = Read(data, offset, version) && version == k_program_version && Read(data, offset, file_key) && file_key == key &&
+               Read(data, offset, file_check) && file_check == check && Read(data, offset, format) && Read(data, offset, size) &&
+               offset + size == data.size();
+  if (!ok)
+    return false;
+
+  glProgramBinary(program, format, data.data() + offset, static_cast<GLsizei>(size));
+
+  s32 linked = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  return linked != 0;
+}
+
+static void SaveProgram(u32 program, const std::string &path, u64 key, u64 check)
+{
+  s32 linked = 0, size = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (!linked || size <= 0)
+    return;
+
+  std::string binary(static_cast<size_t>(size), '\0');
+  GLenum format = 0;
+  GLsizei written = 0;
+  glGetProgramBinary(program, size, &written, &format, binary.data());
+  if (written <= 0)
+    return;
+
+  std::error_code error;
+  std::filesystem::create_directories(s_cache.directory_, error);
+  if (error)
+    return;
+
+  std::string data;
+  data.append(k_program_magic, sizeof(k_program_magic));
+  Append(data, k_program_version);
+  Append(data, key);
+  Append(data, check);
+  Append(data, static_cast<u32>(format));
+  Append(data, static_cast<u32>(written));
+  data.append(binary.data(), static_cast<size_t>(written));
+
+  SaveSourceInBinary(path.c_str(), data);
+}
+
+static boolean LoadCached(const byte *fragment_source, const byte *vertex_source, CompileJob &job)
+{
+  if (!s_cache.active_ || !s_cache.supported_)
+    return false;
+
+  job.key_ = SourcesHash(0xCBF29CE484222325ull, fragment_source, vertex_source);
+  job.check_ = SourcesHash(0x84222325CBF29CE4ull, fragment_source, vertex_source);
+  job.path_ = CachePath(job.key_);
+
+  job.program_ = glCreateProgram();
+  if (LoadProgram(job.program_, job.path_, job.key_, job.check_))
+  {
+    s_cache.stats_.loaded_++;
+    return true;
+  }
+
+  // A binary of another driver build or a damaged file, it is replaced
+  std::error_code error;
+  if (std::filesystem::exists(job.path_, error))
+    s_cache.stats_.rejected_++;
+  glDeleteProgram(job.program_);
+
+  return false;
+}
+
+static void BuildJob(CompileJob &job)
+{
+  for (u32 shader : job.shaders_)
+    if (shader != 0)
+      glCompileShader(shader);
+
+  glLinkProgram(job.program_);
+}
+
+static void WorkerLoop(GLFWwindow *context)
+{
+  glfwMakeContextCurrent(context);
+
+  for (;;)
+  {
+    CompileJob *job = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(s_cache.queue_mutex_);
+      s_cache.queue_cv_.wait(lock, [] { return s_cache.stop_ || !s_cache.queue_.empty(); });
+      if (s_cache.stop_)
+        return;
+
+      job = s_cache.queue_.front();
+      s_cache.queue_.pop_front();
+    }
+
+    BuildJob(*job);
+
+    // The link ends here before the window context uses the program
+    glFinish();
+    job->done_.store(true, std::memory_order_release);
+  }
+}
+
+// The window is created by the engine, the worker context shares its objects
+static boolean StartWorker()
+{
+  if (s_cache.worker_context_)
+    return true;
+  if (s_cache.worker_failed_)
+    return false;
+
+  GLFWwindow *window = glfwGetCurrentContext();
+  if (window)
+  {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    s_cache.worker_context_ = glfwCreateWindow(1, 1, "", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+  }
+
+  if (!s_cache.worker_context_)
+  {
+    s_cache.worker_failed_ = true;
+    return false;
+  }
+
+  s_cache.worker_ = std::thread(WorkerLoop, s_cache.worker_context_);
+  return true;
+}
+
+// Nothing here asks the driver for a status, that would wait for the compile
+static CompileJob *StartJob(const byte *fragment_source, const byte *vertex_source, std::unique_ptr<CompileJob> job, boolean use_worker)
+{
+  const byte *sources[2] = {vertex_source, fragment_source};
+  const GLenum types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+
+  job->program_ = glCreateProgram();
+  for (u32 i = 0; i < 2; i++)
+  {
+    if (!sources[i])
+      continue;
+
+    job->shaders_[i] = glCreateShader(types[i]);
+    glShaderSource(job->shaders_[i], 1, &sources[i], nullptr);
+    glAttachShader(job->program_, job->shaders_[i]);
+  }
+  glProgramParameteri(job->program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+  s_cache.stats_.compiled_++;
+  CompileJob *started = job.get();
+  s_cache.jobs_[started->program_] = std::move(job);
+
+  if (use_worker)
+  {
+    std::lock_guard<std::mutex> lock(s_cache.queue_mutex_);
+    s_cache.queue_.push_back(started);
+    s_cache.queue_cv_.notify_one();
+  }
+  else
+  {
+    BuildJob(*started);
+    started->done_.store(true, std::memory_order_release);
+  }
+
+  return started;
+}
+
+static void DropJob(CompileJob &job)
+{
+  for (u32 shader : job.shaders_)
+    if (shader != 0)
+      glDeleteShader(shader);
+}
+
+// Same checks as GPUResources::CreateProgram, then the binary is saved
+static boolean FinishJob(CompileJob &job)
+{
+  const byte *stages[2] = {"vertex", "fragment"};
+  for (u32 i = 0; i < 2; i++)
+  {
+    if (job.shaders_[i] == 0)
+      continue;
+
+    s32 compiled = 0;
+    glGetShaderiv(job.shaders_[i], GL_COMPILE_STATUS, &compiled);
+    if (!compiled)
+    {
+      byte log[512];
+      glGetShaderInfoLog(job.shaders_[i], sizeof(log), nullptr, log);
+      JAM_Engine::AddError(std::string(stages[i]) + ": " + log, __func__, std::to_string(__LINE__));
+    }
+  }
+  DropJob(job);
+
+  s32 linked = 0;
+  glGetProgramiv(job.program_, GL_LINK_STATUS, &linked);
+  if (!linked)
+  {
+    byte log[512];
+    glGetProgramInfoLog(job.program_, sizeof(log), nullptr, log);
+    JAM_Engine::AddError(log, __func__, std::to_string(__LINE__));
+  }
+  else if (!job.path_.empty())
+    SaveProgram(job.program_, job.path_, job.key_, job.check_);
+
+  return linked != 0;
+}
+
+// Programs deleted while the worker had them go once it is done
+static void SweepJobs()
+{
+  for (auto it = s_cache.jobs_.begin(); it != s_cache.jobs_.end();)
+  {
+    CompileJob &job = *it->second;
+    if (job.discard_ && job.done_.load(std::memory_order_acquire))
+    {
+      DropJob(job);
+      glDeleteProgram(job.program_);
+      it = s_cache.jobs_.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+///////////////////////////////////////////////////////////////////////////////
+
+u32 ProgramCache::CreateProgram(const byte *fragment_source, const byte *vertex_source)
+{
+  ReadDriver();
+
+  auto job = std::make_unique<CompileJob>();
+  if (LoadCached(fragment_source, vertex_source, *job))
+    return job->program_;
+
+  CompileJob *started = StartJob(fragment_source, vertex_source, std::move(job), false);
+  u32 program = started->program_;
+  FinishJob(*started);
+  s_cache.jobs_.erase(program);
+
+  return program;
+}
+
+u32 ProgramCache::CreateProgramAsync(const byte *fragment_source, const byte *vertex_source)
+{
+  ReadDriver();
+
+  auto job = std::make_unique<CompileJob>();
+  if (LoadCached(fragment_source, vertex_source, *job))
+    return job->program_;
+
+  // With parallel compile the calls return at once and the driver threads do the work
+  boolean use_worker = !s_cache.parallel_ && StartWorker();
+  return StartJob(fragment_source, vertex_source, std::move(job), use_worker)->program_;
+}
+
+ProgramCache::Status ProgramCache::PollProgram(u32 program)
+{
+  SweepJobs();
+
+  auto found = s_cache.jobs_.find(program);
+  if (found == s_cache.jobs_.end())
+    return Status::Ready;
+
+  CompileJob &job = *found->second;
+  if (!job.done_.load(std::memory_order_acquire))
+    return Status::Compiling;
+
+  if (s_cache.parallel_)
+  {
+    s32 complete = 0;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &complete);
+    if (!complete)
+      return Status::Compiling;
+  }
+
+  boolean linked = FinishJob(job);
+  s_cache.jobs_.erase(found);
+
+  return linked ? Status::Ready : Status::Failed;
+}
+
+void ProgramCache::DeleteProgram(u32 program)
+{
+  auto found = s_cache.jobs_.find(program);
+  if (found != s_cache.jobs_.end())
+  {
+    CompileJob &job = *found->second;
+    if (!job.done_.load(std::memory_order_acquire))
+    {
+      job.discard_ = true;
+      return;
+    }
+
+    DropJob(job);
+    s_cache.jobs_.erase(found);
+  }
+
+  GLState::DeleteProgram(program);
+}
+
+void ProgramCache::SetDirectory(const byte *directory) { s_cache.directory_ = directory; }
+
+void ProgramCache::SetActive(boolean active) { s_cache.active_ = active; }
+
+ProgramCache::Stats ProgramCache::GetStats()
+{
+  Stats stats = s_cache.stats_;
+  for (const auto &[program, job] : s_cache.jobs_)
+    if (!job->discard_)
+      stats.pending_++;
+
+  return stats;
+}
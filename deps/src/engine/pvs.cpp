@@ -0,0 +1,445 @@
+#include <engine/jam_engine.h>
+#include <engine/filemanager.h>
+#include <engine/pvs.h>
+#include <engine/renderer.h>
+#include <engine/taskmanager.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <random>
+
+// File header
+const char k_pvs_magic[4] = {'J', 'P', 'V', 'S'};
+const u32 k_pvs_version = 1;
+
+// Triangles per leaf of the hierarchy
+const u32 k_max_leaf_triangles = 4;
+
+// Cells baked by one task
+const u32 k_cells_per_task = 16;
+
+// Owner returned when nothing blocks the ray
+const s32 k_no_hit = -2;
+
+static f32 Axis(Math::Vec3 v, u32 axis) { return (axis == 0) ? v.x : ((axis == 1) ? v.y : v.z); }
+
+static Math::Vec3 RandomPoint(std::mt19937 &rng, const Math::AABB &box)
+{
+  std::uniform_real_distribution<f32> unit(0.0f, 1.0f);
+  Math::Vec3 size = box.Size();
+
+  return Math::Vec3(box.min.x + (size.x * unit(rng)), box.min.y + (size.y * unit(rng)), box.min.z + (size.z * unit(rng)));
+}
+
+// Moller-Trumbore, t is the fraction of the segment from the origin
+static boolean SegmentHitsTriangle(Math::Vec3 origin, Math::Vec3 segment, Math::Vec3 a, Math::Vec3 b, Math::Vec3 c, f32 &t)
+{
+  const f32 epsilon = 1e-7f;
+
+  Math::Vec3 edge_1 = b - a, edge_2 = c - a;
+  Math::Vec3 p = Math::Vec3::CrossProduct(segment, edge_2);
+  f32 det = Math::Vec3::DotProduct(edge_1, p);
+  if (std::abs(det) < epsilon)
+    return false;
+
+  f32 inv_det = 1.0f / det;
+  Math::Vec3 s = origin - a;
+  f32 u = Math::Vec3::DotProduct(s, p) * inv_det;
+  if (u < 0.0f || u > 1.0f)
+    return false;
+
+  Math::Vec3 q = Math::Vec3::CrossProduct(s, edge_1);
+  f32 v = Math::Vec3::DotProduct(segment, q) * inv_det;
+  if (v < 0.0f || u + v > 1.0f)
+    return false;
+
+  t = Math::Vec3::DotProduct(edge_2, q) * inv_det;
+
+  return (t > 1e-4f && t < 1.0f - 1e-4f);
+}
+
+template <typename T>
+static void Append(std::string &data, const T &value) { data.append(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+template <typename T>
+static boolean Read(const std::string &data, size_t &offset, T &value)
+{
+  if (offset + sizeof(T) > data.size())
+    return false;
+
+  memcpy(&value, data.data() + offset, sizeof(T));
+  offset += sizeof(T);
+
+  return true;
+}
+
+PVS::PVS() : origin_(0.0f), cell_size_(1.0f), cells_x_(0), cells_y_(0), cells_z_(0), row_words_(0) {}
+
+PVS::~PVS() {}
+
+void PVS::free()
+{
+  cells_x_ = cells_y_ = cells_z_ = row_words_ = 0;
+
+  bits_.clear();
+  object_ids_.clear();
+  object_bounds_.clear();
+  indices_.clear();
+  triangles_.clear();
+  nodes_.clear();
+}
+
+boolean PVS::addEntity(Entity::Id root_node, boolean occluder)
+{
+  Math::AABB bounds;
+  if (!Renderer::GetWorldBounds(root_node, Math::Mat4::Identity(), bounds))
+    return false;
+
+  // Without meshes there is nothing to see, it stays out and always visible
+  if (bounds.IsEmpty() || indices_.contains(root_node))
+    return true;
+
+  s32 index = static_cast<s32>(object_ids_.size());
+  object_ids_.push_back(root_node);
+  object_bounds_.push_back(bounds);
+  indices_.insert(std::make_pair(root_node, index));
+
+  if (occluder)
+    addTreeMeshes(root_node, Math::Mat4::Identity(), index);
+
+  return true;
+}
+
+void PVS::addTreeMeshes(Entity::Id node_id, Math::Mat4 father_mat, s32 owner)
+{
+  Transform *tr = EM->getComponent<Transform>(node_id);
+  Math::Mat4 world = tr ? (tr->getTrMatrix() * father_mat) : father_mat;
+
+  Mesh **mesh = EM->getComponent<Mesh *>(node_id);
+  if (mesh && *mesh && (*mesh)->has_mesh_ && (*mesh)->vertices_ && (*mesh)->indices_)
+  {
+    size_t first = triangles_.size();
+    addOccluder(&(*mesh)->vertices_[0].position_, sizeof(Vertex), (*mesh)->vertices_size_, (*mesh)->indices_, (*mesh)->indices_size_, world);
+    for (size_t i = first; i < triangles_.size(); i++)
+      triangles_[i].owner_ = owner;
+  }
+
+  Treenode *node = EM->getComponent<Treenode>(node_id);
+  if (!node)
+    return;
+
+  for (u32 i = 0; i < Treenode::k_max_childs; i++)
+  {
+    Entity::Id child = node->getChild(i);
+    if (child != UINT32_MAX)
+      addTreeMeshes(child, world, owner);
+  }
+}
+
+void PVS::addOccluder(const void *positions, size_t stride, u32 vertex_count, const u32 *indices, u32 index_count, const Math::Mat4 &model_mat)
+{
+  if (!positions || !indices)
+    return;
+
+  const u_byte *base = reinterpret_cast<const u_byte *>(positions);
+  const f32 *m = model_mat.m;
+  auto world = [&](u32 index)
+  {
+    f32 p[3];
+    memcpy(p, base + (stride * index), sizeof(p));
+
+    return Math::Vec3((p[0] * m[0]) + (p[1] * m[4]) + (p[2] * m[8]) + m[12],
+                      (p[0] * m[1]) + (p[1] * m[5]) + (p[2] * m[9]) + m[13],
+                      (p[0] * m[2]) + (p[1] * m[6]) + (p[2] * m[10]) + m[14]);
+  };
+
+  for (u32 i = 0; i + 2 < index_count; i += 3)
+  {
+    if (indices[i] >= vertex_count || indices[i + 1] >= vertex_count || indices[i + 2] >= vertex_count)
+      continue;
+
+    Triangle tri;
+    tri.a_ = world(indices[i]);
+    tri.b_ = world(indices[i + 1]);
+    tri.c_ = world(indices[i + 2]);
+    tri.owner_ = -1;
+    triangles_.push_back(tri);
+  }
+}
+
+void PVS::buildNode(u32 node_index, u32 first, u32 count)
+{
+  Math::AABB bounds, centroids;
+  for (u32 i = first; i < first + count; i++)
+  {
+    const Triangle &tri = triangles_[i];
+    bounds.Expand(tri.a_);
+    bounds.Expand(tri.b_);
+    bounds.Expand(tri.c_);
+    centroids.Expand((tri.a_ + tri.b_ + tri.c_) / 3.0f);
+  }
+
+  nodes_[node_index].bounds_ = bounds;
+  nodes_[node_index].first_ = first;
+  nodes_[node_index].count_ = count;
+
+  if (count <= k_max_leaf_triangles)
+    return;
+
+  Math::Vec3 size = centroids.Size();
+  u32 axis = (size.x > size.y && size.x > size.z) ? 0 : ((size.y > size.z) ? 1 : 2);
+  auto centroid = [axis](const Triangle &tri) { return (Axis(tri.a_, axis) + Axis(tri.b_, axis) + Axis(tri.c_, axis)) / 3.0f; };
+
+  // Middle of the longest axis, or the median when everything falls on one side
+  f32 middle = (Axis(centroids.min, axis) + Axis(centroids.max, axis)) * 0.5f;
+  auto begin = triangles_.begin() + first;
+  u32 left = static_cast<u32>(std::partition(begin, begin + count, [&](const Triangle &tri) { return centroid(tri) < middle; }) - begin);
+  if (left == 0 || left == count)
+  {
+    left = count / 2;
+    std::nth_element(begin, begin + left, begin + count, [&](const Triangle &a, const Triangle &b) { return centroid(a) < centroid(b); });
+  }
+
+  u32 child = static_cast<u32>(nodes_.size());
+  nodes_.push_back(Node());
+  nodes_.push_back(Node());
+  nodes_[node_index].first_ = child;
+  nodes_[node_index].count_ = 0;
+
+  buildNode(child, first, left);
+  buildNode(child + 1, first + left, count - left);
+}
+
+s32 PVS::closestHit(Math::Vec3 from, Math::Vec3 to) const
+{
+  if (nodes_.empty())
+    return k_no_hit;
+
+  Math::Vec3 segment = to - from;
+  Math::Vec3 inv_dir(1.0f / segment.x, 1.0f / segment.y, 1.0f / segment.z);
+
+  s32 owner = k_no_hit;
+  f32 closest = 1.0f;
+
+  thread_local std::vector<u32> stack;
+  stack.clear();
+  stack.push_back(0);
+
+  while (!stack.empty())
+  {
+    const Node &node = nodes_[stack.back()];
+    stack.pop_back();
+
+    f32 entry;
+    if (!node.bounds_.IntersectsRay(from, inv_dir, closest, entry))
+      continue;
+
+    if (node.count_ == 0)
+    {
+      stack.push_back(node.first_ + 1);
+      stack.push_back(node.first_);
+      continue;
+    }
+
+    for (u32 i = node.first_; i < node.first_ + node.count_; i++)
+    {
+      const Triangle &tri = triangles_[i];
+      f32 t;
+      if (SegmentHitsTriangle(from, segment, tri.a_, tri.b_, tri.c_, t) && t < closest)
+      {
+        closest = t;
+        owner = tri.owner_;
+      }
+    }
+  }
+
+  return owner;
+}
+
+void PVS::bake(const BakeSettings &settings)
+{
+  Math::AABB world = settings.world_;
+  if (world.IsEmpty())
+    for (const Math::AABB &bounds : object_bounds_)
+      world.Expand(bounds);
+
+  if (world.IsEmpty() || !(settings.cell_size_.x > 0.0f && settings.cell_size_.y > 0.0f && settings.cell_size_.z > 0.0f))
+    return;
+
+  origin_ = world.min;
+  cell_size_ = settings.cell_size_;
+
+  Math::Vec3 size = world.Size();
+  cells_x_ = std::max(1u, static_cast<u32>(std::ceil(size.x / cell_size_.x)));
+  cells_y_ = std::max(1u, static_cast<u32>(std::ceil(size.y / cell_size_.y)));
+  cells_z_ = std::max(1u, static_cast<u32>(std::ceil(size.z / cell_size_.z)));
+  row_words_ = (static_cast<u32>(object_ids_.size()) + 63) / 64;
+  bits_.assign(static_cast<size_t>(cells_x_) * cells_y_ * cells_z_ * row_words_, 0);
+
+  // Triangle hierarchy for the rays
+  nodes_.clear();
+  if (!triangles_.empty())
+  {
+    nodes_.reserve(triangles_.size() * 2 / k_max_leaf_triangles + 1);
+    nodes_.push_back(Node());
+    buildNode(0, 0, static_cast<u32>(triangles_.size()));
+  }
+
+  // With one core the task manager has no workers
+  u32 workers = settings.threaded_ ? TM->workerCount() : 0;
+  u32 total = cells();
+
+  std::vector<std::future<void>> tasks;
+  u32 first = 0;
+  if (workers > 0)
+  {
+    for (; first < total; first += k_cells_per_task)
+    {
+      u32 end = std::min(first + k_cells_per_task, total);
+      tasks.push_back(TM->enqueue([this, first, end, rays = settings.rays_]()
+      { bakeCells(first, end, rays); }));
+    }
+  }
+
+  bakeCells(first, total, settings.rays_);
+  for (auto &task : tasks)
+    task.wait();
+}
+
+void PVS::bakeCells(u32 first, u32 end, u32 rays)
+{
+  for (u32 cell = first; cell < end; cell++)
+  {
+    u32 x = cell % cells_x_;
+    u32 y = (cell / cells_x_) % cells_y_;
+    u32 z = cell / (cells_x_ * cells_y_);
+
+    Math::Vec3 min(origin_.x + (cell_size_.x * static_cast<f32>(x)), origin_.y + (cell_size_.y * static_cast<f32>(y)), origin_.z + (cell_size_.z * static_cast<f32>(z)));
+    Math::AABB cell_box(min, min + cell_size_);
+
+    // Same samples every bake
+    std::mt19937 rng(cell);
+    u64 *row = bits_.data() + (static_cast<size_t>(cell) * row_words_);
+
+    for (u32 object = 0; object < object_bounds_.size(); object++)
+    {
+      const Math::AABB &bounds = object_bounds_[object];
+      boolean visible = cell_box.Intersects(bounds);
+
+      for (u32 r = 0; r < rays && !visible; r++)
+      {
+        s32 hit = closestHit(RandomPoint(rng, cell_box), RandomPoint(rng, bounds));
+        visible = (hit == k_no_hit || hit == static_cast<s32>(object));
+      }
+
+      if (visible)
+        row[object / 64] |= (1ull << (object % 64));
+    }
+  }
+}
+
+void PVS::save(const char *file) const
+{
+  std::string data;
+  data.append(k_pvs_magic, sizeof(k_pvs_magic));
+  Append(data, k_pvs_version);
+  Append(data, origin_.x);
+  Append(data, origin_.y);
+  Append(data, origin_.z);
+  Append(data, cell_size_.x);
+  Append(data, cell_size_.y);
+  Append(data, cell_size_.z);
+  Append(data, cells_x_);
+  Append(data, cells_y_);
+  Append(data, cells_z_);
+  Append(data, static_cast<u32>(object_ids_.size()));
+
+  data.append(reinterpret_cast<const char *>(object_ids_.data()), object_ids_.size() * sizeof(Entity::Id));
+  data.append(reinterpret_cast<const char *>(bits_.data()), bits_.size() * sizeof(u64));
+
+  SaveSourceInBinary(file, data);
+}
+
+boolean PVS::load(const char *file)
+{
+  free();
+
+  std::string data = LoadSourceFromBinary(file);
+  if (data.size() < sizeof(k_pvs_magic) || memcmp(data.data(), k_pvs_magic, sizeof(k_pvs_magic)) != 0)
+    return false;
+
+  size_t offset = sizeof(k_pvs_magic);
+  u32 version = 0, object_count = 0;
+  boolean ok = Read(data, offset, version) && version == k_pvs_version &&
+               Read(data, offset, origin_.x) && Read(data, offset, origin_.y) && Read(data, offset, origin_.z) &&
+               Read(data, offset, cell_size_.x) && Read(data, offset, cell_size_.y) && Read(data, offset, cell_size_.z) &&
+               Read(data, offset, cells_x_) && Read(data, offset, cells_y_) && Read(data, offset, cells_z_) &&
+               Read(data, offset, object_count);
+
+  row_words_ = (object_count + 63) / 64;
+  size_t ids_size = static_cast<size_t>(object_count) * sizeof(Entity::Id);
+  size_t bits_size = static_cast<size_t>(cells_x_) * cells_y_ * cells_z_ * row_words_ * sizeof(u64);
+  if (!ok || data.size() != offset + ids_size + bits_size)
+  {
+    free();
+    return false;
+  }
+
+  object_ids_.resize(object_count);
+  memcpy(object_ids_.data(), data.data() + offset, ids_size);
+  bits_.resize(bits_size / sizeof(u64));
+  memcpy(bits_.data(), data.data() + offset + ids_size, bits_size);
+
+  for (u32 i = 0; i < object_count; i++)
+    indices_.insert(std::make_pair(object_ids_[i], static_cast<s32>(i)));
+
+  return true;
+}
+
+s32 PVS::cellIndex(Math::Vec3 position) const
+{
+  if (bits_.empty())
+    return -1;
+
+  f32 fx = std::floor((position.x - origin_.x) / cell_size_.x);
+  f32 fy = std::floor((position.y - origin_.y) / cell_size_.y);
+  f32 fz = std::floor((position.z - origin_.z) / cell_size_.z);
+  if (fx < 0.0f || fy < 0.0f || fz < 0.0f || fx >= static_cast<f32>(cells_x_) || fy >= static_cast<f32>(cells_y_) || fz >= static_cast<f32>(cells_z_))
+    return -1;
+
+  u32 x = static_cast<u32>(fx), y = static_cast<u32>(fy), z = static_cast<u32>(fz);
+
+  return static_cast<s32>(x + (cells_x_ * (y + (cells_y_ * z))));
+}
+
+const u64 *PVS::cellBits(Math::Vec3 position) const
+{
+  s32 cell = cellIndex(position);
+  if (cell < 0)
+    return nullptr;
+
+  return bits_.data() + (static_cast<size_t>(cell) * row_words_);
+}
+
+s32 PVS::objectIndex(Entity::Id entity_id) const
+{
+  auto it = indices_.find(entity_id);
+
+  return (it != indices_.end()) ? it->second : -1;
+}
+
+boolean PVS::isVisible(Math::Vec3 position, Entity::Id entity_id) const
+{
+  const u64 *row = cellBits(position);
+  s32 index = objectIndex(entity_id);
+  if (!row || index < 0)
+    return true;
+
+  return ((row[index / 64] >> (index % 64)) & 1ull) != 0;
+}
+
+u32 PVS::cells() const { return cells_x_ * cells_y_ * cells_z_; }
+
+u32 PVS::objects() const { return static_cast<u32>(object_ids_.size()); }
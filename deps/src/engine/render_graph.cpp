@@ -0,0 +1,509 @@
+#include <engine/render_graph.h>
+#include <engine/gl_state.h>
+#include <engine/jam_engine.h>
+
+#include <algorithm>
+
+// Pool
+///////////////////////////////////////////////////////////////////////////////
+const u32 k_free = UINT32_MAX;
+const u32 k_unused_frames = 60;
+const u32 k_max_colour_attachments = 8;
+
+static boolean IsDepthFormat(u32 format)
+{
+  return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32 || format == GL_DEPTH_COMPONENT32F ||
+         format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+}
+
+static boolean IsStencilFormat(u32 format) { return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8; }
+
+static u64 TexelBytes(u32 format)
+{
+  switch (format)
+  {
+  case GL_R8:
+  case GL_STENCIL_INDEX8:
+    return 1;
+  case GL_RG8:
+  case GL_R16F:
+  case GL_DEPTH_COMPONENT16:
+    return 2;
+  case GL_RGBA16F:
+  case GL_RG32F:
+  case GL_DEPTH32F_STENCIL8:
+    return 8;
+  case GL_RGBA32F:
+    return 16;
+  default:
+    return 4;
+  }
+}
+
+static u64 TextureBytes(const RenderGraph::TextureDesc &desc)
+{
+  u64 bytes = 0;
+  for (u32 level = 0; level < desc.levels_; level++)
+    bytes += static_cast<u64>(std::max(desc.width_ >> level, 1u)) * std::max(desc.height_ >> level, 1u) * TexelBytes(desc.format_);
+
+  return bytes;
+}
+
+static boolean SameDesc(const RenderGraph::TextureDesc &a, const RenderGraph::TextureDesc &b)
+{
+  return a.width_ == b.width_ && a.height_ == b.height_ && a.format_ == b.format_ && a.levels_ == b.levels_;
+}
+
+// Image stores and storage writes are the only ones GL does not order on its own
+static boolean IsIncoherent(RenderGraph::Access access) { return access == RenderGraph::Access::Image || access == RenderGraph::Access::Storage; }
+
+static u32 BarrierBit(RenderGraph::Access access)
+{
+  switch (access)
+  {
+  case RenderGraph::Access::Sampled:
+    return GL_TEXTURE_FETCH_BARRIER_BIT;
+  case RenderGraph::Access::Attachment:
+    return GL_FRAMEBUFFER_BARRIER_BIT;
+  case RenderGraph::Access::Image:
+    return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+  case RenderGraph::Access::Storage:
+    return GL_SHADER_STORAGE_BARRIER_BIT;
+  case RenderGraph::Access::Indirect:
+    return GL_COMMAND_BARRIER_BIT;
+  }
+
+  return 0;
+}
+///////////////////////////////////////////////////////////////////////////////
+
+RenderGraph::RenderGraph() : compiled_(false) {}
+
+RenderGraph::~RenderGraph() {}
+
+void RenderGraph::free()
+{
+  for (PoolTexture &pooled : pool_)
+    GLState::DeleteTextures(1, &pooled.texture_);
+  for (CachedFramebuffer &cached : framebuffers_)
+    GLState::DeleteFramebuffers(1, &cached.framebuffer_);
+
+  pool_.clear();
+  framebuffers_.clear();
+  clear();
+}
+
+void RenderGraph::clear()
+{
+  passes_.clear();
+  resources_.clear();
+  compiled_ = false;
+}
+
+RenderGraph::Resource RenderGraph::create(const std::string &name, const TextureDesc &desc)
+{
+  ResourceData resource = {name, desc, 0, false, false, k_free, k_free, k_free};
+  resources_.push_back(resource);
+  compiled_ = false;
+
+  return static_cast<Resource>(resources_.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::import(const std::string &name, u32 texture, const TextureDesc &desc)
+{
+  ResourceData resource = {name, desc, texture, true, false, k_free, k_free, k_free};
+  resources_.push_back(resource);
+  compiled_ = false;
+
+  return static_cast<Resource>(resources_.size() - 1);
+}
+
+u32 RenderGraph::addPass(const std::string &name, ExecuteFunction execute, void *data)
+{
+  PassData pass = {name, execute, data, {}, {}, false, false, 0, 0};
+  passes_.push_back(pass);
+  compiled_ = false;
+
+  return static_cast<u32>(passes_.size() - 1);
+}
+
+boolean RenderGraph::valid(u32 pass, Resource resource, const byte *function) const
+{
+  if (pass != k_free && pass >= passes_.size())
+  {
+    JAM_Engine::AddError("Render graph pass " + std::to_string(pass) + " does not exist", function, std::to_string(__LINE__));
+    return false;
+  }
+
+  if (resource != k_free && resource >= resources_.size())
+  {
+    JAM_Engine::AddError("Render graph resource " + std::to_string(resource) + " does not exist", function, std::to_string(__LINE__));
+    return false;
+  }
+
+  return true;
+}
+
+void RenderGraph::read(u32 pass, Resource resource, Access access)
+{
+  if (!valid(pass, resource, __func__))
+    return;
+
+  passes_[pass].reads_.push_back({resource, access});
+  compiled_ = false;
+}
+
+void RenderGraph::write(u32 pass, Resource resource, Access access)
+{
+  if (!valid(pass, resource, __func__))
+    return;
+
+  passes_[pass].writes_.push_back({resource, access});
+  compiled_ = false;
+}
+
+void RenderGraph::keep(u32 pass)
+{
+  if (!valid(pass, k_free, __func__))
+    return;
+
+  passes_[pass].keep_ = true;
+  compiled_ = false;
+}
+
+void RenderGraph::output(Resource resource)
+{
+  if (!valid(k_free, resource, __func__))
+    return;
+
+  resources_[resource].output_ = true;
+  compiled_ = false;
+}
+
+void RenderGraph::cull()
+{
+  // The writer a pass reads from is the last one added before it
+  std::vector<u32> last_writer(resources_.size(), k_free);
+  std::vector<std::vector<u32>> producers(passes_.size());
+  for (u32 p = 0; p < passes_.size(); p++)
+  {
+    PassData &pass = passes_[p];
+    for (const Use &use : pass.reads_)
+    {
+      if (last_writer[use.resource_] != k_free)
+        producers[p].push_back(last_writer[use.resource_]);
+      else if (!resources_[use.resource_].imported_)
+        JAM_Engine::AddError("Pass " + pass.name_ + " reads " + resources_[use.resource_].name_ + " before anything writes it", __func__,
+                             std::to_string(__LINE__));
+    }
+
+    for (const Use &use : pass.writes_)
+      last_writer[use.resource_] = p;
+
+    pass.alive_ = pass.keep_;
+  }
+
+  for (u32 r = 0; r < resources_.size(); r++)
+    if (resources_[r].output_ && last_writer[r] != k_free)
+      passes_[last_writer[r]].alive_ = true;
+
+  // Producers are always earlier, one walk backwards reaches all of them
+  for (u32 p = static_cast<u32>(passes_.size()); p-- > 0;)
+    if (passes_[p].alive_)
+      for (u32 producer : producers[p])
+        passes_[producer].alive_ = true;
+}
+
+void RenderGraph::placeTransients()
+{
+  for (ResourceData &resource : resources_)
+  {
+    resource.first_ = resource.last_ = k_free;
+    resource.slot_ = k_free;
+  }
+
+  for (u32 p = 0; p < passes_.size(); p++)
+  {
+    if (!passes_[p].alive_)
+      continue;
+
+    for (const std::vector<Use> *uses : {&passes_[p].reads_, &passes_[p].writes_})
+      for (const Use &use : *uses)
+      {
+        ResourceData &resource = resources_[use.resource_];
+        if (resource.first_ == k_free)
+          resource.first_ = p;
+        resource.last_ = p;
+      }
+  }
+
+  // Transients in the order they start, each takes the first free texture that fits
+  std::vector<u32> order;
+  for (u32 r = 0; r < resources_.size(); r++)
+    if (!resources_[r].imported_ && resources_[r].first_ != k_free)
+      order.push_back(r);
+  std::sort(order.begin(), order.end(), [this](u32 a, u32 b) { return resources_[a].first_ < resources_[b].first_; });
+
+  for (PoolTexture &pooled : pool_)
+  {
+    pooled.busy_until_ = k_free;
+    pooled.unused_++;
+  }
+
+  u64 transient_bytes = 0;
+  for (u32 r : order)
+  {
+    ResourceData &resource = resources_[r];
+    transient_bytes += TextureBytes(resource.desc_);
+
+    u32 slot = k_free;
+    for (u32 i = 0; i < pool_.size() && slot == k_free; i++)
+      if (SameDesc(pool_[i].desc_, resource.desc_) && (pool_[i].busy_until_ == k_free || pool_[i].busy_until_ < resource.first_))
+        slot = i;
+
+    if (slot == k_free)
+    {
+      const TextureDesc &desc = resource.desc_;
+      u32 texture = 0;
+      glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+      glTextureStorage2D(texture, static_cast<GLsizei>(std::max(desc.levels_, 1u)), desc.format_, static_cast<GLsizei>(desc.width_),
+                         static_cast<GLsizei>(desc.height_));
+      glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, desc.levels_ > 1 ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+      glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+      // Counted as unused until the transient is placed
+      pool_.push_back({texture, desc, k_free, 1});
+      slot = static_cast<u32>(pool_.size() - 1);
+    }
+
+    PoolTexture &pooled = pool_[slot];
+    if (pooled.unused_ != 0)
+    {
+      stats_.textures_++;
+      stats_.bytes_ += TextureBytes(pooled.desc_);
+    }
+    pooled.busy_until_ = resource.last_;
+    pooled.unused_ = 0;
+
+    resource.slot_ = slot;
+    resource.texture_ = pooled.texture_;
+  }
+
+  stats_.transients_ = static_cast<u32>(order.size());
+  stats_.saved_ = transient_bytes - stats_.bytes_;
+}
+
+void RenderGraph::findBarriers()
+{
+  // Kept per texture of the pool, two transients in one texture are a hazard too
+  u32 pool_size = static_cast<u32>(pool_.size());
+  std::vector<u32> pending(pool_size + resources_.size(), 0);
+  auto Slot = [this, pool_size](Resource r) { return resources_[r].slot_ != k_free ? resources_[r].slot_ : pool_size + r; };
+
+  for (PassData &pass : passes_)
+  {
+    pass.barriers_ = 0;
+    if (!pass.alive_)
+      continue;
+
+    for (const std::vector<Use> *uses : {&pass.reads_, &pass.writes_})
+      for (const Use &use : *uses)
+        pass.barriers_ |= pending[Slot(use.resource_)] & BarrierBit(use.access_);
+
+    // A barrier covers the writes of every resource
+    if (pass.barriers_ != 0)
+      for (u32 &bits : pending)
+        bits &= ~pass.barriers_;
+
+    for (const Use &use : pass.writes_)
+      if (IsIncoherent(use.access_))
+        pending[Slot(use.resource_)] = GL_ALL_BARRIER_BITS;
+  }
+}
+
+u32 RenderGraph::findFramebuffer(const PassData &pass)
+{
+  std::vector<u32> attachments;
+  u32 depth = 0;
+  for (const Use &use : pass.writes_)
+  {
+    const ResourceData &resource = resources_[use.resource_];
+    if (use.access_ != Access::Attachment || resource.texture_ == 0)
+      continue;
+
+    if (IsDepthFormat(resource.desc_.format_))
+      depth = resource.texture_;
+    else if (attachments.size() < k_max_colour_attachments)
+      attachments.push_back(resource.texture_);
+  }
+
+  // A depth read as attachment is the depth test of the pass
+  for (const Use &use : pass.reads_)
+  {
+    const ResourceData &resource = resources_[use.resource_];
+    if (use.access_ == Access::Attachment && resource.texture_ != 0 && IsDepthFormat(resource.desc_.format_))
+      depth = resource.texture_;
+  }
+
+  if (attachments.empty() && depth == 0)
+    return 0;
+
+  attachments.push_back(depth);
+  for (CachedFramebuffer &cached : framebuffers_)
+  {
+    if (cached.attachments_ == attachments)
+    {
+      cached.unused_ = 0;
+      return cached.framebuffer_;
+    }
+  }
+
+  u32 framebuffer = 0;
+  glCreateFramebuffers(1, &framebuffer);
+
+  GLenum draw_buffers[k_max_colour_attachments];
+  u32 colours = static_cast<u32>(attachments.size() - 1);
+  for (u32 i = 0; i < colours; i++)
+  {
+    glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0 + i, attachments[i], 0);
+    draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+  }
+  glNamedFramebufferDrawBuffers(framebuffer, static_cast<GLsizei>(colours), draw_buffers);
+  if (colours == 0)
+    glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+
+  if (depth != 0)
+  {
+    // The format of the depth is the one of the resource written or read
+    boolean stencil = false;
+    for (const std::vector<Use> *uses : {&pass.reads_, &pass.writes_})
+      for (const Use &use : *uses)
+        if (resources_[use.resource_].texture_ == depth)
+          stencil = IsStencilFormat(resources_[use.resource_].desc_.format_);
+    glNamedFramebufferTexture(framebuffer, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, depth, 0);
+  }
+
+  if (glCheckNamedFramebufferStatus(framebuffer, GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    JAM_Engine::AddError("Framebuffer of pass " + pass.name_ + " is not complete", __func__, std::to_string(__LINE__));
+
+  framebuffers_.push_back({framebuffer, attachments, 0});
+  return framebuffer;
+}
+
+void RenderGraph::trim()
+{
+  for (size_t i = 0; i < pool_.size();)
+  {
+    if (pool_[i].unused_ < k_unused_frames)
+    {
+      i++;
+      continue;
+    }
+
+    // The framebuffers with it attached go too
+    u32 texture = pool_[i].texture_;
+    for (size_t f = 0; f < framebuffers_.size();)
+    {
+      std::vector<u32> &attachments = framebuffers_[f].attachments_;
+      if (std::find(attachments.begin(), attachments.end(), texture) == attachments.end())
+      {
+        f++;
+        continue;
+      }
+      GLState::DeleteFramebuffers(1, &framebuffers_[f].framebuffer_);
+      framebuffers_[f] = framebuffers_.back();
+      framebuffers_.pop_back();
+    }
+
+    GLState::DeleteTextures(1, &texture);
+    pool_[i] = pool_.back();
+    pool_.pop_back();
+  }
+
+  for (size_t f = 0; f < framebuffers_.size();)
+  {
+    if (++framebuffers_[f].unused_ < k_unused_frames)
+    {
+      f++;
+      continue;
+    }
+    GLState::DeleteFramebuffers(1, &framebuffers_[f].framebuffer_);
+    framebuffers_[f] = framebuffers_.back();
+    framebuffers_.pop_back();
+  }
+}
+
+void RenderGraph::compile()
+{
+  stats_ = Stats();
+
+  // Removing pool textures moves the others, nothing is placed yet
+  trim();
+  cull();
+  placeTransients();
+  findBarriers();
+
+  for (PassData &pass : passes_)
+  {
+    pass.framebuffer_ = pass.alive_ ? findFramebuffer(pass) : 0;
+    if (pass.alive_)
+      stats_.passes_++;
+    else
+      stats_.culled_++;
+  }
+
+  compiled_ = true;
+}
+
+void RenderGraph::execute()
+{
+  if (!compiled_)
+    compile();
+
+  for (const PassData &pass : passes_)
+  {
+    if (!pass.alive_)
+      continue;
+
+    if (pass.barriers_ != 0)
+    {
+      glMemoryBarrier(pass.barriers_);
+      stats_.barriers_++;
+    }
+
+    if (pass.framebuffer_ == 0)
+    {
+      pass.execute_(*this, pass.data_);
+      continue;
+    }
+
+    // The size of the first attachment is the one of the pass
+    TextureDesc size;
+    for (const std::vector<Use> *uses : {&pass.writes_, &pass.reads_})
+      for (const Use &use : *uses)
+        if (size.width_ == 0 && use.access_ == Access::Attachment && resources_[use.resource_].texture_ != 0)
+          size = resources_[use.resource_].desc_;
+
+    s32 framebuffer = 0;
+    s32 viewport[4] = {0, 0, 0, 0};
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, pass.framebuffer_);
+    glViewport(0, 0, static_cast<GLsizei>(size.width_), static_cast<GLsizei>(size.height_));
+    pass.execute_(*this, pass.data_);
+
+    // The pass may have changed the state without GLState
+    GLState::Invalidate();
+    GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<u32>(framebuffer));
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  }
+}
+
+u32 RenderGraph::texture(Resource resource) const { return resource < resources_.size() ? resources_[resource].texture_ : 0; }
+
+RenderGraph::TextureDesc RenderGraph::desc(Resource resource) const { return resource < resources_.size() ? resources_[resource].desc_ : TextureDesc(); }
+
+RenderGraph::Stats RenderGraph::getStats() const { return stats_; }
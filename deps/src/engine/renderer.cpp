@@ -0,0 +1,2079 @@
+#include <engine/gl_state.h>
+#include <engine/gpu_culling.h>
+#include <engine/jam_engine.h>
+#include <engine/mesh_pool.h>
+#include <engine/program_cache.h>
+#include <engine/renderer.h>
+#include <engine/ring_buffer.h>
+#include <engine/taskmanager.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Sort keys
+///////////////////////////////////////////////////////////////////////////////
+// From the most to the least significant bits:
+// | pass 2 | shader 12 | texture set 8 | mesh 10 | draw config 6 | depth 26 |
+// So the queue is grouped by program, then by textures and buffers, and
+// front to back inside every group. The texture set is only used with the
+// multi draw, without it the mesh already tells the textures.
+const u32 k_pass_bits = 2;
+const u32 k_shader_bits = 12;
+const u32 k_textures_bits = 8;
+const u32 k_mesh_bits = 10;
+const u32 k_config_bits = 6;
+const u32 k_depth_bits = 26;
+
+const u32 k_depth_shift = 0;
+const u32 k_config_shift = k_depth_shift + k_depth_bits;
+const u32 k_mesh_shift = k_config_shift + k_config_bits;
+const u32 k_textures_shift = k_mesh_shift + k_mesh_bits;
+const u32 k_shader_shift = k_textures_shift + k_textures_bits;
+const u32 k_pass_shift = k_shader_shift + k_shader_bits;
+
+// Same texture unit the engine gives to the material textures
+const u32 k_material_texture_unit = 7;
+
+// Trees read at once by a thread when a world is extracted
+const size_t k_extract_chunk = 256;
+
+// Thread that records a view
+const u32 k_owner_none = 0;
+const u32 k_owner_worker = 1;
+const u32 k_owner_caller = 2;
+
+enum class RenderPass : u32
+{
+  Shadow = 0,
+  Main,
+};
+
+struct DrawItem
+{
+  Entity::Id id_;           ///< Root node of the tree.
+  Math::Mat4 father_;       ///< Matrix given to Render.
+  Math::Mat4 world_;        ///< Model matrix of the root node.
+  Shader *shader_;          ///< Program of the root node, may be null.
+  Mesh *mesh_;              ///< Mesh of the root node, may be null.
+  DrawConfig config_;       ///< Raster state of the root node.
+  boolean leaf_;            ///< The tree is only the root node, it can skip the engine.
+  Math::AABB bounds_;       ///< World bounds of the tree.
+  boolean has_bounds_;      ///< False if the tree had no bounds when it was queued.
+};
+
+struct SortEntry
+{
+  u64 key_;   ///< Sort key of the item.
+  u32 index_; ///< Item index in the queue.
+};
+
+// Same layout as InstanceData in the vertex prelude (std430)
+struct InstanceData
+{
+  Math::Mat4 m_matrix_; ///< Model matrix.
+  u32 entity_id_;       ///< Entity identifier for the picker.
+  u32 padding_[3];      ///< Struct size is rounded to the mat4 alignment.
+};
+
+static_assert(sizeof(InstanceData) == 80, "InstanceData must match the std430 layout");
+
+// Same layout as DrawElementsIndirectCommand
+struct DrawCommand
+{
+  u32 count_;          ///< Indices of the mesh.
+  u32 instance_count_; ///< Trees drawn with the mesh.
+  u32 first_index_;    ///< First index in the pool.
+  s32 base_vertex_;    ///< First vertex in the pool.
+  u32 base_instance_;  ///< First instance in the instance buffer.
+};
+
+static_assert(sizeof(DrawCommand) == 20, "DrawCommand must match DrawElementsIndirectCommand");
+
+enum class DrawStep : u32
+{
+  Engine = 0, ///< The engine draws the tree and sets up its program.
+  Program,    ///< The renderer sets up a program the engine set up before, nothing is drawn.
+  Leaves,     ///< Leaves with the same state, instanced or one by one.
+  MultiDraw,  ///< Bucket of the multi draw.
+};
+
+// Draws of the sorted queue, planned before any of them is sent
+struct DrawRun
+{
+  DrawStep step_; ///< How the run is drawn.
+  u32 first_;     ///< First position in the sorted queue.
+  u32 end_;       ///< One past the last position.
+  u32 bucket_;    ///< Bucket of the GPU culling, only in the multi draw.
+  u32 command_;   ///< First command of the bucket in the GPU culling.
+  u32 commands_;  ///< Commands of the bucket in the GPU culling.
+};
+
+// Dense storage of the components a draw reads, indexed by the internal identifiers
+struct ComponentArrays
+{
+  Entity::Components<Transform> *transforms_;
+  Entity::Components<Shader *> *shaders_;
+  Entity::Components<Mesh *> *meshes_;
+  Entity::Components<DrawConfig> *configs_;
+  Entity::Components<Treenode> *nodes_;
+};
+
+// Draws of one view, filled on the render thread or on a worker of the task
+// manager. Nothing in it calls GL, the texture sets of the multi draw are put
+// in the keys when it is drawn
+struct CommandList
+{
+  RenderPass pass_ = RenderPass::Main;  ///< Pass of the draws.
+  std::vector<Math::Frustum> frustums_; ///< Frustums of the view, visible if any of them sees it.
+  Math::Vec3 view_pos_;                 ///< Camera position for the depth key.
+  boolean culling_ = true;              ///< Culling active when the view was set.
+  const PVS *pvs_ = nullptr;            ///< Potentially visible set when the view was set.
+  const u64 *pvs_row_ = nullptr;        ///< Visibility bits of the camera cell.
+
+  std::unordered_map<const Shader *, u32> shader_keys_; ///< Sort index of every program seen.
+  std::unordered_map<const Mesh *, u32> mesh_keys_;     ///< Sort index of every mesh seen.
+
+  std::vector<DrawItem> queue_;         ///< Draws of the view.
+  std::vector<SortEntry> keys_;         ///< Sort keys of the queue.
+  std::vector<SortEntry> keys_scratch_; ///< Radix sort ping-pong buffer.
+  boolean sorted_ = false;              ///< The keys are already in order.
+
+  std::vector<Entity::Id> span_ids_;  ///< Entities gathered by RenderAll.
+  std::vector<size_t> span_internal_; ///< Internal identifiers of the gathered entities.
+  std::vector<boolean> child_flags_;  ///< Entities that are children of another one, by identifier.
+
+  std::vector<Math::Frustum::Result> results_;         ///< Frustum test of every tree of a world.
+  std::vector<Math::Frustum::Result> results_scratch_; ///< Test of the next frustum of the view.
+  std::vector<u32> remap_;                             ///< New position of every draw when a recording is taken.
+
+  Renderer::Stats stats_; ///< Culling counters of the draws, added to the frame when they are drawn.
+};
+
+// What the views of a frame read, copied from the entities and the hierarchy
+// so the workers never read them while the simulation changes them
+struct RenderWorld
+{
+  const SceneBVH *source_ = nullptr; ///< Hierarchy it was extracted from.
+  u32 frame_ = UINT32_MAX;           ///< Frame it was extracted in.
+  std::vector<Entity::Id> ids_;      ///< Root nodes of the hierarchy.
+  std::vector<size_t> internal_ids_; ///< Internal identifiers of the root nodes.
+  std::vector<DrawItem> trees_;      ///< Draw of every root node, with its world bounds.
+  std::vector<f32> centers_[3];      ///< Bounds centers of the trees by axis, for the batched frustum test.
+  std::vector<f32> extents_[3];      ///< Bounds extents of the trees by axis.
+  std::vector<u8> occluded_;         ///< Trees hidden by the occluders of the main pass when it was extracted.
+};
+
+// View recorded by a worker, taken by the pass that draws the same view
+struct Recording
+{
+  CommandList list_;                             ///< Draws recorded.
+  const SceneBVH *scene_ = nullptr;              ///< Hierarchy recorded.
+  const RenderWorld *world_ = nullptr;           ///< Copy of the frame it reads.
+  Camera *camera_ = nullptr;                     ///< Camera of a main pass recording.
+  u32 light_id_ = 0;                             ///< Light of a shadow recording.
+  LightType light_type_ = LightType::PointLight; ///< Type of the light.
+  boolean sort_ = false;                         ///< Sorted by the worker, not with the multi draw.
+  boolean pending_ = false;                      ///< Recorded this frame and not taken yet.
+  std::atomic<u32> owner_ = k_owner_none;        ///< Thread that records it, the first one to claim it.
+  std::future<void> task_;                       ///< Worker recording it.
+};
+
+// View drawn from a hierarchy this frame, recorded again for the next one
+struct PipelinedView
+{
+  RenderPass pass_;        ///< Pass of the view.
+  const SceneBVH *scene_;  ///< Hierarchy drawn.
+  Camera *camera_;         ///< Camera of a main pass view.
+  u32 light_id_;           ///< Light of a shadow view.
+  LightType light_type_;   ///< Type of the light.
+};
+///////////////////////////////////////////////////////////////////////////////
+
+// Handles of the uniforms the renderer sets on every program
+struct ShaderUniforms
+{
+  Shader::Uniform instanced_;
+  Shader::Uniform m_matrix_;
+  Shader::Uniform mesh_id_;
+  Shader::Uniform light_sizes_[3];
+  boolean engine_ready_ = false; ///< The engine set up the program once, the shader kept its values.
+};
+///////////////////////////////////////////////////////////////////////////////
+
+// Renderer data
+///////////////////////////////////////////////////////////////////////////////
+struct RendererData
+{
+  std::unordered_map<const Mesh *, Math::AABB> mesh_bounds_; ///< Local bounds of every loaded mesh.
+  std::mutex bounds_mutex_;                                  ///< The workers read the mesh bounds too.
+
+  boolean culling_ = true;                     ///< Culling active.
+  const OcclusionBuffer *occlusion_ = nullptr; ///< Occluders of the main pass.
+  const PVS *pvs_ = nullptr;                   ///< Potentially visible set of the main pass.
+
+  std::unordered_map<Shader *, ShaderUniforms> shader_uniforms_; ///< Uniform handles of every program seen.
+
+  CommandList list_;                                   ///< Draws of the current pass.
+  Camera *camera_ = nullptr;                           ///< Camera of the current main pass.
+  u32 light_id_ = 0;                                   ///< Light of the current shadow pass.
+  LightType light_type_ = LightType::PointLight;       ///< Type of the light.
+  std::vector<std::unique_ptr<Recording>> recordings_; ///< Views recorded by the workers, kept between frames.
+  RenderWorld worlds_[2];                              ///< Frames extracted for the recordings, one may still be read.
+  u32 world_ = 0;                                      ///< Last world extracted.
+  boolean pipelined_ = false;                          ///< The views of a frame are recorded again for the next one.
+  std::vector<PipelinedView> views_;                   ///< Views drawn from a hierarchy this frame.
+
+  std::vector<InstanceData> instances_; ///< Instance data of the queue in sorted order.
+  u32 instance_buffer_ = 0;             ///< Storage buffer bound at INSTANCE_BIND.
+  size_t instance_capacity_ = 0;        ///< Size of the storage buffer in bytes.
+  RingBuffer::Slice instance_slice_;    ///< Instances of the queue in the ring buffer, used instead of the storage buffer.
+
+  MeshPool pool_;                     ///< Shared buffers for the multi draw.
+  boolean multi_draw_ = false;        ///< Multi draw active.
+  std::vector<DrawCommand> commands_; ///< Commands of the current bucket.
+  u32 indirect_buffer_ = 0;           ///< Indirect buffer of the pass.
+  size_t indirect_capacity_ = 0;      ///< Size of the indirect buffer in bytes.
+  size_t indirect_offset_ = 0;        ///< Bytes used in the current pass.
+  boolean indirect_ring_ = false;     ///< The commands of the pass go to the ring buffer.
+  std::vector<DrawRun> runs_;         ///< Draws of the current pass.
+  u32 engine_materials_ = 0;          ///< Material buffer the engine had bound, put back after the multi draws.
+  boolean pool_materials_ = false;    ///< The pool materials are bound in place of the engine ones.
+
+  GPUCulling gpu_culling_;                           ///< Compute culling of the multi draw buckets.
+  boolean gpu_cull_ = false;                         ///< GPU culling active.
+  boolean has_camera_ = false;                       ///< BeginRender got a camera.
+  Math::Mat4 view_projection_;                       ///< Camera of the main pass.
+  f32 time_ = 0.0f;                                  ///< Time of the frame block.
+  u32 frame_count_ = 0;                              ///< Frames begun.
+  std::vector<GPUCulling::Instance> cull_instances_; ///< Bounds of the multi draw trees.
+  std::vector<GPUCulling::Command> cull_commands_;   ///< Commands of the multi draw buckets.
+
+  std::unordered_map<const Mesh *, const Meshlets *> meshlets_; ///< Clusters of the meshes culled by parts.
+  std::vector<Meshlets::Range> meshlet_ranges_;                 ///< Visible clusters of the mesh being drawn.
+  std::vector<s32> meshlet_counts_;                             ///< Index counts of the visible ranges.
+  std::vector<const void *> meshlet_offsets_;                   ///< Byte offsets of the visible ranges.
+
+  Renderer::Stats frame_;      ///< Stats of the frame in progress.
+  Renderer::Stats last_frame_; ///< Stats of the last finished frame.
+};
+
+static RendererData s_renderer;
+///////////////////////////////////////////////////////////////////////////////
+
+// Helpers
+///////////////////////////////////////////////////////////////////////////////
+static ShaderUniforms &Uniforms(Shader *shader)
+{
+  auto it = s_renderer.shader_uniforms_.find(shader);
+  if (it != s_renderer.shader_uniforms_.end())
+    return it->second;
+
+  ShaderUniforms uniforms;
+  uniforms.instanced_ = shader->getUniform("u_instanced");
+  uniforms.m_matrix_ = shader->getUniform("u_m_matrix");
+  uniforms.mesh_id_ = shader->getUniform("u_mesh_id");
+  uniforms.light_sizes_[0] = shader->getUniform("u_point_light_size");
+  uniforms.light_sizes_[1] = shader->getUniform("u_spot_light_size");
+  uniforms.light_sizes_[2] = shader->getUniform("u_directional_light_size");
+  return s_renderer.shader_uniforms_.emplace(shader, uniforms).first->second;
+}
+
+static boolean IsVisible(const CommandList &list, const Math::AABB &bounds, boolean has_bounds)
+{
+  if (!list.culling_ || list.frustums_.empty() || !has_bounds)
+    return true;
+
+  for (const Math::Frustum &frustum : list.frustums_)
+    if (frustum.IsVisible(bounds))
+      return true;
+
+  return false;
+}
+
+// Render thread only, the workers read what the world tested when it was
+// extracted, the occluders may be rasterized again meanwhile
+static boolean IsOccluded(boolean culling, const Math::AABB &bounds, boolean has_bounds)
+{
+  if (!culling || !s_renderer.occlusion_ || !has_bounds)
+    return false;
+
+  return !s_renderer.occlusion_->isVisible(bounds);
+}
+
+static boolean IsHiddenByPVS(const CommandList &list, Entity::Id root_node)
+{
+  if (!list.culling_ || !list.pvs_row_)
+    return false;
+
+  s32 index = list.pvs_->objectIndex(root_node);
+  if (index < 0)
+    return false;
+
+  return ((list.pvs_row_[index / 64] >> (index % 64)) & 1ull) == 0;
+}
+
+template <typename T>
+static u32 SortIndex(std::unordered_map<const T *, u32> &indices, const T *ptr)
+{
+  auto it = indices.find(ptr);
+  if (it != indices.end())
+    return it->second;
+
+  u32 index = static_cast<u32>(indices.size());
+  indices.insert(std::make_pair(ptr, index));
+
+  return index;
+}
+
+static u32 ConfigBits(DrawConfig config)
+{
+  return (static_cast<u32>(config.mode_) & 0x3) |
+         (config.active_culling_ ? 0x4 : 0x0) |
+         ((static_cast<u32>(config.cll_mode_) & 0x3) << 3) |
+         ((static_cast<u32>(config.cll_face_) & 0x1) << 5);
+}
+
+static u32 DepthBits(f32 distance)
+{
+  // Positive floats keep their order when read as integers
+  if (!(distance > 0.0f))
+    return 0;
+
+  u32 bits;
+  memcpy(&bits, &distance, sizeof(bits));
+
+  return bits >> (32 - k_depth_bits);
+}
+
+static u64 MakeKey(RenderPass pass, u32 shader, u32 textures, u32 mesh, u32 config, u32 depth)
+{
+  return ((static_cast<u64>(pass) & ((1ull << k_pass_bits) - 1)) << k_pass_shift) |
+         ((static_cast<u64>(shader) & ((1ull << k_shader_bits) - 1)) << k_shader_shift) |
+         ((static_cast<u64>(textures) & ((1ull << k_textures_bits) - 1)) << k_textures_shift) |
+         ((static_cast<u64>(mesh) & ((1ull << k_mesh_bits) - 1)) << k_mesh_shift) |
+         ((static_cast<u64>(config) & ((1ull << k_config_bits) - 1)) << k_config_shift) |
+         ((static_cast<u64>(depth) & ((1ull << k_depth_bits) - 1)) << k_depth_shift);
+}
+
+static u64 ItemKey(CommandList &list, const DrawItem &item)
+{
+  // The shadow program is the same for everything, the texture set is put in
+  // by ResolveTextures because the pool uploads the meshes
+  u32 shader_index = (list.pass_ == RenderPass::Main) ? SortIndex(list.shader_keys_, static_cast<const Shader *>(item.shader_)) : 0;
+  u32 mesh_index = SortIndex(list.mesh_keys_, static_cast<const Mesh *>(item.mesh_));
+  u32 depth = 0;
+  if (list.pass_ == RenderPass::Main && item.has_bounds_)
+    depth = DepthBits(Math::Vec3::Distance(list.view_pos_, item.bounds_.Center()));
+
+  return MakeKey(list.pass_, shader_index, 0, mesh_index, ConfigBits(item.config_), depth);
+}
+
+static void EnqueueItem(CommandList &list, const DrawItem &item, const Math::AABB &bounds, boolean has_bounds)
+{
+  list.queue_.push_back(item);
+  DrawItem &queued = list.queue_.back();
+  queued.bounds_ = bounds;
+  queued.has_bounds_ = has_bounds && !bounds.IsEmpty();
+
+  SortEntry entry;
+  entry.key_ = ItemKey(list, queued);
+  entry.index_ = static_cast<u32>(list.queue_.size() - 1);
+
+  list.keys_.push_back(entry);
+  list.sorted_ = false;
+}
+
+static void Enqueue(CommandList &list, Entity::Id root_node, Math::Mat4 father_mat, const Math::AABB &bounds, boolean has_bounds)
+{
+  DrawItem item;
+  item.id_ = root_node;
+  item.father_ = father_mat;
+
+  Transform *tr = EM->getComponent<Transform>(root_node);
+  item.world_ = tr ? (tr->getTrMatrix() * father_mat) : father_mat;
+
+  Shader **shader = EM->getComponent<Shader *>(root_node);
+  item.shader_ = shader ? *shader : nullptr;
+
+  Mesh **mesh = EM->getComponent<Mesh *>(root_node);
+  item.mesh_ = mesh ? *mesh : nullptr;
+
+  DrawConfig *config = EM->getComponent<DrawConfig>(root_node);
+  item.config_ = config ? *config : DrawConfig();
+
+  item.leaf_ = true;
+  Treenode *node = EM->getComponent<Treenode>(root_node);
+  if (node)
+    for (u32 i = 0; i < Treenode::k_max_childs && item.leaf_; i++)
+      item.leaf_ = (node->getChild(i) == UINT32_MAX);
+
+  EnqueueItem(list, item, bounds, has_bounds);
+}
+
+static ComponentArrays GetComponentArrays()
+{
+  ComponentArrays arrays;
+  arrays.transforms_ = EM->getComponentsStorage<Transform>();
+  arrays.shaders_ = EM->getComponentsStorage<Shader *>();
+  arrays.meshes_ = EM->getComponentsStorage<Mesh *>();
+  arrays.configs_ = EM->getComponentsStorage<DrawConfig>();
+  arrays.nodes_ = EM->getComponentsStorage<Treenode>();
+
+  return arrays;
+}
+
+template <typename T>
+static T *DenseComponent(const Entity::Components<T> *storage, size_t internal_id)
+{
+  if (internal_id >= storage->size_ || !storage->has_value_[internal_id])
+    return nullptr;
+
+  return storage->components_ + internal_id;
+}
+
+// Reads a tree from the dense arrays, the leaf bounds come from the mesh
+// bounds of the last mesh seen, so runs of the same mesh skip the lookup
+static void ReadTree(const ComponentArrays &arrays, Entity::Id root_node, size_t internal_id, Math::Mat4 father_mat,
+                     const Mesh *&last_mesh, Math::AABB &last_bounds, DrawItem &item)
+{
+  item.id_ = root_node;
+  item.father_ = father_mat;
+
+  Transform *tr = DenseComponent(arrays.transforms_, internal_id);
+  item.world_ = tr ? (tr->getTrMatrix() * father_mat) : father_mat;
+
+  Shader **shader = DenseComponent(arrays.shaders_, internal_id);
+  item.shader_ = shader ? *shader : nullptr;
+
+  Mesh **mesh = DenseComponent(arrays.meshes_, internal_id);
+  item.mesh_ = mesh ? *mesh : nullptr;
+
+  DrawConfig *config = DenseComponent(arrays.configs_, internal_id);
+  item.config_ = config ? *config : DrawConfig();
+
+  item.leaf_ = true;
+  Treenode *node = DenseComponent(arrays.nodes_, internal_id);
+  if (node)
+    for (u32 c = 0; c < Treenode::k_max_childs && item.leaf_; c++)
+      item.leaf_ = (node->getChild(c) == UINT32_MAX);
+
+  item.bounds_ = Math::AABB();
+  item.has_bounds_ = true;
+  if (!item.leaf_)
+  {
+    item.has_bounds_ = Renderer::GetWorldBounds(item.id_, father_mat, item.bounds_);
+  }
+  else if (item.mesh_)
+  {
+    if (item.mesh_ != last_mesh)
+    {
+      last_mesh = item.mesh_;
+      last_bounds = Renderer::GetMeshBounds(item.mesh_);
+    }
+
+    item.has_bounds_ = !last_bounds.IsEmpty();
+    if (item.has_bounds_)
+      item.bounds_ = last_bounds.Transformed(item.world_);
+  }
+}
+
+// Frustum and occluders, the PVS is tested before the tree is read
+static void EnqueueTree(CommandList &list, const DrawItem &item)
+{
+  u32 &draws = (list.pass_ == RenderPass::Main) ? list.stats_.draws_ : list.stats_.shadow_draws_;
+  u32 &culled = (list.pass_ == RenderPass::Main) ? list.stats_.culled_ : list.stats_.shadow_culled_;
+
+  if (!IsVisible(list, item.bounds_, item.has_bounds_))
+  {
+    culled++;
+    return;
+  }
+
+  if (list.pass_ == RenderPass::Main && IsOccluded(list.culling_, item.bounds_, item.has_bounds_))
+  {
+    list.stats_.occluded_++;
+    return;
+  }
+
+  draws++;
+  EnqueueItem(list, item, item.bounds_, item.has_bounds_);
+}
+
+// Same as the single entity path, but every component is read straight from
+// its dense array instead of looking up every entity on its own
+static void EnqueueSpan(CommandList &list, std::span<const Entity::Id> roots, const size_t *internal_ids, Math::Mat4 father_mat)
+{
+  if (roots.empty())
+    return;
+
+  ComponentArrays arrays = GetComponentArrays();
+
+  list.queue_.reserve(list.queue_.size() + roots.size());
+  list.keys_.reserve(list.keys_.size() + roots.size());
+
+  const Mesh *last_mesh = nullptr;
+  Math::AABB last_bounds;
+
+  for (size_t i = 0; i < roots.size(); i++)
+  {
+    size_t internal_id = internal_ids[i];
+    if (internal_id == SIZE_MAX)
+      continue;
+
+    if (list.pass_ == RenderPass::Main && IsHiddenByPVS(list, roots[i]))
+    {
+      list.stats_.pvs_culled_++;
+      continue;
+    }
+
+    DrawItem item;
+    ReadTree(arrays, roots[i], internal_id, father_mat, last_mesh, last_bounds, item);
+    EnqueueTree(list, item);
+  }
+}
+
+static void EnqueueIds(CommandList &list, std::span<const Entity::Id> roots, Math::Mat4 father_mat)
+{
+  list.span_internal_.resize(roots.size());
+  EM->getInternalIds(roots, list.span_internal_.data());
+
+  EnqueueSpan(list, roots, list.span_internal_.data(), father_mat);
+}
+
+static void EnqueueQuery(CommandList &list, RenderQuery query, Math::Mat4 father_mat)
+{
+  std::vector<Entity::Id> &ids = list.span_ids_;
+  std::vector<size_t> &internal_ids = list.span_internal_;
+  std::vector<boolean> &child_flags = list.child_flags_;
+
+  ids.clear();
+  internal_ids.clear();
+  EM->forEachEntity([&](Entity::Id id, size_t internal_id)
+  {
+    ids.push_back(id);
+    internal_ids.push_back(internal_id);
+  });
+
+  if (query.roots_only_)
+  {
+    // The children are drawn by their roots
+    Entity::Components<Treenode> *nodes = EM->getComponentsStorage<Treenode>();
+    child_flags.clear();
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+      Treenode *node = DenseComponent(nodes, internal_ids[i]);
+      if (!node)
+        continue;
+
+      for (u32 c = 0; c < Treenode::k_max_childs; c++)
+      {
+        Entity::Id child = node->getChild(c);
+        if (child == UINT32_MAX)
+          continue;
+
+        if (child >= child_flags.size())
+          child_flags.resize(static_cast<size_t>(child) + 1, false);
+        child_flags[child] = true;
+      }
+    }
+  }
+
+  size_t count = 0;
+  for (size_t i = 0; i < ids.size(); i++)
+  {
+    if (query.roots_only_ && ids[i] < child_flags.size() && child_flags[ids[i]])
+      continue;
+    if (query.filter_ && !query.filter_(ids[i]))
+      continue;
+
+    ids[count] = ids[i];
+    internal_ids[count] = internal_ids[i];
+    count++;
+  }
+
+  EnqueueSpan(list, std::span<const Entity::Id>(ids.data(), count), internal_ids.data(), father_mat);
+}
+
+// Trees of the hierarchy in the frustums of the list, left in span_ids_
+static void QueryScene(CommandList &list, const SceneBVH &scene)
+{
+  std::vector<Entity::Id> &ids = list.span_ids_;
+  ids.clear();
+
+  if (!list.culling_ || list.frustums_.empty())
+  {
+    scene.entities(ids);
+  }
+  else
+  {
+    for (const Math::Frustum &frustum : list.frustums_)
+      scene.query(frustum, ids);
+
+    // Point lights have six frustums, a tree can be in more than one
+    if (list.frustums_.size() > 1)
+    {
+      std::sort(ids.begin(), ids.end());
+      ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+  }
+
+  u32 &culled = (list.pass_ == RenderPass::Main) ? list.stats_.culled_ : list.stats_.shadow_culled_;
+  culled += scene.size() - static_cast<u32>(ids.size());
+}
+
+static void EnqueueScene(CommandList &list, const SceneBVH &scene)
+{
+  QueryScene(list, scene);
+  EnqueueIds(list, list.span_ids_, Math::Mat4::Identity());
+}
+
+// Same culling as EnqueueScene, with the trees read when the world was
+// extracted. Every tree is tested against the view in one batched pass
+// instead of walking the hierarchy
+static void EnqueueWorld(CommandList &list, const RenderWorld &world)
+{
+  size_t count = world.trees_.size();
+  boolean frustum_test = list.culling_ && !list.frustums_.empty();
+
+  if (frustum_test)
+  {
+    Math::Batch::ConstVec3Span centers(world.centers_[0].data(), world.centers_[1].data(), world.centers_[2].data(), count);
+    Math::Batch::ConstVec3Span extents(world.extents_[0].data(), world.extents_[1].data(), world.extents_[2].data(), count);
+
+    list.results_.resize(count);
+    Math::Batch::ClassifyAABBs(list.frustums_[0], centers, extents, list.results_.data());
+
+    // Point lights have six frustums, a tree is visible if any of them sees it
+    list.results_scratch_.resize(count);
+    for (size_t f = 1; f < list.frustums_.size(); f++)
+    {
+      Math::Batch::ClassifyAABBs(list.frustums_[f], centers, extents, list.results_scratch_.data());
+      for (size_t i = 0; i < count; i++)
+        if (list.results_[i] == Math::Frustum::Result::Outside)
+          list.results_[i] = list.results_scratch_[i];
+    }
+  }
+
+  list.queue_.reserve(list.queue_.size() + count);
+  list.keys_.reserve(list.keys_.size() + count);
+
+  u32 &draws = (list.pass_ == RenderPass::Main) ? list.stats_.draws_ : list.stats_.shadow_draws_;
+  u32 &culled = (list.pass_ == RenderPass::Main) ? list.stats_.culled_ : list.stats_.shadow_culled_;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    if (world.internal_ids_[i] == SIZE_MAX)
+      continue;
+
+    const DrawItem &item = world.trees_[i];
+    if (frustum_test && item.has_bounds_ && list.results_[i] == Math::Frustum::Result::Outside)
+    {
+      culled++;
+      continue;
+    }
+
+    if (list.pass_ == RenderPass::Main && IsHiddenByPVS(list, item.id_))
+    {
+      list.stats_.pvs_culled_++;
+      continue;
+    }
+
+    if (list.pass_ == RenderPass::Main && list.culling_ && world.occluded_[i])
+    {
+      list.stats_.occluded_++;
+      continue;
+    }
+
+    draws++;
+    EnqueueItem(list, item, item.bounds_, item.has_bounds_);
+  }
+}
+
+static void SortQueue(CommandList &list)
+{
+  std::vector<SortEntry> &keys = list.keys_;
+  std::vector<SortEntry> &scratch = list.keys_scratch_;
+  u32 count = static_cast<u32>(keys.size());
+  list.sorted_ = true;
+  if (count < 2)
+    return;
+
+  // LSD radix sort, 8 bits per pass, stable so equal keys keep the call order
+  u32 histogram[8][256] = {};
+  for (const SortEntry &entry : keys)
+    for (u32 byte = 0; byte < 8; byte++)
+      histogram[byte][(entry.key_ >> (byte * 8)) & 0xFF]++;
+
+  scratch.resize(count);
+  for (u32 byte = 0; byte < 8; byte++)
+  {
+    u32 *bucket = histogram[byte];
+    u32 shift = byte * 8;
+
+    // Every key has the same byte, nothing moves
+    if (bucket[(keys[0].key_ >> shift) & 0xFF] == count)
+      continue;
+
+    u32 offset = 0;
+    for (u32 i = 0; i < 256; i++)
+    {
+      u32 size = bucket[i];
+      bucket[i] = offset;
+      offset += size;
+    }
+
+    for (const SortEntry &entry : keys)
+      scratch[bucket[(entry.key_ >> shift) & 0xFF]++] = entry;
+
+    keys.swap(scratch);
+  }
+}
+
+static void TakeStats(CommandList &list)
+{
+  Renderer::Stats &frame = s_renderer.frame_;
+  frame.draws_ += list.stats_.draws_;
+  frame.culled_ += list.stats_.culled_;
+  frame.shadow_draws_ += list.stats_.shadow_draws_;
+  frame.shadow_culled_ += list.stats_.shadow_culled_;
+  frame.occluded_ += list.stats_.occluded_;
+  frame.pvs_culled_ += list.stats_.pvs_culled_;
+
+  list.stats_ = Renderer::Stats();
+}
+
+static void ClearList(CommandList &list)
+{
+  list.queue_.clear();
+  list.keys_.clear();
+  list.sorted_ = false;
+}
+
+// The pool uploads the meshes it takes, so the texture sets of the multi draw
+// are put in the keys on the render thread, right before the sort
+static void ResolveTextures(CommandList &list)
+{
+  if (list.pass_ != RenderPass::Main || !s_renderer.multi_draw_)
+    return;
+
+  const u64 mask = ((1ull << k_textures_bits) - 1) << k_textures_shift;
+  for (SortEntry &entry : list.keys_)
+  {
+    Mesh *mesh = list.queue_[entry.index_].mesh_;
+    if (!mesh)
+      continue;
+
+    s_renderer.pool_.add(mesh);
+    u64 textures = (static_cast<u64>(s_renderer.pool_.textureSet(mesh)) << k_textures_shift) & mask;
+    if ((entry.key_ & mask) == textures)
+      continue;
+
+    entry.key_ = (entry.key_ & ~mask) | textures;
+    list.sorted_ = false;
+  }
+}
+
+static void ApplyDrawConfig(DrawConfig config)
+{
+  // Same tables as the engine
+  static const GLenum cull_modes[] = {GL_FRONT, GL_BACK, GL_FRONT_AND_BACK};
+  static const GLenum cull_faces[] = {GL_CW, GL_CCW};
+
+  if (!config.active_culling_)
+  {
+    GLState::SetCapability(GL_CULL_FACE, false);
+    return;
+  }
+
+  GLState::SetCapability(GL_CULL_FACE, true);
+  GLState::CullFace(cull_modes[static_cast<s16>(config.cll_mode_)]);
+  GLState::FrontFace(cull_faces[static_cast<s16>(config.cll_face_)]);
+}
+
+static void FlushShadowQueue()
+{
+  CommandList &list = s_renderer.list_;
+  TakeStats(list);
+  if (!list.sorted_)
+    SortQueue(list);
+
+  // The light views are bound per tree inside the engine, sorting only keeps
+  // the same meshes together
+  for (const SortEntry &entry : s_renderer.list_.keys_)
+  {
+    const DrawItem &item = s_renderer.list_.queue_[entry.index_];
+    JAM_Engine::RenderShadow(item.id_, item.father_);
+  }
+  GLState::Invalidate();
+
+  ClearList(list);
+}
+
+static boolean SameState(const DrawItem &a, const DrawItem &b)
+{
+  return b.leaf_ && a.shader_ == b.shader_ && a.mesh_ == b.mesh_ && ConfigBits(a.config_) == ConfigBits(b.config_);
+}
+
+static void UploadInstances()
+{
+  // One instance per queued tree, in sorted order, so a run of the queue
+  // starts at its own position in the buffer
+  u32 count = static_cast<u32>(s_renderer.list_.keys_.size());
+  s_renderer.instances_.resize(count);
+  for (u32 i = 0; i < count; i++)
+  {
+    const DrawItem &item = s_renderer.list_.queue_[s_renderer.list_.keys_[i].index_];
+    s_renderer.instances_[i].m_matrix_ = item.world_;
+    s_renderer.instances_[i].entity_id_ = item.id_;
+  }
+
+  size_t size = sizeof(InstanceData) * count;
+  if (RingBuffer::Upload(s_renderer.instances_.data(), static_cast<u32>(size), s_renderer.instance_slice_))
+  {
+    RingBuffer::BindRange(GL_SHADER_STORAGE_BUFFER, INSTANCE_BIND, s_renderer.instance_slice_);
+    return;
+  }
+  s_renderer.instance_slice_ = RingBuffer::Slice();
+
+  if (s_renderer.instance_buffer_ == 0)
+    glGenBuffers(1, &s_renderer.instance_buffer_);
+
+  if (size > s_renderer.instance_capacity_)
+    s_renderer.instance_capacity_ = size;
+
+  // Orphan the old storage so the driver does not wait for the last frame
+  GLState::BindBuffer(GL_SHADER_STORAGE_BUFFER, s_renderer.instance_buffer_);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(s_renderer.instance_capacity_), nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, static_cast<GLsizeiptr>(size), s_renderer.instances_.data());
+  GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BIND, s_renderer.instance_buffer_);
+}
+
+static void BindInstances()
+{
+  if (s_renderer.instance_slice_.buffer_ != 0)
+    RingBuffer::BindRange(GL_SHADER_STORAGE_BUFFER, INSTANCE_BIND, s_renderer.instance_slice_);
+  else
+    GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BIND, s_renderer.instance_buffer_);
+}
+
+static boolean SameBucket(const DrawItem &a, const DrawItem &b)
+{
+  if (!b.leaf_ || !b.mesh_ || a.shader_ != b.shader_ || ConfigBits(a.config_) != ConfigBits(b.config_))
+    return false;
+
+  u32 textures = s_renderer.pool_.textureSet(a.mesh_);
+  return textures != 0 && textures == s_renderer.pool_.textureSet(b.mesh_) && s_renderer.pool_.find(b.mesh_);
+}
+
+static void BeginMultiDraw()
+{
+  // The commands are written to the ring, the own buffer is for contexts without it
+  s_renderer.indirect_offset_ = 0;
+  s_renderer.indirect_ring_ = RingBuffer::Active();
+  if (s_renderer.indirect_ring_)
+    return;
+
+  // Worst case is one command per queued tree
+  size_t size = sizeof(DrawCommand) * s_renderer.list_.keys_.size();
+  if (size > s_renderer.indirect_capacity_)
+    s_renderer.indirect_capacity_ = size;
+
+  if (s_renderer.indirect_buffer_ == 0)
+    glGenBuffers(1, &s_renderer.indirect_buffer_);
+
+  GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, s_renderer.indirect_buffer_);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, static_cast<GLsizeiptr>(s_renderer.indirect_capacity_), nullptr, GL_STREAM_DRAW);
+}
+
+static void BindPoolMaterials()
+{
+  if (s_renderer.pool_materials_)
+    return;
+
+  // The engine leaves the material buffer of the last loaded mesh bound, the
+  // driver is only asked when the engine ran since GLState last saw it
+  u32 materials = GLState::GetBoundBuffer(GL_SHADER_STORAGE_BUFFER, VERTEX_MATERIAL_BIND);
+  if (materials == UINT32_MAX)
+  {
+    s32 bound = 0;
+    glGetIntegeri_v(GL_SHADER_STORAGE_BUFFER_BINDING, VERTEX_MATERIAL_BIND, &bound);
+    materials = static_cast<u32>(bound);
+  }
+
+  s_renderer.engine_materials_ = materials;
+  s_renderer.pool_materials_ = true;
+  GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, VERTEX_MATERIAL_BIND, s_renderer.pool_.materials());
+}
+
+static void RestoreEngineMaterials()
+{
+  if (!s_renderer.pool_materials_)
+    return;
+
+  s_renderer.pool_materials_ = false;
+  GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, VERTEX_MATERIAL_BIND, s_renderer.engine_materials_);
+}
+
+static void MultiDraw(u32 first, u32 end)
+{
+  // Consecutive trees with the same mesh go in the same command
+  std::vector<DrawCommand> &commands = s_renderer.commands_;
+  commands.clear();
+
+  const Mesh *last_mesh = nullptr;
+  for (u32 i = first; i < end; i++)
+  {
+    const DrawItem &item = s_renderer.list_.queue_[s_renderer.list_.keys_[i].index_];
+    if (item.mesh_ == last_mesh)
+    {
+      commands.back().instance_count_++;
+      continue;
+    }
+
+    const MeshPool::Range *range = s_renderer.pool_.find(item.mesh_);
+
+    DrawCommand command;
+    command.count_ = range->index_count_;
+    command.instance_count_ = 1;
+    command.first_index_ = range->first_index_;
+    command.base_vertex_ = range->base_vertex_;
+    command.base_instance_ = i;
+    commands.push_back(command);
+
+    last_mesh = item.mesh_;
+  }
+
+  size_t size = sizeof(DrawCommand) * commands.size();
+  size_t offset = 0;
+
+  RingBuffer::Slice slice;
+  if (s_renderer.indirect_ring_ && RingBuffer::Upload(commands.data(), static_cast<u32>(size), slice))
+  {
+    offset = slice.offset_;
+    GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, slice.buffer_);
+  }
+  else
+  {
+    // The ring failed in the middle of the pass, the rest goes to the own buffer
+    if (s_renderer.indirect_ring_)
+      BeginMultiDraw();
+
+    offset = s_renderer.indirect_offset_;
+    s_renderer.indirect_offset_ += size;
+
+    GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, s_renderer.indirect_buffer_);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), commands.data());
+  }
+
+  // Kept bound for the next buckets, the next engine draw puts the old one back
+  BindPoolMaterials();
+
+  static const GLenum draw_modes[] = {GL_POINTS, GL_LINES, GL_TRIANGLES};
+  const DrawItem &item = s_renderer.list_.queue_[s_renderer.list_.keys_[first].index_];
+
+  item.shader_->setU32(Uniforms(item.shader_).instanced_, 1);
+  s_renderer.pool_.bind();
+  glMultiDrawElementsIndirect(draw_modes[static_cast<s16>(item.config_.mode_)], GL_UNSIGNED_INT, reinterpret_cast<const void *>(offset),
+                              static_cast<GLsizei>(commands.size()), 0);
+  item.shader_->setU32(Uniforms(item.shader_).instanced_, 0);
+
+  s_renderer.frame_.multi_draws_++;
+  s_renderer.frame_.multi_draw_commands_ += static_cast<u32>(commands.size());
+}
+
+static boolean GPUCullingActive()
+{
+  return s_renderer.gpu_cull_ && s_renderer.multi_draw_ && s_renderer.has_camera_;
+}
+
+static const Meshlets *ReadyMeshlets(const DrawItem &item)
+{
+  if (!item.leaf_ || !item.mesh_ || s_renderer.meshlets_.empty() || s_renderer.list_.frustums_.empty())
+    return nullptr;
+
+  auto it = s_renderer.meshlets_.find(item.mesh_);
+  return (it != s_renderer.meshlets_.end()) ? it->second : nullptr;
+}
+
+static void PlanQueue()
+{
+  // The engine sets the frame uniforms on every call, once a program is set
+  // up the next leaves with the same program only need their own state
+  std::vector<DrawRun> &runs = s_renderer.runs_;
+  runs.clear();
+
+  boolean gpu_culling = GPUCullingActive();
+  Shader *current_shader = nullptr;
+
+  u32 count = static_cast<u32>(s_renderer.list_.keys_.size());
+  u32 i = 0;
+  while (i < count)
+  {
+    const DrawItem &item = s_renderer.list_.queue_[s_renderer.list_.keys_[i].index_];
+
+    // The engine would draw the whole mesh, leaves drawn by clusters never
+    // reach it once it has set up their program
+    if (item.leaf_ && item.shader_ && item.mesh_ && item.shader_ != current_shader && ReadyMeshlets(item) && Uniforms(item.shader_).engine_ready_)
+    {
+      runs.push_back({DrawStep::Program, i, i, 0, 0, 0});
+      current_shader = item.shader_;
+    }
+
+    if (!item.leaf_ || !item.shader_ || !item.mesh_ || item.shader_ != current_shader)
+    {
+      runs.push_back({DrawStep::Engine, i, i + 1, 0, 0, 0});
+
+      // The children may leave any program bound
+      current_shader = item.leaf_ ? item.shader_ : nullptr;
+      i++;
+      continue;
+    }
+
+    // Leaves with the same program, mesh and draw config
+    u32 end = i + 1;
+    while (end < count && SameState(item, s_renderer.list_.queue_[s_renderer.list_.keys_[end].index_]))
+      end++;
+
+    // With the multi draw, leaves of the pool with the same textures
+    u32 bucket_end = i;
+    if (s_renderer.multi_draw_ && s_renderer.pool_.find(item.mesh_))
+    {
+      bucket_end = i + 1;
+      while (bucket_end < count && SameBucket(item, s_renderer.list_.queue_[s_renderer.list_.keys_[bucket_end].index_]))
+        bucket_end++;
+    }
+
+    // The GPU culling takes every bucket, it culls inside the runs too
+    if (bucket_end > end || (gpu_culling && bucket_end > i))
+    {
+      runs.push_back({DrawStep::MultiDraw, i, bucket_end, 0, 0, 0});
+      i = bucket_end;
+      continue;
+    }
+
+    runs.push_back({DrawStep::Leaves, i, end, 0, 0, 0});
+    i = end;
+  }
+}
+
+static void CullBuckets()
+{
+  // Same commands as the multi draw, but each one gets room in the compacted
+  // instance buffer for all its trees and the GPU fills in how many are left
+  std::vector<GPUCulling::Instance> &instances = s_renderer.cull_instances_;
+  std::vector<GPUCulling::Command> &commands = s_renderer.cull_commands_;
+  instances.clear();
+  commands.clear();
+
+  u32 bucket_count = 0;
+  u32 output_count = 0;
+  for (DrawRun &run : s_renderer.runs_)
+  {
+    if (run.step_ != DrawStep::MultiDraw)
+      continue;
+
+    run.bucket_ = bucket_count++;
+    run.command_ = static_cast<u32>(commands.size());
+
+    const Mesh *last_mesh = nullptr;
+    for (u32 i = run.first_; i < run.end_; i++)
+    {
+      const DrawItem &item = s_renderer.list_.queue_[s_renderer.list_.keys_[i].index_];
+      if (item.mesh_ != last_mesh)
+      {
+        const MeshPool::Range *range = s_renderer.pool_.find(item.mesh_);
+
+        GPUCulling::Command command = {};
+        command.count_ = range->index_count_;
+        command.first_index_ = range->first_index_;
+        command.base_vertex_ = range->base_vertex_;
+        command.base_instance_ = output_count;
+        command.bucket_ = run.bucket_;
+        command.bucket_first_ = run.command_;
+        commands.push_back(command);
+
+        last_mesh = item.mesh_;
+      }
+
+      GPUCulling::Instance instance = {};
+      instance.min_[0] = item.bounds_.min.x;
+      instance.min_[1] = item.bounds_.min.y;
+      instance.min_[2] = item.bounds_.min.z;
+      instance.max_[0] = item.bounds_.max.x;
+      instance.max_[1] = item.bounds_.max.y;
+      instance.max_[2] = item.bounds_.max.z;
+      instance.command_ = static_cast<u32>(commands.size() - 1);
+      instance.source_ = i;
+      instance.always_visible_ = item.has_bounds_ ? 0 : 1;
+      instances.push_back(instance);
+
+      output_count++;
+    }
+
+    run.commands_ = static_cast<u32>(commands.size()) - run.command_;
+  }
+
+  s_renderer.gpu_culling_.cull(instances, commands, bucket_count, output_count, s_renderer.view_projection_);
+
+  s_renderer.frame_.gpu_cull_instances_ += static_cast<u32>(instances.size());
+}
+
+static void CulledMultiDraw(const DrawRun &run)
+{
+  // Same state as MultiDraw, the commands and their count come from the GPU
+  BindPoolMaterials();
+
+  static const GLenum draw_modes[] = {GL_POINTS, GL_LINES, GL_TRIANGLES};
+  const DrawItem &item = s_renderer.list_.queue_[s_renderer.list_.keys_[run.first_].index_];
+
+  item.shader_->setU32(Uniforms(item.shader_).instanced_, 1);
+  s_renderer.pool_.bind();
+  s_renderer.gpu_culling_.draw(draw_modes[static_cast<s16>(item.config_.mode_)], run.bucket_, run.command_, run.commands_);
+  item.shader_->setU32(Uniforms(item.shader_).instanced_, 0);
+
+  // The culled instances took the place of the queue ones
+  BindInstances();
+
+  s_renderer.frame_.multi_draws_++;
+  s_renderer.frame_.multi_draw_commands_ += run.commands_;
+}
+
+static boolean DrawMeshlets(const DrawItem &item, const Meshlets *meshlets)
+{
+  // The normal cone only tells the back faces when those are culled
+  boolean cone_test = item.config_.active_culling_ && item.config_.cll_mode_ == CullMode::Back;
+
+  std::vector<Meshlets::Range> &ranges = s_renderer.meshlet_ranges_;
+  u32 visible = meshlets->cull(s_renderer.list_.frustums_[0], s_renderer.list_.view_pos_, item.world_, cone_test, ranges);
+  s_renderer.frame_.meshlets_drawn_ += visible;
+  s_renderer.frame_.meshlets_culled_ += meshlets->size() - visible;
+
+  return Renderer::DrawRanges(item.mesh_, item.config_, ranges);
+}
+
+template <typename T>
+static u32 CountLights(T *(*get)(u32))
+{
+  u32 count = 0;
+  while (get(count))
+    count++;
+
+  return count;
+}
+
+// The shader keeps the shadow map samplers and every value the engine gave
+// it, and the engine binds the maps to the same units on every call. Only
+// the light counts can change since then
+static void SetUpProgram(Shader *shader)
+{
+  ShaderUniforms &uniforms = Uniforms(shader);
+  shader->use();
+  shader->setU32(uniforms.light_sizes_[0], CountLights(&JAM_Engine::GetPointLight));
+  shader->setU32(uniforms.light_sizes_[1], CountLights(&JAM_Engine::GetSpotLight));
+  shader->setU32(uniforms.light_sizes_[2], CountLights(&JAM_Engine::GetDirectionalLight));
+}
+
+static void FlushQueue()
+{
+  CommandList &list = s_renderer.list_;
+  TakeStats(list);
+  ResolveTextures(list);
+  if (!list.sorted_)
+    SortQueue(list);
+  PlanQueue();
+
+  Mesh *current_mesh = nullptr;
+  u32 current_config = 0;
+  boolean instances_uploaded = false;
+
+  u32 count = static_cast<u32>(s_renderer.list_.keys_.size());
+  if (s_renderer.multi_draw_ && count > 0)
+    BeginMultiDraw();
+
+  // Every bucket is culled with the same dispatch before anything is drawn
+  boolean gpu_culling = GPUCullingActive() && s_renderer.gpu_culling_.init();
+  if (gpu_culling && count > 0)
+  {
+    UploadInstances();
+    instances_uploaded = true;
+    CullBuckets();
+  }
+
+  for (const DrawRun &run : s_renderer.runs_)
+  {
+    const DrawItem &item = s_renderer.list_.queue_[s_renderer.list_.keys_[run.first_].index_];
+
+    // The other draws read the materials the engine bound
+    if (run.step_ != DrawStep::MultiDraw)
+      RestoreEngineMaterials();
+
+    if (run.step_ == DrawStep::Engine)
+    {
+      JAM_Engine::Render(item.id_, item.father_);
+      GLState::Invalidate();
+      if (item.shader_)
+        Uniforms(item.shader_).engine_ready_ = true;
+
+      s_renderer.frame_.shader_binds_++;
+      s_renderer.frame_.texture_binds_++;
+
+      current_mesh = item.mesh_;
+      current_config = ConfigBits(item.config_);
+      continue;
+    }
+
+    if (run.step_ == DrawStep::Program)
+    {
+      SetUpProgram(item.shader_);
+      s_renderer.frame_.shader_binds_++;
+
+      // Nothing of the leaves is set up yet
+      current_mesh = nullptr;
+      current_config = UINT32_MAX;
+      continue;
+    }
+
+    u32 config = ConfigBits(item.config_);
+    if (config != current_config)
+    {
+      ApplyDrawConfig(item.config_);
+      current_config = config;
+    }
+
+    if (item.mesh_ != current_mesh)
+    {
+      item.mesh_->bindMaterialTextures(item.shader_, k_material_texture_unit);
+      s_renderer.frame_.texture_binds_++;
+      current_mesh = item.mesh_;
+    }
+
+    if (run.step_ == DrawStep::MultiDraw)
+    {
+      if (!instances_uploaded)
+      {
+        UploadInstances();
+        instances_uploaded = true;
+      }
+
+      if (gpu_culling)
+        CulledMultiDraw(run);
+      else
+        MultiDraw(run.first_, run.end_);
+      continue;
+    }
+
+    u32 i = run.first_;
+    u32 end = run.end_;
+    if (end - i > 1)
+    {
+      if (!instances_uploaded)
+      {
+        UploadInstances();
+        instances_uploaded = true;
+      }
+
+      item.shader_->setU32(Uniforms(item.shader_).instanced_, 1);
+      boolean drawn = Renderer::DrawInstanced(item.mesh_, item.config_, i, end - i);
+      item.shader_->setU32(Uniforms(item.shader_).instanced_, 0);
+
+      if (drawn)
+      {
+        s_renderer.frame_.instanced_draws_++;
+        s_renderer.frame_.instances_ += end - i;
+        continue;
+      }
+    }
+
+    for (; i < end; i++)
+    {
+      const DrawItem &leaf = s_renderer.list_.queue_[s_renderer.list_.keys_[i].index_];
+      const ShaderUniforms &uniforms = Uniforms(leaf.shader_);
+      leaf.shader_->setMat4(uniforms.m_matrix_, leaf.world_);
+      leaf.shader_->setU32(uniforms.mesh_id_, leaf.id_);
+
+      const Meshlets *meshlets = ReadyMeshlets(leaf);
+      if (meshlets && DrawMeshlets(leaf, meshlets))
+        continue;
+
+      // Same draw as Mesh::render, which also creates the buffers in the first one
+      if (!Renderer::DrawInstanced(leaf.mesh_, leaf.config_, 0, 1))
+      {
+        leaf.mesh_->render(leaf.config_);
+        GLState::Invalidate();
+      }
+    }
+  }
+
+  // The engine draws next, and does not bind a vertex array to create buffers
+  RestoreEngineMaterials();
+  GLState::BindVertexArray(0);
+
+  ClearList(list);
+  s_renderer.runs_.clear();
+}
+
+static void LightFrustums(u32 light_id, LightType light_type, std::vector<Math::Frustum> &frustums)
+{
+  frustums.clear();
+
+  switch (light_type)
+  {
+  case LightType::PointLight:
+  {
+    // One frustum per cube map face
+    PointLight *light = JAM_Engine::GetPointLight(light_id);
+    if (!light)
+      break;
+
+    Math::Mat4 projection = light->getPerspectiveMatrix();
+    for (s16 dir = 0; dir < static_cast<s16>(LightDirection::Max); dir++)
+      frustums.push_back(Math::Frustum::FromMatrix(light->getViewMatrix(static_cast<LightDirection>(dir)) * projection));
+    break;
+  }
+  case LightType::SpotLight:
+  {
+    SpotLight *light = JAM_Engine::GetSpotLight(light_id);
+    if (light)
+      frustums.push_back(Math::Frustum::FromMatrix(light->getViewMatrix() * light->getPerspectiveMatrix()));
+    break;
+  }
+  case LightType::DirectionalLight:
+  {
+    DirectionalLight *light = JAM_Engine::GetDirectionalLight(light_id);
+    if (light)
+      frustums.push_back(Math::Frustum::FromMatrix(light->getViewMatrix() * light->getPerspectiveMatrix()));
+    break;
+  }
+  }
+}
+
+static Math::Mat4 CameraProjection(Camera *camera)
+{
+  // Same projection choice as the engine
+  return (camera->getRenderType() == Camera::RenderType::Perspective) ? camera->getPerspectiveMatrix() : camera->getOrtoMatrix();
+}
+
+static void SetCameraView(CommandList &list, Camera *camera)
+{
+  list.frustums_.clear();
+  list.pvs_ = s_renderer.pvs_;
+  list.pvs_row_ = nullptr;
+  if (!camera)
+    return;
+
+  list.frustums_.push_back(Math::Frustum::FromMatrix(camera->getViewMatrix() * CameraProjection(camera)));
+  list.view_pos_ = camera->getPosition();
+
+  // The camera cell is found once per view
+  if (list.pvs_)
+    list.pvs_row_ = list.pvs_->cellBits(list.view_pos_);
+}
+
+static boolean Running(const Recording &recording)
+{
+  return recording.task_.valid() && recording.task_.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+static void RecordView(Recording *recording);
+
+static boolean Claim(Recording &recording, u32 owner)
+{
+  u32 none = k_owner_none;
+  return recording.owner_.compare_exchange_strong(none, owner, std::memory_order_acq_rel);
+}
+
+// A view no worker has started is recorded by the calling thread, instead of
+// waiting behind the loads queued before it in the task manager
+static void Finish(Recording &recording)
+{
+  if (Claim(recording, k_owner_caller))
+    RecordView(&recording);
+  else if (recording.owner_.load(std::memory_order_acquire) == k_owner_worker)
+    recording.task_.wait();
+}
+
+// Same, without recording a view nobody is going to draw
+static void Cancel(Recording &recording)
+{
+  if (!Claim(recording, k_owner_caller) && recording.owner_.load(std::memory_order_acquire) == k_owner_worker)
+    recording.task_.wait();
+}
+
+static Recording &NextRecording()
+{
+  // Dropped views may still be recording
+  for (std::unique_ptr<Recording> &recording : s_renderer.recordings_)
+    if (!recording->pending_ && !Running(*recording))
+    {
+      Cancel(*recording);
+      return *recording;
+    }
+
+  s_renderer.recordings_.push_back(std::make_unique<Recording>());
+  return *s_renderer.recordings_.back();
+}
+
+// Chunks of one extraction, taken by the workers and the calling thread
+struct ExtractJob
+{
+  RenderWorld *world_ = nullptr;
+  const OcclusionBuffer *occlusion_ = nullptr; ///< Occluders tested, null without culling.
+  size_t count_ = 0;
+  size_t chunk_size_ = 0;
+  std::atomic<size_t> next_ = 0; ///< First tree not taken.
+  std::atomic<size_t> done_ = 0; ///< Trees read.
+};
+
+static void ExtractTrees(const ExtractJob &job, size_t first, size_t end);
+
+static void RunExtractJob(std::shared_ptr<ExtractJob> job)
+{
+  for (;;)
+  {
+    size_t first = job->next_.fetch_add(job->chunk_size_, std::memory_order_relaxed);
+    if (first >= job->count_)
+      return;
+
+    size_t end = std::min(first + job->chunk_size_, job->count_);
+    ExtractTrees(*job, first, end);
+    job->done_.fetch_add(end - first, std::memory_order_release);
+  }
+}
+
+static void ExtractTrees(const ExtractJob &job, size_t first, size_t end)
+{
+  RenderWorld *world = job.world_;
+  ComponentArrays arrays = GetComponentArrays();
+
+  const Mesh *last_mesh = nullptr;
+  Math::AABB last_bounds;
+  for (size_t i = first; i < end; i++)
+  {
+    Math::Vec3 center = Math::Vec3::zero;
+    Math::Vec3 extents = Math::Vec3::zero;
+
+    DrawItem &item = world->trees_[i];
+    world->occluded_[i] = 0;
+    if (world->internal_ids_[i] != SIZE_MAX)
+    {
+      ReadTree(arrays, world->ids_[i], world->internal_ids_[i], Math::Mat4::Identity(), last_mesh, last_bounds, item);
+      if (item.has_bounds_ && !item.bounds_.IsEmpty())
+      {
+        center = item.bounds_.Center();
+        extents = item.bounds_.Extents();
+      }
+
+      if (job.occlusion_ && item.has_bounds_ && !job.occlusion_->isVisible(item.bounds_))
+        world->occluded_[i] = 1;
+    }
+
+    world->centers_[0][i] = center.x, world->centers_[1][i] = center.y, world->centers_[2][i] = center.z;
+    world->extents_[0][i] = extents.x, world->extents_[1][i] = extents.y, world->extents_[2][i] = extents.z;
+  }
+}
+
+// Copies what the views read from the hierarchy, once per frame, into the
+// world the last frame did not use
+static const RenderWorld &ExtractWorld(const SceneBVH &scene)
+{
+  RenderWorld &last = s_renderer.worlds_[s_renderer.world_];
+  if (last.source_ == &scene && last.frame_ == s_renderer.frame_count_)
+    return last;
+
+  s_renderer.world_ ^= 1;
+  RenderWorld &world = s_renderer.worlds_[s_renderer.world_];
+
+  // Views dropped two frames ago may still read it
+  for (std::unique_ptr<Recording> &recording : s_renderer.recordings_)
+    if (recording->world_ == &world)
+      Cancel(*recording);
+
+  world.source_ = &scene;
+  world.frame_ = s_renderer.frame_count_;
+
+  world.ids_.clear();
+  scene.entities(world.ids_);
+  size_t count = world.ids_.size();
+  world.internal_ids_.resize(count);
+  EM->getInternalIds(world.ids_, world.internal_ids_.data());
+  world.trees_.resize(count);
+  world.occluded_.resize(count);
+  for (u32 axis = 0; axis < 3; axis++)
+  {
+    world.centers_[axis].resize(count);
+    world.extents_[axis].resize(count);
+  }
+
+  // The calling thread takes chunks too, and reads everything while the
+  // workers are busy with other tasks. A worker that starts late finds none left
+  auto job = std::make_shared<ExtractJob>();
+  job->world_ = &world;
+  job->occlusion_ = s_renderer.culling_ ? s_renderer.occlusion_ : nullptr;
+  job->count_ = count;
+  job->chunk_size_ = k_extract_chunk;
+
+  size_t chunks = (count + k_extract_chunk - 1) / k_extract_chunk;
+  size_t helpers = std::min<size_t>(TM->workerCount(), chunks > 0 ? chunks - 1 : 0);
+  for (size_t i = 0; i < helpers; i++)
+    TM->enqueue(&RunExtractJob, job);
+
+  RunExtractJob(job);
+  while (job->done_.load(std::memory_order_acquire) < count)
+    std::this_thread::yield();
+
+  return world;
+}
+
+static void RecordView(Recording *recording)
+{
+  CommandList &list = recording->list_;
+  EnqueueWorld(list, *recording->world_);
+
+  if (recording->sort_)
+    SortQueue(list);
+}
+
+static void RecordViewTask(Recording *recording)
+{
+  if (Claim(*recording, k_owner_worker))
+    RecordView(recording);
+}
+
+static void StartRecording(Recording &recording, const SceneBVH &scene)
+{
+  ClearList(recording.list_);
+  recording.list_.stats_ = Renderer::Stats();
+  recording.list_.culling_ = s_renderer.culling_;
+  recording.scene_ = &scene;
+  recording.world_ = &ExtractWorld(scene);
+  recording.sort_ = !s_renderer.multi_draw_;
+  recording.pending_ = true;
+  recording.owner_.store(k_owner_none, std::memory_order_release);
+
+  // Without workers the view is recorded when it is taken
+  if (TM->workerCount() > 0)
+    recording.task_ = TM->enqueue(&RecordViewTask, &recording);
+}
+
+static Recording *FindRecording(RenderPass pass, const SceneBVH &scene)
+{
+  for (std::unique_ptr<Recording> &recording : s_renderer.recordings_)
+  {
+    if (!recording->pending_ || recording->scene_ != &scene || recording->list_.pass_ != pass)
+      continue;
+
+    if (pass == RenderPass::Main ? (recording->camera_ == s_renderer.camera_)
+                                 : (recording->light_id_ == s_renderer.light_id_ && recording->light_type_ == s_renderer.light_type_))
+      return recording.get();
+  }
+
+  return nullptr;
+}
+
+// A view may be drawn a frame after it was recorded, the trees are drawn with
+// the matrices and bounds they have now, and the ones removed meanwhile are
+// skipped. The depth keys are made again from the new bounds
+static void RefreshQueue(CommandList &list)
+{
+  std::vector<DrawItem> &queue = list.queue_;
+  list.span_ids_.resize(queue.size());
+  for (size_t i = 0; i < queue.size(); i++)
+    list.span_ids_[i] = queue[i].id_;
+
+  list.span_internal_.resize(queue.size());
+  EM->getInternalIds(list.span_ids_, list.span_internal_.data());
+  Entity::Components<Transform> *transforms = EM->getComponentsStorage<Transform>();
+
+  const Mesh *last_mesh = nullptr;
+  Math::AABB last_bounds;
+  list.remap_.resize(queue.size());
+  u32 kept = 0;
+  for (size_t i = 0; i < queue.size(); i++)
+  {
+    size_t internal_id = list.span_internal_[i];
+    if (internal_id == SIZE_MAX)
+    {
+      list.remap_[i] = UINT32_MAX;
+      continue;
+    }
+
+    DrawItem &item = queue[i];
+    Transform *tr = DenseComponent(transforms, internal_id);
+    item.world_ = tr ? (tr->getTrMatrix() * item.father_) : item.father_;
+
+    // Same bounds as ReadTree, from the mesh for a leaf
+    item.bounds_ = Math::AABB();
+    item.has_bounds_ = true;
+    if (!item.leaf_)
+    {
+      item.has_bounds_ = Renderer::GetWorldBounds(item.id_, item.father_, item.bounds_);
+    }
+    else if (item.mesh_)
+    {
+      if (item.mesh_ != last_mesh)
+      {
+        last_mesh = item.mesh_;
+        last_bounds = Renderer::GetMeshBounds(item.mesh_);
+      }
+
+      item.has_bounds_ = !last_bounds.IsEmpty();
+      if (item.has_bounds_)
+        item.bounds_ = last_bounds.Transformed(item.world_);
+    }
+    item.has_bounds_ = item.has_bounds_ && !item.bounds_.IsEmpty();
+
+    list.remap_[i] = kept;
+    queue[kept++] = item;
+  }
+
+  queue.resize(kept);
+  size_t key_count = 0;
+  for (SortEntry entry : list.keys_)
+  {
+    entry.index_ = list.remap_[entry.index_];
+    if (entry.index_ == UINT32_MAX)
+      continue;
+
+    entry.key_ = ItemKey(list, queue[entry.index_]);
+    list.keys_[key_count++] = entry;
+  }
+  list.keys_.resize(key_count);
+  list.sorted_ = false;
+}
+
+static void TakeRecording(Recording &recording)
+{
+  Finish(recording);
+  recording.pending_ = false;
+
+  CommandList &list = s_renderer.list_;
+  CommandList &recorded = recording.list_;
+  recorded.view_pos_ = list.view_pos_;
+  RefreshQueue(recorded);
+  TakeStats(recorded);
+
+  // The sort indices of the keys belong to the list that made them, an empty
+  // pass takes the recorded keys and the indices with them
+  if (list.queue_.empty())
+  {
+    list.queue_.swap(recorded.queue_);
+    list.keys_.swap(recorded.keys_);
+    list.shader_keys_.swap(recorded.shader_keys_);
+    list.mesh_keys_.swap(recorded.mesh_keys_);
+    list.sorted_ = recorded.sorted_;
+    ClearList(recorded);
+    return;
+  }
+
+  list.queue_.reserve(list.queue_.size() + recorded.queue_.size());
+  list.keys_.reserve(list.keys_.size() + recorded.queue_.size());
+  for (const DrawItem &item : recorded.queue_)
+  {
+    list.queue_.push_back(item);
+
+    SortEntry entry;
+    entry.key_ = ItemKey(list, item);
+    entry.index_ = static_cast<u32>(list.queue_.size() - 1);
+    list.keys_.push_back(entry);
+  }
+  list.sorted_ = false;
+
+  ClearList(recorded);
+}
+
+static void DropRecordings()
+{
+  // Views of this frame recorded but not drawn, like the shadows of a culled
+  // pass, the ones recorded after BeginRender are for the next frame
+  for (std::unique_ptr<Recording> &recording : s_renderer.recordings_)
+  {
+    if (!recording->pending_ || recording->world_->frame_ >= s_renderer.frame_count_)
+      continue;
+
+    Cancel(*recording);
+    recording->pending_ = false;
+    ClearList(recording->list_);
+  }
+}
+
+// The views of this frame are recorded for the next one. The world is
+// extracted here, only the culling and sorting run in the task manager
+static void RecordViews()
+{
+  for (const PipelinedView &view : s_renderer.views_)
+  {
+    if (view.pass_ == RenderPass::Shadow)
+      Renderer::RecordShadow(view.light_id_, view.light_type_, *view.scene_);
+    else
+      Renderer::Record(view.camera_, *view.scene_);
+  }
+
+  s_renderer.views_.clear();
+}
+///////////////////////////////////////////////////////////////////////////////
+
+Math::AABB Renderer::GetMeshBounds(const Mesh *mesh)
+{
+  if (!mesh)
+    return Math::AABB();
+
+  {
+    std::lock_guard<std::mutex> lock(s_renderer.bounds_mutex_);
+    auto it = s_renderer.mesh_bounds_.find(mesh);
+    if (it != s_renderer.mesh_bounds_.end())
+      return it->second;
+  }
+
+  // Meshes load in the task manager, wait until it's done
+  if (!mesh->has_mesh_ || !mesh->vertices_ || mesh->vertices_size_ == 0)
+    return Math::AABB();
+
+  // Positions to structure of arrays, then one batched min and max
+  size_t total = mesh->vertices_size_;
+  std::vector<f32> positions(total * 3);
+  Math::Batch::Vec3Span span = {positions.data(), positions.data() + total, positions.data() + total * 2, total};
+  Math::Batch::Deinterleave(&mesh->vertices_[0].position_, sizeof(Vertex), total, span);
+
+  Math::AABB bounds;
+  Math::Batch::ComputeAABB(span, bounds.min, bounds.max);
+
+  std::lock_guard<std::mutex> lock(s_renderer.bounds_mutex_);
+  s_renderer.mesh_bounds_.insert(std::make_pair(mesh, bounds));
+
+  return bounds;
+}
+
+boolean Renderer::GetWorldBounds(Entity::Id root_node, Math::Mat4 father_mat, Math::AABB &bounds)
+{
+  Transform *tr = EM->getComponent<Transform>(root_node);
+  Math::Mat4 world = tr ? (tr->getTrMatrix() * father_mat) : father_mat;
+
+  Mesh **mesh = EM->getComponent<Mesh *>(root_node);
+  if (mesh && *mesh)
+  {
+    Math::AABB local = GetMeshBounds(*mesh);
+    if (local.IsEmpty())
+      return false;
+
+    bounds.Expand(local.Transformed(world));
+  }
+
+  Treenode *node = EM->getComponent<Treenode>(root_node);
+  if (!node)
+    return true;
+
+  for (u32 i = 0; i < Treenode::k_max_childs; i++)
+  {
+    Entity::Id child = node->getChild(i);
+    if (child != UINT32_MAX && !GetWorldBounds(child, world, bounds))
+      return false;
+  }
+
+  return true;
+}
+
+void Renderer::SetCulling(boolean active) { s_renderer.culling_ = active; }
+
+void Renderer::SetOcclusion(const OcclusionBuffer *buffer) { s_renderer.occlusion_ = buffer; }
+
+void Renderer::SetPVS(const PVS *pvs) { s_renderer.pvs_ = pvs; }
+
+void Renderer::SetPipelined(boolean active)
+{
+  s_renderer.pipelined_ = active;
+  s_renderer.views_.clear();
+}
+
+void Renderer::SetMultiDraw(boolean active)
+{
+  s_renderer.multi_draw_ = active;
+
+  if (!active)
+    s_renderer.pool_.free();
+}
+
+void Renderer::SetMeshlets(const Mesh *mesh, const Meshlets *meshlets)
+{
+  if (!meshlets)
+  {
+    s_renderer.meshlets_.erase(mesh);
+    return;
+  }
+
+  s_renderer.meshlets_[mesh] = meshlets;
+
+  // Buffers created before the indices were reordered
+  if (mesh->EBO != UINT32_MAX && mesh->indices_)
+    glNamedBufferSubData(mesh->EBO, 0, static_cast<GLsizeiptr>(sizeof(u32) * mesh->indices_size_), mesh->indices_);
+}
+
+void Renderer::InvalidateMesh(const Mesh *mesh)
+{
+  {
+    std::lock_guard<std::mutex> lock(s_renderer.bounds_mutex_);
+    s_renderer.mesh_bounds_.erase(mesh);
+  }
+  s_renderer.meshlets_.erase(mesh);
+
+  if (s_renderer.pool_.find(mesh))
+    s_renderer.pool_.free();
+}
+
+void Renderer::SetGPUCulling(boolean active)
+{
+  s_renderer.gpu_cull_ = active;
+
+  if (!active)
+    s_renderer.gpu_culling_.free();
+}
+
+boolean Renderer::DrawInstanced(const Mesh *mesh, DrawConfig config, u32 first_instance, u32 instance_count)
+{
+  // Same checks as Mesh::render, the buffers are created in its first call
+  if (!mesh->has_mesh_ || mesh->VAO == UINT32_MAX || mesh->VBO == UINT32_MAX || mesh->EBO == UINT32_MAX || mesh->SSBO == UINT32_MAX)
+    return false;
+
+  static const GLenum draw_modes[] = {GL_POINTS, GL_LINES, GL_TRIANGLES};
+
+  GLState::BindVertexArray(mesh->VAO);
+  glDrawElementsInstancedBaseInstance(draw_modes[static_cast<s16>(config.mode_)], static_cast<GLsizei>(mesh->indices_size_), GL_UNSIGNED_INT,
+                                      nullptr, static_cast<GLsizei>(instance_count), first_instance);
+
+  return true;
+}
+
+boolean Renderer::DrawRanges(const Mesh *mesh, DrawConfig config, std::span<const Meshlets::Range> ranges)
+{
+  if (!mesh->has_mesh_ || mesh->VAO == UINT32_MAX || mesh->VBO == UINT32_MAX || mesh->EBO == UINT32_MAX || mesh->SSBO == UINT32_MAX)
+    return false;
+
+  if (ranges.empty())
+    return true;
+
+  s_renderer.meshlet_counts_.resize(ranges.size());
+  s_renderer.meshlet_offsets_.resize(ranges.size());
+  for (size_t i = 0; i < ranges.size(); i++)
+  {
+    s_renderer.meshlet_counts_[i] = static_cast<s32>(ranges[i].index_count_);
+    s_renderer.meshlet_offsets_[i] = reinterpret_cast<const void *>(sizeof(u32) * ranges[i].first_index_);
+  }
+
+  static const GLenum draw_modes[] = {GL_POINTS, GL_LINES, GL_TRIANGLES};
+
+  GLState::BindVertexArray(mesh->VAO);
+  glMultiDrawElements(draw_modes[static_cast<s16>(config.mode_)], s_renderer.meshlet_counts_.data(), GL_UNSIGNED_INT,
+                      s_renderer.meshlet_offsets_.data(), static_cast<GLsizei>(ranges.size()));
+
+  return true;
+}
+
+// Recording
+void Renderer::RecordShadow(u32 light_id, LightType light_type, const SceneBVH &scene)
+{
+  Recording &recording = NextRecording();
+  recording.list_.pass_ = RenderPass::Shadow;
+  recording.light_id_ = light_id;
+  recording.light_type_ = light_type;
+  LightFrustums(light_id, light_type, recording.list_.frustums_);
+
+  StartRecording(recording, scene);
+}
+
+void Renderer::Record(Camera *camera, const SceneBVH &scene)
+{
+  Recording &recording = NextRecording();
+  recording.list_.pass_ = RenderPass::Main;
+  recording.camera_ = camera;
+  SetCameraView(recording.list_, camera);
+
+  StartRecording(recording, scene);
+}
+
+// Shadows
+void Renderer::BeginRenderShadow(u32 light_id, LightType light_type)
+{
+  // The state changed outside the renderer since the last pass
+  GLState::Invalidate();
+  RingBuffer::UploadLights();
+
+  s_renderer.list_.pass_ = RenderPass::Shadow;
+  s_renderer.list_.culling_ = s_renderer.culling_;
+  s_renderer.light_id_ = light_id;
+  s_renderer.light_type_ = light_type;
+  LightFrustums(light_id, light_type, s_renderer.list_.frustums_);
+
+  JAM_Engine::BeginRenderShadow(light_id, light_type);
+  GLState::Invalidate();
+}
+
+void Renderer::RenderShadow(Entity::Id root_node, Math::Mat4 father_mat)
+{
+  CommandList &list = s_renderer.list_;
+
+  Math::AABB bounds;
+  boolean has_bounds = GetWorldBounds(root_node, father_mat, bounds);
+  if (!IsVisible(list, bounds, has_bounds))
+  {
+    list.stats_.shadow_culled_++;
+    return;
+  }
+
+  list.stats_.shadow_draws_++;
+  Enqueue(list, root_node, father_mat, bounds, has_bounds);
+}
+
+void Renderer::RenderShadow(std::span<const Entity::Id> root_nodes, Math::Mat4 father_mat)
+{
+  EnqueueIds(s_renderer.list_, root_nodes, father_mat);
+}
+
+void Renderer::RenderShadowAll(RenderQuery query, Math::Mat4 father_mat)
+{
+  EnqueueQuery(s_renderer.list_, query, father_mat);
+}
+
+void Renderer::RenderShadow(const SceneBVH &scene)
+{
+  if (s_renderer.pipelined_)
+    s_renderer.views_.push_back({RenderPass::Shadow, &scene, nullptr, s_renderer.light_id_, s_renderer.light_type_});
+
+  Recording *recording = FindRecording(RenderPass::Shadow, scene);
+  if (recording)
+    TakeRecording(*recording);
+  else
+    EnqueueScene(s_renderer.list_, scene);
+}
+
+void Renderer::EndRenderShadow()
+{
+  FlushShadowQueue();
+  JAM_Engine::EndRenderShadow();
+  GLState::Invalidate();
+  s_renderer.list_.frustums_.clear();
+}
+
+// Render
+void Renderer::BeginRender(Camera *camera)
+{
+  GLState::Invalidate();
+  RingBuffer::UploadLights();
+
+  // Programs compiled since the last frame draw from this one
+  Shader::PollPrograms();
+
+  s_renderer.list_.pass_ = RenderPass::Main;
+  s_renderer.list_.culling_ = s_renderer.culling_;
+  s_renderer.camera_ = camera;
+  SetCameraView(s_renderer.list_, camera);
+
+  if (camera)
+  {
+    Math::Mat4 projection = CameraProjection(camera);
+    s_renderer.view_projection_ = camera->getViewMatrix() * projection;
+
+    // Every program reads the camera from the view block
+    Shader::SetViewBlock(camera->getViewMatrix(), projection, camera->getPosition(), camera->getViewDir());
+  }
+  s_renderer.has_camera_ = (camera != nullptr);
+
+  f32 delta_time = JAM_Engine::DeltaTime();
+  s_renderer.time_ += delta_time;
+  Shader::SetFrameBlock(s_renderer.time_, delta_time, s_renderer.frame_count_++);
+  Shader::BindBlocks();
+
+  JAM_Engine::BeginRender(camera);
+  GLState::Invalidate();
+}
+
+void Renderer::Render(Entity::Id root_node, Math::Mat4 father_mat)
+{
+  CommandList &list = s_renderer.list_;
+
+  if (IsHiddenByPVS(list, root_node))
+  {
+    list.stats_.pvs_culled_++;
+    return;
+  }
+
+  Math::AABB bounds;
+  boolean has_bounds = GetWorldBounds(root_node, father_mat, bounds);
+  if (!IsVisible(list, bounds, has_bounds))
+  {
+    list.stats_.culled_++;
+    return;
+  }
+
+  if (IsOccluded(list.culling_, bounds, has_bounds))
+  {
+    list.stats_.occluded_++;
+    return;
+  }
+
+  list.stats_.draws_++;
+  Enqueue(list, root_node, father_mat, bounds, has_bounds);
+}
+
+void Renderer::Render(std::span<const Entity::Id> root_nodes, Math::Mat4 father_mat)
+{
+  EnqueueIds(s_renderer.list_, root_nodes, father_mat);
+}
+
+void Renderer::RenderAll(RenderQuery query, Math::Mat4 father_mat)
+{
+  EnqueueQuery(s_renderer.list_, query, father_mat);
+}
+
+void Renderer::Render(const SceneBVH &scene)
+{
+  if (s_renderer.pipelined_)
+    s_renderer.views_.push_back({RenderPass::Main, &scene, s_renderer.camera_, 0, LightType::PointLight});
+
+  Recording *recording = FindRecording(RenderPass::Main, scene);
+  if (recording)
+    TakeRecording(*recording);
+  else
+    EnqueueScene(s_renderer.list_, scene);
+}
+
+void Renderer::EndRender()
+{
+  FlushQueue();
+
+  // The depth of this frame is what the next one is culled against
+  if (GPUCullingActive())
+    s_renderer.gpu_culling_.buildPyramid(s_renderer.view_projection_);
+
+  JAM_Engine::EndRender();
+  GLState::Invalidate();
+  s_renderer.list_.frustums_.clear();
+  DropRecordings();
+
+  if (s_renderer.pipelined_)
+    RecordViews();
+
+  // Everything of the frame is in the ring, the next one writes the next region
+  RingBuffer::EndFrame();
+
+  // Shadow passes of the frame included
+  GLState::Stats gl_stats = GLState::GetStats();
+  s_renderer.frame_.gl_calls_ = gl_stats.issued_;
+  s_renderer.frame_.gl_calls_skipped_ = gl_stats.skipped_;
+  GLState::ResetStats();
+  s_renderer.frame_.programs_compiling_ = ProgramCache::GetStats().pending_;
+
+  s_renderer.last_frame_ = s_renderer.frame_;
+  s_renderer.frame_ = Stats();
+}
+
+void Renderer::SetSelectedEntity(Entity::Id id) { Shader::SetSelectedId(id); }
+
+Renderer::Stats Renderer::GetStats() { return s_renderer.last_frame_; }
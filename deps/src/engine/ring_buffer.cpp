@@ -0,0 +1,368 @@
+#include <engine/ring_buffer.h>
+#include <engine/gl_state.h>
+#include <engine/jam_engine.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Ring
+///////////////////////////////////////////////////////////////////////////////
+const u32 k_regions = 3;
+const u32 k_first_region_size = 2 * 1024 * 1024;
+const u32 k_max_region_size = 256 * 1024 * 1024;
+const u32 k_light_binds = 3;
+const GLuint64 k_wait_timeout = 1000000; // 1ms, the wait flushes and tries again
+
+static const u32 light_binds[k_light_binds] = {POINT_LIGHT_BIND, SPOT_LIGHT_BIND, DIRECTIONAL_LIGHT_BIND};
+
+/**
+ * @struct RetiredBuffer
+ *
+ * @brief Buffer replaced by a bigger one, deleted once the GPU is done with it.
+ */
+struct RetiredBuffer
+{
+  u32 buffer_;   ///< Buffer identifier.
+  GLsync fence_; ///< Fence after the last commands that read it.
+};
+
+/**
+ * @struct RingData
+ *
+ * @brief Mapped buffer, the region of the frame and the light buffers sent to it.
+ */
+struct RingData
+{
+  boolean checked_ = false;   ///< The context was checked and the first buffer created.
+  boolean supported_ = false; ///< The context has OpenGL 4.5 and the buffer could be mapped.
+  boolean active_ = true;     ///< Turned on with SetActive.
+
+  u32 buffer_ = 0;           ///< Buffer with the three regions.
+  u_byte *data_ = nullptr;   ///< Mapped memory of the buffer.
+  u32 region_size_ = 0;      ///< Bytes of every region.
+  u32 alignment_ = 16;       ///< Offset alignment of the slices.
+  u32 region_ = 0;           ///< Region of the frame.
+  u32 head_ = 0;             ///< Bytes used in the region of the frame.
+  u32 frame_ = 1;            ///< Frame of the slices given now, 0 is no frame.
+  GLsync fences_[k_regions] = {nullptr, nullptr, nullptr}; ///< Fence after the last frame written in every region.
+
+  std::vector<RetiredBuffer> retired_;
+
+  u32 light_sources_[k_light_binds] = {0, 0, 0}; ///< Light buffers bound by the engine, the ring takes their place.
+  u32 lights_frame_ = 0;                         ///< Frame the lights were written in.
+
+  RingBuffer::Stats stats_;
+};
+
+static RingData s_ring;
+///////////////////////////////////////////////////////////////////////////////
+
+// Helpers
+///////////////////////////////////////////////////////////////////////////////
+static u32 AlignUp(u32 value, u32 alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+// Flushes the commands and waits, a fence that never reaches the GPU would wait forever
+static boolean WaitFence(GLsync fence)
+{
+  GLenum result = glClientWaitSync(fence, 0, 0);
+  if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+    return false;
+
+  while (result == GL_TIMEOUT_EXPIRED)
+    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, k_wait_timeout);
+
+  if (result == GL_WAIT_FAILED)
+    JAM_Engine::AddError("Ring buffer fence wait failed", __func__, std::to_string(__LINE__));
+
+  return true;
+}
+
+static boolean Signaled(GLsync fence)
+{
+  GLenum result = glClientWaitSync(fence, 0, 0);
+  return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED;
+}
+
+static void DeleteFences()
+{
+  for (GLsync &fence : s_ring.fences_)
+  {
+    if (fence)
+      glDeleteSync(fence);
+    fence = nullptr;
+  }
+}
+
+static void DeleteBuffer(u32 buffer)
+{
+  glUnmapNamedBuffer(buffer);
+  GLState::DeleteBuffers(1, &buffer);
+}
+
+static boolean CreateBuffer(u32 region_size)
+{
+  const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  GLsizeiptr size = static_cast<GLsizeiptr>(region_size) * k_regions;
+
+  u32 buffer = 0;
+  glCreateBuffers(1, &buffer);
+  glNamedBufferStorage(buffer, size, nullptr, flags);
+  void *data = glMapNamedBufferRange(buffer, 0, size, flags);
+  if (!data)
+  {
+    GLState::DeleteBuffers(1, &buffer);
+    JAM_Engine::AddError("Ring buffer of " + std::to_string(size) + " bytes could not be mapped", __func__, std::to_string(__LINE__));
+    return false;
+  }
+
+  s_ring.buffer_ = buffer;
+  s_ring.data_ = static_cast<u_byte *>(data);
+  s_ring.region_size_ = region_size;
+  s_ring.stats_.capacity_ = region_size;
+  return true;
+}
+
+// Anything bound to the old buffer keeps reading it until its fence passes
+static void Retire()
+{
+  if (s_ring.buffer_ == 0)
+    return;
+
+  s_ring.retired_.push_back({s_ring.buffer_, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+  DeleteFences();
+  s_ring.buffer_ = 0;
+  s_ring.data_ = nullptr;
+}
+
+static boolean IsRingBuffer(u32 buffer)
+{
+  if (buffer == s_ring.buffer_)
+    return true;
+
+  for (const RetiredBuffer &retired : s_ring.retired_)
+    if (buffer == retired.buffer_)
+      return true;
+
+  return false;
+}
+
+static void Release()
+{
+  Retire();
+  for (RetiredBuffer &retired : s_ring.retired_)
+  {
+    glDeleteSync(retired.fence_);
+    DeleteBuffer(retired.buffer_);
+  }
+  s_ring.retired_.clear();
+
+  // A new buffer can take a deleted name, the old slices must not look current
+  s_ring.frame_ = s_ring.frame_ == UINT32_MAX ? 1 : s_ring.frame_ + 1;
+
+  // The light shaders read the engine buffers again
+  for (u32 i = 0; i < k_light_binds; i++)
+    if (s_ring.light_sources_[i] != 0)
+      GLState::BindBufferBase(GL_SHADER_STORAGE_BUFFER, light_binds[i], s_ring.light_sources_[i]);
+}
+
+static void CheckContext()
+{
+  s_ring.checked_ = true;
+
+  s32 major = 0, minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  if (major < 4 || (major == 4 && minor < 5))
+    return;
+
+  // A slice can be bound as a uniform or storage buffer
+  s32 uniform_alignment = 0, storage_alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+  s_ring.alignment_ = 16;
+  while (s_ring.alignment_ < static_cast<u32>(uniform_alignment) || s_ring.alignment_ < static_cast<u32>(storage_alignment))
+    s_ring.alignment_ *= 2;
+
+  s_ring.supported_ = CreateBuffer(k_first_region_size);
+}
+
+// The slices already given stay in the old buffer, the rest of the frame goes to the new one
+static boolean Grow(u32 size)
+{
+  u32 region_size = s_ring.region_size_;
+  while (region_size < k_max_region_size && region_size < s_ring.head_ + size + s_ring.alignment_)
+    region_size *= 2;
+
+  if (size > region_size)
+  {
+    JAM_Engine::AddError("Upload of " + std::to_string(size) + " bytes does not fit in the ring buffer", __func__, std::to_string(__LINE__));
+    return false;
+  }
+
+  Retire();
+  if (!CreateBuffer(region_size))
+  {
+    s_ring.supported_ = false;
+    Release();
+    return false;
+  }
+
+  s_ring.head_ = 0;
+  s_ring.stats_.grows_++;
+  return true;
+}
+
+// Lights of one type, the engine keeps them in one array, the same memory it uploads
+template <typename T>
+static void UploadLightArray(u32 light, T *(*get)(u32))
+{
+  T *first = get(0);
+  if (!first)
+    return;
+
+  u32 count = 1;
+  while (get(count))
+    count++;
+
+  // The engine buffers are bound once when the lights are added, they are
+  // read before the ring takes their place
+  if (s_ring.light_sources_[light] == 0)
+  {
+    s32 bound = 0;
+    glGetIntegeri_v(GL_SHADER_STORAGE_BUFFER_BINDING, light_binds[light], &bound);
+    if (!IsRingBuffer(static_cast<u32>(bound)))
+      s_ring.light_sources_[light] = static_cast<u32>(bound);
+  }
+
+  RingBuffer::Slice slice;
+  if (RingBuffer::Upload(first, static_cast<u32>(sizeof(T) * count), slice))
+    RingBuffer::BindRange(GL_SHADER_STORAGE_BUFFER, light_binds[light], slice);
+}
+///////////////////////////////////////////////////////////////////////////////
+
+boolean RingBuffer::Active()
+{
+  if (!s_ring.active_)
+    return false;
+
+  if (!s_ring.checked_)
+    CheckContext();
+
+  return s_ring.supported_;
+}
+
+boolean RingBuffer::Allocate(u32 size, Slice &slice)
+{
+  if (size == 0 || !Active())
+    return false;
+
+  u32 offset = AlignUp(s_ring.head_, s_ring.alignment_);
+  if (offset + size > s_ring.region_size_)
+  {
+    if (!Grow(size))
+      return false;
+    offset = 0;
+  }
+
+  // The first write of the frame waits for the GPU to read the region three frames ago
+  GLsync &fence = s_ring.fences_[s_ring.region_];
+  if (fence)
+  {
+    if (WaitFence(fence))
+      s_ring.stats_.waits_++;
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  u32 region_offset = s_ring.region_ * s_ring.region_size_;
+  slice.buffer_ = s_ring.buffer_;
+  slice.offset_ = region_offset + offset;
+  slice.size_ = size;
+  slice.data_ = s_ring.data_ + region_offset + offset;
+  slice.frame_ = s_ring.frame_;
+
+  s_ring.head_ = offset + size;
+  return true;
+}
+
+boolean RingBuffer::Upload(const void *data, u32 size, Slice &slice)
+{
+  if (!Allocate(size, slice))
+    return false;
+
+  memcpy(slice.data_, data, size);
+  return true;
+}
+
+void RingBuffer::BindRange(u32 target, u32 index, const Slice &slice)
+{
+  GLState::BindBufferRange(target, index, slice.buffer_, slice.offset_, slice.size_);
+}
+
+void RingBuffer::UploadLights()
+{
+  if (!Active() || s_ring.lights_frame_ == s_ring.frame_)
+    return;
+
+  s_ring.lights_frame_ = s_ring.frame_;
+  UploadLightArray<PointLight>(0, &JAM_Engine::GetPointLight);
+  UploadLightArray<SpotLight>(1, &JAM_Engine::GetSpotLight);
+  UploadLightArray<DirectionalLight>(2, &JAM_Engine::GetDirectionalLight);
+}
+
+boolean RingBuffer::Current(const Slice &slice) { return slice.buffer_ != 0 && slice.frame_ == s_ring.frame_ && slice.buffer_ == s_ring.buffer_; }
+
+void RingBuffer::EndFrame()
+{
+  if (s_ring.buffer_ == 0)
+    return;
+
+  // A region not written this frame keeps its older fence, the new one passes later
+  GLsync &fence = s_ring.fences_[s_ring.region_];
+  if (fence)
+    glDeleteSync(fence);
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  s_ring.stats_.used_ = s_ring.head_;
+  s_ring.region_ = (s_ring.region_ + 1) % k_regions;
+  s_ring.head_ = 0;
+  s_ring.frame_ = s_ring.frame_ == UINT32_MAX ? 1 : s_ring.frame_ + 1;
+
+  for (size_t i = 0; i < s_ring.retired_.size();)
+  {
+    RetiredBuffer &retired = s_ring.retired_[i];
+    if (!Signaled(retired.fence_))
+    {
+      i++;
+      continue;
+    }
+
+    glDeleteSync(retired.fence_);
+    DeleteBuffer(retired.buffer_);
+    retired = s_ring.retired_.back();
+    s_ring.retired_.pop_back();
+  }
+}
+
+void RingBuffer::SetActive(boolean active)
+{
+  if (active == s_ring.active_)
+    return;
+
+  s_ring.active_ = active;
+  if (active)
+  {
+    // Created again with the next allocation
+    s_ring.checked_ = false;
+    s_ring.supported_ = false;
+    return;
+  }
+
+  if (s_ring.checked_)
+    Release();
+  s_ring.region_ = 0;
+  s_ring.head_ = 0;
+}
+
+RingBuffer::Stats RingBuffer::GetStats() { return s_ring.stats_; }
@@ -0,0 +1,475 @@
+#include <engine/jam_engine.h>
+#include <engine/renderer.h>
+#include <engine/scene_bvh.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+// Build limits
+const u32 k_max_leaf_objects = 4;
+const u32 k_sah_bins = 16;
+
+// A refitted tree is built again when its cost grows this much
+const f32 k_rebuild_cost_ratio = 1.5f;
+
+// Tree entry of a removed object, skipped until the tree is built again
+const u32 k_removed = UINT32_MAX;
+
+static f32 Axis(Math::Vec3 v, u32 axis) { return (axis == 0) ? v.x : ((axis == 1) ? v.y : v.z); }
+
+static boolean HasBox(boolean has_bounds, const Math::AABB &bounds) { return has_bounds && !bounds.IsEmpty(); }
+
+SceneBVH::SceneBVH() {}
+
+SceneBVH::~SceneBVH() {}
+
+void SceneBVH::insert(Entity::Id root_node, boolean is_static)
+{
+  if (object_ids_.contains(root_node))
+    return;
+
+  Object object;
+  object.id_ = root_node;
+  object.matrix_ = Math::Mat4::Identity();
+  object.is_static_ = is_static;
+  object.has_bounds_ = false;
+
+  u32 index = static_cast<u32>(objects_.size());
+  objects_.push_back(object);
+  object_ids_.insert(std::make_pair(root_node, index));
+  unbounded_.push_back(index);
+}
+
+void SceneBVH::remove(Entity::Id root_node)
+{
+  auto it = object_ids_.find(root_node);
+  if (it == object_ids_.end())
+    return;
+
+  // The last object takes the place of the removed one
+  u32 index = it->second;
+  u32 last = static_cast<u32>(objects_.size() - 1);
+  const Object &removed = objects_[index];
+  Tree &removed_tree = removed.is_static_ ? static_tree_ : dynamic_tree_;
+  Tree &moved_tree = objects_[last].is_static_ ? static_tree_ : dynamic_tree_;
+
+  // Only the objects with a box are in a tree, the queries until the next
+  // update skip the removed one and find the moved one at its new index
+  if (HasBox(removed.has_bounds_, removed.bounds_))
+  {
+    std::replace(removed_tree.objects_.begin(), removed_tree.objects_.end(), index, k_removed);
+    removed_tree.dirty_ = true;
+  }
+  if (index != last)
+    std::replace(moved_tree.objects_.begin(), moved_tree.objects_.end(), last, index);
+
+  object_ids_.erase(it);
+  if (index != last)
+  {
+    objects_[index] = objects_[last];
+    object_ids_[objects_[index].id_] = index;
+  }
+  objects_.pop_back();
+
+  unbounded_.erase(std::remove(unbounded_.begin(), unbounded_.end(), index), unbounded_.end());
+  for (u32 &object : unbounded_)
+    if (object == last)
+      object = index;
+}
+
+void SceneBVH::clear()
+{
+  objects_.clear();
+  object_ids_.clear();
+  unbounded_.clear();
+
+  static_tree_ = Tree();
+  dynamic_tree_ = Tree();
+}
+
+void SceneBVH::update()
+{
+  // Root transforms of the dynamic trees, read from the dense storage
+  scratch_ids_.clear();
+  for (const Object &object : objects_)
+    if (!object.is_static_)
+      scratch_ids_.push_back(object.id_);
+
+  scratch_internal_.resize(scratch_ids_.size());
+  EM->getInternalIds(scratch_ids_, scratch_internal_.data());
+  Entity::Components<Transform> *transforms = EM->getComponentsStorage<Transform>();
+
+  boolean moved = false;
+  size_t dynamic_index = 0;
+  for (Object &object : objects_)
+  {
+    if (object.is_static_)
+      continue;
+
+    size_t internal_id = scratch_internal_[dynamic_index++];
+    Transform *tr = nullptr;
+    if (internal_id < transforms->size_ && transforms->has_value_[internal_id])
+      tr = transforms->components_ + internal_id;
+
+    Math::Mat4 matrix = tr ? tr->getTrMatrix() : Math::Mat4::Identity();
+    if (object.has_bounds_ && memcmp(matrix.m, object.matrix_.m, sizeof(matrix.m)) == 0)
+      continue;
+
+    boolean had_box = HasBox(object.has_bounds_, object.bounds_);
+    object.matrix_ = matrix;
+    readBounds(object);
+
+    // Objects coming in or out of the tree need a build, the rest a refit
+    if (had_box != HasBox(object.has_bounds_, object.bounds_))
+      dynamic_tree_.dirty_ = true;
+    else
+      moved = true;
+  }
+
+  // Static trees are read until their meshes have loaded
+  for (u32 index : unbounded_)
+  {
+    Object &object = objects_[index];
+    if (!object.is_static_)
+      continue;
+
+    readBounds(object);
+    if (HasBox(object.has_bounds_, object.bounds_))
+      static_tree_.dirty_ = true;
+  }
+
+  unbounded_.clear();
+  for (u32 i = 0; i < objects_.size(); i++)
+    if (!objects_[i].has_bounds_)
+      unbounded_.push_back(i);
+
+  if (static_tree_.dirty_)
+    build(static_tree_, true);
+
+  if (dynamic_tree_.dirty_)
+  {
+    build(dynamic_tree_, false);
+  }
+  else if (moved)
+  {
+    refit(dynamic_tree_);
+    if (cost(dynamic_tree_) > dynamic_tree_.build_cost_ * k_rebuild_cost_ratio)
+      build(dynamic_tree_, false);
+  }
+}
+
+u32 SceneBVH::size() const { return static_cast<u32>(objects_.size()); }
+
+void SceneBVH::readBounds(Object &object)
+{
+  Math::AABB bounds;
+  object.has_bounds_ = Renderer::GetWorldBounds(object.id_, Math::Mat4::Identity(), bounds);
+  object.bounds_ = object.has_bounds_ ? bounds : Math::AABB();
+}
+
+void SceneBVH::build(Tree &tree, boolean is_static)
+{
+  tree.nodes_.clear();
+  tree.objects_.clear();
+  tree.dirty_ = false;
+  tree.build_cost_ = 0.0f;
+
+  // Trees without meshes have an empty box, nothing can see them
+  for (u32 i = 0; i < objects_.size(); i++)
+    if (objects_[i].is_static_ == is_static && HasBox(objects_[i].has_bounds_, objects_[i].bounds_))
+      tree.objects_.push_back(i);
+
+  if (tree.objects_.empty())
+    return;
+
+  u32 total = static_cast<u32>(tree.objects_.size());
+  tree.nodes_.reserve(static_cast<size_t>(total) * 2);
+  tree.nodes_.push_back(Node());
+  split(tree, 0, 0, total);
+
+  tree.build_cost_ = cost(tree);
+}
+
+void SceneBVH::split(Tree &tree, u32 node_index, u32 first, u32 count)
+{
+  Math::AABB bounds, centroids;
+  for (u32 i = first; i < first + count; i++)
+  {
+    const Math::AABB &object_bounds = objects_[tree.objects_[i]].bounds_;
+    bounds.Expand(object_bounds);
+    centroids.Expand(object_bounds.Center());
+  }
+
+  tree.nodes_[node_index].bounds_ = bounds;
+  tree.nodes_[node_index].first_ = first;
+  tree.nodes_[node_index].count_ = count;
+
+  if (count <= k_max_leaf_objects)
+    return;
+
+  // Binned SAH, the split with the lowest area * objects on both sides
+  struct Bin
+  {
+    Math::AABB bounds_;
+    u32 count_ = 0;
+  };
+
+  u32 best_axis = 3, best_bin = 0;
+  f32 best_cost = FLT_MAX;
+
+  for (u32 axis = 0; axis < 3; axis++)
+  {
+    f32 low = Axis(centroids.min, axis);
+    f32 extent = Axis(centroids.max, axis) - low;
+    if (!(extent > 0.0f))
+      continue;
+
+    Bin bins[k_sah_bins];
+    f32 scale = static_cast<f32>(k_sah_bins) / extent;
+    for (u32 i = first; i < first + count; i++)
+    {
+      const Math::AABB &object_bounds = objects_[tree.objects_[i]].bounds_;
+      u32 bin = std::min(k_sah_bins - 1, static_cast<u32>((Axis(object_bounds.Center(), axis) - low) * scale));
+      bins[bin].bounds_.Expand(object_bounds);
+      bins[bin].count_++;
+    }
+
+    // Left side from the start, right side from the end
+    f32 left_area[k_sah_bins - 1];
+    u32 left_count[k_sah_bins - 1];
+    Math::AABB left_bounds;
+    u32 left_total = 0;
+    for (u32 i = 0; i < k_sah_bins - 1; i++)
+    {
+      left_bounds.Expand(bins[i].bounds_);
+      left_total += bins[i].count_;
+      left_area[i] = left_bounds.SurfaceArea();
+      left_count[i] = left_total;
+    }
+
+    Math::AABB right_bounds;
+    u32 right_total = 0;
+    for (u32 i = k_sah_bins - 1; i > 0; i--)
+    {
+      right_bounds.Expand(bins[i].bounds_);
+      right_total += bins[i].count_;
+
+      if (left_count[i - 1] == 0 || right_total == 0)
+        continue;
+
+      f32 split_cost = (left_area[i - 1] * static_cast<f32>(left_count[i - 1])) + (right_bounds.SurfaceArea() * static_cast<f32>(right_total));
+      if (split_cost < best_cost)
+      {
+        best_cost = split_cost;
+        best_axis = axis;
+        best_bin = i;
+      }
+    }
+  }
+
+  // Every centroid in the same place, it stays as a big leaf
+  if (best_axis == 3)
+    return;
+
+  f32 low = Axis(centroids.min, best_axis);
+  f32 scale = static_cast<f32>(k_sah_bins) / (Axis(centroids.max, best_axis) - low);
+  auto begin = tree.objects_.begin() + first;
+  auto middle = std::partition(begin, begin + count, [&](u32 object)
+  {
+    u32 bin = std::min(k_sah_bins - 1, static_cast<u32>((Axis(objects_[object].bounds_.Center(), best_axis) - low) * scale));
+    return bin < best_bin;
+  });
+
+  u32 left = static_cast<u32>(middle - begin);
+  if (left == 0 || left == count)
+    return;
+
+  u32 child = static_cast<u32>(tree.nodes_.size());
+  tree.nodes_.push_back(Node());
+  tree.nodes_.push_back(Node());
+  tree.nodes_[node_index].first_ = child;
+  tree.nodes_[node_index].count_ = 0;
+
+  split(tree, child, first, left);
+  split(tree, child + 1, first + left, count - left);
+}
+
+void SceneBVH::refit(Tree &tree)
+{
+  // Children are always after their parent
+  for (size_t n = tree.nodes_.size(); n > 0; n--)
+  {
+    Node &node = tree.nodes_[n - 1];
+    Math::AABB bounds;
+
+    if (node.count_ > 0)
+    {
+      for (u32 i = node.first_; i < node.first_ + node.count_; i++)
+        if (tree.objects_[i] != k_removed)
+          bounds.Expand(objects_[tree.objects_[i]].bounds_);
+    }
+    else
+    {
+      bounds.Expand(tree.nodes_[node.first_].bounds_);
+      bounds.Expand(tree.nodes_[node.first_ + 1].bounds_);
+    }
+
+    node.bounds_ = bounds;
+  }
+}
+
+f32 SceneBVH::cost(const Tree &tree) const
+{
+  if (tree.nodes_.empty())
+    return 0.0f;
+
+  f32 root_area = tree.nodes_[0].bounds_.SurfaceArea();
+  if (!(root_area > 0.0f))
+    return 0.0f;
+
+  f32 total = 0.0f;
+  for (const Node &node : tree.nodes_)
+    total += node.bounds_.SurfaceArea() * static_cast<f32>((node.count_ > 0) ? node.count_ : 1);
+
+  return total / root_area;
+}
+
+template <typename Test, typename Visit>
+void SceneBVH::walk(const Tree &tree, Test test, Visit visit) const
+{
+  if (tree.nodes_.empty())
+    return;
+
+  // Node and whether it's already known to be inside
+  thread_local std::vector<std::pair<u32, boolean>> stack;
+  stack.clear();
+  stack.push_back(std::make_pair(0u, false));
+
+  while (!stack.empty())
+  {
+    auto [node_index, inside] = stack.back();
+    stack.pop_back();
+
+    const Node &node = tree.nodes_[node_index];
+    if (!inside)
+    {
+      Math::Frustum::Result result = test(node.bounds_);
+      if (result == Math::Frustum::Result::Outside)
+        continue;
+      inside = (result == Math::Frustum::Result::Inside);
+    }
+
+    if (node.count_ == 0)
+    {
+      stack.push_back(std::make_pair(node.first_ + 1, inside));
+      stack.push_back(std::make_pair(node.first_, inside));
+      continue;
+    }
+
+    for (u32 i = node.first_; i < node.first_ + node.count_; i++)
+    {
+      if (tree.objects_[i] == k_removed)
+        continue;
+
+      const Object &object = objects_[tree.objects_[i]];
+      if (inside || test(object.bounds_) != Math::Frustum::Result::Outside)
+        visit(object);
+    }
+  }
+}
+
+void SceneBVH::query(const Math::Frustum &frustum, std::vector<Entity::Id> &result) const
+{
+  auto test = [&](const Math::AABB &box) { return frustum.Classify(box); };
+  auto visit = [&](const Object &object) { result.push_back(object.id_); };
+
+  walk(static_tree_, test, visit);
+  walk(dynamic_tree_, test, visit);
+
+  // Without bounds they can not be culled
+  for (u32 index : unbounded_)
+    result.push_back(objects_[index].id_);
+}
+
+void SceneBVH::query(Math::Sphere sphere, std::vector<Entity::Id> &result) const
+{
+  auto test = [&](const Math::AABB &box)
+  { return sphere.Intersects(box) ? Math::Frustum::Result::Intersect : Math::Frustum::Result::Outside; };
+  auto visit = [&](const Object &object) { result.push_back(object.id_); };
+
+  walk(static_tree_, test, visit);
+  walk(dynamic_tree_, test, visit);
+}
+
+void SceneBVH::query(Math::AABB box, std::vector<Entity::Id> &result) const
+{
+  auto test = [&](const Math::AABB &other)
+  { return box.Intersects(other) ? Math::Frustum::Result::Intersect : Math::Frustum::Result::Outside; };
+  auto visit = [&](const Object &object) { result.push_back(object.id_); };
+
+  walk(static_tree_, test, visit);
+  walk(dynamic_tree_, test, visit);
+}
+
+void SceneBVH::overlaps(Entity::Id root_node, std::vector<Entity::Id> &result) const
+{
+  Math::AABB bounds;
+  if (!getBounds(root_node, bounds) || bounds.IsEmpty())
+    return;
+
+  size_t first = result.size();
+  query(bounds, result);
+  result.erase(std::remove(result.begin() + static_cast<std::ptrdiff_t>(first), result.end(), root_node), result.end());
+}
+
+boolean SceneBVH::raycast(Math::Vec3 origin, Math::Vec3 direction, f32 max_distance, Entity::Id &hit, f32 &distance) const
+{
+  direction = direction.Normalized();
+  Math::Vec3 inv_dir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+  // The closest hit so far shortens the ray, so farther nodes are skipped
+  boolean found = false;
+  f32 closest = max_distance;
+
+  auto test = [&](const Math::AABB &box)
+  {
+    f32 t;
+    return box.IntersectsRay(origin, inv_dir, closest, t) ? Math::Frustum::Result::Intersect : Math::Frustum::Result::Outside;
+  };
+  auto visit = [&](const Object &object)
+  {
+    f32 t;
+    if (object.bounds_.IntersectsRay(origin, inv_dir, closest, t))
+    {
+      found = true;
+      closest = t;
+      hit = object.id_;
+    }
+  };
+
+  walk(static_tree_, test, visit);
+  walk(dynamic_tree_, test, visit);
+
+  if (found)
+    distance = closest;
+
+  return found;
+}
+
+boolean SceneBVH::getBounds(Entity::Id root_node, Math::AABB &bounds) const
+{
+  auto it = object_ids_.find(root_node);
+  if (it == object_ids_.end() || !objects_[it->second].has_bounds_)
+    return false;
+
+  bounds = objects_[it->second].bounds_;
+
+  return true;
+}
+
+void SceneBVH::entities(std::vector<Entity::Id> &result) const
+{
+  for (const Object &object : objects_)
+    result.push_back(object.id_);
+}
@@ -0,0 +1,1384 @@
+#include <engine/gl_state.h>
+#include <engine/jam_engine.h>
+#include <engine/program_cache.h>
+#include <engine/ring_buffer.h>
+
+#include <cctype>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Shader preludes
+///////////////////////////////////////////////////////////////////////////////
+static const std::string version = R"(
+  #version 460
+)";
+
+static const std::string uniform_blocks = R"(
+  layout(std140, binding = VIEW_UNIFORM_BIND) uniform View_Block {
+    mat4 u_v_matrix;
+    mat4 u_p_matrix;
+    mat4 u_vp_matrix;
+    vec3 u_camera_pos;
+    vec3 u_camera_dir;
+  };
+
+  layout(std140, binding = FRAME_UNIFORM_BIND) uniform Frame_Block {
+    float u_time;
+    float u_delta_time;
+    uint u_selected_id;
+    uint u_frame;
+  };
+)";
+
+static const std::string vertex_material = R"(
+  struct VertexMaterial
+  {
+    vec3 a_ambient;
+    uint a_ambient_index;
+
+    vec3 a_diffuse;
+    uint a_diffuse_index;
+    
+    vec3 a_specular;
+    uint a_specular_index;
+    
+    vec3 a_transmittance;
+    uint a_specular_highlight_index;
+
+    vec3 a_emission;
+    uint a_emissive_index;
+
+    float a_shininess;
+    float a_ior;
+    float a_dissolve;
+    int a_illum;
+
+    uint a_bump_index;
+    uint a_displacement_index;
+    uint a_alpha_index;
+    uint a_reflection_index;
+
+    uint a_roughness_index;
+    uint a_metallic_index;
+    uint a_sheen_index;
+    uint a_normal_index;
+  };
+
+  layout(std430, binding = VERTEX_MATERIAL_BIND) buffer VertexMaterialBlock {
+    VertexMaterial materials_[];
+  };
+)";
+
+static const std::string light_vert_shader_string = R"(
+  layout(location = 0) in vec3 a_position;
+  layout(location = 1) in vec3 a_normal;
+  layout(location = 2) in vec2 a_tex_coords;
+
+  uniform mat4 u_m_matrix;
+
+  uniform uint u_mesh_id;
+
+  uniform uint u_instanced;
+
+  struct InstanceData
+  {
+    mat4 m_matrix;
+    uint entity_id;
+  };
+
+  layout(std430, binding = INSTANCE_BIND) readonly buffer Instance_Block {
+    InstanceData instances_[];
+  };
+
+  mat4 GetModelMatrix()
+  {
+    if (u_instanced != 0u)
+      return instances_[gl_BaseInstance + gl_InstanceID].m_matrix;
+
+    return u_m_matrix;
+  }
+
+  uint GetEntityId()
+  {
+    if (u_instanced != 0u)
+      return instances_[gl_BaseInstance + gl_InstanceID].entity_id;
+
+    return u_mesh_id;
+  }
+
+  struct Vertex 
+  {
+    vec3 normal;
+    vec3 position;
+    vec2 tex_coord;
+    vec4 frag_picker;
+
+    vec3 world_normal;
+    vec3 eye_normal;
+
+    vec3 world_position;
+    vec3 eye_position;
+  };
+
+  out Vertex vertex_data;
+
+  out uint material_index;
+
+  out uint entity_id;
+
+  vec4 GetWorldPosition()
+  {
+    return u_vp_matrix * GetModelMatrix() * vec4(a_position, 1.0);
+  }
+
+  void PassVertexToFragment()
+  {
+    vertex_data.normal = normalize(a_normal);
+    vertex_data.position = a_position;
+    vertex_data.tex_coord = a_tex_coords;
+
+    uint id = GetEntityId();
+    mat4 m_matrix = GetModelMatrix();
+
+    int i = int(id);
+    int r = (i & 0x000000FF) >>  0;
+    int g = (i & 0x0000FF00) >>  8;
+    int b = (i & 0x00FF0000) >> 16;
+
+    vertex_data.frag_picker = vec4(float(r)/255.0, float(g)/255.0, float(b)/255.0, 1.0);
+
+    vertex_data.world_normal = normalize(m_matrix * vec4(a_normal, 0.0)).xyz;
+    vertex_data.world_position = (m_matrix * vec4(a_position, 1.0)).xyz;
+
+    vec4 worldPosition = vec4(vertex_data.world_position, 1.0);
+    vertex_data.eye_position = (u_v_matrix * worldPosition).xyz;
+    vertex_data.eye_normal = normalize(mat3(u_v_matrix) * vertex_data.world_normal);
+
+    material_index = gl_VertexID;
+    entity_id = id;
+  }
+
+  // The user code gets the instance values with the usual names
+  #define u_m_matrix GetModelMatrix()
+  #define u_mesh_id GetEntityId()
+)";
+
+static const std::string light_frag_shader_string = R"(
+  layout(location = 0) out vec4 fragColor;
+  layout(location = 1) out vec4 fragLocation;
+  layout(location = 2) out vec4 fragNormal;
+  layout(location = 3) out vec4 fragPicker;
+
+  uniform mat4 u_m_matrix;
+
+  uniform uint u_mesh_id;
+
+  flat in uint material_index;
+  flat in uint entity_id;
+
+  struct Vertex 
+  {
+    vec3 normal;
+    vec3 position;
+    vec2 tex_coord;
+    vec4 frag_picker;
+
+    vec3 world_normal;
+    vec3 eye_normal;
+
+    vec3 world_position;
+    vec3 eye_position;
+  };
+
+  in Vertex vertex_data;
+
+  void Draw(vec4 color, vec4 world_pos, vec4 world_normal)
+  {
+    fragColor = color;
+    fragLocation = world_pos;
+    fragNormal = world_normal;
+    fragPicker = vertex_data.frag_picker;
+  }
+)";
+
+static const std::string outline_string = R"(
+  vec4 OutlineEffect(vec4 color, vec4 outline_color, vec3 eye_pos, vec3 eye_norm)
+  {
+    float dotEyeNorm = dot(normalize(-eye_pos), normalize(eye_norm));
+    dotEyeNorm = max(0.0, dotEyeNorm);
+
+    return mix(outline_color, color, smoothstep(0.2, 0.3, dotEyeNorm));
+  }
+)";
+
+static const std::string point_light_string = R"(
+  struct PointLight
+  {
+    mat4 v_matrix[6];
+    mat4 p_matrix;
+
+    vec3 position;
+    float bright;
+
+    vec3 difuse_clr;
+    float specular_str;
+
+    float quadratic_attenuation;
+    float constant_attenuation;
+    float linear_attenuation;
+    uint use_volumetric;
+    
+    vec2 padding_two;
+    uint on;
+    float specular_bright;
+  };
+
+  layout(std430, binding = POINT_LIGHT_BIND) buffer Point_Light_Block {
+    PointLight point_light_[];
+  };
+
+  uniform uint u_point_light_size;
+
+  vec3 GetLight(PointLight pLight, vec3 world_position, vec3 world_normal, bool specular, vec3 specular_clr)
+  {
+    vec3 camera_obj_direction = normalize(u_camera_pos - world_position);
+
+    // Point light with bright
+    //////////////////////////////////////////////////////////////////////////////
+    vec3 point_light_dir = pLight.position - world_position;
+    float point_light_distance = length(point_light_dir);
+
+    vec3 point_light = normalize(point_light_dir) * pLight.bright;
+    float attenuation = 1.0 / (pLight.constant_attenuation + (pLight.linear_attenuation * point_light_distance) + (pLight.quadratic_attenuation * pow(point_light_distance, 2)));
+    point_light *= attenuation;
+    vec3 result = dot(point_light, world_normal) * pLight.difuse_clr;
+    //////////////////////////////////////////////////////////////////////////////
+
+    // Specular light based on point light
+    //////////////////////////////////////////////////////////////////////////////
+    if (specular)
+    {
+      vec3 specular_direction = normalize(reflect(-point_light_dir, world_normal));
+      float specular_intensity = pow(max(dot(camera_obj_direction, specular_direction), 0.0), pLight.specular_bright);
+      vec3 specular_light = (specular_intensity * specular_clr) * pLight.specular_str * attenuation;
+      result += specular_light;
+    }
+    //////////////////////////////////////////////////////////////////////////////
+
+    return max(result, vec3(0.0));
+  }
+
+  // Maybe convert ifs into maths?
+  uint GetNearestDirection(vec3 light_position, vec3 world_position)
+  {
+    vec3 direction = world_position - light_position;
+
+    float absX = abs(direction.x);
+    float absY = abs(direction.y);
+    float absZ = abs(direction.z);
+
+    // X
+    if (absX >= absY && absX >= absZ) 
+    {
+      if (direction.x > 0.0)
+        return 4u; // Right
+      else
+        return 5u; // Left
+    }
+
+    // Y
+    if (absY >= absX && absY >= absZ) 
+    {
+      if (direction.y > 0.0)
+        return 2u; // Up
+      else
+        return 3u; // Down
+    }
+
+    // Z
+    if (direction.z > 0.0)
+      return 0u; // Front
+    else
+      return 1u; // Back
+  }
+
+
+  float GetShadowFactor(PointLight point_light, sampler2DArray shadow_map, uint layer_index, vec3 world_position)
+  {
+    uint nearest_direction = GetNearestDirection(point_light.position, world_position.xyz);
+    vec4 light_pos = point_light.p_matrix * point_light.v_matrix[nearest_direction] * vec4(world_position, 1.0);
+
+    uint inner_layer_index = ((layer_index * 6) + nearest_direction);
+
+    vec3 ProjCoords = light_pos.xyz / light_pos.w;
+
+    ProjCoords = (ProjCoords * 0.5) + 0.5;
+
+    float closestDepth = texture(shadow_map, vec3(ProjCoords.xy, inner_layer_index)).r;
+
+    float currentDepth = ProjCoords.z;
+
+    float bias = 0.01;
+    float shadow = (currentDepth - bias) > closestDepth ? 1.0 : 0.0;
+
+    return (1.0 - shadow);
+  }
+)";
+
+static const std::string spot_light_string = R"(
+  struct SpotLight
+  {
+    mat4 v_matrix;
+    mat4 p_matrix;
+
+    vec3 position;
+    float bright;
+
+    vec3 direction;
+    float cut_off;
+
+    vec3 difuse_clr;
+    float specular_str;
+
+    float linear_attenuation;
+    float constant_attenuation;
+    float quadratic_attenuation;
+    float outter_cut_off;
+
+    uint use_volumetric;
+    float padding_;
+    float specular_bright;
+    uint on;
+  };
+
+  layout(std430, binding = SPOT_LIGHT_BIND) buffer Spot_Light_Block {
+    SpotLight spot_light_[];
+  };
+
+  uniform uint u_spot_light_size;
+
+  vec3 GetLight(SpotLight sLight, vec3 world_position, vec3 world_normal, bool specular, vec3 specular_clr)
+  {
+    vec3 camera_obj_direction = normalize(u_camera_pos - world_position);
+
+    vec3 light_direction = normalize(sLight.position - world_position);
+    float light_distance = length(light_direction);
+    float spot_light_intensity = dot(light_direction, normalize(-sLight.direction));
+  
+    // Ensure cut_off <= outter_cut_off
+    if (sLight.cut_off > sLight.outter_cut_off) 
+    {
+      float temp = sLight.cut_off;
+      sLight.cut_off = sLight.outter_cut_off;
+      sLight.outter_cut_off = temp;
+    }
+  
+    // Spot light with bright
+    //////////////////////////////////////////////////////////////////////////////
+    float attenuation = 1.0 / (sLight.constant_attenuation + (sLight.linear_attenuation * light_distance) + (sLight.quadratic_attenuation * pow(light_distance, 2)));
+    float spot_intensity = clamp((spot_light_intensity - sLight.cut_off) / (sLight.outter_cut_off - sLight.cut_off), 0.0, 1.0);
+    vec3 point_light = normalize(light_direction);
+    point_light *= attenuation * spot_intensity * sLight.bright;
+    vec3 result = dot(point_light, world_normal) * sLight.difuse_clr;
+    //////////////////////////////////////////////////////////////////////////////
+
+    // Specular light based on spot light
+    //////////////////////////////////////////////////////////////////////////////
+    if(specular)
+    {
+      vec3 specular_direction = normalize(reflect(-light_direction, world_normal));
+      float specular_intensity = pow(max(dot(camera_obj_direction, specular_direction), 0.0), sLight.specular_bright);
+      vec3 specular_light = (specular_intensity * specular_clr) * sLight.specular_str * attenuation * spot_intensity;
+      result += specular_light;
+    }
+    //////////////////////////////////////////////////////////////////////////////
+    return max(result, vec3(0.0));
+  }
+
+  float GetShadowFactor(SpotLight spot_light, sampler2DArray shadow_map, uint layer_index, vec3 world_position)
+  {
+    vec4 light_pos = spot_light.p_matrix * spot_light.v_matrix * vec4(world_position, 1.0);
+
+    vec3 ProjCoords = light_pos.xyz / light_pos.w;
+
+    ProjCoords = (ProjCoords * 0.5) + 0.5;
+
+    float closestDepth = texture(shadow_map, vec3(ProjCoords.xy, layer_index)).r;
+
+    float currentDepth = ProjCoords.z;
+
+    float bias = 0.01;
+    float shadow = (currentDepth - bias) > closestDepth ? 1.0 : 0.0;
+
+    return (1.0 - shadow);
+  }
+)";
+
+static const std::string directional_light_string = R"(
+  struct DirectionalLight
+  {
+    mat4 v_matrix;
+    mat4 p_matrix;
+
+    vec3 position;
+    float bright;
+    vec3 direction;
+    float specular_bright;
+
+    vec3 difuse_clr;
+    float specular_str;
+  
+    uint use_volumetric;
+    vec2 padding;
+    uint on;
+  };
+
+  layout(std430, binding = DIRECTIONAL_LIGHT_BIND) buffer Directional_Light_Block {
+    DirectionalLight directional_light_[];
+  };
+
+  uniform uint u_directional_light_size;
+
+  vec3 GetLight(DirectionalLight dLight, vec3 world_position, vec3 world_normal, bool specular, vec3 specular_clr)
+  {
+    vec3 camera_obj_direction = normalize(u_camera_pos - world_position);
+    
+    // Directional light with bright
+    //////////////////////////////////////////////////////////////////////////////
+    vec3 result = dot(-dLight.direction, world_normal) * dLight.bright * dLight.difuse_clr;
+    //////////////////////////////////////////////////////////////////////////////
+
+    // Specular light based on directional light
+    //////////////////////////////////////////////////////////////////////////////
+    if(specular)
+    {
+      vec3 specular_direction = normalize(reflect(dLight.direction, world_normal));
+      float specular_intensity = pow(max(dot(camera_obj_direction, specular_direction), 0.0), dLight.specular_bright);
+      vec3 specular_light = specular_clr * specular_intensity * dLight.specular_str;
+
+      result = result + dot(-dLight.direction, world_normal) * specular_light;
+    }
+    //////////////////////////////////////////////////////////////////////////////
+    return max(result, vec3(0.0));
+  }
+
+  float GetShadowFactor(DirectionalLight dir_light, sampler2DArray shadow_map, uint layer_index, vec3 world_position)
+  {
+    vec4 light_pos = dir_light.p_matrix * dir_light.v_matrix * vec4(world_position, 1.0);
+
+    vec3 ProjCoords = light_pos.xyz / light_pos.w;
+
+    ProjCoords = (ProjCoords * 0.5) + 0.5;
+
+   float closestDepth = texture(shadow_map, vec3(ProjCoords.xy, layer_index)).r;
+
+    float currentDepth = ProjCoords.z;
+
+    float bias = 0.01;
+    float shadow = (currentDepth - bias) > closestDepth ? 1.0 : 0.0;
+
+    return (1.0 - shadow);
+  }
+)";
+
+static const std::string volumetric_light_string = R"(
+  bool ObjectReached(vec3 dir, vec3 pos, vec3 final_pos)
+  {
+    vec3 sub_dir = normalize(final_pos - pos);
+    return dot(sub_dir, dir) < 0.0;
+  }
+)";
+
+static const std::string volumetric_spot_light_string = R"(
+  vec3 GetVolumetricLight(SpotLight s_light, sampler2DArray shadow_map, uint layer_index, vec3 pixel_pos, float attenuation, float max_distance, float step_offset)
+  {
+    vec3 accum_light = vec3(0.0);
+
+    vec3 camera_ray_dir = normalize(pixel_pos - u_camera_pos);
+    vec3 camera_ray_step_offset = (camera_ray_dir * step_offset);
+    vec3 camera_ray_pos = u_camera_pos; // Iterator
+
+    for(float i = 0; i < max_distance; i += step_offset)
+    {
+      if(ObjectReached(camera_ray_dir, camera_ray_pos, pixel_pos))
+        break;
+
+      if(GetShadowFactor(s_light, shadow_map, layer_index, camera_ray_pos) == 1.0f)
+        accum_light += (GetLight(s_light, camera_ray_pos, s_light.position - camera_ray_pos, false, vec3(0.0)) * attenuation);
+
+      camera_ray_pos += (camera_ray_step_offset);
+    }
+
+    return accum_light;
+  }
+)";
+
+static const std::string volumetric_point_light_string = R"(
+  vec3 GetVolumetricLight(PointLight p_light, sampler2DArray shadow_map, uint layer_index, vec3 pixel_pos, float attenuation, float max_distance, float step_offset)
+  {
+    vec3 accum_light = vec3(0.0);
+
+    vec3 camera_ray_dir = normalize(pixel_pos - u_camera_pos);
+    vec3 camera_ray_step_offset = (camera_ray_dir * step_offset);
+    vec3 camera_ray_pos = u_camera_pos; // Iterator
+
+    for(float i = 0; i < max_distance; i += step_offset)
+    {
+      if(ObjectReached(camera_ray_dir, camera_ray_pos, pixel_pos))
+        break;
+
+      if(GetShadowFactor(p_light, shadow_map, layer_index, camera_ray_pos) == 1.0f)
+        accum_light += (GetLight(p_light, camera_ray_pos, p_light.position - camera_ray_pos, false, vec3(0.0)) * attenuation);
+
+      camera_ray_pos += (camera_ray_step_offset);
+    }
+
+    return accum_light;
+  }
+)";
+
+static const std::string volumetric_directional_light_string = R"(
+  vec3 GetVolumetricLight(DirectionalLight d_light, sampler2DArray shadow_map, uint layer_index, vec3 pixel_pos, float attenuation, float max_distance, float step_offset)
+  {
+    vec3 accum_light = vec3(0.0);
+
+    vec3 camera_ray_dir = normalize(pixel_pos - u_camera_pos);
+    vec3 camera_ray_step_offset = (camera_ray_dir * step_offset);
+    vec3 camera_ray_pos = u_camera_pos; // Iterator
+
+    for(float i = 0; i < max_distance; i += step_offset)
+    {
+      if(ObjectReached(camera_ray_dir, camera_ray_pos, pixel_pos))
+        break;
+
+      if(GetShadowFactor(d_light, shadow_map, layer_index, camera_ray_pos) == 1.0f)
+        accum_light += (GetLight(d_light, camera_ray_pos, -d_light.direction, false, vec3(0.0)) * attenuation);
+
+      camera_ray_pos += (camera_ray_step_offset);
+    }
+
+    return accum_light;
+  }
+)";
+
+static const byte *const material_textures[] = {
+    "u_ambient_texture",
+    "u_diffuse_texture",
+    "u_specular_texture",
+    "u_specular_highlight_texture",
+    "u_bump_texture",
+    "u_displacement_texture",
+    "u_alpha_texture",
+    "u_reflection_texture",
+    "u_roughness_texture",
+    "u_metallic_texture",
+    "u_sheen_texture",
+    "u_emissive_texture",
+    "u_normal_texture",
+};
+///////////////////////////////////////////////////////////////////////////////
+
+// Prelude features
+///////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief Optional parts of the preludes, a shader only gets the ones it uses.
+ */
+enum PreludeFeature : u32
+{
+  k_feature_materials = 1 << 0,
+  k_feature_point_lights = 1 << 1,
+  k_feature_spot_lights = 1 << 2,
+  k_feature_directional_lights = 1 << 3,
+  k_feature_volumetric = 1 << 4,
+  k_feature_outline = 1 << 5,
+  k_feature_lights = k_feature_point_lights | k_feature_spot_lights | k_feature_directional_lights,
+  k_feature_all = (1 << 6) - 1,
+};
+
+/**
+ * @brief Names that pull a feature in, also the names of the jam_features pragma.
+ */
+struct FeatureName
+{
+  const byte *name_; ///< Identifier in the shader.
+  u32 features_;     ///< Features it needs.
+};
+
+static const FeatureName feature_identifiers[] = {
+    {"materials_", k_feature_materials},
+    {"VertexMaterial", k_feature_materials},
+    {"point_light_", k_feature_point_lights},
+    {"PointLight", k_feature_point_lights},
+    {"u_point_light_size", k_feature_point_lights},
+    {"GetNearestDirection", k_feature_point_lights},
+    {"spot_light_", k_feature_spot_lights},
+    {"SpotLight", k_feature_spot_lights},
+    {"u_spot_light_size", k_feature_spot_lights},
+    {"directional_light_", k_feature_directional_lights},
+    {"DirectionalLight", k_feature_directional_lights},
+    {"u_directional_light_size", k_feature_directional_lights},
+    {"GetVolumetricLight", k_feature_volumetric},
+    {"ObjectReached", k_feature_volumetric},
+    {"OutlineEffect", k_feature_outline},
+};
+
+static const FeatureName feature_pragma_names[] = {
+    {"materials", k_feature_materials},
+    {"point_lights", k_feature_point_lights},
+    {"spot_lights", k_feature_spot_lights},
+    {"directional_lights", k_feature_directional_lights},
+    {"lights", k_feature_lights},
+    {"volumetric", k_feature_volumetric},
+    {"outline", k_feature_outline},
+    {"all", k_feature_all},
+};
+
+const std::string_view k_features_pragma = "jam_features";
+
+/**
+ * @struct SourceFeatures
+ *
+ * @brief Prelude parts a shader source needs.
+ */
+struct SourceFeatures
+{
+  u32 features_ = 0;         ///< PreludeFeature bits.
+  u32 textures_ = 0;         ///< Bits of material_textures.
+  boolean explicit_ = false; ///< Given by a jam_features pragma instead of found.
+};
+
+static boolean IsIdentifierStart(byte c) { return isalpha(static_cast<u_byte>(c)) || c == '_'; }
+
+static boolean IsIdentifierChar(byte c) { return isalnum(static_cast<u_byte>(c)) || c == '_'; }
+
+// #pragma jam_features(point_lights, volumetric), material_textures gives every sampler
+static void ReadFeaturesPragma(std::string_view line, SourceFeatures &result)
+{
+  size_t open = line.find('(');
+  size_t close = line.find(')', open);
+  if (open == std::string_view::npos || close == std::string_view::npos)
+    return;
+
+  result.explicit_ = true;
+  std::string_view list = line.substr(open + 1, close - open - 1);
+  size_t i = 0;
+  while (i < list.size())
+  {
+    if (!IsIdentifierChar(list[i]))
+    {
+      i++;
+      continue;
+    }
+
+    size_t start = i;
+    while (i < list.size() && IsIdentifierChar(list[i]))
+      i++;
+    std::string_view name = list.substr(start, i - start);
+
+    if (name == "material_textures")
+      result.textures_ = (1u << (sizeof(material_textures) / sizeof(material_textures[0]))) - 1;
+    for (const FeatureName &feature : feature_pragma_names)
+      if (name == feature.name_)
+        result.features_ |= feature.features_;
+  }
+}
+
+// The identifiers of the source, comments left out, decide the parts
+static SourceFeatures FindFeatures(std::string_view source)
+{
+  std::unordered_set<std::string_view> identifiers;
+  SourceFeatures result;
+
+  size_t i = 0;
+  while (i < source.size())
+  {
+    byte c = source[i];
+    byte next = (i + 1 < source.size()) ? source[i + 1] : '\0';
+
+    if (c == '/' && next == '/')
+      i = std::min(source.find('\n', i), source.size());
+    else if (c == '/' && next == '*')
+      i = std::min(source.find("*/", i + 2), source.size() - 2) + 2;
+    else if (c == '#')
+    {
+      size_t end = std::min(source.find('\n', i), source.size());
+      std::string_view line = source.substr(i, end - i);
+      if (line.find("pragma") != std::string_view::npos && line.find(k_features_pragma) != std::string_view::npos)
+        ReadFeaturesPragma(line.substr(line.find(k_features_pragma) + k_features_pragma.size()), result);
+      i++;
+    }
+    else if (IsIdentifierStart(c) || isdigit(static_cast<u_byte>(c)))
+    {
+      // Numbers are skipped whole, 0x00FF has no identifier
+      size_t start = i;
+      while (i < source.size() && IsIdentifierChar(source[i]))
+        i++;
+      if (IsIdentifierStart(c))
+        identifiers.insert(source.substr(start, i - start));
+    }
+    else
+      i++;
+  }
+
+  if (result.explicit_)
+    return result;
+
+  for (const FeatureName &feature : feature_identifiers)
+    if (identifiers.count(feature.name_))
+      result.features_ |= feature.features_;
+
+  for (u32 t = 0; t < sizeof(material_textures) / sizeof(material_textures[0]); t++)
+    if (identifiers.count(material_textures[t]))
+      result.textures_ |= 1u << t;
+
+  // The light functions are overloaded per type, without a type name every type is given
+  boolean light_call = identifiers.count("GetLight") || identifiers.count("GetShadowFactor") || (result.features_ & k_feature_volumetric);
+  if (light_call && !(result.features_ & k_feature_lights))
+    result.features_ |= k_feature_lights;
+
+  return result;
+}
+
+static std::string BuildFragmentPrelude(u32 features, u32 textures)
+{
+  std::string prelude = version + binds + uniform_blocks;
+  if (features & k_feature_materials)
+    prelude += vertex_material;
+
+  prelude += light_frag_shader_string;
+  if (textures)
+    prelude += "\n";
+  for (u32 t = 0; t < sizeof(material_textures) / sizeof(material_textures[0]); t++)
+    if (textures & (1u << t))
+      prelude += std::string("  uniform sampler2DArray ") + material_textures[t] + ";\n";
+
+  if (features & k_feature_outline)
+    prelude += outline_string;
+  if (features & k_feature_point_lights)
+    prelude += point_light_string;
+  if (features & k_feature_spot_lights)
+    prelude += spot_light_string;
+  if (features & k_feature_directional_lights)
+    prelude += directional_light_string;
+
+  if (features & k_feature_volumetric)
+  {
+    prelude += volumetric_light_string;
+    if (features & k_feature_spot_lights)
+      prelude += volumetric_spot_light_string;
+    if (features & k_feature_point_lights)
+      prelude += volumetric_point_light_string;
+    if (features & k_feature_directional_lights)
+      prelude += volumetric_directional_light_string;
+  }
+
+  return prelude;
+}
+
+static std::string BuildVertexPrelude(u32 features)
+{
+  std::string prelude = version + binds + uniform_blocks;
+  if (features & k_feature_materials)
+    prelude += vertex_material;
+
+  return prelude + light_vert_shader_string;
+}
+
+// Every permutation is built once, the program cache keeps the compiled ones
+static std::unordered_map<u32, std::string> s_fragment_preludes;
+static std::unordered_map<u32, std::string> s_vertex_preludes;
+
+static const std::string &FragmentPrelude(const SourceFeatures &found)
+{
+  u32 key = found.features_ | (found.textures_ << 8);
+  auto it = s_fragment_preludes.find(key);
+  if (it == s_fragment_preludes.end())
+    it = s_fragment_preludes.emplace(key, BuildFragmentPrelude(found.features_, found.textures_)).first;
+
+  return it->second;
+}
+
+static const std::string &VertexPrelude(const SourceFeatures &found)
+{
+  u32 key = found.features_ & k_feature_materials;
+  auto it = s_vertex_preludes.find(key);
+  if (it == s_vertex_preludes.end())
+    it = s_vertex_preludes.emplace(key, BuildVertexPrelude(key)).first;
+
+  return it->second;
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// Uniform blocks
+///////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief Member of the frame or view block, in the order of block_members.
+ */
+enum BlockMember : u32
+{
+  k_no_block = 0,
+  k_v_matrix,
+  k_p_matrix,
+  k_vp_matrix,
+  k_camera_pos,
+  k_camera_dir,
+  k_time,
+  k_delta_time,
+  k_selected_id,
+  k_frame,
+};
+
+/**
+ * @brief Name and std140 place of a block member.
+ */
+struct BlockLayout
+{
+  const byte *name_; ///< Uniform name in the shaders.
+  u32 block_;        ///< 0 for the frame block, 1 for the view block.
+  u32 offset_;       ///< Offset in the block.
+  u32 size_;         ///< Bytes of the member.
+};
+
+static const BlockLayout block_members[] = {
+    {"", 0, 0, 0},
+    {"u_v_matrix", 1, 0, 64},
+    {"u_p_matrix", 1, 64, 64},
+    {"u_vp_matrix", 1, 128, 64},
+    {"u_camera_pos", 1, 192, 12},
+    {"u_camera_dir", 1, 208, 12},
+    {"u_time", 0, 0, 4},
+    {"u_delta_time", 0, 4, 4},
+    {"u_selected_id", 0, 8, 4},
+    {"u_frame", 0, 12, 4},
+};
+
+static const u32 block_binds[2] = {FRAME_UNIFORM_BIND, VIEW_UNIFORM_BIND};
+static const u32 block_sizes[2] = {16, 224};
+
+/**
+ * @struct UniformBlocks
+ *
+ * @brief Frame and view blocks, with a copy of what the buffers have.
+ */
+struct UniformBlocks
+{
+  u32 buffers_[2] = {UINT32_MAX, UINT32_MAX};   ///< Frame and view uniform buffers.
+  alignas(16) u32 frame_[4] = {0, 0, UINT32_MAX, 0}; ///< Frame block, nothing selected.
+  alignas(16) f32 view_[56] = {};                    ///< View block.
+  boolean dirty_[2] = {false, false};                ///< Blocks changed since their last slice.
+  boolean in_ring_ = false;                          ///< The blocks are bound from the ring buffer.
+  RingBuffer::Slice slices_[2];                      ///< Last slice of every block.
+
+  u_byte *data(u32 block) { return block ? reinterpret_cast<u_byte *>(view_) : reinterpret_cast<u_byte *>(frame_); }
+};
+
+static UniformBlocks s_blocks;
+
+static u32 BlockMemberOf(std::string_view name)
+{
+  for (u32 i = 1; i < sizeof(block_members) / sizeof(block_members[0]); i++)
+    if (name == block_members[i].name_)
+      return i;
+
+  return k_no_block;
+}
+
+static void CreateBlocks()
+{
+  if (s_blocks.buffers_[0] != UINT32_MAX)
+    return;
+
+  glCreateBuffers(2, s_blocks.buffers_);
+  for (u32 block = 0; block < 2; block++)
+  {
+    glNamedBufferData(s_blocks.buffers_[block], block_sizes[block], s_blocks.data(block), GL_DYNAMIC_DRAW);
+    GLState::BindBufferBase(GL_UNIFORM_BUFFER, block_binds[block], s_blocks.buffers_[block]);
+  }
+}
+
+// Only the bytes that change are uploaded
+static void WriteBlock(u32 member, const void *value)
+{
+  const BlockLayout &layout = block_members[member];
+  u_byte *copy = s_blocks.data(layout.block_) + layout.offset_;
+  if (s_blocks.buffers_[0] != UINT32_MAX && memcmp(copy, value, layout.size_) == 0)
+    return;
+
+  memcpy(copy, value, layout.size_);
+  if (s_blocks.buffers_[0] == UINT32_MAX)
+  {
+    CreateBlocks();
+    if (member != k_v_matrix && member != k_p_matrix)
+      return;
+  }
+  else if (RingBuffer::Active())
+    s_blocks.dirty_[layout.block_] = true;
+  else
+    glNamedBufferSubData(s_blocks.buffers_[layout.block_], layout.offset_, layout.size_, copy);
+
+  // The shaders project with the product, it follows its factors
+  if (member == k_v_matrix || member == k_p_matrix)
+  {
+    Math::Mat4 view, projection;
+    memcpy(view.m, s_blocks.data(1) + block_members[k_v_matrix].offset_, sizeof(view.m));
+    memcpy(projection.m, s_blocks.data(1) + block_members[k_p_matrix].offset_, sizeof(projection.m));
+    Math::Mat4 view_projection = view * projection;
+    WriteBlock(k_vp_matrix, view_projection.m);
+  }
+}
+
+// With the ring every change is a new slice, a slice of an older frame is written again too
+static void FlushBlocks()
+{
+  if (s_blocks.buffers_[0] == UINT32_MAX)
+    return;
+
+  if (!RingBuffer::Active())
+  {
+    // Back to the own buffers, that missed the changes
+    if (!s_blocks.in_ring_)
+      return;
+
+    for (u32 block = 0; block < 2; block++)
+    {
+      glNamedBufferSubData(s_blocks.buffers_[block], 0, block_sizes[block], s_blocks.data(block));
+      GLState::BindBufferBase(GL_UNIFORM_BUFFER, block_binds[block], s_blocks.buffers_[block]);
+    }
+    s_blocks.in_ring_ = false;
+    return;
+  }
+
+  for (u32 block = 0; block < 2; block++)
+  {
+    RingBuffer::Slice &slice = s_blocks.slices_[block];
+    if (!s_blocks.dirty_[block] && RingBuffer::Current(slice))
+      continue;
+
+    if (!RingBuffer::Upload(s_blocks.data(block), block_sizes[block], slice))
+      return;
+
+    RingBuffer::BindRange(GL_UNIFORM_BUFFER, block_binds[block], slice);
+    s_blocks.dirty_[block] = false;
+    s_blocks.in_ring_ = true;
+  }
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// Compiling programs
+///////////////////////////////////////////////////////////////////////////////
+static const std::string fallback_vert_shader_string = R"(
+  void main()
+  {
+    PassVertexToFragment();
+    gl_Position = GetWorldPosition();
+  }
+)";
+
+static const std::string fallback_frag_shader_string = R"(
+  void main()
+  {
+    Draw(vec4(1.0, 0.0, 1.0, 1.0), vec4(vertex_data.world_position, 1.0), vec4(vertex_data.world_normal, 0.0));
+  }
+)";
+
+/**
+ * @struct PendingProgram
+ *
+ * @brief Program of a shader that is still compiling.
+ */
+struct PendingProgram
+{
+  Shader *shader_;  ///< Shader that takes the program.
+  u32 program_;     ///< Program being compiled.
+  boolean first_;   ///< The shader has no older program, the fallback draws meanwhile.
+  boolean failed_;  ///< The first program did not compile, the fallback stays until a recharge.
+};
+
+// Kept out of the shaders, the engine archive allocates them with a fixed size
+static std::unordered_map<const Shader *, PendingProgram> s_pending;
+static u32 s_fallback_program = UINT32_MAX;
+
+static boolean UsesFallback(const Shader *shader)
+{
+  if (s_pending.empty())
+    return false;
+
+  auto found = s_pending.find(shader);
+  return found != s_pending.end() && found->second.first_;
+}
+
+static void SendUniform(u32 program, s32 location, u32 type, const u32 *value)
+{
+  f32 data[16];
+  memcpy(data, value, sizeof(data));
+
+  switch (type)
+  {
+  case GL_UNSIGNED_INT: glProgramUniform1ui(program, location, value[0]); break;
+  case GL_INT: glProgramUniform1i(program, location, static_cast<s32>(value[0])); break;
+  case GL_FLOAT: glProgramUniform1f(program, location, data[0]); break;
+  case GL_FLOAT_VEC2: glProgramUniform2fv(program, location, 1, data); break;
+  case GL_FLOAT_VEC3: glProgramUniform3fv(program, location, 1, data); break;
+  case GL_FLOAT_VEC4: glProgramUniform4fv(program, location, 1, data); break;
+  case GL_FLOAT_MAT2: glProgramUniformMatrix2fv(program, location, 1, GL_FALSE, data); break;
+  case GL_FLOAT_MAT3: glProgramUniformMatrix3fv(program, location, 1, GL_FALSE, data); break;
+  case GL_FLOAT_MAT4: glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, data); break;
+  default: break;
+  }
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// The engine archive allocates the shaders itself with this size
+static_assert(sizeof(Shader) == 80, "Shader must keep the size the engine allocates");
+
+Shader::Shader() : program_id_(UINT32_MAX), has_shader_(false), fragmentPath_(nullptr), vertexPath_(nullptr) {}
+
+Shader::~Shader() {}
+
+void Shader::free()
+{
+  auto pending = s_pending.find(this);
+  if (pending != s_pending.end())
+  {
+    if (!pending->second.first_)
+      ProgramCache::DeleteProgram(pending->second.program_);
+    s_pending.erase(pending);
+  }
+
+  if (program_id_ != UINT32_MAX)
+    ProgramCache::DeleteProgram(program_id_);
+
+  uniforms_.clear();
+
+  DESTROY(fragmentPath_);
+  DESTROY(vertexPath_);
+}
+
+boolean Shader::hasShader() { return has_shader_; }
+
+// The engine code the user code needs goes before it
+static std::string FragmentSource(const std::string &source) { return FragmentPrelude(FindFeatures(source)) + source; }
+
+static std::string VertexSource(const std::string &source) { return VertexPrelude(FindFeatures(source)) + source; }
+
+// Built on the first use, it waits for its compile
+static u32 FallbackProgram()
+{
+  if (s_fallback_program == UINT32_MAX)
+  {
+    std::string fragment_source = FragmentSource(fallback_frag_shader_string);
+    std::string vertex_source = VertexSource(fallback_vert_shader_string);
+    s_fallback_program = ProgramCache::CreateProgram(fragment_source.c_str(), vertex_source.c_str());
+  }
+
+  return s_fallback_program;
+}
+
+void Shader::loadShader(const byte *fragment, const byte *vertex, boolean is_path)
+{
+  if (has_shader_)
+    return;
+
+  std::string fragment_source, vertex_source;
+
+  if (is_path)
+  {
+    // Keep the paths to recharge the shader
+    size_t fragment_len = strlen(fragment);
+    size_t vertex_len = strlen(vertex);
+    fragmentPath_ = (byte *)calloc(fragment_len + 1, sizeof(byte));
+    vertexPath_ = (byte *)calloc(vertex_len + 1, sizeof(byte));
+    if (!fragmentPath_ || !vertexPath_)
+      return;
+
+    memcpy(fragmentPath_, fragment, fragment_len);
+    memcpy(vertexPath_, vertex, vertex_len);
+
+    fragment_source = FragmentSource(LoadSourceFromFile(fragmentPath_));
+    vertex_source = VertexSource(LoadSourceFromFile(vertexPath_));
+  }
+  else
+  {
+    fragment_source = FragmentSource(fragment);
+    vertex_source = VertexSource(vertex);
+  }
+
+  program_id_ = ProgramCache::CreateProgramAsync(fragment_source.c_str(), vertex_source.c_str());
+  has_shader_ = true;
+  s_pending[this] = {this, program_id_, true, false};
+
+  // Handles asked before the load get their locations now, in the fallback if it has to wait
+  if (!pollProgram())
+    resolveUniforms();
+}
+
+void Shader::rechargeShader()
+{
+  if (!has_shader_ || !fragmentPath_ || !vertexPath_)
+    return;
+
+  std::string fragment_source = FragmentSource(LoadSourceFromFile(fragmentPath_));
+  std::string vertex_source = VertexSource(LoadSourceFromFile(vertexPath_));
+
+  u32 program = ProgramCache::CreateProgramAsync(fragment_source.c_str(), vertex_source.c_str());
+
+  // A program still compiling from an older recharge is replaced
+  auto pending = s_pending.find(this);
+  if (pending == s_pending.end())
+    s_pending[this] = {this, program, false, false};
+  else if (pending->second.first_)
+  {
+    ProgramCache::DeleteProgram(program_id_);
+    program_id_ = program;
+    pending->second = {this, program, true, false};
+  }
+  else
+  {
+    ProgramCache::DeleteProgram(pending->second.program_);
+    pending->second.program_ = program;
+  }
+
+  // The current program keeps drawing until the new one is ready
+  pollProgram();
+}
+
+void Shader::setTexture(const byte *uniform_name, u32 texture_id, u32 texture_unit)
+{
+  if (!has_shader_ || texture_unit > 31)
+    return;
+
+  // A program that does not sample it needs no bind, one still compiling might
+  Uniform uniform = getUniform(uniform_name);
+  if (uniform->location_ >= 0 || uniform->fallback_location_ >= 0 || s_pending.count(this))
+    GLState::BindTexture(texture_unit, GL_TEXTURE_2D, texture_id);
+
+  s32 unit = static_cast<s32>(texture_unit);
+  setValue(uniform, GL_INT, &unit, sizeof(unit));
+}
+
+void Shader::setTexture2DArray(const byte *uniform_name, u32 texture_id, u32 texture_unit)
+{
+  if (!has_shader_ || texture_unit > 31)
+    return;
+
+  // A program that does not sample it needs no bind, one still compiling might
+  Uniform uniform = getUniform(uniform_name);
+  if (uniform->location_ >= 0 || uniform->fallback_location_ >= 0 || s_pending.count(this))
+    GLState::BindTexture(texture_unit, GL_TEXTURE_2D_ARRAY, texture_id);
+
+  s32 unit = static_cast<s32>(texture_unit);
+  setValue(uniform, GL_INT, &unit, sizeof(unit));
+}
+
+void Shader::setU32(const byte *uniform_name, u32 value) { setU32(getUniform(uniform_name), value); }
+
+void Shader::setF32(const byte *uniform_name, f32 value) { setF32(getUniform(uniform_name), value); }
+
+void Shader::setVec2(const byte *uniform_name, Math::Vec2 value) { setVec2(getUniform(uniform_name), value); }
+
+void Shader::setVec3(const byte *uniform_name, Math::Vec3 value) { setVec3(getUniform(uniform_name), value); }
+
+void Shader::setVec4(const byte *uniform_name, Math::Vec4 value) { setVec4(getUniform(uniform_name), value); }
+
+void Shader::setMat2(const byte *uniform_name, Math::Mat2 matrix) { setMat2(getUniform(uniform_name), matrix); }
+
+void Shader::setMat3(const byte *uniform_name, Math::Mat3 matrix) { setMat3(getUniform(uniform_name), matrix); }
+
+void Shader::setMat4(const byte *uniform_name, Math::Mat4 matrix) { setMat4(getUniform(uniform_name), matrix); }
+
+Shader::Uniform Shader::getUniform(const byte *uniform_name)
+{
+  auto it = uniforms_.find(uniform_name);
+  if (it != uniforms_.end())
+    return &it->second;
+
+  UniformSlot slot = {-1, -1, BlockMemberOf(uniform_name), 0, 0, {}};
+  if (has_shader_ && slot.block_ == k_no_block)
+    locate(uniform_name, slot);
+
+  return &uniforms_.emplace(uniform_name, slot).first->second;
+}
+
+void Shader::setU32(Uniform uniform, u32 value) { setValue(uniform, GL_UNSIGNED_INT, &value, sizeof(value)); }
+
+void Shader::setF32(Uniform uniform, f32 value) { setValue(uniform, GL_FLOAT, &value, sizeof(value)); }
+
+void Shader::setVec2(Uniform uniform, Math::Vec2 value)
+{
+  f32 data[2] = {value.x, value.y};
+  setValue(uniform, GL_FLOAT_VEC2, data, sizeof(data));
+}
+
+void Shader::setVec3(Uniform uniform, Math::Vec3 value)
+{
+  f32 data[3] = {value.x, value.y, value.z};
+  setValue(uniform, GL_FLOAT_VEC3, data, sizeof(data));
+}
+
+void Shader::setVec4(Uniform uniform, Math::Vec4 value)
+{
+  f32 data[4] = {value.x, value.y, value.z, value.w};
+  setValue(uniform, GL_FLOAT_VEC4, data, sizeof(data));
+}
+
+void Shader::setMat2(Uniform uniform, Math::Mat2 matrix) { setValue(uniform, GL_FLOAT_MAT2, matrix.m, sizeof(matrix.m)); }
+
+void Shader::setMat3(Uniform uniform, Math::Mat3 matrix) { setValue(uniform, GL_FLOAT_MAT3, matrix.m, sizeof(matrix.m)); }
+
+void Shader::setMat4(Uniform uniform, Math::Mat4 matrix) { setValue(uniform, GL_FLOAT_MAT4, matrix.m, sizeof(matrix.m)); }
+
+void Shader::use() const
+{
+  if (!has_shader_)
+    return;
+
+  // The first program is still compiling, or did not compile
+  GLState::UseProgram(UsesFallback(this) ? FallbackProgram() : program_id_);
+  FlushBlocks();
+}
+
+void Shader::SetViewBlock(Math::Mat4 view, Math::Mat4 projection, Math::Vec3 camera_pos, Math::Vec3 camera_dir)
+{
+  f32 position[3] = {camera_pos.x, camera_pos.y, camera_pos.z};
+  f32 direction[3] = {camera_dir.x, camera_dir.y, camera_dir.z};
+
+  WriteBlock(k_v_matrix, view.m);
+  WriteBlock(k_p_matrix, projection.m);
+  WriteBlock(k_camera_pos, position);
+  WriteBlock(k_camera_dir, direction);
+  FlushBlocks();
+}
+
+void Shader::SetFrameBlock(f32 time, f32 delta_time, u32 frame)
+{
+  WriteBlock(k_time, &time);
+  WriteBlock(k_delta_time, &delta_time);
+  WriteBlock(k_frame, &frame);
+  FlushBlocks();
+}
+
+void Shader::SetSelectedId(u32 selected_id)
+{
+  WriteBlock(k_selected_id, &selected_id);
+  FlushBlocks();
+}
+
+void Shader::BindBlocks()
+{
+  CreateBlocks();
+  FlushBlocks();
+
+  for (u32 block = 0; block < 2; block++)
+  {
+    if (s_blocks.in_ring_)
+      RingBuffer::BindRange(GL_UNIFORM_BUFFER, block_binds[block], s_blocks.slices_[block]);
+    else
+      GLState::BindBufferBase(GL_UNIFORM_BUFFER, block_binds[block], s_blocks.buffers_[block]);
+  }
+}
+
+void Shader::PollPrograms()
+{
+  if (s_pending.empty())
+    return;
+
+  // Taking a program removes it from the list
+  std::vector<Shader *> shaders;
+  for (const auto &[key, pending] : s_pending)
+    shaders.push_back(pending.shader_);
+
+  for (Shader *shader : shaders)
+    shader->pollProgram();
+}
+
+void Shader::resolveUniforms()
+{
+  for (auto &[name, slot] : uniforms_)
+  {
+    if (slot.block_ != k_no_block)
+      continue;
+
+    // A new program starts with its default values, the last ones are sent again
+    locate(name.c_str(), slot);
+    if (slot.size_ > 0)
+      upload(slot);
+  }
+}
+
+void Shader::locate(const byte *uniform_name, UniformSlot &slot) const
+{
+  boolean fallback = UsesFallback(this);
+  slot.location_ = fallback ? -1 : glGetUniformLocation(program_id_, uniform_name);
+  slot.fallback_location_ = fallback ? glGetUniformLocation(FallbackProgram(), uniform_name) : -1;
+}
+
+boolean Shader::pollProgram()
+{
+  auto found = s_pending.find(this);
+  if (found == s_pending.end() || found->second.failed_)
+    return false;
+
+  PendingProgram pending = found->second;
+  ProgramCache::Status status = ProgramCache::PollProgram(pending.program_);
+  if (status == ProgramCache::Status::Compiling)
+    return false;
+
+  // The errors are in the log, the program that worked keeps drawing
+  if (status == ProgramCache::Status::Failed)
+  {
+    if (pending.first_)
+      found->second.failed_ = true;
+    else
+    {
+      ProgramCache::DeleteProgram(pending.program_);
+      s_pending.erase(found);
+    }
+    return false;
+  }
+
+  s_pending.erase(found);
+  if (!pending.first_)
+  {
+    ProgramCache::DeleteProgram(program_id_);
+    program_id_ = pending.program_;
+  }
+
+  // The handles stay, with the locations of the new program
+  resolveUniforms();
+  return true;
+}
+
+void Shader::setValue(Uniform uniform, u32 type, const void *value, u32 size)
+{
+  if (uniform->block_ != k_no_block)
+  {
+    if (size == block_members[uniform->block_].size_)
+    {
+      WriteBlock(uniform->block_, value);
+      FlushBlocks();
+    }
+    return;
+  }
+
+  if (uniform->type_ == type && uniform->size_ == size && memcmp(uniform->value_, value, size) == 0)
+    return;
+
+  // Kept also without a location, a program compiled later gets it
+  memcpy(uniform->value_, value, size);
+  uniform->type_ = type;
+  uniform->size_ = size;
+
+  upload(*uniform);
+}
+
+void Shader::upload(const UniformSlot &slot) const
+{
+  if (!has_shader_)
+    return;
+
+  if (slot.location_ >= 0)
+    SendUniform(program_id_, slot.location_, slot.type_, slot.value_);
+  if (slot.fallback_location_ >= 0)
+    SendUniform(FallbackProgram(), slot.fallback_location_, slot.type_, slot.value_);
+}
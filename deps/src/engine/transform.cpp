@@ -0,0 +1,99 @@
+#include <engine/transform.h>
+
+// Same layout and results as the Transform of the engine archive, which
+// stores it by value: every change keeps its own matrix up to date and the
+// combined one is composed from them when it is read
+
+Transform::Transform() : translate_(0.0f, 0.0f, 0.0f), rotate_(0.0f, 0.0f, 0.0f), scalate_(0.0f, 0.0f, 0.0f),
+                         orbit_(0.0f, 0.0f, 0.0f), orbit_center_(0.0f, 0.0f, 0.0f)
+{
+  for (int i = 0; i < 4; i++)
+    matrix_[i] = Math::Mat4::Identity();
+}
+
+Transform::~Transform() {}
+
+Math::Mat4 Transform::getTrMatrix()
+{
+  // Same result as Rotate * Scale * Translate without the full products
+  const Math::Mat4 &rot = matrix_[MatrixTr::Rotate];
+  Math::Mat4 result;
+  for (int row = 0; row < 3; row++)
+  {
+    result.m[row * 4 + 0] = rot.m[row * 4 + 0] * scalate_.x;
+    result.m[row * 4 + 1] = rot.m[row * 4 + 1] * scalate_.y;
+    result.m[row * 4 + 2] = rot.m[row * 4 + 2] * scalate_.z;
+    result.m[row * 4 + 3] = 0.0f;
+  }
+  result.m[12] = translate_.x;
+  result.m[13] = translate_.y;
+  result.m[14] = translate_.z;
+  result.m[15] = 1.0f;
+
+  if (orbit_ == Math::Vec3(0.0f, 0.0f, 0.0f))
+    return result;
+
+  return result * matrix_[MatrixTr::Orbit];
+}
+
+// Rotate
+void Transform::rotate(Math::Vec3 radians)
+{
+  rotate_ += radians;
+  matrix_[MatrixTr::Rotate] = Math::Mat4::Rotate(rotate_);
+}
+
+Math::Vec3 Transform::getRotate() const { return rotate_; }
+
+void Transform::setRotation(Math::Quat rotation)
+{
+  rotation = rotation.Normalized();
+  rotate_ = rotation.ToEuler();
+  matrix_[MatrixTr::Rotate] = rotation.ToMat4();
+}
+
+Math::Quat Transform::getRotation() const { return Math::Quat::FromEuler(rotate_); }
+
+Math::Mat4 Transform::getRotateMat() const { return matrix_[MatrixTr::Rotate]; }
+
+// Scale
+void Transform::scale(Math::Vec3 size)
+{
+  scalate_ += size;
+  matrix_[MatrixTr::Scale] = Math::Mat4::Scale(scalate_);
+}
+
+Math::Vec3 Transform::getScale() const { return scalate_; }
+
+Math::Mat4 Transform::getScaleMat() const { return matrix_[MatrixTr::Scale]; }
+
+// Translate
+void Transform::translate(Math::Vec3 move)
+{
+  translate_ += move;
+  matrix_[MatrixTr::Translate] = Math::Mat4::Translate(translate_);
+}
+
+Math::Vec3 Transform::getTranslate() const { return translate_; }
+
+Math::Mat4 Transform::getTranslateMat() const { return matrix_[MatrixTr::Translate]; }
+
+// Orbit
+void Transform::orbit(Math::Vec3 orbit)
+{
+  orbit_ += orbit;
+
+  // Rotates around the center set before the orbit
+  if (orbit_center_ == Math::Vec3(0.0f, 0.0f, 0.0f))
+    matrix_[MatrixTr::Orbit] = Math::Mat4::Rotate(orbit_);
+  else
+    matrix_[MatrixTr::Orbit] = Math::Mat4::Translate(-orbit_center_) * Math::Mat4::Rotate(orbit_) * Math::Mat4::Translate(orbit_center_);
+}
+
+Math::Vec3 Transform::getOrbit() const { return orbit_; }
+
+Math::Mat4 Transform::getOrbitMat() const { return matrix_[MatrixTr::Orbit]; }
+
+void Transform::orbitCenter(Math::Vec3 orbit_center) { orbit_center_ = orbit_center; }
+
+Math::Vec3 Transform::getOrbitCenter() const { return orbit_center_; }
@@ -1,4 +1,7 @@
 #include <engine/jam_engine.h>
+#include <engine/asset_watcher.h>
+#include <engine/render_graph.h>
+#include <engine/renderer.h>
 #include <cstdlib>
 
 static f32 win_x = 16 * 75;
@@ -37,6 +40,9 @@ static const u32 total_forst_mtls = 5;
 
 static u32 selected_entity = UINT32_MAX;
 
+static SceneBVH scene_bvh;
+static RenderGraph render_graph;
+
 static const std::string forest_mtls[total_forst_mtls] = { OBJ("terrain/ground_path_mask.png"), 
                                                            OBJ("terrain/aerial_grass_rock_4k/aerial_grass_rock_diff_4k.jpg"), OBJ("terrain/forrest_ground_03_4k/forrest_ground_03_diff_4k.jpg"), 
                                                            OBJ("terrain/aerial_grass_rock_4k/aerial_grass_rock_nor_gl_4k.png"), OBJ("terrain/forrest_ground_03_4k/forrest_ground_03_nor_gl_4k.png")};
@@ -74,23 +80,43 @@ static Source::Id zelda_background;
 static PointLight* p_light_ptr = nullptr;
 
 
+// The static trees keep the bounds of the old mesh until they are inserted again
+static void MeshReloaded(Mesh *mesh)
+{
+  std::vector<Entity::Id> ids;
+  scene_bvh.entities(ids);
+
+  for (Entity::Id id : ids)
+  {
+    Mesh **entity_mesh = EM->getComponent<Mesh *>(id);
+    if (entity_mesh && *entity_mesh == mesh)
+    {
+      scene_bvh.remove(id);
+      scene_bvh.insert(id, true);
+    }
+  }
+}
+
 void UserInit(s32 argc, byte *argv[], void *)
 {
   PRINT_ARGS;
   camera.init(config);
 
+  AssetWatcher::Start(ASSETS(""));
+  AssetWatcher::SetMeshCallback(MeshReloaded);
+
   Texture::Wrap wrap[13] = { Texture::Wrap::Repeat };
   Texture::Filter filter[13] = { Texture::Filter::Nearest_Mipmap_Nearest };
 
-  // Mesh
-  terrain = JAM_Engine::GetMesh(JAM_Engine::UploadMesh(OBJ("terrain/Terrain.obj"), false));
-  tree = JAM_Engine::GetMesh(JAM_Engine::UploadMesh(OBJ("tree/tree.obj"), false, wrap, wrap, filter, filter));
-  lamp = JAM_Engine::GetMesh(JAM_Engine::UploadMesh(OBJ("stone_lamp/stone_lamp.obj"), false, wrap, wrap, filter, filter));
+  // Mesh, uploaded through the watcher to reload them when their files change
+  terrain = JAM_Engine::GetMesh(AssetWatcher::UploadMesh(OBJ("terrain/Terrain.obj"), false));
+  tree = JAM_Engine::GetMesh(AssetWatcher::UploadMesh(OBJ("tree/tree.obj"), false, wrap, wrap, filter, filter));
+  lamp = JAM_Engine::GetMesh(AssetWatcher::UploadMesh(OBJ("stone_lamp/stone_lamp.obj"), false, wrap, wrap, filter, filter));
 
   // Material
-  terrain_shader = JAM_Engine::GetShader(JAM_Engine::UploadShader(SHADER("terrain.fs"), SHADER("terrain.vs")));
-  tree_shader = JAM_Engine::GetShader(JAM_Engine::UploadShader(SHADER("tree.fs"), SHADER("tree.vs")));
-  lamp_shader = JAM_Engine::GetShader(JAM_Engine::UploadShader(SHADER("lamp.fs"), SHADER("lamp.vs")));
+  terrain_shader = JAM_Engine::GetShader(AssetWatcher::UploadShader(SHADER("terrain.fs"), SHADER("terrain.vs")));
+  tree_shader = JAM_Engine::GetShader(AssetWatcher::UploadShader(SHADER("tree.fs"), SHADER("tree.vs")));
+  lamp_shader = JAM_Engine::GetShader(AssetWatcher::UploadShader(SHADER("lamp.fs"), SHADER("lamp.vs")));
  
   Transform tr[total_trees + 1];
   Transform tr_lamp;
@@ -101,7 +127,7 @@ void UserInit(s32 argc, byte *argv[], void *)
   tr[0].scale(Math::Vec3(1.0f));
 
   dr_config.cll_face_ = CullFront::CounterClockwise;
-  TexturesArray::Id terrain_materials_ids = JAM_Engine::UploadTexturesArray(forest_mtls, total_forst_mtls, TexturesArray::Wrap::Repeat, TexturesArray::Wrap::Repeat, TexturesArray::Filter::Nearest_Mipmap_Nearest, TexturesArray::Filter::Nearest_Mipmap_Nearest);
+  TexturesArray::Id terrain_materials_ids = AssetWatcher::UploadTexturesArray(forest_mtls, total_forst_mtls, TexturesArray::Wrap::Repeat, TexturesArray::Wrap::Repeat, TexturesArray::Filter::Nearest_Mipmap_Nearest, TexturesArray::Filter::Nearest_Mipmap_Nearest);
 
   terrain_textures = JAM_Engine::GetTexturesArray(terrain_materials_ids);
 
@@ -147,6 +173,11 @@ void UserInit(s32 argc, byte *argv[], void *)
 
   path_mask.free();
 
+  scene_bvh.insert(terrain_id, true);
+  scene_bvh.insert(lamp_id, true);
+  for (u32 i = 0; i < total_trees; i++)
+    scene_bvh.insert(trees_id[i], true);
+
   //Sound
   f32 pos[3] = { camera.getPosition().x, camera.getPosition().y, camera.getPosition().z  };
   f32 vel[3] = { 0.0f };
@@ -173,6 +204,22 @@ void UserInit(s32 argc, byte *argv[], void *)
   p_light_ptr = JAM_Engine::GetPointLight(JAM_Engine::AddLight(point_light));
 }
 
+static void ShadowPass(const RenderGraph&, void*)
+{
+  Renderer::BeginRenderShadow(0, LightType::PointLight);
+  Renderer::RenderShadow(scene_bvh);
+  Renderer::EndRenderShadow();
+}
+
+static void ScenePass(const RenderGraph&, void*)
+{
+  terrain_shader->use();
+  terrain_shader->setTexture2DArray("u_terrain_samplers", terrain_textures->id(), 13);
+  Renderer::BeginRender(&camera);
+  Renderer::Render(scene_bvh);
+  Renderer::EndRender();
+}
+
 void UserUpdate(void*)
 {
   camera.control(JAM_Engine::DeltaTime());
@@ -180,36 +227,41 @@ void UserUpdate(void*)
   if (JAM_Engine::InputDown(Inputs::Key::Key_F5))
     JAM_Engine::RechargeShaders();
 
-  JAM_Engine::BeginRenderShadow(0, LightType::PointLight);
-  JAM_Engine::RenderShadow(lamp_id);
-  JAM_Engine::RenderShadow(terrain_id);
-  for (int i = 0; i < total_trees; i++)
-    JAM_Engine::RenderShadow(trees_id[i]);
-  JAM_Engine::EndRenderShadow();
+  AssetWatcher::Update();
+  scene_bvh.update();
 
-  terrain_shader->use();
-  terrain_shader->setTexture2DArray("u_terrain_samplers", terrain_textures->id(), 13);
-  JAM_Engine::BeginRender(&camera);
-  JAM_Engine::Render(lamp_id);
-  JAM_Engine::Render(terrain_id);
-  for (int i = 0; i < total_trees; i++)
-    JAM_Engine::Render(trees_id[i]);
-  JAM_Engine::EndRender();
+  // The render world is extracted here, after the camera moved, and both
+  // views are culled in the task manager while the graph is built and runs
+  if (p_light_ptr && p_light_ptr->active_)
+    Renderer::RecordShadow(0, LightType::PointLight, scene_bvh);
+  Renderer::Record(&camera, scene_bvh);
+
+  // The targets are owned by the engine, imported only to order the passes
+  render_graph.clear();
+  RenderGraph::Resource shadow_maps = render_graph.import("Shadow maps", 0, RenderGraph::TextureDesc());
+  RenderGraph::Resource screen = render_graph.import("Screen", 0, RenderGraph::TextureDesc());
+
+  u32 shadow_pass = render_graph.addPass("Shadows", &ShadowPass);
+  render_graph.write(shadow_pass, shadow_maps, RenderGraph::Access::Attachment);
+
+  // Without the light nothing reads the maps, and the shadow pass is culled
+  u32 scene_pass = render_graph.addPass("Scene", &ScenePass);
+  if (p_light_ptr && p_light_ptr->active_)
+    render_graph.read(scene_pass, shadow_maps, RenderGraph::Access::Sampled);
+  render_graph.write(scene_pass, screen, RenderGraph::Access::Attachment);
+
+  render_graph.output(screen);
+  render_graph.execute();
 
   if (JAM_Engine::InputDown(Inputs::MouseButton::Mouse_Button_Left))
   {
     selected_entity = camera.getSelectedEntityId();
     fprintf(stdout, "Selected entity %d\n", selected_entity);
-    terrain_shader->use();
-    terrain_shader->setU32("u_selected_id", selected_entity);
-    lamp_shader->use();
-    lamp_shader->setU32("u_selected_id", selected_entity);
-    tree_shader->use();
-    tree_shader->setU32("u_selected_id", selected_entity);
+    Renderer::SetSelectedEntity(selected_entity);
   }
 }
 
-void UserClean(void *) {}
+void UserClean(void *) { render_graph.free(); }
 
 s32 main(s32 argc, byte *argv[])
 {
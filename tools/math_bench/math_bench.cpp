@@ -0,0 +1,703 @@
+/**
+ * @file math_bench.cpp
+ *
+ * @brief Microbenchmark and accuracy suite for deps/include/engine/math.
+ * It only needs the math library, no window or GL context. Build it
+ * with and without -mavx2 -mfma to compare the SIMD and scalar paths,
+ * the output is JSON so two runs can be diffed.
+ *
+ * Usage: math_bench [--iterations N] [--accuracy-only]
+ *
+ * --accuracy-only skips the timings, the output is then deterministic
+ * for a given build. The exit code is 1 if any accuracy check fails.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <engine/math/mathlib.h>
+
+using namespace Math;
+
+// Helpers
+///////////////////////////////////////////////////////////////////////////////
+
+// Same sequence on every platform, unlike <random> distributions
+struct Rng
+{
+  uint32_t state = 0x12345678u;
+
+  inline uint32_t next()
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+
+  inline float range(float min, float max) { return min + (max - min) * (static_cast<float>(next() >> 8) * (1.0f / 16777216.0f)); }
+  inline Vec3 vec3(float min, float max) { return Vec3(range(min, max), range(min, max), range(min, max)); }
+};
+
+// Distance in units in the last place between two floats
+static uint32_t UlpDistance(float a, float b)
+{
+  int32_t ia, ib;
+  std::memcpy(&ia, &a, sizeof(float));
+  std::memcpy(&ib, &b, sizeof(float));
+  if (ia < 0)
+    ia = static_cast<int32_t>(0x80000000u - static_cast<uint32_t>(ia));
+  if (ib < 0)
+    ib = static_cast<int32_t>(0x80000000u - static_cast<uint32_t>(ib));
+
+  int64_t diff = static_cast<int64_t>(ia) - static_cast<int64_t>(ib);
+  return static_cast<uint32_t>(diff < 0 ? -diff : diff);
+}
+
+// Row-vector product in double, reference for every matrix check
+static void MulRef(const double *a, const double *b, double *out)
+{
+  for (int r = 0; r < 4; r++)
+    for (int c = 0; c < 4; c++)
+    {
+      double sum = 0.0;
+      for (int k = 0; k < 4; k++)
+        sum += a[r * 4 + k] * b[k * 4 + c];
+      out[r * 4 + c] = sum;
+    }
+}
+
+static void ToDouble(const Mat4 &m, double *out)
+{
+  for (int i = 0; i < 16; i++)
+    out[i] = static_cast<double>(m.m[i]);
+}
+
+static double MaxAbs(const double *m)
+{
+  double ret = 0.0;
+  for (int i = 0; i < 16; i++)
+    ret = std::max(ret, std::abs(m[i]));
+  return ret;
+}
+
+static Mat4 RandomTRS(Rng &rng)
+{
+  return Mat4::TRS(rng.vec3(-50.0f, 50.0f), rng.vec3(-3.14f, 3.14f), rng.vec3(0.25f, 4.0f));
+}
+
+// Well conditioned but not affine
+static Mat4 RandomProjective(Rng &rng)
+{
+  Mat4 m = RandomTRS(rng);
+  m.m[3] = rng.range(-0.1f, 0.1f);
+  m.m[7] = rng.range(-0.1f, 0.1f);
+  m.m[11] = rng.range(-0.1f, 0.1f);
+  return m;
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// Report
+///////////////////////////////////////////////////////////////////////////////
+struct BenchResult
+{
+  std::string name;
+  size_t ops;
+  double ns_per_op;
+};
+
+struct AccuracyResult
+{
+  std::string name;
+  const char *metric; // "ulp", "abs" or "mismatches"
+  double max_error;
+  double tolerance;
+  bool pass;
+};
+
+static std::vector<BenchResult> s_bench;
+static std::vector<AccuracyResult> s_accuracy;
+
+// Keeps the optimizer from removing the benchmarked work
+static volatile float s_sink = 0.0f;
+
+template <typename Fn>
+static void Bench(const char *name, size_t ops, Fn fn)
+{
+  fn(); // Warm up
+
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto end = std::chrono::steady_clock::now();
+
+  double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  s_bench.push_back({name, ops, ns / static_cast<double>(ops)});
+}
+
+static void Check(const char *name, const char *metric, double max_error, double tolerance)
+{
+  s_accuracy.push_back({name, metric, max_error, tolerance, max_error <= tolerance});
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// Accuracy
+///////////////////////////////////////////////////////////////////////////////
+static void AccuracyVec3(Rng &rng)
+{
+  double cross_err = 0.0, norm_ulp = 0.0;
+  for (int i = 0; i < 4096; i++)
+  {
+    Vec3 a = rng.vec3(-10.0f, 10.0f), b = rng.vec3(-10.0f, 10.0f);
+
+    Vec3 c = Vec3::CrossProduct(a, b);
+    double rx = static_cast<double>(a.y) * b.z - static_cast<double>(a.z) * b.y;
+    double ry = static_cast<double>(a.z) * b.x - static_cast<double>(a.x) * b.z;
+    double rz = static_cast<double>(a.x) * b.y - static_cast<double>(a.y) * b.x;
+    cross_err = std::max(cross_err, std::max(std::abs(c.x - rx), std::max(std::abs(c.y - ry), std::abs(c.z - rz))));
+
+    float len = a.Normalized().Magnitude();
+    norm_ulp = std::max(norm_ulp, static_cast<double>(UlpDistance(len, 1.0f)));
+  }
+
+  Check("vec3_cross", "abs", cross_err, 1e-4);
+  Check("vec3_normalize_length", "ulp", norm_ulp, 4.0);
+}
+
+static void AccuracyMat4(Rng &rng)
+{
+  double mul_err = 0.0, inv_err = 0.0, inv_affine_err = 0.0, inv_ortho_err = 0.0;
+  for (int i = 0; i < 1024; i++)
+  {
+    double da[16], db[16], dref[16], dout[16];
+
+    // Product
+    Mat4 a = RandomProjective(rng), b = RandomTRS(rng);
+    Mat4 ab = a * b;
+    ToDouble(a, da);
+    ToDouble(b, db);
+    MulRef(da, db, dref);
+    for (int k = 0; k < 16; k++)
+      mul_err = std::max(mul_err, std::abs(ab.m[k] - dref[k]) / (1.0 + std::abs(dref[k])));
+
+    // General inverse, M * M^-1 = I relative to the magnitude of both
+    Mat4 inv = a.Inverse();
+    ToDouble(inv, db);
+    MulRef(da, db, dout);
+    double scale = MaxAbs(da) * MaxAbs(db);
+    for (int k = 0; k < 16; k++)
+      inv_err = std::max(inv_err, std::abs(dout[k] - ((k % 5) == 0 ? 1.0 : 0.0)) / scale);
+
+    // Affine path, through the Inverse dispatch
+    Mat4 trs = RandomTRS(rng);
+    inv = trs.Inverse();
+    ToDouble(trs, da);
+    ToDouble(inv, db);
+    MulRef(da, db, dout);
+    for (int k = 0; k < 16; k++)
+      inv_affine_err = std::max(inv_affine_err, std::abs(dout[k] - ((k % 5) == 0 ? 1.0 : 0.0)));
+
+    // Rigid transform
+    Mat4 rigid = Mat4::TRS(rng.vec3(-50.0f, 50.0f), rng.vec3(-3.14f, 3.14f), Vec3(1.0f, 1.0f, 1.0f));
+    inv = rigid.InverseOrthonormal();
+    ToDouble(rigid, da);
+    ToDouble(inv, db);
+    MulRef(da, db, dout);
+    for (int k = 0; k < 16; k++)
+      inv_ortho_err = std::max(inv_ortho_err, std::abs(dout[k] - ((k % 5) == 0 ? 1.0 : 0.0)));
+  }
+
+  Check("mat4_mul", "abs", mul_err, 1e-5);
+  Check("mat4_inverse", "abs", inv_err, 1e-5);
+  Check("mat4_inverse_affine", "abs", inv_affine_err, 1e-4);
+  Check("mat4_inverse_orthonormal", "abs", inv_ortho_err, 1e-4);
+}
+
+static void AccuracyCamera(Rng &rng)
+{
+  double view_err = 0.0, persp_ulp = 0.0;
+  for (int i = 0; i < 1024; i++)
+  {
+    Vec3 eye = rng.vec3(-100.0f, 100.0f);
+    Vec3 target = eye + rng.vec3(-10.0f, 10.0f);
+    Mat4 view = Mat4::ViewMatrix(eye, target, Vec3(0.0f, 1.0f, 0.0f));
+
+    // The target must land on the -z axis of the view
+    Vec3 t = MathUtils::Mat4TransformVec3(view, target);
+    double dist = static_cast<double>((target - eye).Magnitude());
+    view_err = std::max(view_err, std::abs(static_cast<double>(t.x)) / dist);
+    view_err = std::max(view_err, std::abs(static_cast<double>(t.y)) / dist);
+    view_err = std::max(view_err, std::abs(-static_cast<double>(t.z) - dist) / dist);
+
+    float fov = rng.range(0.3f, 2.0f), aspect = rng.range(0.5f, 2.5f);
+    float near = rng.range(0.01f, 1.0f), far = near + rng.range(10.0f, 1000.0f);
+    Mat4 persp = Mat4::PerspectiveMatrix(fov, aspect, near, far);
+
+    double tan_half = std::tan(static_cast<double>(fov) * 0.5);
+    double range = static_cast<double>(far) - static_cast<double>(near);
+    double ref[4] = {1.0 / (static_cast<double>(aspect) * tan_half), 1.0 / tan_half,
+                     -(static_cast<double>(far) + static_cast<double>(near)) / range,
+                     -2.0 * static_cast<double>(far) * static_cast<double>(near) / range};
+    float got[4] = {persp.m[0], persp.m[5], persp.m[10], persp.m[11]};
+    for (int k = 0; k < 4; k++)
+      persp_ulp = std::max(persp_ulp, static_cast<double>(UlpDistance(got[k], static_cast<float>(ref[k]))));
+  }
+
+  Check("view_matrix", "abs", view_err, 1e-5);
+  Check("perspective_matrix", "ulp", persp_ulp, 8.0);
+}
+
+static void AccuracyUtils(Rng &rng)
+{
+  // Rotate3dPoint takes degrees, compare with a double rotation X, then Y, then Z
+  double rot_err = 0.0;
+  for (int i = 0; i < 4096; i++)
+  {
+    Vec3 deg = rng.vec3(-180.0f, 180.0f), p = rng.vec3(-10.0f, 10.0f);
+    Vec3 got = MathUtils::Rotate3dPoint(deg, p);
+
+    double rx = deg.x * M_PI / 180.0, ry = deg.y * M_PI / 180.0, rz = deg.z * M_PI / 180.0;
+    double x = p.x, y = p.y, z = p.z, tmp;
+    tmp = y * std::cos(rx) - z * std::sin(rx);
+    z = y * std::sin(rx) + z * std::cos(rx);
+    y = tmp;
+    tmp = x * std::cos(ry) + z * std::sin(ry);
+    z = -x * std::sin(ry) + z * std::cos(ry);
+    x = tmp;
+    tmp = x * std::cos(rz) - y * std::sin(rz);
+    y = x * std::sin(rz) + y * std::cos(rz);
+    x = tmp;
+
+    double len = static_cast<double>(p.Magnitude()) + 1.0;
+    rot_err = std::max(rot_err, std::max(std::abs(got.x - x), std::max(std::abs(got.y - y), std::abs(got.z - z))) / len);
+  }
+  Check("rotate3d_point", "abs", rot_err, 1e-5);
+
+  // SegmentTriangle against the same test in double, near misses are skipped
+  double mismatches = 0.0;
+  for (int i = 0; i < 4096; i++)
+  {
+    Vec3 v0 = rng.vec3(-10.0f, 10.0f), v1 = rng.vec3(-10.0f, 10.0f), v2 = rng.vec3(-10.0f, 10.0f);
+    Vec3 start = rng.vec3(-10.0f, 10.0f), end = rng.vec3(-10.0f, 10.0f);
+    Vec3 plane = MathUtils::TrianglePlane(v0, v1, v2);
+    bool got = MathUtils::SegmentTriangle(start, end, v0, v1, v2, plane);
+
+    double n[3] = {plane.x, plane.y, plane.z};
+    double s_side = (start.x - v0.x) * n[0] + (start.y - v0.y) * n[1] + (start.z - v0.z) * n[2];
+    double e_side = (end.x - v0.x) * n[0] + (end.y - v0.y) * n[1] + (end.z - v0.z) * n[2];
+    if (std::abs(s_side) < 1e-2 || std::abs(e_side) < 1e-2)
+      continue;
+
+    bool ref = false;
+    if (s_side * e_side <= 0.0)
+    {
+      double t = s_side / (s_side - e_side);
+      double px = start.x + (end.x - start.x) * t, py = start.y + (end.y - start.y) * t;
+      double d1 = (static_cast<double>(v2.x) - v1.x) * (py - v1.y) - (static_cast<double>(v2.y) - v1.y) * (px - v1.x);
+      double d2 = (static_cast<double>(v0.x) - v2.x) * (py - v2.y) - (static_cast<double>(v0.y) - v2.y) * (px - v2.x);
+      double d3 = (static_cast<double>(v1.x) - v0.x) * (py - v0.y) - (static_cast<double>(v1.y) - v0.y) * (px - v0.x);
+      if (std::abs(d1) < 1e-2 || std::abs(d2) < 1e-2 || std::abs(d3) < 1e-2)
+        continue;
+      ref = (d1 >= 0 && d2 >= 0 && d3 >= 0) || (d1 <= 0 && d2 <= 0 && d3 <= 0);
+    }
+
+    if (got != ref)
+      mismatches += 1.0;
+  }
+  Check("segment_triangle", "mismatches", mismatches, 0.0);
+
+  // Quaternions follow Mat4::Rotate
+  double quat_err = 0.0;
+  for (int i = 0; i < 1024; i++)
+  {
+    Vec3 r = rng.vec3(-3.14f, 3.14f);
+    Mat4 a = Quat::FromEuler(r).ToMat4(), b = Mat4::Rotate(r);
+    for (int k = 0; k < 16; k++)
+      quat_err = std::max(quat_err, static_cast<double>(std::abs(a.m[k] - b.m[k])));
+  }
+  Check("quat_from_euler", "abs", quat_err, 1e-5);
+}
+
+static void AccuracyBatch(Rng &rng)
+{
+  const size_t count = 1027; // Not a multiple of 8, the tail is checked too
+  std::vector<float> x(count), y(count), z(count), ox(count), oy(count), oz(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    x[i] = rng.range(-100.0f, 100.0f);
+    y[i] = rng.range(-100.0f, 100.0f);
+    z[i] = rng.range(-100.0f, 100.0f);
+  }
+
+  Mat4 m = RandomTRS(rng);
+  Batch::TransformPoints(m, Batch::ConstVec3Span(x.data(), y.data(), z.data(), count), {ox.data(), oy.data(), oz.data(), count});
+
+  double err = 0.0;
+  for (size_t i = 0; i < count; i++)
+  {
+    Vec3 ref = MathUtils::Mat4TransformVec3(m, Vec3(x[i], y[i], z[i]));
+    double len = static_cast<double>(ref.Magnitude()) + 1.0;
+    err = std::max(err, std::max(std::abs(ox[i] - ref.x), std::max(std::abs(oy[i] - ref.y), std::abs(oz[i] - ref.z))) / len);
+  }
+  Check("batch_transform_points", "abs", err, 1e-6);
+
+  std::vector<Mat4> left(count), out(count);
+  for (size_t i = 0; i < count; i++)
+    left[i] = RandomTRS(rng);
+  Batch::MultiplyBy(left.data(), m, out.data(), count);
+
+  err = 0.0;
+  for (size_t i = 0; i < count; i++)
+  {
+    Mat4 ref = left[i] * m;
+    for (int k = 0; k < 16; k++)
+      err = std::max(err, std::abs(out[i].m[k] - ref.m[k]) / (1.0 + std::abs(ref.m[k])));
+  }
+  Check("batch_multiply_by", "abs", err, 1e-5);
+}
+
+static Frustum RandomFrustum(Rng &rng, Vec3 &eye, Vec3 &target)
+{
+  eye = rng.vec3(-20.0f, 20.0f);
+  target = eye + rng.vec3(-10.0f, 10.0f);
+  Mat4 view = Mat4::ViewMatrix(eye, target, Vec3(0.0f, 1.0f, 0.0f));
+  Mat4 proj = Mat4::PerspectiveMatrix(rng.range(0.5f, 1.5f), rng.range(0.5f, 2.0f), rng.range(0.1f, 1.0f), rng.range(50.0f, 200.0f));
+
+  return Frustum::FromMatrix(view * proj);
+}
+
+static void AccuracyBounds(Rng &rng)
+{
+  // Frustum planes against the clip space test -w <= x, y, z <= w
+  double mismatches = 0.0;
+  for (int i = 0; i < 256; i++)
+  {
+    Vec3 eye = rng.vec3(-20.0f, 20.0f);
+    Vec3 target = eye + rng.vec3(-10.0f, 10.0f);
+    Mat4 view_proj = Mat4::ViewMatrix(eye, target, Vec3(0.0f, 1.0f, 0.0f)) *
+                     Mat4::PerspectiveMatrix(rng.range(0.5f, 1.5f), rng.range(0.5f, 2.0f), rng.range(0.1f, 1.0f), rng.range(50.0f, 200.0f));
+    Frustum frustum = Frustum::FromMatrix(view_proj);
+
+    for (int k = 0; k < 64; k++)
+    {
+      Vec3 p = eye + rng.vec3(-60.0f, 60.0f);
+      double da[16];
+      ToDouble(view_proj, da);
+      double clip[4];
+      for (int c = 0; c < 4; c++)
+        clip[c] = p.x * da[c] + p.y * da[4 + c] + p.z * da[8 + c] + da[12 + c];
+
+      double margin = clip[3] - std::max(std::abs(clip[0]), std::max(std::abs(clip[1]), std::abs(clip[2])));
+      if (std::abs(margin) < 1e-3)
+        continue;
+
+      if (frustum.Contains(p) != (margin >= 0.0))
+        mismatches += 1.0;
+    }
+  }
+  Check("frustum_from_matrix", "mismatches", mismatches, 0.0);
+
+  // Transformed box holds the 8 transformed corners
+  double aabb_err = 0.0;
+  for (int i = 0; i < 1024; i++)
+  {
+    AABB box = AABB::FromCenterExtents(rng.vec3(-10.0f, 10.0f), rng.vec3(0.1f, 5.0f));
+    Mat4 m = RandomTRS(rng);
+    AABB ref;
+    for (int corner = 0; corner < 8; corner++)
+    {
+      Vec3 v((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+      ref.Expand(MathUtils::Mat4TransformVec3(m, v));
+    }
+    AABB got = box.Transformed(m);
+    for (int k = 0; k < 3; k++)
+    {
+      double len = static_cast<double>(ref.Size().Magnitude()) + 1.0;
+      aabb_err = std::max(aabb_err, std::abs(got.min[k] - ref.min[k]) / len);
+      aabb_err = std::max(aabb_err, std::abs(got.max[k] - ref.max[k]) / len);
+    }
+  }
+  Check("aabb_transformed", "abs", aabb_err, 1e-5);
+
+  // Batched classification must give the same answers as Frustum::Classify
+  const size_t count = 4099;
+  std::vector<float> cx(count), cy(count), cz(count), ex(count), ey(count), ez(count);
+  std::vector<Frustum::Result> results(count);
+  Vec3 eye, target;
+  Frustum frustum = RandomFrustum(rng, eye, target);
+  for (size_t i = 0; i < count; i++)
+  {
+    Vec3 c = eye + rng.vec3(-100.0f, 100.0f), e = rng.vec3(0.1f, 4.0f);
+    cx[i] = c.x, cy[i] = c.y, cz[i] = c.z;
+    ex[i] = e.x, ey[i] = e.y, ez[i] = e.z;
+  }
+  Batch::ClassifyAABBs(frustum, Batch::ConstVec3Span(cx.data(), cy.data(), cz.data(), count),
+                       Batch::ConstVec3Span(ex.data(), ey.data(), ez.data(), count), results.data());
+
+  mismatches = 0.0;
+  for (size_t i = 0; i < count; i++)
+  {
+    AABB box = AABB::FromCenterExtents(Vec3(cx[i], cy[i], cz[i]), Vec3(ex[i], ey[i], ez[i]));
+
+    // Boxes touching a plane can go either way with FMA
+    bool boundary = false;
+    for (int p = 0; p < Frustum::MaxPlanes; p++)
+    {
+      const Vec4 &pl = frustum.planes[p];
+      float dist = frustum.Distance(static_cast<Frustum::Plane>(p), box.Center());
+      float radius = std::abs(pl.x) * ex[i] + std::abs(pl.y) * ey[i] + std::abs(pl.z) * ez[i];
+      boundary = boundary || std::abs(dist - radius) < 1e-3f || std::abs(dist + radius) < 1e-3f;
+    }
+
+    if (!boundary && results[i] != frustum.Classify(box))
+      mismatches += 1.0;
+  }
+  Check("batch_classify_aabbs", "mismatches", mismatches, 0.0);
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// Benchmarks
+///////////////////////////////////////////////////////////////////////////////
+static void Benchmarks(Rng &rng, size_t iterations)
+{
+  const size_t count = 1024;
+  std::vector<Vec3> va(count), vb(count);
+  std::vector<Mat4> ma(count), mb(count), mp(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    va[i] = rng.vec3(-10.0f, 10.0f);
+    vb[i] = rng.vec3(-10.0f, 10.0f);
+    ma[i] = RandomTRS(rng);
+    mb[i] = RandomTRS(rng);
+    mp[i] = RandomProjective(rng);
+  }
+  size_t ops = count * iterations;
+
+  Bench("vec3_add_mul", ops, [&]()
+        { Vec3 acc(0.0f, 0.0f, 0.0f);
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += va[i] * 0.5f + vb[i];
+          s_sink = acc.x + acc.y + acc.z; });
+
+  Bench("vec3_dot", ops, [&]()
+        { float acc = 0.0f;
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += Vec3::DotProduct(va[i], vb[i]);
+          s_sink = acc; });
+
+  Bench("vec3_cross", ops, [&]()
+        { Vec3 acc(0.0f, 0.0f, 0.0f);
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += Vec3::CrossProduct(va[i], vb[i]);
+          s_sink = acc.x + acc.y + acc.z; });
+
+  Bench("vec3_normalize", ops, [&]()
+        { Vec3 acc(0.0f, 0.0f, 0.0f);
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += va[i].Normalized();
+          s_sink = acc.x + acc.y + acc.z; });
+
+  Bench("mat4_mul", ops, [&]()
+        { float acc = 0.0f;
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += (ma[i] * mb[i]).m[it & 15];
+          s_sink = acc; });
+
+  Bench("mat4_transform_vec3", ops, [&]()
+        { Vec3 acc(0.0f, 0.0f, 0.0f);
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += MathUtils::Mat4TransformVec3(ma[i], va[i]);
+          s_sink = acc.x + acc.y + acc.z; });
+
+  Bench("mat4_inverse", ops, [&]()
+        { float acc = 0.0f;
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += mp[i].Inverse().m[it & 15];
+          s_sink = acc; });
+
+  Bench("mat4_inverse_affine", ops, [&]()
+        { float acc = 0.0f;
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += ma[i].Inverse().m[it & 15];
+          s_sink = acc; });
+
+  Bench("view_matrix", ops, [&]()
+        { float acc = 0.0f;
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += Mat4::ViewMatrix(va[i], vb[i], Vec3(0.0f, 1.0f, 0.0f)).m[it & 15];
+          s_sink = acc; });
+
+  Bench("perspective_matrix", ops, [&]()
+        { float acc = 0.0f;
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += Mat4::PerspectiveMatrix(1.0f + va[i].x * 0.01f, 1.7f, 0.1f, 100.0f).m[it & 15];
+          s_sink = acc; });
+
+  Bench("segment_triangle", ops, [&]()
+        { unsigned hits = 0;
+          Vec3 v0(-5.0f, -5.0f, 0.0f), v1(5.0f, -5.0f, 0.0f), v2(0.0f, 5.0f, 0.0f);
+          Vec3 plane = MathUtils::TrianglePlane(v0, v1, v2);
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              hits += MathUtils::SegmentTriangle(va[i], vb[i], v0, v1, v2, plane) ? 1u : 0u;
+          s_sink = static_cast<float>(hits); });
+
+  Bench("rotate3d_point", ops, [&]()
+        { Vec3 acc(0.0f, 0.0f, 0.0f);
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              acc += MathUtils::Rotate3dPoint(vb[i] * 18.0f, va[i]);
+          s_sink = acc.x + acc.y + acc.z; });
+
+  // Batched kernels, ops are points or matrices
+  std::vector<float> x(count), y(count), z(count), ox(count), oy(count), oz(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    x[i] = va[i].x;
+    y[i] = va[i].y;
+    z[i] = va[i].z;
+  }
+  Batch::ConstVec3Span in(x.data(), y.data(), z.data(), count);
+  Batch::Vec3Span out = {ox.data(), oy.data(), oz.data(), count};
+
+  Bench("batch_transform_points", ops, [&]()
+        { for (size_t it = 0; it < iterations; it++)
+            Batch::TransformPoints(ma[it % count], in, out);
+          s_sink = ox[0] + oy[count - 1]; });
+
+  std::vector<Mat4> mout(count);
+  Bench("batch_multiply_by", ops, [&]()
+        { for (size_t it = 0; it < iterations; it++)
+            Batch::MultiplyBy(ma.data(), mb[it % count], mout.data(), count);
+          s_sink = mout[0].m[0]; });
+
+  // Culling, ops are boxes
+  Vec3 eye, target;
+  Frustum frustum = RandomFrustum(rng, eye, target);
+  std::vector<AABB> boxes(count);
+  std::vector<float> ex(count), ey(count), ez(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    boxes[i] = AABB::FromCenterExtents(eye + va[i] * 10.0f, vb[i] * 0.1f + Vec3(1.5f, 1.5f, 1.5f));
+    Vec3 c = boxes[i].Center(), e = boxes[i].Extents();
+    x[i] = c.x, y[i] = c.y, z[i] = c.z;
+    ex[i] = e.x, ey[i] = e.y, ez[i] = e.z;
+  }
+  std::vector<Frustum::Result> results(count);
+
+  Bench("frustum_classify_aabb", ops, [&]()
+        { unsigned visible = 0;
+          for (size_t it = 0; it < iterations; it++)
+            for (size_t i = 0; i < count; i++)
+              visible += (frustum.Classify(boxes[i]) != Frustum::Result::Outside) ? 1u : 0u;
+          s_sink = static_cast<float>(visible); });
+
+  Bench("batch_classify_aabbs", ops, [&]()
+        { size_t visible = 0;
+          for (size_t it = 0; it < iterations; it++)
+            visible += Batch::ClassifyAABBs(frustum, in, Batch::ConstVec3Span(ex.data(), ey.data(), ez.data(), count), results.data());
+          s_sink = static_cast<float>(visible); });
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// Output
+///////////////////////////////////////////////////////////////////////////////
+static const char *SimdName()
+{
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__AVX__)
+  return "avx";
+#else
+  return "scalar";
+#endif
+}
+
+static bool PrintJson(size_t iterations, bool timings)
+{
+  bool passed = true;
+
+  printf("{\n");
+  printf("  \"suite\": \"math_bench\",\n");
+#if defined(__FMA__)
+  printf("  \"build\": {\"simd\": \"%s\", \"fma\": true},\n", SimdName());
+#else
+  printf("  \"build\": {\"simd\": \"%s\", \"fma\": false},\n", SimdName());
+#endif
+
+  if (timings)
+  {
+    printf("  \"iterations\": %zu,\n", iterations);
+    printf("  \"benchmarks\": [\n");
+    for (size_t i = 0; i < s_bench.size(); i++)
+      printf("    {\"name\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.3f}%s\n", s_bench[i].name.c_str(), s_bench[i].ops,
+             s_bench[i].ns_per_op, (i + 1 < s_bench.size()) ? "," : "");
+    printf("  ],\n");
+  }
+
+  printf("  \"accuracy\": [\n");
+  for (size_t i = 0; i < s_accuracy.size(); i++)
+  {
+    const AccuracyResult &a = s_accuracy[i];
+    passed = passed && a.pass;
+    printf("    {\"name\": \"%s\", \"metric\": \"%s\", \"max_error\": %.3g, \"tolerance\": %.3g, \"pass\": %s}%s\n", a.name.c_str(),
+           a.metric, a.max_error, a.tolerance, a.pass ? "true" : "false", (i + 1 < s_accuracy.size()) ? "," : "");
+  }
+  printf("  ],\n");
+  printf("  \"passed\": %s\n", passed ? "true" : "false");
+  printf("}\n");
+
+  return passed;
+}
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+  size_t iterations = 200;
+  bool timings = true;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--iterations") && (i + 1) < argc)
+      iterations = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+    else if (!strcmp(argv[i], "--accuracy-only"))
+      timings = false;
+    else
+    {
+      fprintf(stderr, "Usage: %s [--iterations N] [--accuracy-only]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (iterations == 0)
+    iterations = 1;
+
+  Rng rng;
+  AccuracyVec3(rng);
+  AccuracyMat4(rng);
+  AccuracyCamera(rng);
+  AccuracyUtils(rng);
+  AccuracyBatch(rng);
+  AccuracyBounds(rng);
+
+  if (timings)
+    Benchmarks(rng, iterations);
+
+  return PrintJson(iterations, timings) ? 0 : 1;
+}
@@ -0,0 +1,392 @@
+/**
+ * @file occlusion_bench.cpp
+ *
+ * @brief Microbenchmark and correctness suite for the OcclusionBuffer.
+ * It runs in the CPU only, no window or GL context. The checks cover
+ * hidden and visible boxes, occluders crossing the near plane, threaded
+ * against unthreaded rasterization, and that the masked tiles never keep
+ * a pixel closer than its closest occluder.
+ *
+ * Usage: occlusion_bench [--iterations N] [--accuracy-only]
+ *
+ * --accuracy-only skips the timings, the output is then deterministic
+ * for a given build. The exit code is 1 if any check fails.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <engine/occlusion_buffer.h>
+#include <engine/taskmanager.h>
+
+using namespace Math;
+
+// Helpers
+///////////////////////////////////////////////////////////////////////////////
+
+const u32 k_width = 320;
+const u32 k_height = 192;
+const float k_fov = 1.0f;
+const float k_near = 0.5f;
+const float k_far = 500.0f;
+
+// Same sequence on every platform, unlike <random> distributions
+struct Rng
+{
+  uint32_t state = 0x12345678u;
+
+  inline uint32_t next()
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+
+  inline float range(float min, float max) { return min + (max - min) * (static_cast<float>(next() >> 8) * (1.0f / 16777216.0f)); }
+  inline Vec3 vec3(float min, float max) { return Vec3(range(min, max), range(min, max), range(min, max)); }
+};
+
+// Row vector perspective with the camera at the origin looking down -z
+static Mat4 Projection()
+{
+  float f = 1.0f / tanf(k_fov * 0.5f);
+  float aspect = static_cast<float>(k_width) / static_cast<float>(k_height);
+
+  Mat4 m;
+  m.m[0] = f / aspect;
+  m.m[5] = f;
+  m.m[10] = -(k_far + k_near) / (k_far - k_near);
+  m.m[11] = -1.0f;
+  m.m[14] = -2.0f * k_far * k_near / (k_far - k_near);
+
+  return m;
+}
+
+// Point at a distance in front of the camera that lands on a pixel position
+static Vec3 Unproject(float px, float py, float distance)
+{
+  float f = 1.0f / tanf(k_fov * 0.5f);
+  float aspect = static_cast<float>(k_width) / static_cast<float>(k_height);
+  float x = ((px / static_cast<float>(k_width)) * 2.0f - 1.0f) * distance * aspect / f;
+  float y = ((py / static_cast<float>(k_height)) * 2.0f - 1.0f) * distance / f;
+
+  return Vec3(x, y, -distance);
+}
+
+struct Quad
+{
+  Vec3 corners[4];
+};
+
+static const u32 k_quad_indices[6] = {0, 1, 2, 0, 2, 3};
+
+static void AddQuad(OcclusionBuffer &buffer, const Quad &quad)
+{
+  buffer.addOccluder(quad.corners, sizeof(Vec3), 4, k_quad_indices, 6, Mat4::Identity());
+}
+
+// Unit cube, 12 triangles
+static const Vec3 k_cube_vertices[8] = {
+    Vec3(-1.0f, -1.0f, -1.0f), Vec3(1.0f, -1.0f, -1.0f), Vec3(1.0f, 1.0f, -1.0f), Vec3(-1.0f, 1.0f, -1.0f),
+    Vec3(-1.0f, -1.0f, 1.0f), Vec3(1.0f, -1.0f, 1.0f), Vec3(1.0f, 1.0f, 1.0f), Vec3(-1.0f, 1.0f, 1.0f)};
+
+static const u32 k_cube_indices[36] = {
+    0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+    3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5};
+
+static std::vector<Mat4> RandomCubes(Rng &rng, size_t count)
+{
+  std::vector<Mat4> ret;
+  for (size_t i = 0; i < count; i++)
+  {
+    Vec3 position(rng.range(-30.0f, 30.0f), rng.range(-15.0f, 15.0f), rng.range(-80.0f, -10.0f));
+    ret.push_back(Mat4::TRS(position, rng.vec3(-3.14f, 3.14f), rng.vec3(1.0f, 6.0f)));
+  }
+
+  return ret;
+}
+
+static void AddCubes(OcclusionBuffer &buffer, const std::vector<Mat4> &cubes)
+{
+  for (const Mat4 &model : cubes)
+    buffer.addOccluder(k_cube_vertices, sizeof(Vec3), 8, k_cube_indices, 36, model);
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// Report
+///////////////////////////////////////////////////////////////////////////////
+struct BenchResult
+{
+  std::string name;
+  size_t ops;
+  double ns_per_op;
+};
+
+struct AccuracyResult
+{
+  std::string name;
+  const char *metric; // "abs" or "mismatches"
+  double max_error;
+  double tolerance;
+  bool pass;
+};
+
+static std::vector<BenchResult> s_bench;
+static std::vector<AccuracyResult> s_accuracy;
+
+// Keeps the optimizer from removing the benchmarked work
+static volatile u32 s_sink = 0;
+
+template <typename Fn>
+static void Bench(const char *name, size_t ops, Fn fn)
+{
+  fn(); // Warm up
+
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto end = std::chrono::steady_clock::now();
+
+  double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  s_bench.push_back({name, ops, ns / static_cast<double>(ops)});
+}
+
+static void Check(const char *name, const char *metric, double max_error, double tolerance)
+{
+  s_accuracy.push_back({name, metric, max_error, tolerance, max_error <= tolerance});
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// Accuracy
+///////////////////////////////////////////////////////////////////////////////
+static void AccuracyVisibility(OcclusionBuffer &buffer)
+{
+  // A wall filling the screen at 10 units
+  buffer.begin(Projection());
+  AddQuad(buffer, {{Unproject(-8.0f, -8.0f, 10.0f), Unproject(k_width + 8.0f, -8.0f, 10.0f),
+                    Unproject(k_width + 8.0f, k_height + 8.0f, 10.0f), Unproject(-8.0f, k_height + 8.0f, 10.0f)}});
+  buffer.rasterize(false);
+
+  double wrong = 0.0;
+  wrong += buffer.isVisible(AABB(Vec3(-1.0f, -1.0f, -22.0f), Vec3(1.0f, 1.0f, -20.0f))) ? 1.0 : 0.0;
+  wrong += buffer.isVisible(AABB(Vec3(-4.0f, -2.0f, -60.0f), Vec3(-2.0f, 2.0f, -40.0f))) ? 1.0 : 0.0;
+  wrong += buffer.isVisible(AABB(Vec3(-1.0f, -1.0f, -6.0f), Vec3(1.0f, 1.0f, -4.0f))) ? 0.0 : 1.0;
+  wrong += buffer.isVisible(AABB(Vec3(-1.0f, -1.0f, -12.0f), Vec3(1.0f, 1.0f, -8.0f))) ? 0.0 : 1.0;
+  Check("wall_hides_and_shows", "mismatches", wrong, 0.0);
+
+  // Nothing added, everything is visible
+  buffer.begin(Projection());
+  buffer.rasterize(false);
+  Check("empty_buffer_visible", "mismatches", buffer.isVisible(AABB(Vec3(-1.0f, -1.0f, -22.0f), Vec3(1.0f, 1.0f, -20.0f))) ? 0.0 : 1.0, 0.0);
+}
+
+static void AccuracyNearClip(OcclusionBuffer &buffer)
+{
+  // A slanted wall whose top corners are behind the camera, so every
+  // triangle crosses the near plane. At y = 0 it is 2.5 units away
+  buffer.begin(Projection());
+  AddQuad(buffer, {{Vec3(-200.0f, -50.0f, -10.0f), Vec3(200.0f, -50.0f, -10.0f), Vec3(200.0f, 50.0f, 5.0f), Vec3(-200.0f, 50.0f, 5.0f)}});
+  buffer.rasterize(false);
+
+  double wrong = 0.0;
+  wrong += (buffer.triangles() == 0) ? 1.0 : 0.0;
+  wrong += buffer.isVisible(AABB(Vec3(-1.0f, -1.0f, -42.0f), Vec3(1.0f, 1.0f, -40.0f))) ? 1.0 : 0.0;
+  wrong += buffer.isVisible(AABB(Vec3(-0.2f, -0.2f, -1.2f), Vec3(0.2f, 0.2f, -1.0f))) ? 0.0 : 1.0;
+  Check("near_plane_clipped", "mismatches", wrong, 0.0);
+}
+
+static void AccuracyThreaded(OcclusionBuffer &buffer, Rng &rng)
+{
+  std::vector<Mat4> cubes = RandomCubes(rng, 96);
+
+  buffer.begin(Projection());
+  AddCubes(buffer, cubes);
+  buffer.rasterize(false);
+  std::vector<float> single;
+  for (u32 y = 0; y < buffer.height(); y++)
+    for (u32 x = 0; x < buffer.width(); x++)
+      single.push_back(buffer.depth(x, y));
+
+  buffer.begin(Projection());
+  AddCubes(buffer, cubes);
+  buffer.rasterize(true);
+  double mismatches = 0.0;
+  for (u32 y = 0; y < buffer.height(); y++)
+    for (u32 x = 0; x < buffer.width(); x++)
+      mismatches += (buffer.depth(x, y) != single[(y * buffer.width()) + x]) ? 1.0 : 0.0;
+
+  Check("threaded_matches_single", "mismatches", mismatches, 0.0);
+}
+
+static void AccuracyConservative(OcclusionBuffer &buffer, Rng &rng)
+{
+  // Rectangles facing the camera at random distances, their edges between
+  // pixel centers so the closest occluder of every pixel is exact
+  struct Rect
+  {
+    float x0, y0, x1, y1, distance;
+  };
+  std::vector<Rect> rects;
+  for (int i = 0; i < 200; i++)
+  {
+    float x0 = std::floor(rng.range(-16.0f, k_width)) + 0.25f;
+    float y0 = std::floor(rng.range(-16.0f, k_height)) + 0.25f;
+    rects.push_back({x0, y0, x0 + std::floor(rng.range(2.0f, 96.0f)), y0 + std::floor(rng.range(2.0f, 64.0f)), rng.range(2.0f, 200.0f)});
+  }
+
+  buffer.begin(Projection());
+  for (const Rect &r : rects)
+    AddQuad(buffer, {{Unproject(r.x0, r.y0, r.distance), Unproject(r.x1, r.y0, r.distance), Unproject(r.x1, r.y1, r.distance),
+                      Unproject(r.x0, r.y1, r.distance)}});
+  buffer.rasterize(true);
+
+  // How much closer than its closest occluder a pixel claims to be
+  double error = 0.0;
+  for (u32 y = 0; y < k_height; y++)
+  {
+    for (u32 x = 0; x < k_width; x++)
+    {
+      float px = static_cast<float>(x) + 0.5f, py = static_cast<float>(y) + 0.5f;
+      double closest = 0.0;
+      for (const Rect &r : rects)
+        if (px > r.x0 && px < r.x1 && py > r.y0 && py < r.y1)
+          closest = std::max(closest, 1.0 / static_cast<double>(r.distance));
+
+      error = std::max(error, static_cast<double>(buffer.depth(x, y)) - closest);
+    }
+  }
+
+  Check("depth_conservative", "abs", error, 1e-5);
+}
+///////////////////////////////////////////////////////////////////////////////
+
+// Benchmarks
+///////////////////////////////////////////////////////////////////////////////
+static void Benchmarks(OcclusionBuffer &buffer, Rng &rng, size_t iterations)
+{
+  std::vector<Mat4> cubes = RandomCubes(rng, 128);
+
+  std::vector<AABB> boxes;
+  for (int i = 0; i < 4096; i++)
+    boxes.push_back(AABB::FromCenterExtents(Vec3(rng.range(-40.0f, 40.0f), rng.range(-20.0f, 20.0f), rng.range(-150.0f, -20.0f)),
+                                            rng.vec3(0.5f, 3.0f)));
+
+  Bench("rasterize_128_cubes", iterations, [&]()
+        {
+          for (size_t i = 0; i < iterations; i++)
+          {
+            buffer.begin(Projection());
+            AddCubes(buffer, cubes);
+            buffer.rasterize(false);
+            s_sink = s_sink + buffer.triangles();
+          } });
+
+  Bench("rasterize_128_cubes_threaded", iterations, [&]()
+        {
+          for (size_t i = 0; i < iterations; i++)
+          {
+            buffer.begin(Projection());
+            AddCubes(buffer, cubes);
+            buffer.rasterize(true);
+            s_sink = s_sink + buffer.triangles();
+          } });
+
+  Bench("is_visible", iterations * boxes.size(), [&]()
+        {
+          u32 visible = 0;
+          for (size_t i = 0; i < iterations; i++)
+            for (const AABB &box : boxes)
+              visible += buffer.isVisible(box) ? 1 : 0;
+          s_sink = s_sink + visible; });
+}
+///////////////////////////////////////////////////////////////////////////////
+
+static const char *SimdName()
+{
+#if defined(__AVX__)
+  return "avx";
+#else
+  return "scalar";
+#endif
+}
+
+static bool PrintJson(size_t iterations, bool timings)
+{
+  bool passed = true;
+
+  printf("{\n");
+  printf("  \"suite\": \"occlusion_bench\",\n");
+  printf("  \"build\": {\"simd\": \"%s\", \"width\": %u, \"height\": %u},\n", SimdName(), k_width, k_height);
+
+  if (timings)
+  {
+    printf("  \"iterations\": %zu,\n", iterations);
+    printf("  \"workers\": %u,\n", TM->workerCount());
+    printf("  \"benchmarks\": [\n");
+    for (size_t i = 0; i < s_bench.size(); i++)
+      printf("    {\"name\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.3f}%s\n", s_bench[i].name.c_str(), s_bench[i].ops,
+             s_bench[i].ns_per_op, (i + 1 < s_bench.size()) ? "," : "");
+    printf("  ],\n");
+  }
+
+  printf("  \"accuracy\": [\n");
+  for (size_t i = 0; i < s_accuracy.size(); i++)
+  {
+    const AccuracyResult &a = s_accuracy[i];
+    passed = passed && a.pass;
+    printf("    {\"name\": \"%s\", \"metric\": \"%s\", \"max_error\": %.3g, \"tolerance\": %.3g, \"pass\": %s}%s\n", a.name.c_str(),
+           a.metric, a.max_error, a.tolerance, a.pass ? "true" : "false", (i + 1 < s_accuracy.size()) ? "," : "");
+  }
+  printf("  ],\n");
+  printf("  \"passed\": %s\n", passed ? "true" : "false");
+  printf("}\n");
+
+  return passed;
+}
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+  size_t iterations = 50;
+  bool timings = true;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--iterations") && (i + 1) < argc)
+      iterations = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+    else if (!strcmp(argv[i], "--accuracy-only"))
+      timings = false;
+    else
+    {
+      fprintf(stderr, "Usage: %s [--iterations N] [--accuracy-only]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (iterations == 0)
+    iterations = 1;
+
+  OcclusionBuffer buffer;
+  buffer.resize(k_width, k_height);
+
+  Rng rng;
+  AccuracyVisibility(buffer);
+  AccuracyNearClip(buffer);
+  AccuracyThreaded(buffer, rng);
+  AccuracyConservative(buffer, rng);
+
+  if (timings)
+    Benchmarks(buffer, rng, iterations);
+
+  bool passed = PrintJson(iterations, timings);
+  TM->free();
+
+  return passed ? 0 : 1;
+}
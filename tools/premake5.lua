@@ -72,6 +72,7 @@ workspace "Main"
 	architecture "x64"
 	location "../build/Visual_Studio"
 	cppdialect "c++20"
+	vectorextensions "AVX2"
 	startproject "Test"
 
 	filter "configurations:Debug"
@@ -110,4 +111,47 @@ files {
 }
 filter "files:**.obj"
     flags { "ExcludeFromBuild" }
+filter {}
+-------------------------------------------------------------------------------
+
+-- MathBench
+-------------------------------------------------------------------------------
+-- Math microbenchmark and accuracy suite, no window or GL needed.
+-- Built with the workspace AVX2 flags, the scalar build is the "Math Bench (Scalar)" task.
+project "MathBench"
+
+kind "ConsoleApp"
+language "C++"
+targetdir "../build/%{prj.name}/%{cfg.buildcfg}"
+includedirs { "../deps/include" }
+filter "configurations:Debug"
+  links {"../deps/libs/jam_engine/JAM_Engine_x64_d.lib"}
+filter "configurations:Release"
+  links {"../deps/libs/jam_engine/JAM_Engine_x64.lib"}
+filter {}
+files {
+  "math_bench/**",
+}
+-------------------------------------------------------------------------------
+
+-- OcclusionBench
+-------------------------------------------------------------------------------
+-- OcclusionBuffer microbenchmark and correctness suite, no window or GL needed.
+-- Conan only gives the GL headers that mesh.h includes.
+project "OcclusionBench"
+
+kind "ConsoleApp"
+language "C++"
+targetdir "../build/%{prj.name}/%{cfg.buildcfg}"
+includedirs { "../deps/include" }
+filter "configurations:Debug"
+  links {"../deps/libs/jam_engine/JAM_Engine_x64_d.lib"}
+filter "configurations:Release"
+  links {"../deps/libs/jam_engine/JAM_Engine_x64.lib"}
+filter {}
+conan_config_exec()
+files {
+  "occlusion_bench/**",
+  "../deps/src/engine/occlusion_buffer.cpp",
+}
 -------------------------------------------------------------------------------